@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dsp_ref.h"
+
+// sin(x) in Q15 for x = 2 pi phase / 65536, quarter-wave table of 65
+// points (rounded) with linear interpolation between 256 phase steps
+static int32_t refSin(uint32_t phase)
+{
+    int32_t quadrant = (phase >> 14) & 3;
+    int32_t p = phase & 0x3FFF;
+    int32_t i0, i1, v;
+
+    if (quadrant & 1)
+        p = 0x4000 - p;
+
+    i0 = lround(32767.0 * sin((p >> 8) * M_PI / 128.0));
+    i1 = lround(32767.0 * sin(((p >> 8) + 1) * M_PI / 128.0));
+    v = i0;
+    if ((p >> 8) < 64)
+        v += ((i1 - i0) * (p & 0xFF)) >> 8;
+
+    return (quadrant & 2) ? -v : v;
+}
+
+static int32_t refCos(uint32_t phase)
+{
+    return refSin((phase + 0x4000) & 0xFFFF);
+}
+
+void dspRefBandpass(int16_t *coeffs, uint32_t centerFreqKhz, uint32_t samplFreqKhz)
+{
+    uint32_t step = ((centerFreqKhz << 16) / samplFreqKhz) & 0xFFFF;
+    int32_t raw[DSP_REF_TAPS];
+    int32_t gain = 0;
+    int32_t k;
+
+    for (k = 0; k < DSP_REF_TAPS; k++)
+    {
+        int32_t win = (32767 - refCos(((uint32_t)(k + 1) << 16) / (DSP_REF_TAPS + 1))) >> 1;
+        // Phase of the tap relative to the center, modulo one turn
+        int32_t c = refCos((uint32_t)(step * (k - (DSP_REF_TAPS - 1) / 2)) & 0xFFFF);
+
+        raw[k] = (win * c) >> 15;
+        gain += (raw[k] * c) >> 15;
+    }
+
+    if (gain <= 0)
+        gain = 1;
+
+    for (k = 0; k < DSP_REF_TAPS; k++)
+        coeffs[k] = (int16_t)((raw[k] * 32768) / gain);
+}
+
+uint32_t dspRefEnvelope(const int16_t *in, uint32_t n, const int16_t *coeffs,
+                        uint32_t log2Dec, int16_t *out)
+{
+    int32_t *rect = malloc(n * sizeof(*rect));
+    uint32_t dec = 1u << log2Dec;
+    uint32_t i, m;
+    int32_t k;
+
+    // Bandpass and rectification
+    for (i = 0; i < n; i++)
+    {
+        int64_t acc = 0;
+        int64_t y;
+
+        for (k = 0; k < DSP_REF_TAPS; k++)
+        {
+            if ((int64_t) i - k >= 0)
+                acc += (int64_t) coeffs[k] * in[i - k];
+        }
+
+        y = (acc + 0x4000) >> 15;
+        if (y > 32767)
+            y = 32767;
+        if (y < -32768)
+            y = -32768;
+        y = llabs(y);
+        rect[i] = (y > 32767) ? 32767 : (int32_t) y;
+    }
+
+    // Block mean
+    for (m = 0; m < n / dec; m++)
+    {
+        int32_t sum = 0;
+
+        for (i = 0; i < dec; i++)
+            sum += rect[m * dec + i];
+        out[m] = (int16_t)(sum >> log2Dec);
+    }
+
+    free(rect);
+    return n / dec;
+}
+
+uint32_t dspRefPack(const int16_t *in, uint32_t n, uint32_t packMode, uint8_t *out)
+{
+    uint32_t bit = 0;
+    uint32_t i, k;
+
+    if (packMode == 1)
+    {
+        // 12-bit two's complement, LSB first bit stream
+        memset(out, 0, (12 * n + 7) / 8);
+        for (i = 0; i < n; i++)
+        {
+            for (k = 0; k < 12; k++, bit++)
+            {
+                if (((uint32_t) in[i] >> k) & 1)
+                    out[bit / 8] |= (uint8_t)(1u << (bit % 8));
+            }
+        }
+        return (12 * n + 7) / 8;
+    }
+
+    // Sign and magnitude, 4 mantissa bits below the leading one from 32 on
+    for (i = 0; i < n; i++)
+    {
+        int32_t mag = labs((long) in[i]);
+        uint32_t code;
+
+        if (mag > 2047)
+            mag = 2047;
+        if (mag < 32)
+        {
+            code = (uint32_t) mag;
+        }
+        else
+        {
+            uint32_t msb = (uint32_t) floor(log2((double) mag));
+
+            code = ((msb - 3) << 4) | (((uint32_t) mag >> (msb - 4)) & 0x0F);
+        }
+        out[i] = (uint8_t)(code | ((in[i] < 0) ? 0x80 : 0));
+    }
+    return n;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Reference model of the on-device frame processing (uslib_dsp.h).
+//
+// Written from the specification in uslib_dsp.h, independent of the
+// firmware code: full-length convolution, separate rectification and
+// decimation passes, sine table computed with libm. The output must match
+// the firmware bit by bit.
+
+#ifndef HOST_SIM_DSP_REF_H_
+#define HOST_SIM_DSP_REF_H_
+
+#include <stdint.h>
+
+#define DSP_REF_TAPS    (15)
+
+// Bandpass coefficients (Q15), frequencies in kHz
+void dspRefBandpass(int16_t *coeffs, uint32_t centerFreqKhz, uint32_t samplFreqKhz);
+
+// Envelope of n input samples, returns the number of output samples
+uint32_t dspRefEnvelope(const int16_t *in, uint32_t n, const int16_t *coeffs,
+                        uint32_t log2Dec, int16_t *out);
+
+// Sample packing (us_pack_mode_t: 1 - 12-bit, 2 - log 8-bit) of n samples,
+// returns the number of output Bytes
+uint32_t dspRefPack(const int16_t *in, uint32_t n, uint32_t packMode, uint8_t *out);
+
+#endif /* HOST_SIM_DSP_REF_H_ */
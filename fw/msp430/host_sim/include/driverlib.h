@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Host replacement of the MSP430 driverlib subset used by the WULPUS firmware.
+// Constants match driverlib/MSP430FR5xx_6xx, the functions are implemented
+// by the simulator (sim/sim_io.c).
+
+#ifndef HOST_SIM_DRIVERLIB_H_
+#define HOST_SIM_DRIVERLIB_H_
+
+#include <msp430.h>
+
+//// GPIO ////
+
+#define GPIO_PORT_P1                        1
+#define GPIO_PORT_P2                        2
+#define GPIO_PORT_P3                        3
+#define GPIO_PORT_P4                        4
+#define GPIO_PORT_P5                        5
+#define GPIO_PORT_P6                        6
+#define GPIO_PORT_P7                        7
+#define GPIO_PORT_PJ                        13
+
+#define GPIO_PIN0                           (0x0001)
+#define GPIO_PIN1                           (0x0002)
+#define GPIO_PIN2                           (0x0004)
+#define GPIO_PIN3                           (0x0008)
+#define GPIO_PIN4                           (0x0010)
+#define GPIO_PIN5                           (0x0020)
+#define GPIO_PIN6                           (0x0040)
+#define GPIO_PIN7                           (0x0080)
+
+#define GPIO_PRIMARY_MODULE_FUNCTION        (0x01)
+#define GPIO_SECONDARY_MODULE_FUNCTION      (0x02)
+#define GPIO_TERNARY_MODULE_FUNCTION        (0x03)
+
+#define GPIO_INPUT_PIN_HIGH                 (0x01)
+#define GPIO_INPUT_PIN_LOW                  (0x00)
+
+void GPIO_setAsOutputPin(uint8_t selectedPort, uint16_t selectedPins);
+void GPIO_setAsInputPin(uint8_t selectedPort, uint16_t selectedPins);
+void GPIO_setAsPeripheralModuleFunctionOutputPin(uint8_t selectedPort,
+                                                 uint16_t selectedPins,
+                                                 uint8_t mode);
+void GPIO_setAsPeripheralModuleFunctionInputPin(uint8_t selectedPort,
+                                                uint16_t selectedPins,
+                                                uint8_t mode);
+void GPIO_setOutputHighOnPin(uint8_t selectedPort, uint16_t selectedPins);
+void GPIO_setOutputLowOnPin(uint8_t selectedPort, uint16_t selectedPins);
+void GPIO_toggleOutputOnPin(uint8_t selectedPort, uint16_t selectedPins);
+uint8_t GPIO_getInputPinValue(uint8_t selectedPort, uint16_t selectedPins);
+
+//// PMM ////
+
+void PMM_unlockLPM5(void);
+
+//// DMA ////
+
+#define DMA_CHANNEL_0                       (0x00)
+#define DMA_CHANNEL_1                       (0x10)
+#define DMA_CHANNEL_2                       (0x20)
+
+#define DMA_TRANSFER_SINGLE                 (0x0000)
+#define DMA_TRANSFER_BLOCK                  (0x1000)
+#define DMA_TRANSFER_BURSTBLOCK             (0x2000)
+#define DMA_TRANSFER_REPEATED_SINGLE        (0x4000)
+#define DMA_TRANSFER_REPEATED_BLOCK         (0x5000)
+#define DMA_TRANSFER_REPEATED_BURSTBLOCK    (0x6000)
+
+#define DMA_TRIGGERSOURCE_0                 (0x00)
+#define DMA_TRIGGERSOURCE_16                (0x10)
+#define DMA_TRIGGERSOURCE_17                (0x11)
+
+#define DMA_SIZE_SRCWORD_DSTWORD            (0x00)
+#define DMA_SIZE_SRCBYTE_DSTWORD            (0x80)
+#define DMA_SIZE_SRCWORD_DSTBYTE            (0x40)
+#define DMA_SIZE_SRCBYTE_DSTBYTE            (0xC0)
+
+#define DMA_TRIGGER_RISINGEDGE              (0x00)
+#define DMA_TRIGGER_HIGH                    (0x04)
+
+#define DMA_DIRECTION_UNCHANGED             (0x00)
+#define DMA_DIRECTION_DECREMENT             (0x02)
+#define DMA_DIRECTION_INCREMENT             (0x03)
+
+#define DMA_INT_INACTIVE                    (0x00)
+#define DMA_INT_ACTIVE                      (0x08)
+
+typedef struct DMA_initParam {
+    uint8_t channelSelect;
+    uint16_t transferModeSelect;
+    uint16_t transferSize;
+    uint8_t triggerSourceSelect;
+    uint8_t transferUnitSelect;
+    uint8_t triggerTypeSelect;
+} DMA_initParam;
+
+void DMA_init(DMA_initParam *param);
+void DMA_setTransferSize(uint8_t channelSelect, uint16_t transferSize);
+uint16_t DMA_getTransferSize(uint8_t channelSelect);
+void DMA_setSrcAddress(uint8_t channelSelect,
+                       uint32_t srcAddress,
+                       uint16_t directionSelect);
+void DMA_setDstAddress(uint8_t channelSelect,
+                       uint32_t dstAddress,
+                       uint16_t directionSelect);
+void DMA_enableTransfers(uint8_t channelSelect);
+void DMA_disableTransfers(uint8_t channelSelect);
+void DMA_startTransfer(uint8_t channelSelect);
+void DMA_enableInterrupt(uint8_t channelSelect);
+void DMA_disableInterrupt(uint8_t channelSelect);
+uint16_t DMA_getInterruptStatus(uint8_t channelSelect);
+void DMA_clearInterrupt(uint8_t channelSelect);
+
+//// eUSCI SPI ////
+
+#define EUSCI_A_SPI_MSB_FIRST                                       (0x2000)
+#define EUSCI_A_SPI_PHASE_DATA_CHANGED_ONFIRST_CAPTURED_ON_NEXT     (0x0000)
+#define EUSCI_A_SPI_CLOCKPOLARITY_INACTIVITY_LOW                    (0x0000)
+#define EUSCI_A_SPI_4PIN_UCxSTE_ACTIVE_LOW                          (0x0400)
+#define EUSCI_A_SPI_ENABLE_SIGNAL_FOR_4WIRE_SLAVE                   (0x0002)
+
+#define EUSCI_B_SPI_CLOCKSOURCE_SMCLK                               (0x80)
+#define EUSCI_B_SPI_MSB_FIRST                                       (0x2000)
+#define EUSCI_B_SPI_PHASE_DATA_CAPTURED_ONFIRST_CHANGED_ON_NEXT     (0x8000)
+#define EUSCI_B_SPI_CLOCKPOLARITY_INACTIVITY_LOW                    (0x0000)
+#define EUSCI_B_SPI_4PIN_UCxSTE_ACTIVE_LOW                          (0x0400)
+#define EUSCI_B_SPI_ENABLE_SIGNAL_FOR_4WIRE_SLAVE                   (0x0002)
+
+typedef struct EUSCI_A_SPI_initSlaveParam {
+    uint16_t msbFirst;
+    uint16_t clockPhase;
+    uint16_t clockPolarity;
+    uint16_t spiMode;
+} EUSCI_A_SPI_initSlaveParam;
+
+typedef struct EUSCI_B_SPI_initMasterParam {
+    uint8_t selectClockSource;
+    uint32_t clockSourceFrequency;
+    uint32_t desiredSpiClock;
+    uint16_t msbFirst;
+    uint16_t clockPhase;
+    uint16_t clockPolarity;
+    uint16_t spiMode;
+} EUSCI_B_SPI_initMasterParam;
+
+void EUSCI_A_SPI_initSlave(uint16_t baseAddress,
+                           EUSCI_A_SPI_initSlaveParam *param);
+void EUSCI_A_SPI_select4PinFunctionality(uint16_t baseAddress,
+                                         uint8_t select4PinFunctionality);
+void EUSCI_A_SPI_enable(uint16_t baseAddress);
+
+void EUSCI_B_SPI_initMaster(uint16_t baseAddress,
+                            EUSCI_B_SPI_initMasterParam *param);
+void EUSCI_B_SPI_select4PinFunctionality(uint16_t baseAddress,
+                                         uint8_t select4PinFunctionality);
+void EUSCI_B_SPI_enable(uint16_t baseAddress);
+
+#endif /* HOST_SIM_DRIVERLIB_H_ */
@@ -0,0 +1,530 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Host replacement of the TI <msp430.h> device header.
+//
+// Every peripheral register used by the WULPUS firmware is routed to the
+// simulated register file (see sim/sim_core.c). Register addresses are only
+// used as keys into this register file: they follow the MSP430FR5043 memory
+// map where it matters (timer offsets) but are not guaranteed to match the
+// device. The same applies to the bit values of the USS registers, which only
+// need to be unique within a register for the model.
+
+#ifndef HOST_SIM_MSP430_H_
+#define HOST_SIM_MSP430_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+//// Simulator hooks ////
+
+volatile uint16_t * simReg16(uint16_t addr);
+volatile uint8_t  * simReg8(uint16_t addr);
+
+void     simDisableInterrupt(void);
+void     simEnableInterrupt(void);
+uint16_t simGetSR(void);
+void     simBisSR(uint16_t bits);
+void     simBicSR(uint16_t bits);
+void     simBicSROnExit(uint16_t bits);
+void     simDelayCycles(uint32_t cycles);
+
+// LEA RAM of the device (4 KB at 0x4000), placed in the host address space
+extern uint8_t simLeaRam[0x1000];
+
+// Start of the LEA RAM as seen by the firmware
+#define LEA_RAM_START_ADDR    ((uintptr_t) simLeaRam)
+
+// 64-bit divisions are runtime library calls on the device, the model
+// charges their cost (see uslib.h)
+uint64_t simDivU64(uint64_t num, uint64_t den);
+#define US_DIV_U64(num, den)  simDivU64((num), (den))
+
+// Multiply-accumulate of the frame processing (see uslib_dsp.h)
+int32_t simDspMac(int32_t acc, int32_t a, int32_t b);
+#define US_DSP_MAC(acc, a, b)  ((acc) = simDspMac((acc), (a), (b)))
+
+#define HWREG8(x)     (*simReg8((uint16_t)(x)))
+#define HWREG16(x)    (*simReg16((uint16_t)(x)))
+
+//// Intrinsics ////
+
+#define __interrupt
+#define __disable_interrupt()           simDisableInterrupt()
+#define __enable_interrupt()            simEnableInterrupt()
+#define __get_SR_register()             simGetSR()
+#define __bis_SR_register(x)            simBisSR(x)
+#define __bic_SR_register(x)            simBicSR(x)
+#define __bic_SR_register_on_exit(x)    simBicSROnExit(x)
+#define __delay_cycles(x)               simDelayCycles(x)
+#define __even_in_range(x, y)           (x)
+#define __no_operation()                simDelayCycles(1)
+
+//// Status register ////
+
+#define GIE                 (0x0008)
+#define CPUOFF              (0x0010)
+#define OSCOFF              (0x0020)
+#define SCG0                (0x0040)
+#define SCG1                (0x0080)
+
+#define LPM0_bits           (CPUOFF)
+#define LPM1_bits           (SCG0 + CPUOFF)
+#define LPM2_bits           (SCG1 + CPUOFF)
+#define LPM3_bits           (SCG1 + SCG0 + CPUOFF)
+#define LPM4_bits           (SCG1 + SCG0 + OSCOFF + CPUOFF)
+
+#define LPM0_EXIT           __bic_SR_register_on_exit(LPM0_bits)
+#define LPM1_EXIT           __bic_SR_register_on_exit(LPM1_bits)
+#define LPM2_EXIT           __bic_SR_register_on_exit(LPM2_bits)
+#define LPM3_EXIT           __bic_SR_register_on_exit(LPM3_bits)
+#define LPM4_EXIT           __bic_SR_register_on_exit(LPM4_bits)
+
+//// Generic bits ////
+
+#define BIT0                (0x0001)
+#define BIT1                (0x0002)
+#define BIT2                (0x0004)
+#define BIT3                (0x0008)
+#define BIT4                (0x0010)
+#define BIT5                (0x0020)
+#define BIT6                (0x0040)
+#define BIT7                (0x0080)
+#define BIT8                (0x0100)
+#define BIT9                (0x0200)
+#define BITA                (0x0400)
+#define BITB                (0x0800)
+#define BITC                (0x1000)
+#define BITD                (0x2000)
+#define BITE                (0x4000)
+#define BITF                (0x8000)
+
+//// SFR, CS and digital IO ////
+
+#define SFRIFG1_ADDR        (0x0102)
+#define SFRIFG1             HWREG16(SFRIFG1_ADDR)
+#define OFIFG               (0x0002)
+
+#define CSCTL0_H            HWREG8(0x0161)
+#define CSCTL5              HWREG16(0x016A)
+#define CSKEY               (0xA500)
+#define LFXTOFFG            (0x0001)
+
+#define P1OUT               HWREG8(0x0202)
+#define P1DIR               HWREG8(0x0204)
+
+//// Timer_A ////
+
+#define TIMER_A0_BASE       (0x0340)
+#define TIMER_A1_BASE       (0x0380)
+
+#define TIMER0_A0_VECTOR    (52)
+#define TIMER0_A1_VECTOR    (51)
+#define TIMER1_A0_VECTOR    (49)
+#define TIMER1_A1_VECTOR    (48)
+
+#define OFS_TAxCTL          (0x0000)
+#define OFS_TAxCCTL0        (0x0002)
+#define OFS_TAxCCTL1        (0x0004)
+#define OFS_TAxCCTL2        (0x0006)
+#define OFS_TAxR            (0x0010)
+#define OFS_TAxCCR0         (0x0012)
+#define OFS_TAxCCR1         (0x0014)
+#define OFS_TAxCCR2         (0x0016)
+#define OFS_TAxIV           (0x002E)
+#define OFS_TAxEX0          (0x0020)
+
+#define TASSEL__TACLK       (0x0000)
+#define TASSEL__ACLK        (0x0100)
+#define TASSEL__SMCLK       (0x0200)
+#define TASSEL__INCLK       (0x0300)
+#define TASSEL_3            (0x0300)
+#define ID__1               (0x0000)
+#define ID__2               (0x0040)
+#define ID__4               (0x0080)
+#define ID__8               (0x00C0)
+#define ID_3                (0x00C0)
+#define MC__STOP            (0x0000)
+#define MC__UP              (0x0010)
+#define MC__CONTINUOUS      (0x0020)
+#define MC__UPDOWN          (0x0030)
+#define MC_3                (0x0030)
+#define TACLR               (0x0004)
+#define TAIE                (0x0002)
+#define TAIFG               (0x0001)
+
+#define CCIE                (0x0010)
+#define CCIFG               (0x0001)
+#define OUTMOD_0            (0x0000)
+#define OUTMOD_1            (0x0020)
+#define OUTMOD_7            (0x00E0)
+#define OUT                 (0x0004)
+
+#define TAIDEX_0            (0x0000)
+#define TAIDEX_7            (0x0007)
+
+#define TAIV__NONE          (0x0000)
+#define TAIV__TACCR1        (0x0002)
+#define TAIV__TACCR2        (0x0004)
+#define TAIV__TAIFG         (0x000E)
+
+//// eUSCI ////
+
+#define EUSCI_A1_BASE       (0x05E0)
+#define EUSCI_B1_BASE       (0x0680)
+
+#define UCA1RXBUF_ADDR      (0x05EC)
+#define UCA1TXBUF_ADDR      (0x05EE)
+#define UCA1RXBUF           HWREG16(UCA1RXBUF_ADDR)
+#define UCA1TXBUF           HWREG16(UCA1TXBUF_ADDR)
+
+#define UCB1STAT_ADDR       (0x0688)
+#define UCB1TXBUF_ADDR      (0x068E)
+#define UCB1IFG_ADDR        (0x06AC)
+#define UCB1STAT            HWREG16(UCB1STAT_ADDR)
+#define UCB1TXBUF           HWREG16(UCB1TXBUF_ADDR)
+#define UCB1IFG             HWREG16(UCB1IFG_ADDR)
+#define UCBBUSY             (0x0001)
+#define UCRXIFG             (0x0001)
+#define UCTXIFG             (0x0002)
+
+//// HSPLL ////
+
+#define HSPLL_VECTOR        (45)
+
+#define HSPLL_BASE          (0x0EC0)
+
+#define HSPLLCTL_ADDR       (0x0EC0)
+#define HSPLLIIDX_ADDR      (0x0EC2)
+#define HSPLLIMSC_ADDR      (0x0EC4)
+#define HSPLLICR_ADDR       (0x0EC6)
+#define HSPLLUSSXTLCTL_ADDR (0x0ECC)
+
+#define OFS_HSPLLCTL        (0x0000)
+#define OFS_HSPLLIIDX       (0x0002)
+#define OFS_HSPLLIMSC       (0x0004)
+#define OFS_HSPLLICR        (0x0006)
+#define OFS_HSPLLUSSXTLCTL  (0x000C)
+
+#define HSPLLCTL            HWREG16(HSPLLCTL_ADDR)
+#define HSPLLIIDX           HWREG16(HSPLLIIDX_ADDR)
+#define HSPLLIMSC           HWREG16(HSPLLIMSC_ADDR)
+#define HSPLLICR            HWREG16(HSPLLICR_ADDR)
+#define HSPLLUSSXTLCTL      HWREG16(HSPLLUSSXTLCTL_ADDR)
+
+#define PLLM_MASK           (0xFC00)
+#define PLLINFREQ           (0x0200)
+#define PLL_LOCK            (0x0100)
+#define PLLUNLOCK           (0x0001)
+
+#define USSXTEN             (0x0001)
+#define XTOUTOFF            (0x0002)
+#define OSCSTATE_0          (0x0000)
+#define OSCSTATE_1          (0x0100)
+#define OSCTYPE             (0x0200)
+
+//// UUPS ////
+
+#define UUPS_VECTOR         (46)
+
+#define UUPS_BASE           (0x0E80)
+
+#define UUPSCTL_ADDR        (0x0E80)
+#define UUPSIIDX_ADDR       (0x0E82)
+#define UUPSIMSC_ADDR       (0x0E84)
+#define UUPSICR_ADDR        (0x0E86)
+
+#define OFS_UUPSCTL         (0x0000)
+#define OFS_UUPSIIDX        (0x0002)
+#define OFS_UUPSIMSC        (0x0004)
+#define OFS_UUPSICR         (0x0006)
+
+#define UUPSCTL             HWREG16(UUPSCTL_ADDR)
+#define UUPSIIDX            HWREG16(UUPSIIDX_ADDR)
+#define UUPSIMSC            HWREG16(UUPSIMSC_ADDR)
+#define UUPSICR             HWREG16(UUPSICR_ADDR)
+
+#define USSPWRUP            (0x0001)
+#define USSPWRDN            (0x0002)
+#define USSSWRST            (0x0004)
+#define USS_BUSY            (0x0008)
+#define UPSTATE_0           (0x0000)
+#define UPSTATE_1           (0x0010)
+#define UPSTATE_2           (0x0020)
+#define UPSTATE_3           (0x0030)
+#define USSPWRUPSEL_0       (0x0000)
+#define USSPWRUPSEL_1       (0x0100)
+#define USSPWRUPSEL_2       (0x0200)
+#define USSPWRUPSEL_3       (0x0300)
+#define ASQEN               (0x0400)
+#define LBHDEL_0            (0x0000)
+#define LBHDEL_1            (0x1000)
+#define LBHDEL_2            (0x2000)
+#define LBHDEL_3            (0x3000)
+
+#define PTMOUT              (0x0001)
+#define STPBYDB             (0x0004)
+
+//// SAPH_A ////
+
+#define SAPH_VECTOR         (47)
+
+#define SAPH_A_BASE         (0x0E00)
+
+#define SAPH_AIIDX_ADDR     (0x0E00)
+#define SAPH_AMIS_ADDR      (0x0E02)
+#define SAPH_ARIS_ADDR      (0x0E04)
+#define SAPH_AIMSC_ADDR     (0x0E06)
+#define SAPH_AICR_ADDR      (0x0E08)
+#define SAPH_AKEY_ADDR      (0x0E0E)
+#define SAPH_AOCTL1_ADDR    (0x0E12)
+#define SAPH_AOSEL_ADDR     (0x0E14)
+#define SAPH_AICTL0_ADDR    (0x0E20)
+#define SAPH_ABCTL_ADDR     (0x0E24)
+#define SAPH_APGC_ADDR      (0x0E30)
+#define SAPH_APGLPER_ADDR   (0x0E32)
+#define SAPH_APGHPER_ADDR   (0x0E34)
+#define SAPH_APGCTL_ADDR    (0x0E36)
+#define SAPH_AXPGCTL_ADDR   (0x0E3C)
+#define SAPH_AASCTL0_ADDR   (0x0E40)
+#define SAPH_AASCTL1_ADDR   (0x0E42)
+#define SAPH_AASQTRIG_ADDR  (0x0E44)
+#define SAPH_AAPOL_ADDR     (0x0E46)
+#define SAPH_AAPLEV_ADDR    (0x0E48)
+#define SAPH_AAPHIZ_ADDR    (0x0E4A)
+#define SAPH_AATM_A_ADDR    (0x0E4E)
+#define SAPH_AATM_B_ADDR    (0x0E50)
+#define SAPH_AATM_C_ADDR    (0x0E52)
+#define SAPH_AATM_D_ADDR    (0x0E54)
+#define SAPH_AATM_E_ADDR    (0x0E56)
+#define SAPH_AATM_F_ADDR    (0x0E58)
+#define SAPH_ATACTL_ADDR    (0x0E5A)
+#define SAPH_AMCNF_ADDR     (0x0E60)
+
+#define OFS_SAPH_AIIDX      (0x0000)
+#define OFS_SAPH_AMIS       (0x0002)
+#define OFS_SAPH_ARIS       (0x0004)
+#define OFS_SAPH_AIMSC      (0x0006)
+#define OFS_SAPH_AICR       (0x0008)
+#define OFS_SAPH_AKEY       (0x000E)
+#define OFS_SAPH_AOCTL1     (0x0012)
+#define OFS_SAPH_AOSEL      (0x0014)
+#define OFS_SAPH_AICTL0     (0x0020)
+#define OFS_SAPH_ABCTL      (0x0024)
+#define OFS_SAPH_APGC       (0x0030)
+#define OFS_SAPH_APGLPER    (0x0032)
+#define OFS_SAPH_APGHPER    (0x0034)
+#define OFS_SAPH_APGCTL     (0x0036)
+#define OFS_SAPH_AXPGCTL    (0x003C)
+#define OFS_SAPH_AASCTL0    (0x0040)
+#define OFS_SAPH_AASCTL1    (0x0042)
+#define OFS_SAPH_AASQTRIG   (0x0044)
+#define OFS_SAPH_AAPOL      (0x0046)
+#define OFS_SAPH_AAPLEV     (0x0048)
+#define OFS_SAPH_AAPHIZ     (0x004A)
+#define OFS_SAPH_AATM_A     (0x004E)
+#define OFS_SAPH_AATM_B     (0x0050)
+#define OFS_SAPH_AATM_C     (0x0052)
+#define OFS_SAPH_AATM_D     (0x0054)
+#define OFS_SAPH_AATM_E     (0x0056)
+#define OFS_SAPH_AATM_F     (0x0058)
+#define OFS_SAPH_ATACTL     (0x005A)
+#define OFS_SAPH_AMCNF      (0x0060)
+
+#define SAPHIIDX            HWREG16(SAPH_AIIDX_ADDR)
+#define SAPH_AIIDX          HWREG16(SAPH_AIIDX_ADDR)
+#define SAPH_AMIS           HWREG16(SAPH_AMIS_ADDR)
+#define SAPH_ARIS           HWREG16(SAPH_ARIS_ADDR)
+#define SAPH_AIMSC          HWREG16(SAPH_AIMSC_ADDR)
+#define SAPH_AICR           HWREG16(SAPH_AICR_ADDR)
+#define SAPH_AKEY           HWREG16(SAPH_AKEY_ADDR)
+#define SAPH_AOCTL1         HWREG16(SAPH_AOCTL1_ADDR)
+#define SAPH_AOSEL          HWREG16(SAPH_AOSEL_ADDR)
+#define SAPH_AICTL0         HWREG16(SAPH_AICTL0_ADDR)
+#define SAPH_ABCTL          HWREG16(SAPH_ABCTL_ADDR)
+#define SAPH_APGC           HWREG16(SAPH_APGC_ADDR)
+#define SAPH_APGLPER        HWREG16(SAPH_APGLPER_ADDR)
+#define SAPH_APGHPER        HWREG16(SAPH_APGHPER_ADDR)
+#define SAPH_APGCTL         HWREG16(SAPH_APGCTL_ADDR)
+#define SAPH_AXPGCTL        HWREG16(SAPH_AXPGCTL_ADDR)
+#define SAPH_AASCTL0        HWREG16(SAPH_AASCTL0_ADDR)
+#define SAPH_AASCTL1        HWREG16(SAPH_AASCTL1_ADDR)
+#define SAPH_AASQTRIG       HWREG16(SAPH_AASQTRIG_ADDR)
+#define SAPH_AAPOL          HWREG16(SAPH_AAPOL_ADDR)
+#define SAPH_AAPLEV         HWREG16(SAPH_AAPLEV_ADDR)
+#define SAPH_AAPHIZ         HWREG16(SAPH_AAPHIZ_ADDR)
+#define SAPH_AATM_A         HWREG16(SAPH_AATM_A_ADDR)
+#define SAPH_AATM_B         HWREG16(SAPH_AATM_B_ADDR)
+#define SAPH_AATM_C         HWREG16(SAPH_AATM_C_ADDR)
+#define SAPH_AATM_D         HWREG16(SAPH_AATM_D_ADDR)
+#define SAPH_AATM_E         HWREG16(SAPH_AATM_E_ADDR)
+#define SAPH_AATM_F         HWREG16(SAPH_AATM_F_ADDR)
+#define SAPH_ATACTL         HWREG16(SAPH_ATACTL_ADDR)
+#define SAPH_AMCNF          HWREG16(SAPH_AMCNF_ADDR)
+
+#define IIDX_1              (0x0001)
+#define IIDX_2              (0x0002)
+#define IIDX_3              (0x0003)
+#define IIDX_4              (0x0004)
+
+#define DATAERR             (0x0001)
+#define TMFTO               (0x0002)
+#define SEQDN               (0x0004)
+#define PNGDN               (0x0008)
+
+#define KEY                 (0x5AA5)
+#define UNLOCK              (0x0001)
+
+#define BIMP_0              (0x0000)
+#define BIMP_1              (0x0001)
+#define BIMP_2              (0x0002)
+#define BIMP_3              (0x0003)
+#define CPEO                (0x0100)
+#define LPBE                (0x0200)
+
+#define PCH0SEL_1           (0x0001)
+#define PCH1SEL_1           (0x0004)
+
+#define MUXSEL_0            (0x0000)
+#define MUXSEL_15           (0x000F)
+#define MUXCTL              (0x0010)
+#define DUMEN               (0x0080)
+
+#define ASQBSC              (0x0001)
+#define ASQBSC_1            (0x0001)
+#define CH0EBSW             (0x0002)
+#define CH1EBSW             (0x0004)
+#define PGABSW              (0x0008)
+#define EXCBIAS_2           (0x0200)
+
+#define PPGEN               (0x0001)
+#define PGSEL_1             (0x0002)
+#define TRSEL_0             (0x0000)
+#define TRSEL_1             (0x0010)
+#define TRSEL_2             (0x0020)
+
+#define ETY_0               (0x0000)
+#define XMOD_0              (0x0000)
+
+#define ASQTEN              (0x0001)
+#define TRIGSEL_0           (0x0000)
+#define TRIGSEL_1           (0x0002)
+#define TRIGSEL_2           (0x0004)
+#define TRIGSEL__SWTRIG     (TRIGSEL_0)
+#define TRIGSEL__PSQ        (TRIGSEL_1)
+#define TRIGSEL__TIMER      (TRIGSEL_2)
+#define TRIGSEL_MASK        (0x0006)
+#define ASQCHSEL_0          (0x0000)
+#define ASQCHSEL_1          (0x0010)
+
+#define STDBY               (0x0001)
+#define ESOFF               (0x0002)
+#define CHOWN               (0x0004)
+
+#define ASQTRIG             (0x0001)
+
+//// SDHS ////
+
+#define SDHS_VECTOR         (44)
+
+#define SDHS_BASE           (0x0E90)
+
+#define SDHSCTL0_ADDR       (0x0E90)
+#define SDHSCTL1_ADDR       (0x0E92)
+#define SDHSCTL2_ADDR       (0x0E94)
+#define SDHSCTL3_ADDR       (0x0E96)
+#define SDHSCTL4_ADDR       (0x0E98)
+#define SDHSCTL5_ADDR       (0x0E9A)
+#define SDHSCTL6_ADDR       (0x0E9C)
+#define SDHSCTL7_ADDR       (0x0E9E)
+#define SDHSDTCDA_ADDR      (0x0EA4)
+#define SDHSWINHITH_ADDR    (0x0EA6)
+#define SDHSWINLOTH_ADDR    (0x0EA8)
+#define SDHSIIDX_ADDR       (0x0EB0)
+#define SDHSRIS_ADDR        (0x0EB4)
+#define SDHSIMSC_ADDR       (0x0EB6)
+#define SDHSICR_ADDR        (0x0EB8)
+
+#define OFS_SDHSCTL0        (0x0000)
+#define OFS_SDHSCTL1        (0x0002)
+#define OFS_SDHSCTL2        (0x0004)
+#define OFS_SDHSCTL3        (0x0006)
+#define OFS_SDHSCTL4        (0x0008)
+#define OFS_SDHSCTL5        (0x000A)
+#define OFS_SDHSCTL6        (0x000C)
+#define OFS_SDHSCTL7        (0x000E)
+#define OFS_SDHSDTCDA       (0x0014)
+#define OFS_SDHSWINHITH     (0x0016)
+#define OFS_SDHSWINLOTH     (0x0018)
+#define OFS_SDHSIIDX        (0x0020)
+#define OFS_SDHSRIS         (0x0024)
+#define OFS_SDHSIMSC        (0x0026)
+#define OFS_SDHSICR         (0x0028)
+
+#define SDHSCTL0            HWREG16(SDHSCTL0_ADDR)
+#define SDHSCTL1            HWREG16(SDHSCTL1_ADDR)
+#define SDHSCTL2            HWREG16(SDHSCTL2_ADDR)
+#define SDHSCTL3            HWREG16(SDHSCTL3_ADDR)
+#define SDHSCTL4            HWREG16(SDHSCTL4_ADDR)
+#define SDHSCTL5            HWREG16(SDHSCTL5_ADDR)
+#define SDHSCTL6            HWREG16(SDHSCTL6_ADDR)
+#define SDHSCTL7            HWREG16(SDHSCTL7_ADDR)
+#define SDHSDTCDA           HWREG16(SDHSDTCDA_ADDR)
+#define SDHSWINHITH         HWREG16(SDHSWINHITH_ADDR)
+#define SDHSWINLOTH         HWREG16(SDHSWINLOTH_ADDR)
+#define SDHSIIDX            HWREG16(SDHSIIDX_ADDR)
+#define SDHSRIS             HWREG16(SDHSRIS_ADDR)
+#define SDHSIMSC            HWREG16(SDHSIMSC_ADDR)
+#define SDHSICR             HWREG16(SDHSICR_ADDR)
+
+#define TRGSRC              (0x0001)
+#define SHIFT_0             (0x0000)
+#define OBR_0               (0x0000)
+#define DFMSEL_0            (0x0000)
+#define DALGN_0             (0x0000)
+#define INTDLY_0            (0x0000)
+#define AUTOSSDIS           (0x0800)
+
+#define DTCOFF_0            (0x0000)
+#define WINCMPEN            (0x0800)
+#define WINCMPEN_0          (0x0000)
+#define WINCMPEN_1          (0x0800)
+#define SMPSZ_MASK          (0x03FF)
+
+#define TRIGEN              (0x0001)
+#define SDHSON              (0x0001)
+
+#define MODOPTI0            (0x0001)
+#define MODOPTI1            (0x0002)
+#define MODOPTI2            (0x0004)
+#define MODOPTI3            (0x0008)
+
+#define OVF                 (0x0001)
+#define ACQDONE             (0x0002)
+#define SSTRG               (0x0004)
+#define DTRDY               (0x0008)
+#define WINHI               (0x0010)
+#define WINLO               (0x0020)
+#define ISTOP               (0x0040)
+
+//// DMA ////
+
+#define DMA_VECTOR          (40)
+
+#endif /* HOST_SIM_MSP430_H_ */
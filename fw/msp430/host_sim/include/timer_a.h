@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Host replacement of driverlib timer_a.h. uslib only needs the base
+// addresses and register offsets, which live in the simulated <msp430.h>.
+
+#ifndef HOST_SIM_TIMER_A_H_
+#define HOST_SIM_TIMER_A_H_
+
+#include <msp430.h>
+
+#endif /* HOST_SIM_TIMER_A_H_ */
@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Register-level model of the MSP430FR5043 peripherals used by WULPUS.
+//
+// The firmware runs natively on the host. Every peripheral register access
+// goes through simReg16()/simReg8(), which charges a fixed number of MCLK
+// cycles and lets the models react to register writes. Simulated time only
+// advances through these charges, __delay_cycles() and low-power mode entry,
+// where the model jumps straight to the next peripheral event.
+//
+// All times are kept in picoseconds. Cycle counts reported by the simulator
+// are MODELED (register accesses, driverlib calls, ISR overhead), they do
+// not include the cost of plain C code executed between register accesses.
+
+#ifndef HOST_SIM_SIM_H_
+#define HOST_SIM_SIM_H_
+
+#include <msp430.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define SIM_PS_PER_US           (1000000ULL)
+#define SIM_PS_PER_S            (1000000000000ULL)
+#define SIM_TIME_NONE           (UINT64_MAX)
+
+#define SIM_US(x)               ((uint64_t)(x) * SIM_PS_PER_US)
+
+// Size of the simulated register file (peripheral address space)
+#define SIM_REG_FILE_SIZE       (0x1000)
+
+// Max number of bytes captured per SPI frame on the nRF side
+#define SIM_SPI_FRAME_MAX       (4096)
+
+// Depth of the acquisition log and of the LEA snapshots kept for checks
+#define SIM_ACQ_LOG_LEN         (4096)
+#define SIM_ACQ_SNAPSHOTS       (128)
+
+//// Model parameters ////
+
+typedef struct
+{
+    // CPU and clocks
+    uint32_t mclkHz;
+    uint32_t aclkHz;
+    uint32_t regAccessCycles;       // Per peripheral register access
+    uint32_t driverlibCallCycles;   // Per driverlib call (call + body)
+    uint32_t isrOverheadCycles;     // Interrupt entry + RETI
+    uint32_t divU64Cycles;          // 64-bit division (runtime library)
+    uint32_t dspMacCycles;          // FIR multiply-accumulate (MPY32)
+    uint32_t lpm0WakeupUs;
+    uint32_t lpm3WakeupUs;
+
+    // Ultrasound subsystem
+    uint32_t ussxtStartupUs;        // USSXTEN -> OSCSTATE
+    uint32_t uupsPowerUpUs;         // USSPWRUP -> UPSTATE ready (LDO + PLL)
+
+    // nRF52 SPI master
+    uint32_t nrfSpiHz;
+    uint32_t nrfChunkBytes;
+    uint32_t nrfChunks;             // Until a configuration package is sent
+    uint32_t nrfChunkPeriodUs;
+    uint32_t nrfLatencyUs;          // DATA_READY edge -> timers enabled
+    uint32_t bleReadyDelayUs;       // Reset -> BLE ready pin high
+
+} sim_params_t;
+
+extern sim_params_t simParams;
+
+//// Acquisition log ////
+
+// Time stamps (ps) of one ultrasound acquisition, SIM_TIME_NONE if the
+// phase was not reached. A warm acquisition (USSXT and UUPS still powered
+// from the previous one) starts at the trigger.
+typedef struct
+{
+    uint64_t tPeriod;       // Last slow timer CCR0 match (measurement period)
+    uint64_t tDcDcOn;       // HV PCB DC-DC converters last enabled
+    uint64_t tXtalOn;       // USSXTEN set
+    uint64_t tXtalReady;    // OSCSTATE set by the model
+    uint64_t tPwrUpReq;     // USSPWRUP written
+    uint64_t tUupsReady;    // UPSTATE ready
+    uint64_t tTrigger;      // ASQ triggered
+    uint64_t tSeqDone;      // SEQDN or TMFTO
+    uint64_t tPwrDown;      // UUPS powered down
+    uint64_t tXtalOff;      // USSXTEN cleared
+
+    // CPU statistics at tXtalOn, used to compute per-frame deltas
+    uint64_t activePsAtStart;
+    uint64_t regAccessesAtStart;
+
+    // Settings at the trigger
+    uint16_t rxGain;        // SDHSCTL6
+    uint16_t ppgPeriod;     // APGLPER + APGHPER
+    uint8_t  numPulses;
+    uint16_t adcStart;      // AATM_D
+    uint16_t muxTx;         // HV MUX latched at the trigger
+    uint16_t muxRx;         // HV MUX latched at the end of the sequence
+
+    uint16_t numSamples;
+    bool     timeout;
+    bool     aborted;
+    bool     warm;          // Triggered without USSXT/UUPS start-up
+
+} sim_acq_t;
+
+// One complete SPI frame as seen by the nRF52
+typedef struct
+{
+    uint64_t tDataReady;
+    uint64_t tStart;
+    uint64_t tDone;
+    uint32_t len;
+    uint8_t  data[SIM_SPI_FRAME_MAX];
+
+} sim_spi_frame_t;
+
+//// Run control ////
+
+typedef enum
+{
+    SIM_EXIT_NONE = 0,
+    SIM_EXIT_STOP,          // Stop condition of the harness reached
+    SIM_EXIT_TIMEOUT,       // Simulated time limit reached
+    SIM_EXIT_ABORT,         // Model error (deadlock, interrupt storm, ...)
+
+} sim_exit_t;
+
+typedef enum
+{
+    SIM_CPU_ACTIVE,
+    SIM_CPU_LPM0,
+    SIM_CPU_LPM3,
+    SIM_CPU_LPM4,
+    SIM_CPU_STATE_NUM,
+
+} sim_cpu_state_t;
+
+typedef struct
+{
+    uint64_t nowPs;
+    uint64_t statePs[SIM_CPU_STATE_NUM];
+    uint64_t regAccesses;
+    uint64_t driverlibCalls;
+    uint64_t divU64Calls;
+    uint64_t dspMacs;
+    uint64_t isrCount;
+    uint64_t wakeups;
+
+} sim_stats_t;
+
+extern sim_stats_t simStats;
+
+// Reset the whole model (registers, peripherals, time)
+void simReset(void);
+
+// Run fn() until it returns, stop() returns true or the time limit elapses
+sim_exit_t simRun(void (*fn)(void), bool (*stop)(void), uint64_t limitPs);
+
+// Abort the current run with a message (never returns)
+void simAbort(const char *fmt, ...);
+const char * simAbortMessage(void);
+
+// Charge CPU cycles spent outside the register model
+void simChargeCycles(uint32_t cycles);
+
+// Modeled MCLK cycles of CPU activity so far
+uint64_t simActiveCycles(void);
+
+static inline double simPsToUs(uint64_t ps)
+{
+    return (double) ps / (double) SIM_PS_PER_US;
+}
+
+//// Event scheduling (used by the peripheral models) ////
+
+typedef enum
+{
+    SIM_EVT_USSXT_READY,
+    SIM_EVT_UUPS_READY,
+    SIM_EVT_SEQ_DONE,
+    SIM_EVT_NRF_CHUNK,
+    SIM_EVT_BLE_READY,
+    SIM_EVT_NUM,
+
+} sim_event_t;
+
+void simSchedule(sim_event_t evt, uint64_t tPs);
+void simCancel(sim_event_t evt);
+
+//// Register file access for the models (no cycle charge) ////
+
+uint16_t simRegGet(uint16_t addr);
+void     simRegSet(uint16_t addr, uint16_t val);
+void     simRegSetBits(uint16_t addr, uint16_t bits);
+void     simRegClearBits(uint16_t addr, uint16_t bits);
+uint8_t * simRegPtr(uint16_t addr);
+
+//// Timer_A model (sim_timer.c) ////
+
+void     simTimerReset(void);
+void     simTimerOnWrite(uint16_t addr, uint16_t oldVal, uint16_t newVal);
+void     simTimerOnRead(uint16_t addr);
+uint64_t simTimerNextEvent(void);
+void     simTimerFire(uint64_t tPs);
+bool     simTimerCc0Pending(uint16_t base);
+bool     simTimerCc1Pending(uint16_t base);
+bool     simTimerOwns(uint16_t addr);
+// Time of the last CCR0 match (SIM_TIME_NONE before the first one)
+uint64_t simTimerLastCc0(uint16_t base);
+
+//// USS model (sim_uss.c) ////
+
+void     simUssReset(void);
+void     simUssOnWrite(uint16_t addr, uint16_t oldVal, uint16_t newVal);
+void     simUssOnRead(uint16_t addr);
+void     simUssEvent(sim_event_t evt);
+// Rising edge of the timer trigger (TA0.1 output)
+void     simUssTimerTrigger(void);
+bool     simUssOwns(uint16_t addr);
+bool     simSaphPending(void);
+bool     simUupsPending(void);
+bool     simHspllPending(void);
+
+// Acquisition log access
+uint32_t simAcqCount(void);
+const sim_acq_t * simAcqGet(uint32_t idx);
+// Sample bytes written by the DTC for acquisition idx (NULL if too old)
+const uint8_t * simAcqSamples(uint32_t idx, uint32_t *len);
+// Total time (ps) the USSXT was enabled and the UUPS was not OFF
+void simUssOnTime(uint64_t *ussxtPs, uint64_t *uupsPs);
+
+//// IO model: GPIO, DMA, eUSCI and nRF52 SPI master (sim_io.c) ////
+
+void     simIoReset(void);
+void     simIoOnWrite(uint16_t addr, uint16_t oldVal, uint16_t newVal);
+void     simIoOnRead(uint16_t addr);
+void     simIoEvent(sim_event_t evt);
+bool     simIoOwns(uint16_t addr);
+bool     simDmaPending(void);
+
+uint8_t  simGpioGetOut(uint8_t port);
+// Last time the HV PCB DC-DC converters were enabled (SIM_TIME_NONE: never)
+uint64_t simHvDcDcOnTime(void);
+// Configuration latched into the HV MUX switches
+uint16_t simHvMuxLatched(void);
+
+// nRF52 side of the link
+void     simNrfSetTx(const uint8_t *data, uint32_t len);
+void     simNrfSetBleReady(bool ready);
+void     simNrfSetFrameCallback(void (*cb)(const sim_spi_frame_t *frame));
+
+//// Firmware interrupt service routines ////
+
+void timerSlowCc0Int(void);
+void timerSlowCc1Int(void);
+void timerFastCc0Int(void);
+void timerFastCc1Int(void);
+void hsPllInt(void);
+void uupsInt(void);
+void ISR_SAPH(void);
+void ISR_DMA(void);
+
+#endif /* HOST_SIM_SIM_H_ */
@@ -0,0 +1,679 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Simulator core: register file, simulated time, interrupts and LPM
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+
+#include "sim.h"
+
+sim_params_t simParams;
+sim_stats_t simStats;
+
+uint8_t simLeaRam[0x1000] __attribute__((aligned(4)));
+
+static uint8_t regFile[SIM_REG_FILE_SIZE] __attribute__((aligned(2)));
+
+// Status register and interrupt state
+static uint16_t sr;
+static bool inIsr;
+static uint16_t isrExitClear;
+static bool wakeRequest;
+
+// Peripheral events
+static uint64_t eventTime[SIM_EVT_NUM];
+
+// Recently accessed registers, compared at the next sync point to detect
+// writes (the firmware writes through a plain pointer)
+#define TRACK_LEN 4
+
+typedef struct
+{
+    bool     used;
+    bool     wide;
+    uint16_t addr;
+    uint16_t val;
+
+} track_t;
+
+static track_t track[TRACK_LEN];
+static uint8_t trackIdx;
+
+// Run control
+static jmp_buf runJmp;
+static bool running;
+static bool (*stopCond)(void);
+static uint64_t limitPs;
+static char abortMsg[256];
+static uint32_t dispatchBurst;
+
+static void setDefaultParams(void)
+{
+    simParams.mclkHz = 8000000;
+    simParams.aclkHz = 32768;
+    // MOV/BIS with absolute addressing: 4..6 cycles
+    simParams.regAccessCycles = 5;
+    simParams.driverlibCallCycles = 30;
+    // 6 cycles interrupt latency + 5 cycles RETI
+    simParams.isrOverheadCycles = 11;
+    // Shift-subtract loop of the runtime library, 64 iterations
+    simParams.divU64Cycles = 1500;
+    // Two MOV to MACS/OP2 with auto-increment, index update
+    simParams.dspMacCycles = 10;
+    simParams.lpm0WakeupUs = 0;
+    simParams.lpm3WakeupUs = 7;
+
+    simParams.ussxtStartupUs = 150;
+    simParams.uupsPowerUpUs = 120;
+
+    simParams.nrfSpiHz = 8000000;
+    simParams.nrfChunkBytes = 201;
+    simParams.nrfChunks = 4;
+    simParams.nrfChunkPeriodUs = 300;
+    simParams.nrfLatencyUs = 5;
+    simParams.bleReadyDelayUs = 20000;
+}
+
+//// Time ////
+
+static uint64_t cyclesToPs(uint64_t cycles)
+{
+    return cycles * SIM_PS_PER_S / simParams.mclkHz;
+}
+
+uint64_t simActiveCycles(void)
+{
+    return simStats.statePs[SIM_CPU_ACTIVE] * simParams.mclkHz / SIM_PS_PER_S;
+}
+
+static uint64_t nextEventTime(void)
+{
+    uint64_t t = simTimerNextEvent();
+    int i;
+
+    for (i = 0; i < SIM_EVT_NUM; i++)
+    {
+        if (eventTime[i] < t)
+        {
+            t = eventTime[i];
+        }
+    }
+    return t;
+}
+
+// Move time to tPs and fire everything that is due
+static void fireEvents(uint64_t tPs, sim_cpu_state_t state)
+{
+    int i;
+
+    if (tPs > simStats.nowPs)
+    {
+        simStats.statePs[state] += tPs - simStats.nowPs;
+        simStats.nowPs = tPs;
+    }
+
+    simTimerFire(simStats.nowPs);
+
+    for (i = 0; i < SIM_EVT_NUM; i++)
+    {
+        if (eventTime[i] <= simStats.nowPs)
+        {
+            eventTime[i] = SIM_TIME_NONE;
+            switch ((sim_event_t) i)
+            {
+                case SIM_EVT_USSXT_READY:
+                case SIM_EVT_UUPS_READY:
+                case SIM_EVT_SEQ_DONE:
+                    simUssEvent((sim_event_t) i);
+                    break;
+                default:
+                    simIoEvent((sim_event_t) i);
+                    break;
+            }
+        }
+    }
+}
+
+static void checkRunLimits(void)
+{
+    if (!running)
+        return;
+
+    if (stopCond && stopCond())
+    {
+        running = false;
+        longjmp(runJmp, SIM_EXIT_STOP);
+    }
+    if (simStats.nowPs >= limitPs)
+    {
+        running = false;
+        longjmp(runJmp, SIM_EXIT_TIMEOUT);
+    }
+}
+
+void simSchedule(sim_event_t evt, uint64_t tPs)
+{
+    eventTime[evt] = tPs;
+}
+
+void simCancel(sim_event_t evt)
+{
+    eventTime[evt] = SIM_TIME_NONE;
+}
+
+//// Interrupts ////
+
+typedef struct
+{
+    bool (*pending)(void);
+    void (*isr)(void);
+
+} vector_t;
+
+static bool fastCc0Pending(void) { return simTimerCc0Pending(TIMER_A0_BASE); }
+static bool fastCc1Pending(void) { return simTimerCc1Pending(TIMER_A0_BASE); }
+static bool slowCc0Pending(void) { return simTimerCc0Pending(TIMER_A1_BASE); }
+static bool slowCc1Pending(void) { return simTimerCc1Pending(TIMER_A1_BASE); }
+
+// Fixed priority, highest first
+static const vector_t vectors[] =
+{
+    { fastCc0Pending,  timerFastCc0Int },
+    { fastCc1Pending,  timerFastCc1Int },
+    { slowCc0Pending,  timerSlowCc0Int },
+    { slowCc1Pending,  timerSlowCc1Int },
+    { simSaphPending,  ISR_SAPH        },
+    { simUupsPending,  uupsInt         },
+    { simHspllPending, hsPllInt        },
+    { simDmaPending,   ISR_DMA         },
+};
+
+static void advanceActive(uint64_t ps);
+static void syncWrites(void);
+
+#define NUM_VECTORS (sizeof(vectors) / sizeof(vectors[0]))
+
+static bool anyPending(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < NUM_VECTORS; i++)
+    {
+        if (vectors[i].pending())
+            return true;
+    }
+    return false;
+}
+
+// Run the highest priority pending ISR, returns false if none is pending
+static bool dispatchInterrupt(void)
+{
+    unsigned int i;
+    uint16_t savedSr;
+
+    if (inIsr || !(sr & GIE))
+        return false;
+
+    for (i = 0; i < NUM_VECTORS; i++)
+    {
+        if (vectors[i].pending())
+            break;
+    }
+    if (i == NUM_VECTORS)
+        return false;
+
+    // Hardware clears GIE and the LPM bits on entry
+    savedSr = sr;
+    sr = 0;
+    inIsr = true;
+    isrExitClear = 0;
+    simStats.isrCount++;
+
+    // CCR0 flags are reset automatically when the interrupt is serviced
+    if (i == 0)
+        simRegClearBits(TIMER_A0_BASE + OFS_TAxCCTL0, CCIFG);
+    else if (i == 2)
+        simRegClearBits(TIMER_A1_BASE + OFS_TAxCCTL0, CCIFG);
+
+    advanceActive(cyclesToPs(simParams.isrOverheadCycles));
+    vectors[i].isr();
+    // Last register write of the ISR
+    syncWrites();
+
+    inIsr = false;
+    sr = savedSr & ~isrExitClear;
+
+    // An ISR that does not clear its source would lock up the device
+    if (vectors[i].pending())
+    {
+        if (++dispatchBurst > 10000)
+        {
+            simAbort("interrupt storm (vector %u never cleared)", i);
+        }
+    }
+    else
+    {
+        dispatchBurst = 0;
+    }
+
+    if ((savedSr & CPUOFF) && !(sr & CPUOFF))
+    {
+        wakeRequest = true;
+    }
+    return true;
+}
+
+static void dispatchAll(void)
+{
+    while (dispatchInterrupt())
+        ;
+}
+
+// Advance time with the CPU running, servicing interrupts on the way
+static void advanceActive(uint64_t ps)
+{
+    uint64_t end = simStats.nowPs + ps;
+    uint64_t t;
+
+    syncWrites();
+    while ((t = nextEventTime()) <= end)
+    {
+        fireEvents(t, SIM_CPU_ACTIVE);
+        dispatchAll();
+    }
+
+    if (end > simStats.nowPs)
+    {
+        simStats.statePs[SIM_CPU_ACTIVE] += end - simStats.nowPs;
+        simStats.nowPs = end;
+    }
+
+    dispatchAll();
+    checkRunLimits();
+}
+
+void simChargeCycles(uint32_t cycles)
+{
+    advanceActive(cyclesToPs(cycles));
+}
+
+void simDelayCycles(uint32_t cycles)
+{
+    simChargeCycles(cycles);
+}
+
+uint64_t simDivU64(uint64_t num, uint64_t den)
+{
+    simStats.divU64Calls++;
+    simChargeCycles(simParams.divU64Cycles);
+    return num / den;
+}
+
+int32_t simDspMac(int32_t acc, int32_t a, int32_t b)
+{
+    simStats.dspMacs++;
+    simChargeCycles(simParams.dspMacCycles);
+    return acc + a * b;
+}
+
+void simDisableInterrupt(void)
+{
+    sr &= ~GIE;
+}
+
+void simEnableInterrupt(void)
+{
+    sr |= GIE;
+    dispatchAll();
+}
+
+uint16_t simGetSR(void)
+{
+    return sr;
+}
+
+static sim_cpu_state_t lpmState(uint16_t bits)
+{
+    if (bits & OSCOFF)
+        return SIM_CPU_LPM4;
+    if (bits & (SCG0 | SCG1))
+        return SIM_CPU_LPM3;
+    return SIM_CPU_LPM0;
+}
+
+// Sleep until an ISR clears the LPM bits on exit
+static void lpmSleep(uint16_t lpmBits)
+{
+    sim_cpu_state_t state = lpmState(lpmBits);
+    uint64_t wakeupPs;
+    uint64_t t;
+
+    wakeupPs = SIM_US((state == SIM_CPU_LPM0) ? simParams.lpm0WakeupUs
+                                              : simParams.lpm3WakeupUs);
+    // Writes made right before going to sleep
+    syncWrites();
+    sr |= lpmBits;
+    wakeRequest = false;
+
+    while (!wakeRequest)
+    {
+        if (inIsr || !(sr & GIE))
+        {
+            simAbort("LPM entered with interrupts disabled");
+        }
+
+        if (dispatchInterrupt())
+            continue;
+
+        t = nextEventTime();
+        if (t == SIM_TIME_NONE)
+        {
+            simAbort("deadlock: LPM entered without any wake-up source");
+        }
+        if (t >= limitPs)
+        {
+            fireEvents(limitPs, state);
+            checkRunLimits();
+        }
+
+        fireEvents(t, state);
+
+        // Wake-up time is spent before the ISR runs, events due meanwhile
+        // (timer matches) must not be skipped
+        if (anyPending())
+        {
+            uint64_t end = simStats.nowPs + wakeupPs;
+
+            simStats.wakeups++;
+            while ((t = nextEventTime()) <= end)
+                fireEvents(t, state);
+            fireEvents(end, state);
+        }
+        checkRunLimits();
+    }
+
+    sr &= ~lpmBits;
+}
+
+void simBisSR(uint16_t bits)
+{
+    sr |= (bits & GIE);
+
+    if (bits & CPUOFF)
+    {
+        lpmSleep(bits & (CPUOFF | OSCOFF | SCG0 | SCG1));
+    }
+    else
+    {
+        dispatchAll();
+    }
+}
+
+void simBicSR(uint16_t bits)
+{
+    sr &= ~bits;
+}
+
+void simBicSROnExit(uint16_t bits)
+{
+    if (inIsr)
+    {
+        isrExitClear |= bits;
+    }
+}
+
+//// Register file ////
+
+uint16_t simRegGet(uint16_t addr)
+{
+    return *(uint16_t *) &regFile[addr & (SIM_REG_FILE_SIZE - 2)];
+}
+
+uint8_t * simRegPtr(uint16_t addr)
+{
+    return &regFile[addr & (SIM_REG_FILE_SIZE - 1)];
+}
+
+static void trackUpdate(uint16_t addr)
+{
+    int i;
+
+    for (i = 0; i < TRACK_LEN; i++)
+    {
+        if (track[i].used && ((track[i].addr & ~1) == (addr & ~1)))
+        {
+            track[i].val = track[i].wide ? simRegGet(track[i].addr)
+                                         : regFile[track[i].addr];
+        }
+    }
+}
+
+void simRegSet(uint16_t addr, uint16_t val)
+{
+    *(uint16_t *) &regFile[addr & (SIM_REG_FILE_SIZE - 2)] = val;
+    trackUpdate(addr);
+}
+
+void simRegSetBits(uint16_t addr, uint16_t bits)
+{
+    simRegSet(addr, simRegGet(addr) | bits);
+}
+
+void simRegClearBits(uint16_t addr, uint16_t bits)
+{
+    simRegSet(addr, simRegGet(addr) & ~bits);
+}
+
+// Registers where any access is a write (trigger, clear and TX registers)
+static bool isWriteOnly(uint16_t addr)
+{
+    switch (addr)
+    {
+        case SAPH_AASQTRIG_ADDR:
+        case SAPH_AICR_ADDR:
+        case SDHSICR_ADDR:
+        case UUPSICR_ADDR:
+        case HSPLLICR_ADDR:
+        case UCA1TXBUF_ADDR:
+        case UCB1TXBUF_ADDR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void onWrite(uint16_t addr, uint16_t oldVal, uint16_t newVal)
+{
+    if (simTimerOwns(addr))
+        simTimerOnWrite(addr, oldVal, newVal);
+    else if (simUssOwns(addr))
+        simUssOnWrite(addr, oldVal, newVal);
+    else if (simIoOwns(addr))
+        simIoOnWrite(addr, oldVal, newVal);
+}
+
+// Detect writes to the recently accessed registers
+static void syncWrites(void)
+{
+    int i;
+    uint16_t cur;
+    uint16_t old;
+
+    for (i = 0; i < TRACK_LEN; i++)
+    {
+        if (!track[i].used)
+            continue;
+
+        cur = track[i].wide ? simRegGet(track[i].addr) : regFile[track[i].addr];
+        if ((cur != track[i].val) || isWriteOnly(track[i].addr))
+        {
+            old = track[i].val;
+            track[i].val = cur;
+            if (isWriteOnly(track[i].addr))
+                track[i].used = false;
+            onWrite(track[i].addr & (track[i].wide ? ~1 : ~0), old, cur);
+        }
+    }
+}
+
+static void trackAccess(uint16_t addr, bool wide)
+{
+    int i;
+
+    // Already tracked?
+    for (i = 0; i < TRACK_LEN; i++)
+    {
+        if (track[i].used && track[i].addr == addr && track[i].wide == wide)
+            return;
+    }
+
+    track[trackIdx].used = true;
+    track[trackIdx].wide = wide;
+    track[trackIdx].addr = addr;
+    track[trackIdx].val = wide ? simRegGet(addr) : regFile[addr];
+    trackIdx = (trackIdx + 1) % TRACK_LEN;
+}
+
+static void onRead(uint16_t addr)
+{
+    if (simTimerOwns(addr))
+        simTimerOnRead(addr);
+    else if (simUssOwns(addr))
+        simUssOnRead(addr);
+    else if (simIoOwns(addr))
+        simIoOnRead(addr);
+}
+
+static void access(uint16_t addr, bool wide)
+{
+    if (addr >= SIM_REG_FILE_SIZE)
+    {
+        simAbort("register access out of the modeled range: 0x%04x", addr);
+    }
+
+    syncWrites();
+    simStats.regAccesses++;
+    advanceActive(cyclesToPs(simParams.regAccessCycles));
+    // Interrupts serviced while advancing may have written registers
+    syncWrites();
+
+    onRead(addr);
+    trackAccess(addr, wide);
+}
+
+volatile uint16_t * simReg16(uint16_t addr)
+{
+    addr &= ~1;
+    access(addr, true);
+    return (volatile uint16_t *) &regFile[addr];
+}
+
+volatile uint8_t * simReg8(uint16_t addr)
+{
+    access(addr, false);
+    return (volatile uint8_t *) &regFile[addr];
+}
+
+//// Run control ////
+
+void simReset(void)
+{
+    int i;
+
+    memset(regFile, 0, sizeof(regFile));
+    memset(simLeaRam, 0, sizeof(simLeaRam));
+    memset(track, 0, sizeof(track));
+    memset(&simStats, 0, sizeof(simStats));
+    trackIdx = 0;
+
+    sr = 0;
+    inIsr = false;
+    isrExitClear = 0;
+    wakeRequest = false;
+    dispatchBurst = 0;
+
+    for (i = 0; i < SIM_EVT_NUM; i++)
+    {
+        eventTime[i] = SIM_TIME_NONE;
+    }
+
+    if (simParams.mclkHz == 0)
+    {
+        setDefaultParams();
+    }
+
+    simTimerReset();
+    simUssReset();
+    simIoReset();
+}
+
+sim_exit_t simRun(void (*fn)(void), bool (*stop)(void), uint64_t limit)
+{
+    int ret;
+
+    stopCond = stop;
+    limitPs = simStats.nowPs + limit;
+    abortMsg[0] = 0;
+
+    ret = setjmp(runJmp);
+    if (ret != 0)
+    {
+        // Left through longjmp, possibly from within an ISR
+        running = false;
+        inIsr = false;
+        syncWrites();
+        return (sim_exit_t) ret;
+    }
+
+    running = true;
+    fn();
+    syncWrites();
+    running = false;
+
+    return SIM_EXIT_NONE;
+}
+
+void simAbort(const char *fmt, ...)
+{
+    va_list args;
+    int len;
+
+    len = snprintf(abortMsg, sizeof(abortMsg), "t=%.1f us: ",
+                   simPsToUs(simStats.nowPs));
+
+    va_start(args, fmt);
+    vsnprintf(abortMsg + len, sizeof(abortMsg) - len, fmt, args);
+    va_end(args);
+
+    if (running)
+    {
+        running = false;
+        longjmp(runJmp, SIM_EXIT_ABORT);
+    }
+
+    fprintf(stderr, "sim: %s\n", abortMsg);
+    exit(1);
+}
+
+const char * simAbortMessage(void)
+{
+    return abortMsg;
+}
@@ -0,0 +1,661 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// IO model: driverlib GPIO/DMA/eUSCI functions, the HV MUX SPI master
+// (eUSCI_B1) and the nRF52 acting as SPI master on eUSCI_A1.
+//
+// The HV MUX is a 16-bit shift register behind eUSCI_B1 (TX buffer plus
+// shift register, one byte per 8 SMCLK cycles), latched on the falling
+// edge of ~LE. Writing UCB1TXBUF while it is full or latching while a
+// byte is shifting aborts the run.
+//
+// The nRF52 mirrors fw/nrf52/ble_peripheral: on the rising edge of DATA_READY
+// it enables a timer that starts one SPI transfer of nrfChunkBytes every
+// nrfChunkPeriodUs, nrfChunks times. It clocks out the same TX buffer in
+// every transfer. Bytes are exchanged at the end of each transfer.
+// After an exchange that carried a configuration package the number of
+// transfers follows its sample size (see usCalcFrameLength()), after a
+// preset select command the full number of transfers is used.
+
+#include "driverlib.h"
+#include "sim.h"
+
+#define NUM_PORTS           16
+#define NUM_DMA_CH          3
+
+// nRF52 pins as seen from the MSP430
+#define DATA_READY_PORT     GPIO_PORT_P4
+#define DATA_READY_PIN      GPIO_PIN0
+#define BLE_READY_PORT      GPIO_PORT_P4
+#define BLE_READY_PIN       GPIO_PIN4
+
+// HV MUX latch enable (~LE)
+#define HV_MUX_LE_PORT      GPIO_PORT_P5
+#define HV_MUX_LE_PIN       GPIO_PIN7
+
+// HV PCB DC-DC converters (SW_EN, HV1_EN)
+#define HV_DCDC_PORT        GPIO_PORT_P6
+#define HV_DCDC_PINS        (GPIO_PIN4 | GPIO_PIN5)
+
+typedef struct
+{
+    uint16_t mode;
+    uint16_t size;
+    uint8_t  trigger;
+    uint8_t  unit;
+    uint32_t src;
+    uint32_t dst;
+    uint16_t srcDir;
+    uint16_t dstDir;
+    bool     enabled;
+    bool     ie;
+    bool     ifg;
+
+    // Working copies, reloaded on enable and in repeated modes
+    uint32_t curSrc;
+    uint32_t curDst;
+    uint16_t remaining;
+
+} sim_dma_ch_t;
+
+static uint8_t portOut[NUM_PORTS];
+static uint8_t portDir[NUM_PORTS];
+static sim_dma_ch_t dma[NUM_DMA_CH];
+
+// HV MUX SPI (eUSCI_B1): bytes in the shift register and the TX buffer
+// with the time they are shifted out
+static uint8_t  ucb1Bytes[2];
+static uint64_t ucb1Done[2];
+static uint8_t  ucb1Pending;
+static uint16_t hvMuxShift;
+static uint16_t hvMuxLatch;
+static uint64_t hvDcDcOn;
+
+// nRF52
+static bool bleReady;
+static uint8_t nrfTx[SIM_SPI_FRAME_MAX];
+static uint32_t nrfTxLen;
+static uint32_t nrfChunk;
+static uint32_t nrfChunks;
+static bool nrfBusy;
+static sim_spi_frame_t nrfFrame;
+static void (*frameCallback)(const sim_spi_frame_t *frame);
+
+bool simIoOwns(uint16_t addr)
+{
+    return ((addr >= EUSCI_A1_BASE) && (addr < EUSCI_A1_BASE + 0x20)) ||
+           ((addr >= EUSCI_B1_BASE) && (addr < EUSCI_B1_BASE + 0x30));
+}
+
+void simIoReset(void)
+{
+    memset(portOut, 0, sizeof(portOut));
+    memset(portDir, 0, sizeof(portDir));
+    memset(dma, 0, sizeof(dma));
+    ucb1Pending = 0;
+    hvMuxShift = 0;
+    hvMuxLatch = 0;
+    hvDcDcOn = SIM_TIME_NONE;
+    simRegSet(UCB1IFG_ADDR, UCTXIFG);
+    nrfChunk = 0;
+    nrfChunks = simParams.nrfChunks;
+    nrfBusy = false;
+    bleReady = false;
+
+    if (simParams.bleReadyDelayUs)
+        simSchedule(SIM_EVT_BLE_READY, SIM_US(simParams.bleReadyDelayUs));
+}
+
+static void chargeCall(void)
+{
+    simStats.driverlibCalls++;
+    simChargeCycles(simParams.driverlibCallCycles);
+}
+
+//// Host address of a DMA address ////
+
+// DMA addresses are host addresses truncated to 32 bit, the simulator is
+// linked without PIE so that all static data is below 4 GB
+static uint8_t * hostPtr(uint32_t addr)
+{
+    return (uint8_t *)(uintptr_t) addr;
+}
+
+static bool isReg(uint32_t addr, uint16_t reg)
+{
+    return hostPtr(addr) == simRegPtr(reg);
+}
+
+//// HV MUX ////
+
+// Move the bytes shifted out by now into the shift register of the MUX
+static void ucb1Update(void)
+{
+    while ((ucb1Pending > 0) && (ucb1Done[0] <= simStats.nowPs))
+    {
+        hvMuxShift = (uint16_t)((hvMuxShift << 8) | ucb1Bytes[0]);
+        ucb1Bytes[0] = ucb1Bytes[1];
+        ucb1Done[0] = ucb1Done[1];
+        ucb1Pending--;
+    }
+
+    if (ucb1Pending > 0)
+        simRegSetBits(UCB1STAT_ADDR, UCBBUSY);
+    else
+        simRegClearBits(UCB1STAT_ADDR, UCBBUSY);
+
+    // The TX buffer is free once the last byte moved to the shift register
+    if (ucb1Pending < 2)
+        simRegSetBits(UCB1IFG_ADDR, UCTXIFG);
+    else
+        simRegClearBits(UCB1IFG_ADDR, UCTXIFG);
+}
+
+static void ucb1Write(uint8_t val)
+{
+    uint64_t start = simStats.nowPs;
+
+    ucb1Update();
+    if (ucb1Pending == 2)
+        simAbort("UCB1TXBUF written while full");
+    if (ucb1Pending == 1)
+        start = ucb1Done[0];
+
+    ucb1Bytes[ucb1Pending] = val;
+    ucb1Done[ucb1Pending] = start + 8ULL * SIM_PS_PER_S / simParams.mclkHz;
+    ucb1Pending++;
+    ucb1Update();
+}
+
+uint16_t simHvMuxLatched(void)
+{
+    return hvMuxLatch;
+}
+
+//// GPIO ////
+
+static void onPinChange(uint8_t port, uint8_t rising, uint8_t falling)
+{
+    if ((port == HV_MUX_LE_PORT) && (falling & HV_MUX_LE_PIN))
+    {
+        ucb1Update();
+        if (ucb1Pending > 0)
+            simAbort("HV MUX latched while a byte is shifting");
+        hvMuxLatch = hvMuxShift;
+    }
+
+    if ((port == HV_DCDC_PORT) && (rising & HV_DCDC_PINS))
+        hvDcDcOn = simStats.nowPs;
+
+    if ((port == DATA_READY_PORT) && (rising & DATA_READY_PIN) && !nrfBusy)
+    {
+        nrfBusy = true;
+        nrfChunk = 0;
+        nrfFrame.len = 0;
+        nrfFrame.tDataReady = simStats.nowPs;
+        nrfFrame.tStart = SIM_TIME_NONE;
+        simSchedule(SIM_EVT_NRF_CHUNK, simStats.nowPs +
+                    SIM_US(simParams.nrfLatencyUs + simParams.nrfChunkPeriodUs) +
+                    (uint64_t) simParams.nrfChunkBytes * 8 * SIM_PS_PER_S /
+                    simParams.nrfSpiHz);
+    }
+}
+
+static void setOut(uint8_t port, uint8_t val)
+{
+    uint8_t old = portOut[port];
+
+    portOut[port] = val;
+    onPinChange(port, val & ~old, old & ~val);
+}
+
+void GPIO_setAsOutputPin(uint8_t selectedPort, uint16_t selectedPins)
+{
+    chargeCall();
+    portDir[selectedPort % NUM_PORTS] |= (uint8_t) selectedPins;
+}
+
+void GPIO_setAsInputPin(uint8_t selectedPort, uint16_t selectedPins)
+{
+    chargeCall();
+    portDir[selectedPort % NUM_PORTS] &= ~(uint8_t) selectedPins;
+}
+
+void GPIO_setAsPeripheralModuleFunctionOutputPin(uint8_t selectedPort,
+                                                 uint16_t selectedPins,
+                                                 uint8_t mode)
+{
+    (void) selectedPort;
+    (void) selectedPins;
+    (void) mode;
+    chargeCall();
+}
+
+void GPIO_setAsPeripheralModuleFunctionInputPin(uint8_t selectedPort,
+                                                uint16_t selectedPins,
+                                                uint8_t mode)
+{
+    (void) selectedPort;
+    (void) selectedPins;
+    (void) mode;
+    chargeCall();
+}
+
+void GPIO_setOutputHighOnPin(uint8_t selectedPort, uint16_t selectedPins)
+{
+    chargeCall();
+    setOut(selectedPort % NUM_PORTS,
+           portOut[selectedPort % NUM_PORTS] | (uint8_t) selectedPins);
+}
+
+void GPIO_setOutputLowOnPin(uint8_t selectedPort, uint16_t selectedPins)
+{
+    chargeCall();
+    setOut(selectedPort % NUM_PORTS,
+           portOut[selectedPort % NUM_PORTS] & ~(uint8_t) selectedPins);
+}
+
+void GPIO_toggleOutputOnPin(uint8_t selectedPort, uint16_t selectedPins)
+{
+    chargeCall();
+    setOut(selectedPort % NUM_PORTS,
+           portOut[selectedPort % NUM_PORTS] ^ (uint8_t) selectedPins);
+}
+
+uint8_t GPIO_getInputPinValue(uint8_t selectedPort, uint16_t selectedPins)
+{
+    chargeCall();
+
+    if ((selectedPort == BLE_READY_PORT) && (selectedPins & BLE_READY_PIN))
+        return bleReady ? GPIO_INPUT_PIN_HIGH : GPIO_INPUT_PIN_LOW;
+
+    return (portOut[selectedPort % NUM_PORTS] & selectedPins) ?
+           GPIO_INPUT_PIN_HIGH : GPIO_INPUT_PIN_LOW;
+}
+
+uint8_t simGpioGetOut(uint8_t port)
+{
+    return portOut[port % NUM_PORTS];
+}
+
+uint64_t simHvDcDcOnTime(void)
+{
+    return hvDcDcOn;
+}
+
+void PMM_unlockLPM5(void)
+{
+    chargeCall();
+}
+
+//// DMA ////
+
+static sim_dma_ch_t * dmaCh(uint8_t channelSelect)
+{
+    return &dma[(channelSelect >> 4) % NUM_DMA_CH];
+}
+
+static void dmaReload(sim_dma_ch_t *ch)
+{
+    ch->curSrc = ch->src;
+    ch->curDst = ch->dst;
+    ch->remaining = ch->size;
+}
+
+static uint32_t step(uint32_t addr, uint16_t dir, uint32_t n)
+{
+    if (dir == DMA_DIRECTION_INCREMENT)
+        return addr + n;
+    if (dir == DMA_DIRECTION_DECREMENT)
+        return addr - n;
+    return addr;
+}
+
+// One DMA transfer unit, returns false if the channel is idle
+static bool dmaTransfer(sim_dma_ch_t *ch)
+{
+    bool srcByte = (ch->unit & 0x80) != 0;
+    bool dstByte = (ch->unit & 0x40) != 0;
+    uint16_t val;
+
+    if (!ch->enabled || (ch->remaining == 0))
+        return false;
+
+    if (srcByte)
+        val = *hostPtr(ch->curSrc);
+    else
+        val = *(uint16_t *) hostPtr(ch->curSrc);
+
+    if (dstByte)
+        *hostPtr(ch->curDst) = (uint8_t) val;
+    else
+        *(uint16_t *) hostPtr(ch->curDst) = val;
+
+    ch->curSrc = step(ch->curSrc, ch->srcDir, srcByte ? 1 : 2);
+    ch->curDst = step(ch->curDst, ch->dstDir, dstByte ? 1 : 2);
+
+    if (--ch->remaining == 0)
+    {
+        ch->ifg = true;
+        if (ch->mode >= DMA_TRANSFER_REPEATED_SINGLE)
+            dmaReload(ch);
+        else
+            ch->enabled = false;
+    }
+    return true;
+}
+
+// Trigger all channels waiting for the given trigger source
+static void dmaTrigger(uint8_t trigger)
+{
+    int i;
+
+    for (i = 0; i < NUM_DMA_CH; i++)
+    {
+        if (dma[i].enabled && (dma[i].trigger == trigger))
+            dmaTransfer(&dma[i]);
+    }
+}
+
+void DMA_init(DMA_initParam *param)
+{
+    sim_dma_ch_t *ch = dmaCh(param->channelSelect);
+
+    chargeCall();
+    ch->mode = param->transferModeSelect;
+    ch->size = param->transferSize;
+    ch->trigger = param->triggerSourceSelect;
+    ch->unit = param->transferUnitSelect;
+    ch->enabled = false;
+    ch->ifg = false;
+}
+
+void DMA_setTransferSize(uint8_t channelSelect, uint16_t transferSize)
+{
+    chargeCall();
+    dmaCh(channelSelect)->size = transferSize;
+}
+
+uint16_t DMA_getTransferSize(uint8_t channelSelect)
+{
+    chargeCall();
+    return dmaCh(channelSelect)->size;
+}
+
+void DMA_setSrcAddress(uint8_t channelSelect, uint32_t srcAddress,
+                       uint16_t directionSelect)
+{
+    sim_dma_ch_t *ch = dmaCh(channelSelect);
+
+    chargeCall();
+    ch->src = srcAddress;
+    ch->srcDir = directionSelect;
+}
+
+void DMA_setDstAddress(uint8_t channelSelect, uint32_t dstAddress,
+                       uint16_t directionSelect)
+{
+    sim_dma_ch_t *ch = dmaCh(channelSelect);
+
+    chargeCall();
+    ch->dst = dstAddress;
+    ch->dstDir = directionSelect;
+}
+
+void DMA_enableTransfers(uint8_t channelSelect)
+{
+    sim_dma_ch_t *ch = dmaCh(channelSelect);
+
+    chargeCall();
+    ch->enabled = true;
+    dmaReload(ch);
+}
+
+void DMA_disableTransfers(uint8_t channelSelect)
+{
+    chargeCall();
+    dmaCh(channelSelect)->enabled = false;
+}
+
+void DMA_startTransfer(uint8_t channelSelect)
+{
+    sim_dma_ch_t *ch = dmaCh(channelSelect);
+    uint32_t units = 0;
+
+    chargeCall();
+    if (ch->trigger != DMA_TRIGGERSOURCE_0)
+        return;
+
+    // Block transfers halt the CPU, two MCLK cycles per unit
+    do
+    {
+        if (!dmaTransfer(ch))
+            break;
+        units++;
+    } while ((ch->mode != DMA_TRANSFER_SINGLE) &&
+             (ch->mode != DMA_TRANSFER_REPEATED_SINGLE) &&
+             (ch->remaining != ch->size) && ch->enabled);
+
+    simChargeCycles(2 * units);
+}
+
+void DMA_enableInterrupt(uint8_t channelSelect)
+{
+    chargeCall();
+    dmaCh(channelSelect)->ie = true;
+}
+
+void DMA_disableInterrupt(uint8_t channelSelect)
+{
+    chargeCall();
+    dmaCh(channelSelect)->ie = false;
+}
+
+uint16_t DMA_getInterruptStatus(uint8_t channelSelect)
+{
+    chargeCall();
+    return dmaCh(channelSelect)->ifg ? DMA_INT_ACTIVE : DMA_INT_INACTIVE;
+}
+
+void DMA_clearInterrupt(uint8_t channelSelect)
+{
+    chargeCall();
+    dmaCh(channelSelect)->ifg = false;
+}
+
+bool simDmaPending(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_DMA_CH; i++)
+    {
+        if (dma[i].ie && dma[i].ifg)
+            return true;
+    }
+    return false;
+}
+
+//// eUSCI ////
+
+void EUSCI_A_SPI_initSlave(uint16_t baseAddress,
+                           EUSCI_A_SPI_initSlaveParam *param)
+{
+    (void) baseAddress;
+    (void) param;
+    chargeCall();
+}
+
+void EUSCI_A_SPI_select4PinFunctionality(uint16_t baseAddress,
+                                         uint8_t select4PinFunctionality)
+{
+    (void) baseAddress;
+    (void) select4PinFunctionality;
+    chargeCall();
+}
+
+void EUSCI_A_SPI_enable(uint16_t baseAddress)
+{
+    (void) baseAddress;
+    chargeCall();
+}
+
+void EUSCI_B_SPI_initMaster(uint16_t baseAddress,
+                            EUSCI_B_SPI_initMasterParam *param)
+{
+    (void) baseAddress;
+    (void) param;
+    chargeCall();
+}
+
+void EUSCI_B_SPI_select4PinFunctionality(uint16_t baseAddress,
+                                         uint8_t select4PinFunctionality)
+{
+    (void) baseAddress;
+    (void) select4PinFunctionality;
+    chargeCall();
+}
+
+void EUSCI_B_SPI_enable(uint16_t baseAddress)
+{
+    (void) baseAddress;
+    chargeCall();
+}
+
+void simIoOnWrite(uint16_t addr, uint16_t oldVal, uint16_t newVal)
+{
+    (void) oldVal;
+
+    // The HV MUX shift register is clocked with SMCLK, 8 bits per byte
+    if (addr == UCB1TXBUF_ADDR)
+        ucb1Write((uint8_t) newVal);
+}
+
+void simIoOnRead(uint16_t addr)
+{
+    if ((addr == UCB1STAT_ADDR) || (addr == UCB1IFG_ADDR))
+        ucb1Update();
+}
+
+//// nRF52 SPI master ////
+
+// Exchange one byte on eUSCI_A1
+static uint8_t spiExchange(uint8_t mosi)
+{
+    uint8_t miso;
+
+    // TX buffer moves to the shift register, TXIFG triggers the refill
+    miso = (uint8_t) simRegGet(UCA1TXBUF_ADDR);
+    dmaTrigger(DMA_TRIGGERSOURCE_17);
+
+    // Received byte, RXIFG triggers the RX channel
+    simRegSet(UCA1RXBUF_ADDR, mosi);
+    dmaTrigger(DMA_TRIGGERSOURCE_16);
+
+    return miso;
+}
+
+static void nrfChunkDone(void)
+{
+    uint32_t i;
+    uint8_t miso;
+
+    if (nrfFrame.tStart == SIM_TIME_NONE)
+    {
+        nrfFrame.tStart = simStats.nowPs - (uint64_t) simParams.nrfChunkBytes *
+                          8 * SIM_PS_PER_S / simParams.nrfSpiHz;
+    }
+
+    // The nRF52 sends the same TX buffer in every transfer
+    for (i = 0; i < simParams.nrfChunkBytes; i++)
+    {
+        miso = spiExchange((i < nrfTxLen) ? nrfTx[i] : 0);
+        if (nrfFrame.len < SIM_SPI_FRAME_MAX)
+            nrfFrame.data[nrfFrame.len++] = miso;
+    }
+
+    if (++nrfChunk < nrfChunks)
+    {
+        simSchedule(SIM_EVT_NRF_CHUNK,
+                    simStats.nowPs + SIM_US(simParams.nrfChunkPeriodUs));
+        return;
+    }
+
+    // Configuration package: header and sample size in whole transfers,
+    // the MSB of the sample size selects the extended header, bits 12-13
+    // the packing (1: 3 bytes per 2 samples, 2: 1 byte per sample), bits
+    // 10-11 log2 of the envelope decimation
+    if ((nrfTxLen >= 18) && (nrfTx[0] == 0xFA))
+    {
+        uint32_t sampleSize = nrfTx[16] | ((uint32_t) nrfTx[17] << 8);
+        uint32_t header = (sampleSize & 0x8000) ? 16u : 4u;
+        uint32_t payload = (((sampleSize & 0x03FF) / 2) >> ((sampleSize >> 10) & 3)) * 2;
+
+        if (((sampleSize >> 12) & 3) == 1)
+            payload = (3 * (payload / 2) + 1) / 2;
+        else if (((sampleSize >> 12) & 3) == 2)
+            payload = payload / 2;
+
+        nrfChunks = (header + payload +
+                     simParams.nrfChunkBytes - 1) / simParams.nrfChunkBytes;
+        if (nrfChunks > simParams.nrfChunks)
+            nrfChunks = simParams.nrfChunks;
+    }
+    else if ((nrfTxLen >= 2) && (nrfTx[0] == 0xFC) && (nrfTx[1] == 0x01))
+    {
+        nrfChunks = simParams.nrfChunks;
+    }
+
+    nrfBusy = false;
+    nrfFrame.tDone = simStats.nowPs;
+    if (frameCallback)
+        frameCallback(&nrfFrame);
+}
+
+void simIoEvent(sim_event_t evt)
+{
+    switch (evt)
+    {
+        case SIM_EVT_NRF_CHUNK:
+            nrfChunkDone();
+            break;
+        case SIM_EVT_BLE_READY:
+            bleReady = true;
+            break;
+        default:
+            break;
+    }
+}
+
+void simNrfSetTx(const uint8_t *data, uint32_t len)
+{
+    if (len > sizeof(nrfTx))
+        len = sizeof(nrfTx);
+    memcpy(nrfTx, data, len);
+    nrfTxLen = len;
+}
+
+void simNrfSetBleReady(bool ready)
+{
+    bleReady = ready;
+    simCancel(SIM_EVT_BLE_READY);
+}
+
+void simNrfSetFrameCallback(void (*cb)(const sim_spi_frame_t *frame))
+{
+    frameCallback = cb;
+}
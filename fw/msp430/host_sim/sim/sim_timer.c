@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Timer_A model (TA0 = fast timer on SMCLK, TA1 = slow timer on ACLK)
+//
+// The counter is not stepped, it is computed from the time the timer was
+// last (re)started. Compare events are predicted for CCR0..CCR2 and the
+// overflow in continuous mode, up mode wraps at CCR0.
+//
+// Of the compare output modes only OUTMOD_0 (output = OUT) and OUTMOD_1 (set)
+// are modeled. A rising edge of the TA0.1 output triggers the ASQ when SAPH
+// selects the timer trigger.
+
+#include "sim.h"
+
+#define NUM_TIMERS      2
+#define NUM_CCR         3
+#define TIMER_BLOCK     (0x40)
+
+typedef struct
+{
+    uint16_t base;
+    bool     running;
+    uint64_t t0;            // Time of the last (re)start
+    uint16_t count0;        // Counter value at t0
+    uint64_t srcHz;
+    uint32_t div;
+    bool     out[NUM_CCR];      // Compare output levels
+    uint64_t tCc0;              // Time of the last CCR0 match
+
+} sim_timer_t;
+
+static sim_timer_t timers[NUM_TIMERS];
+
+static sim_timer_t * findTimer(uint16_t addr)
+{
+    int i;
+
+    for (i = 0; i < NUM_TIMERS; i++)
+    {
+        if ((addr >= timers[i].base) && (addr < timers[i].base + TIMER_BLOCK))
+            return &timers[i];
+    }
+    return NULL;
+}
+
+bool simTimerOwns(uint16_t addr)
+{
+    return findTimer(addr) != NULL;
+}
+
+void simTimerReset(void)
+{
+    memset(timers, 0, sizeof(timers));
+    timers[0].base = TIMER_A0_BASE;
+    timers[1].base = TIMER_A1_BASE;
+    timers[0].tCc0 = SIM_TIME_NONE;
+    timers[1].tCc0 = SIM_TIME_NONE;
+    timers[0].div = 1;
+    timers[1].div = 1;
+}
+
+// Clock edges are free-running from time 0: a stopped timer only misses
+// the edges while it is stopped
+static uint64_t edgesAt(const sim_timer_t *t, uint64_t tPs)
+{
+    unsigned __int128 x = (unsigned __int128) tPs * t->srcHz;
+
+    return (uint64_t)(x / ((unsigned __int128) t->div * SIM_PS_PER_S));
+}
+
+static uint64_t ticksAt(const sim_timer_t *t, uint64_t tPs)
+{
+    return edgesAt(t, tPs) - edgesAt(t, t->t0);
+}
+
+static uint64_t timeOfTick(const sim_timer_t *t, uint64_t tick)
+{
+    unsigned __int128 den = t->srcHz;
+    unsigned __int128 x = (unsigned __int128)(edgesAt(t, t->t0) + tick) *
+                          t->div * SIM_PS_PER_S;
+
+    return (uint64_t)((x + den - 1) / den);
+}
+
+static uint16_t ctl(const sim_timer_t *t)
+{
+    return simRegGet(t->base + OFS_TAxCTL);
+}
+
+static bool upMode(const sim_timer_t *t)
+{
+    return (ctl(t) & MC_3) == MC__UP;
+}
+
+// Period of the counter in ticks
+static uint32_t period(const sim_timer_t *t)
+{
+    if (upMode(t))
+        return (uint32_t) simRegGet(t->base + OFS_TAxCCR0) + 1;
+    return 0x10000;
+}
+
+static uint16_t countAt(const sim_timer_t *t, uint64_t tPs)
+{
+    if (!t->running)
+        return t->count0;
+    return (uint16_t)((t->count0 + ticksAt(t, tPs)) % period(t));
+}
+
+static void applyClock(sim_timer_t *t, uint16_t ctlVal)
+{
+    switch (ctlVal & TASSEL_3)
+    {
+        case TASSEL__ACLK:
+            t->srcHz = simParams.aclkHz;
+            break;
+        case TASSEL__SMCLK:
+            t->srcHz = simParams.mclkHz;
+            break;
+        default:
+            // External clocks are not modeled
+            t->srcHz = 0;
+            break;
+    }
+
+    t->div = (1u << ((ctlVal & ID_3) >> 6)) *
+             ((simRegGet(t->base + OFS_TAxEX0) & TAIDEX_7) + 1);
+}
+
+// Freeze the counter at the current time
+static void rebase(sim_timer_t *t, uint16_t count)
+{
+    t->count0 = count;
+    t->t0 = simStats.nowPs;
+}
+
+static void setOutput(sim_timer_t *t, int ch, bool level)
+{
+    bool rising = level && !t->out[ch];
+
+    t->out[ch] = level;
+    if (rising && (t->base == TIMER_A0_BASE) && (ch == 1))
+        simUssTimerTrigger();
+}
+
+// Compare match of CCRn, n > 0
+static void compareOutput(sim_timer_t *t, int ch)
+{
+    if ((simRegGet(t->base + OFS_TAxCCTL0 + 2 * ch) & OUTMOD_7) == OUTMOD_1)
+        setOutput(t, ch, true);
+}
+
+void simTimerOnWrite(uint16_t addr, uint16_t oldVal, uint16_t newVal)
+{
+    sim_timer_t *t = findTimer(addr);
+    uint16_t ofs = addr - t->base;
+
+    switch (ofs)
+    {
+        case OFS_TAxCTL:
+            // Counter value with the old configuration
+            rebase(t, countAt(t, simStats.nowPs));
+
+            if (newVal & TACLR)
+            {
+                t->count0 = 0;
+                simRegClearBits(addr, TACLR);
+                newVal &= ~TACLR;
+            }
+
+            applyClock(t, newVal);
+            t->running = ((newVal & MC_3) != MC__STOP) && (t->srcHz != 0);
+            (void) oldVal;
+            break;
+
+        case OFS_TAxEX0:
+            rebase(t, countAt(t, simStats.nowPs));
+            applyClock(t, ctl(t));
+            break;
+
+        case OFS_TAxR:
+            rebase(t, newVal);
+            break;
+
+        case OFS_TAxCCTL1:
+        case OFS_TAxCCTL2:
+            if ((newVal & OUTMOD_7) == OUTMOD_0)
+                setOutput(t, (ofs - OFS_TAxCCTL0) / 2, (newVal & OUT) != 0);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void simTimerOnRead(uint16_t addr)
+{
+    sim_timer_t *t = findTimer(addr);
+    uint16_t ofs = addr - t->base;
+    uint16_t cctl;
+    uint16_t iv = 0;
+    int ch;
+
+    switch (ofs)
+    {
+        case OFS_TAxR:
+            simRegSet(addr, countAt(t, simStats.nowPs));
+            break;
+
+        case OFS_TAxIV:
+            // Highest pending enabled flag, reading clears it
+            for (ch = 1; ch < NUM_CCR; ch++)
+            {
+                cctl = simRegGet(t->base + OFS_TAxCCTL0 + 2 * ch);
+                if ((cctl & CCIE) && (cctl & CCIFG))
+                {
+                    iv = 2 * ch;
+                    simRegClearBits(t->base + OFS_TAxCCTL0 + 2 * ch, CCIFG);
+                    break;
+                }
+            }
+            if ((iv == 0) && ((ctl(t) & (TAIE | TAIFG)) == (TAIE | TAIFG)))
+            {
+                iv = TAIV__TAIFG;
+                simRegClearBits(t->base + OFS_TAxCTL, TAIFG);
+            }
+            simRegSet(addr, iv);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Next time the counter reaches target, SIM_TIME_NONE if never
+static uint64_t nextMatch(const sim_timer_t *t, uint32_t target)
+{
+    uint64_t now = simStats.nowPs;
+    uint64_t ticks = ticksAt(t, now);
+    uint32_t per = period(t);
+    uint32_t cur = (uint32_t)((t->count0 + ticks) % per);
+    uint32_t d;
+
+    if (target >= per)
+        return SIM_TIME_NONE;
+
+    d = (target + per - cur) % per;
+    // Already at target now: the match happened (or is happening) at this
+    // tick, the next one is a full period away
+    if (d == 0)
+    {
+        if (timeOfTick(t, ticks) == now)
+            return now;
+        d = per;
+    }
+    return timeOfTick(t, ticks + d);
+}
+
+// Time of the next event of one timer; channel = 0..NUM_CCR-1, NUM_CCR for overflow
+static uint64_t timerNext(const sim_timer_t *t, int *channel)
+{
+    uint64_t best = SIM_TIME_NONE;
+    uint64_t tm;
+    int ch;
+
+    if (!t->running)
+        return SIM_TIME_NONE;
+
+    for (ch = 0; ch < NUM_CCR; ch++)
+    {
+        // Flags that are already set do not need a new event
+        if (simRegGet(t->base + OFS_TAxCCTL0 + 2 * ch) & CCIFG)
+            continue;
+
+        tm = nextMatch(t, simRegGet(t->base + OFS_TAxCCR0 + 2 * ch));
+        if (tm < best)
+        {
+            best = tm;
+            *channel = ch;
+        }
+    }
+
+    if (!(ctl(t) & TAIFG))
+    {
+        tm = nextMatch(t, 0);
+        if (tm < best)
+        {
+            best = tm;
+            *channel = NUM_CCR;
+        }
+    }
+    return best;
+}
+
+uint64_t simTimerNextEvent(void)
+{
+    uint64_t best = SIM_TIME_NONE;
+    uint64_t tm;
+    int ch;
+    int i;
+
+    for (i = 0; i < NUM_TIMERS; i++)
+    {
+        tm = timerNext(&timers[i], &ch);
+        if (tm < best)
+            best = tm;
+    }
+    return best;
+}
+
+uint64_t simTimerLastCc0(uint16_t base)
+{
+    int i;
+
+    for (i = 0; i < NUM_TIMERS; i++)
+    {
+        if (timers[i].base == base)
+            return timers[i].tCc0;
+    }
+    return SIM_TIME_NONE;
+}
+
+void simTimerFire(uint64_t tPs)
+{
+    uint64_t tm;
+    int ch = 0;
+    int i;
+
+    for (i = 0; i < NUM_TIMERS; i++)
+    {
+        while ((tm = timerNext(&timers[i], &ch)) <= tPs)
+        {
+            if (ch == NUM_CCR)
+            {
+                simRegSetBits(timers[i].base + OFS_TAxCTL, TAIFG);
+            }
+            else
+            {
+                simRegSetBits(timers[i].base + OFS_TAxCCTL0 + 2 * ch, CCIFG);
+                if (ch > 0)
+                    compareOutput(&timers[i], ch);
+                else
+                    timers[i].tCc0 = tm;
+            }
+        }
+    }
+}
+
+bool simTimerCc0Pending(uint16_t base)
+{
+    uint16_t cctl = simRegGet(base + OFS_TAxCCTL0);
+
+    return (cctl & CCIE) && (cctl & CCIFG);
+}
+
+bool simTimerCc1Pending(uint16_t base)
+{
+    uint16_t cctl;
+    int ch;
+
+    for (ch = 1; ch < NUM_CCR; ch++)
+    {
+        cctl = simRegGet(base + OFS_TAxCCTL0 + 2 * ch);
+        if ((cctl & CCIE) && (cctl & CCIFG))
+            return true;
+    }
+    return (simRegGet(base + OFS_TAxCTL) & (TAIE | TAIFG)) == (TAIE | TAIFG);
+}
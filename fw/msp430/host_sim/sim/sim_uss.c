@@ -0,0 +1,580 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Ultrasound subsystem model: HSPLL/USSXT, UUPS, SAPH acquisition sequencer
+// and SDHS with its data transfer controller (DTC) writing into LEA RAM.
+//
+// Timing follows slau367p:
+//  - SAPH time marks A..D count HSPLL/16, E counts HSPLL/256, F HSPLL/64
+//  - the SDHS samples at HSPLL / OSR, OSR = 10 << SDHSCTL1
+//  - the PLL output is XTAL * (PLLM + 1) / 2
+// The SDHS window comparator flags samples above SDHSWINHITH (WINHI) or
+// below SDHSWINLOTH (WINLO) in SDHSRIS.
+// The echo written by the DTC is synthetic, but deterministic and different
+// for every acquisition so stale or corrupted frames can be detected.
+
+#include <math.h>
+
+#include "sim.h"
+
+#define USS_FIRST_ADDR      (0x0E00)
+#define USS_LAST_ADDR       (0x0EFF)
+
+typedef enum
+{
+    UUPS_OFF,
+    UUPS_TRANSITION,
+    UUPS_READY,
+
+} uups_state_t;
+
+static uups_state_t uupsState;
+static bool seqRunning;
+static bool seqTimeout;
+
+// Raw interrupt status
+static uint16_t saphRis;
+static uint16_t uupsRis;
+static uint16_t hspllRis;
+static uint16_t sdhsRis;
+
+static sim_acq_t acqLog[SIM_ACQ_LOG_LEN];
+static uint32_t acqCount;
+static bool acqOpen;
+
+// Power-on time accounting
+static uint64_t ussxtOnPs;
+static uint64_t ussxtOnSince;
+static uint64_t uupsOnPs;
+static uint64_t uupsOnSince;
+
+static uint8_t snapshot[SIM_ACQ_SNAPSHOTS][sizeof(simLeaRam)];
+static uint32_t snapshotLen[SIM_ACQ_SNAPSHOTS];
+
+bool simUssOwns(uint16_t addr)
+{
+    return (addr >= USS_FIRST_ADDR) && (addr <= USS_LAST_ADDR);
+}
+
+void simUssReset(void)
+{
+    uupsState = UUPS_OFF;
+    seqRunning = false;
+    seqTimeout = false;
+    saphRis = 0;
+    uupsRis = 0;
+    hspllRis = 0;
+    sdhsRis = 0;
+    acqCount = 0;
+    acqOpen = false;
+    ussxtOnPs = 0;
+    ussxtOnSince = SIM_TIME_NONE;
+    uupsOnPs = 0;
+    uupsOnSince = SIM_TIME_NONE;
+    memset(acqLog, 0, sizeof(acqLog));
+    memset(snapshotLen, 0, sizeof(snapshotLen));
+}
+
+//// Acquisition log ////
+
+static sim_acq_t * curAcq(void)
+{
+    if (!acqOpen)
+        return NULL;
+    return &acqLog[(acqCount - 1) % SIM_ACQ_LOG_LEN];
+}
+
+static void openAcq(void)
+{
+    sim_acq_t *acq = &acqLog[acqCount % SIM_ACQ_LOG_LEN];
+
+    memset(acq, 0xFF, sizeof(*acq));
+    acq->numSamples = 0;
+    acq->timeout = false;
+    acq->aborted = false;
+    acq->warm = false;
+    acq->tPeriod = simTimerLastCc0(TIMER_A1_BASE);
+    acq->tXtalOn = simStats.nowPs;
+    acq->activePsAtStart = simStats.statePs[SIM_CPU_ACTIVE];
+    acq->regAccessesAtStart = simStats.regAccesses;
+    acqCount++;
+    acqOpen = true;
+}
+
+uint32_t simAcqCount(void)
+{
+    return acqCount;
+}
+
+const sim_acq_t * simAcqGet(uint32_t idx)
+{
+    if ((idx >= acqCount) || (acqCount - idx > SIM_ACQ_LOG_LEN))
+        return NULL;
+    return &acqLog[idx % SIM_ACQ_LOG_LEN];
+}
+
+const uint8_t * simAcqSamples(uint32_t idx, uint32_t *len)
+{
+    if ((idx >= acqCount) || (acqCount - idx > SIM_ACQ_SNAPSHOTS))
+        return NULL;
+    *len = snapshotLen[idx % SIM_ACQ_SNAPSHOTS];
+    return snapshot[idx % SIM_ACQ_SNAPSHOTS];
+}
+
+void simUssOnTime(uint64_t *ussxtPs, uint64_t *uupsPs)
+{
+    *ussxtPs = ussxtOnPs;
+    if (ussxtOnSince != SIM_TIME_NONE)
+        *ussxtPs += simStats.nowPs - ussxtOnSince;
+    *uupsPs = uupsOnPs;
+    if (uupsOnSince != SIM_TIME_NONE)
+        *uupsPs += simStats.nowPs - uupsOnSince;
+}
+
+//// Clocks and timing ////
+
+static uint64_t pllHz(void)
+{
+    uint16_t ctl = simRegGet(HSPLLCTL_ADDR);
+    uint64_t xtal = (ctl & PLLINFREQ) ? 8000000 : 4000000;
+
+    return xtal * (((ctl & PLLM_MASK) >> 10) + 1) / 2;
+}
+
+static uint64_t pllTicksToPs(uint64_t ticks, uint32_t div)
+{
+    return ticks * div * SIM_PS_PER_S / pllHz();
+}
+
+static uint32_t osr(void)
+{
+    return 10u << (simRegGet(SDHSCTL1_ADDR) & 0x7);
+}
+
+static uint32_t numSamples(void)
+{
+    return (simRegGet(SDHSCTL2_ADDR) & SMPSZ_MASK) + 1;
+}
+
+static void setUpState(uups_state_t state)
+{
+    uint16_t bits;
+
+    if ((state != UUPS_OFF) && (uupsOnSince == SIM_TIME_NONE))
+    {
+        uupsOnSince = simStats.nowPs;
+    }
+    else if ((state == UUPS_OFF) && (uupsOnSince != SIM_TIME_NONE))
+    {
+        uupsOnPs += simStats.nowPs - uupsOnSince;
+        uupsOnSince = SIM_TIME_NONE;
+    }
+
+    uupsState = state;
+    switch (state)
+    {
+        case UUPS_READY:      bits = UPSTATE_3; break;
+        case UUPS_TRANSITION: bits = UPSTATE_2; break;
+        default:              bits = UPSTATE_0; break;
+    }
+    simRegSet(UUPSCTL_ADDR, (simRegGet(UUPSCTL_ADDR) & ~UPSTATE_3) | bits);
+
+    if (state == UUPS_READY)
+        simRegSetBits(HSPLLCTL_ADDR, PLL_LOCK);
+    else
+        simRegClearBits(HSPLLCTL_ADDR, PLL_LOCK);
+}
+
+static void setBusy(bool busy)
+{
+    seqRunning = busy;
+    if (busy)
+        simRegSetBits(UUPSCTL_ADDR, USS_BUSY);
+    else
+        simRegClearBits(UUPSCTL_ADDR, USS_BUSY);
+}
+
+static void powerDown(void)
+{
+    sim_acq_t *acq = curAcq();
+
+    simCancel(SIM_EVT_UUPS_READY);
+    if (seqRunning)
+    {
+        simCancel(SIM_EVT_SEQ_DONE);
+        setBusy(false);
+        if (acq)
+            acq->aborted = true;
+    }
+    if ((uupsState != UUPS_OFF) && acq && (acq->tPwrDown == SIM_TIME_NONE))
+        acq->tPwrDown = simStats.nowPs;
+
+    setUpState(UUPS_OFF);
+}
+
+//// SDHS data ////
+
+// Synthetic echo: three decaying tone bursts at the PPG frequency plus noise
+static void writeSamples(uint32_t n, uint32_t seed)
+{
+    uint32_t per = simRegGet(SAPH_APGLPER_ADDR) + simRegGet(SAPH_APGHPER_ADDR);
+    double fPulse = (per != 0) ? (double) pllHz() / per : 2.25e6;
+    double fs = (double) pllHz() / osr();
+    double gain = pow(10.0, ((int) simRegGet(SDHSCTL6_ADDR) - 28) * 0.85 / 20.0);
+    uint32_t dst = 2u * simRegGet(SDHSDTCDA_ADDR);
+    uint32_t lcg = seed * 1103515245u + 12345u;
+    static const double echoPos[3] = {0.2, 0.45, 0.7};
+    static const double echoAmp[3] = {900.0, 500.0, 250.0};
+    uint32_t i;
+    int k;
+
+    for (i = 0; i < n; i++)
+    {
+        double t = i / fs;
+        double v = 0;
+        int32_t s;
+
+        for (k = 0; k < 3; k++)
+        {
+            double dt = t - echoPos[k] * n / fs;
+            if (dt >= 0)
+                v += echoAmp[k] * exp(-dt * fPulse / 2.0) *
+                     sin(2.0 * M_PI * fPulse * dt);
+        }
+
+        lcg = lcg * 1103515245u + 12345u;
+        s = (int32_t)(v * gain) + (int32_t)((lcg >> 16) % 33) - 16;
+        // 12-bit converter
+        if (s > 2047)
+            s = 2047;
+        if (s < -2048)
+            s = -2048;
+
+        // Window comparator, only flags while enabled
+        if (simRegGet(SDHSCTL2_ADDR) & WINCMPEN)
+        {
+            if (s > (int16_t) simRegGet(SDHSWINHITH_ADDR))
+                sdhsRis |= WINHI;
+            if (s < (int16_t) simRegGet(SDHSWINLOTH_ADDR))
+                sdhsRis |= WINLO;
+        }
+
+        if (dst + 1 >= sizeof(simLeaRam))
+            break;
+        simLeaRam[dst++] = (uint8_t)(s & 0xFF);
+        simLeaRam[dst++] = (uint8_t)((s >> 8) & 0xFF);
+    }
+}
+
+//// Sequencer ////
+
+static void startSequence(void)
+{
+    sim_acq_t *acq = curAcq();
+    uint64_t tAdc = pllTicksToPs(simRegGet(SAPH_AATM_D_ADDR), 16);
+    uint64_t tEnd = tAdc + (uint64_t) numSamples() * osr() * SIM_PS_PER_S / pllHz();
+    uint64_t tTimeout = pllTicksToPs(simRegGet(SAPH_AATM_F_ADDR), 64);
+
+    // USSXT and UUPS still powered from the previous acquisition
+    if (!acq || (acq->tTrigger != SIM_TIME_NONE))
+    {
+        openAcq();
+        acq = curAcq();
+        acq->tXtalOn = SIM_TIME_NONE;
+        acq->warm = true;
+    }
+
+    if (acq)
+    {
+        acq->tTrigger = simStats.nowPs;
+        acq->tDcDcOn = simHvDcDcOnTime();
+        acq->rxGain = simRegGet(SDHSCTL6_ADDR);
+        acq->ppgPeriod = simRegGet(SAPH_APGLPER_ADDR) + simRegGet(SAPH_APGHPER_ADDR);
+        acq->numPulses = (uint8_t)(simRegGet(SAPH_APGC_ADDR) & 0x1F);
+        acq->adcStart = simRegGet(SAPH_AATM_D_ADDR);
+        acq->muxTx = simHvMuxLatched();
+    }
+
+    setBusy(true);
+    seqTimeout = (tEnd > tTimeout);
+    simSchedule(SIM_EVT_SEQ_DONE, simStats.nowPs + (seqTimeout ? tTimeout : tEnd));
+}
+
+static void endSequence(void)
+{
+    sim_acq_t *acq = curAcq();
+    uint32_t n = numSamples();
+    uint32_t slot;
+
+    setBusy(false);
+
+    if (seqTimeout)
+    {
+        saphRis |= TMFTO;
+        snapshotLen[(acqCount - 1) % SIM_ACQ_SNAPSHOTS] = 0;
+    }
+    else
+    {
+        writeSamples(n, acqCount);
+        saphRis |= SEQDN;
+
+        // Keep a copy of what the DTC wrote for the frame checks
+        slot = (acqCount - 1) % SIM_ACQ_SNAPSHOTS;
+        snapshotLen[slot] = 2 * n;
+        if (2u * simRegGet(SDHSDTCDA_ADDR) + snapshotLen[slot] > sizeof(simLeaRam))
+            snapshotLen[slot] = sizeof(simLeaRam) - 2u * simRegGet(SDHSDTCDA_ADDR);
+        memcpy(snapshot[slot], &simLeaRam[2u * simRegGet(SDHSDTCDA_ADDR)],
+               snapshotLen[slot]);
+    }
+
+    if (acq)
+    {
+        acq->tSeqDone = simStats.nowPs;
+        acq->muxRx = simHvMuxLatched();
+        acq->numSamples = seqTimeout ? 0 : n;
+        acq->timeout = seqTimeout;
+    }
+
+    // End of sequence OFF request to the power sequencer
+    if (simRegGet(SAPH_AASCTL1_ADDR) & ESOFF)
+        powerDown();
+}
+
+static void trigger(void)
+{
+    uint16_t asctl0 = simRegGet(SAPH_AASCTL0_ADDR);
+
+    if (!(asctl0 & ASQTEN) || seqRunning)
+        return;
+    if (uupsState != UUPS_READY)
+    {
+        // A trigger without power is silently lost on the device
+        return;
+    }
+    startSequence();
+}
+
+void simUssTimerTrigger(void)
+{
+    if ((simRegGet(SAPH_AASCTL0_ADDR) & TRIGSEL_MASK) == TRIGSEL__TIMER)
+        trigger();
+}
+
+//// Register hooks ////
+
+void simUssOnWrite(uint16_t addr, uint16_t oldVal, uint16_t newVal)
+{
+    sim_acq_t *acq;
+
+    switch (addr)
+    {
+        case HSPLLUSSXTLCTL_ADDR:
+            // OSCSTATE is read-only
+            newVal = (newVal & ~OSCSTATE_1) | (oldVal & OSCSTATE_1);
+            simRegSet(addr, newVal);
+
+            if ((newVal & USSXTEN) && !(oldVal & USSXTEN))
+            {
+                ussxtOnSince = simStats.nowPs;
+                openAcq();
+                simSchedule(SIM_EVT_USSXT_READY,
+                            simStats.nowPs + SIM_US(simParams.ussxtStartupUs));
+            }
+            else if (!(newVal & USSXTEN) && (oldVal & USSXTEN))
+            {
+                ussxtOnPs += simStats.nowPs - ussxtOnSince;
+                ussxtOnSince = SIM_TIME_NONE;
+                simCancel(SIM_EVT_USSXT_READY);
+                simRegClearBits(HSPLLUSSXTLCTL_ADDR, OSCSTATE_1);
+                // Losing the reference while the PLL runs unlocks it
+                if (uupsState != UUPS_OFF)
+                {
+                    hspllRis |= PLLUNLOCK;
+                    powerDown();
+                }
+                acq = curAcq();
+                if (acq)
+                    acq->tXtalOff = simStats.nowPs;
+                acqOpen = false;
+            }
+            break;
+
+        case UUPSCTL_ADDR:
+            // UPSTATE and USS_BUSY are read-only
+            newVal = (newVal & ~(UPSTATE_3 | USS_BUSY)) |
+                     (oldVal & (UPSTATE_3 | USS_BUSY));
+            simRegSet(addr, newVal);
+
+            if (newVal & USSSWRST)
+            {
+                powerDown();
+                break;
+            }
+            if (newVal & USSPWRDN)
+            {
+                simRegClearBits(UUPSCTL_ADDR, USSPWRDN);
+                powerDown();
+            }
+            if (newVal & USSPWRUP)
+            {
+                simRegClearBits(UUPSCTL_ADDR, USSPWRUP);
+                acq = curAcq();
+                if (acq)
+                    acq->tPwrUpReq = simStats.nowPs;
+
+                if (uupsState == UUPS_OFF)
+                {
+                    if (simRegGet(HSPLLUSSXTLCTL_ADDR) & OSCSTATE_1)
+                    {
+                        setUpState(UUPS_TRANSITION);
+                        simSchedule(SIM_EVT_UUPS_READY,
+                                    simStats.nowPs + SIM_US(simParams.uupsPowerUpUs));
+                    }
+                    else
+                    {
+                        // No reference clock: the power-up times out
+                        uupsRis |= PTMOUT;
+                    }
+                }
+            }
+            break;
+
+        case SAPH_AASQTRIG_ADDR:
+            if (newVal & ASQTRIG)
+            {
+                simRegClearBits(SAPH_AASQTRIG_ADDR, ASQTRIG);
+                if ((simRegGet(SAPH_AASCTL0_ADDR) & TRIGSEL_MASK) == TRIGSEL__SWTRIG)
+                    trigger();
+            }
+            break;
+
+        case SAPH_AICR_ADDR:
+            saphRis &= ~newVal;
+            simRegSet(SAPH_AICR_ADDR, 0);
+            break;
+
+        case UUPSICR_ADDR:
+            uupsRis &= ~newVal;
+            simRegSet(UUPSICR_ADDR, 0);
+            break;
+
+        case HSPLLICR_ADDR:
+            hspllRis &= ~newVal;
+            simRegSet(HSPLLICR_ADDR, 0);
+            break;
+
+        case SDHSICR_ADDR:
+            sdhsRis &= ~newVal;
+            simRegSet(SDHSICR_ADDR, 0);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Interrupt index registers return the highest pending source and clear it
+static uint16_t takeIidx(uint16_t *ris, uint16_t imsc, const uint16_t *order,
+                         int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+    {
+        if (*ris & imsc & order[i])
+        {
+            *ris &= ~order[i];
+            return (uint16_t)(i + 1);
+        }
+    }
+    return 0;
+}
+
+static const uint16_t saphOrder[] = { DATAERR, TMFTO, SEQDN, PNGDN };
+// IIDX_2 (standby) is not modeled
+static const uint16_t uupsOrder[] = { PTMOUT, 0, STPBYDB };
+static const uint16_t hspllOrder[] = { PLLUNLOCK };
+
+void simUssOnRead(uint16_t addr)
+{
+    switch (addr)
+    {
+        case SAPH_AIIDX_ADDR:
+            simRegSet(addr, takeIidx(&saphRis, simRegGet(SAPH_AIMSC_ADDR),
+                                     saphOrder, 4));
+            break;
+        case UUPSIIDX_ADDR:
+            simRegSet(addr, takeIidx(&uupsRis, simRegGet(UUPSIMSC_ADDR),
+                                     uupsOrder, 3));
+            break;
+        case HSPLLIIDX_ADDR:
+            simRegSet(addr, takeIidx(&hspllRis, simRegGet(HSPLLIMSC_ADDR),
+                                     hspllOrder, 1));
+            break;
+        case SAPH_ARIS_ADDR:
+            simRegSet(addr, saphRis);
+            break;
+        case SDHSRIS_ADDR:
+            simRegSet(addr, sdhsRis);
+            break;
+        default:
+            break;
+    }
+}
+
+void simUssEvent(sim_event_t evt)
+{
+    sim_acq_t *acq = curAcq();
+
+    switch (evt)
+    {
+        case SIM_EVT_USSXT_READY:
+            simRegSetBits(HSPLLUSSXTLCTL_ADDR, OSCSTATE_1);
+            if (acq)
+                acq->tXtalReady = simStats.nowPs;
+            break;
+
+        case SIM_EVT_UUPS_READY:
+            setUpState(UUPS_READY);
+            if (acq)
+                acq->tUupsReady = simStats.nowPs;
+            break;
+
+        case SIM_EVT_SEQ_DONE:
+            endSequence();
+            break;
+
+        default:
+            break;
+    }
+}
+
+bool simSaphPending(void)
+{
+    return (saphRis & simRegGet(SAPH_AIMSC_ADDR)) != 0;
+}
+
+bool simUupsPending(void)
+{
+    return (uupsRis & simRegGet(UUPSIMSC_ADDR)) != 0;
+}
+
+bool simHspllPending(void)
+{
+    return (hspllRis & simRegGet(HSPLLIMSC_ADDR)) != 0;
+}
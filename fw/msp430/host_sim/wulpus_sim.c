@@ -0,0 +1,1608 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+// Host harness for the WULPUS MSP430 firmware.
+//
+// Runs the unmodified firmware main loop against the peripheral model,
+// plays the nRF52 side of the SPI link (configuration package, then data
+// frames), checks every received frame against the samples written by the
+// simulated SDHS and reports per-phase timing and modeled CPU cost.
+// Returns non-zero if a frame is corrupt or a budget is exceeded.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "dsp_ref.h"
+#include "sim.h"
+#include "wulpus_sys.h"
+
+// Firmware entry point (main.c is built with -Dmain=wulpus_main)
+int wulpus_main(void);
+
+#define MAX_FRAMES          (4096)
+
+// Default configuration package, same values as the Python defaults
+// (sw/wulpus/uss_conf.py) converted to register values
+#define DEF_DCDC_TURNON     (6399)
+#define DEF_MEAS_PERIOD     (10550)
+#define DEF_TRANS_FREQ      (2250000)
+#define DEF_PULSE_FREQ      (2250000)
+#define DEF_NUM_PULSES      (2)
+#define DEF_OSR             (0)
+#define DEF_SAMPLE_SIZE     (800)
+#define DEF_RX_GAIN         (54)
+#define DEF_HVMUX_RX        (4000)
+#define DEF_START_PPG       (2500)
+#define DEF_TURNON_ADC      (25)
+#define DEF_PGA_IN_BIAS     (25)
+#define DEF_ADC_SAMPL       (2515)
+#define DEF_RESTART_CAPT    (937)
+#define DEF_CAPT_TIMEOUT    (3750)
+
+// Sequence table used with -q: near field, high-gain far field with
+// more pulses and a lower frequency at half the sampling rate
+typedef struct
+{
+    uint8_t  rxGain;
+    uint16_t pulseFreqKhz;
+    uint8_t  numPulses;
+    uint8_t  osr;
+    uint8_t  sampleDiv;     // Sample size = sampleSize / sampleDiv
+
+} seq_entry_t;
+
+static const seq_entry_t seqTable[] =
+{
+    { DEF_RX_GAIN, 2250, 2, 0, 1 },
+    { 63,          2250, 4, 0, 1 },
+    { DEF_RX_GAIN, 1500, 3, 1, 2 },
+};
+
+#define SEQ_LEN             (sizeof(seqTable) / sizeof(seqTable[0]))
+
+// Depth range of the threshold gating used with -G: the third echo of
+// the default frame, beyond the end of the shorter frames of sequence
+// table entry 2 (see writeSamples() of sim_uss.c)
+#define GATE_START          (200)
+#define GATE_LEN            (100)
+
+// Depth windows used with -r, one per TX/RX config: start of the ADC
+// sampling (AATM_D) and sample size. The global sample size is set to the
+// largest window, 98 samples fit into one nRF52 transfer.
+typedef struct
+{
+    uint16_t adcStart;
+    uint16_t sampleSize;
+
+} roi_entry_t;
+
+static const roi_entry_t roiTable[SEQ_LEN] =
+{
+    { DEF_ADC_SAMPL,        196 },
+    { DEF_ADC_SAMPL + 500,  160 },
+    { DEF_ADC_SAMPL + 1000, 128 },
+};
+
+typedef struct
+{
+    uint32_t numFrames;
+    uint32_t measPeriod;
+    uint16_t sampleSize;
+    uint8_t  triggerMode;
+    bool     seqTable;
+    uint8_t  decimation;    // Envelope frames, 0: raw frames
+    uint8_t  avgShots;      // Acquisitions averaged per frame
+    bool     avgSum32;      // Frames carry the 32-bit sums
+    bool     roi;           // Depth windows
+    uint8_t  burstLen;      // Frames per burst, 0: no burst mode
+    uint32_t stallUs;       // BLE ready low after the first frame of a burst, 0: never
+    bool     extHeader;     // Extended frame header
+    uint8_t  packMode;      // Sample packing (us_pack_mode_t)
+    uint16_t gateThreshold; // Threshold gating of the depth range GATE_xxx
+    uint8_t  gateHeartbeat; // Quiet frames per heartbeat, 0: no gating
+    uint8_t  bootPreset;    // Preset slot + 1 to boot from, 0: no preset
+    uint8_t  patchGain;     // RX gain patched after half of the frames, 0: none
+    bool     nackFirst;     // Send a corrupt package first (CRC mismatch)
+    double   maxAcqUs;
+    double   maxActiveCycles;
+    double   maxFrameUs;
+    double   maxWakeups;
+    bool     verbose;
+
+} options_t;
+
+// Statistics of one quantity over all frames
+typedef struct
+{
+    const char *name;
+    const char *unit;
+    double sum;
+    double min;
+    double max;
+    uint32_t n;
+
+} stat_t;
+
+enum
+{
+    ST_WAKE,
+    ST_XTAL,
+    ST_UUPS,
+    ST_TRIG,
+    ST_SEQ,
+    ST_TRIG_INTERVAL,
+    ST_ACQ,
+    ST_WAIT_SPI,
+    ST_SPI,
+    ST_PAYLOAD,
+    ST_PERIOD,
+    ST_ACTIVE,
+    ST_REGS,
+    ST_WAKEUPS,
+    ST_DCDC,
+    ST_NUM,
+};
+
+static stat_t stats[ST_NUM] =
+{
+    [ST_WAKE]           = { "Period -> acq. start",   "us" },
+    [ST_XTAL]           = { "USSXT start-up",         "us" },
+    [ST_UUPS]           = { "UUPS power-up",          "us" },
+    [ST_TRIG]           = { "UUPS ready -> trigger",  "us" },
+    [ST_SEQ]            = { "Acquisition sequence",   "us" },
+    [ST_TRIG_INTERVAL]  = { "Trigger interval",       "us" },
+    [ST_ACQ]            = { "USSXT on -> off",        "us" },
+    [ST_WAIT_SPI]       = { "Sequence done -> SPI",   "us" },
+    [ST_SPI]            = { "SPI frame transfer",     "us" },
+    [ST_PAYLOAD]        = { "Frame payload",          "bytes" },
+    [ST_PERIOD]         = { "Frame period",           "us" },
+    [ST_ACTIVE]         = { "Active CPU per frame",   "cycles" },
+    [ST_REGS]           = { "Register accesses",      "per frame" },
+    [ST_WAKEUPS]        = { "CPU wake-ups",           "per frame" },
+    [ST_DCDC]           = { "DC-DC on -> trigger",    "us" },
+};
+
+static options_t opt;
+static uint32_t dataFrames;
+static uint32_t otherFrames;
+static uint32_t badFrames;
+static uint32_t badSettings;
+static uint32_t badMux;
+static uint32_t badHeaders;
+static uint32_t badDcDc;
+static uint32_t badGate;
+// Backpressure: end of the BLE ready low time, frames sent before it
+static uint64_t stallEnd;
+static uint32_t badStalls;
+// Threshold gating: heartbeats, frames not sent and number of the last frame
+static uint32_t heartbeatFrames;
+static uint32_t skippedFrames;
+static uint16_t lastFrameNr = 0xFFFF;
+// CRC-16 of the configuration package (extended header)
+static uint16_t confCrc;
+// Time stamp and trigger of the previous frame (extended header)
+static uint32_t lastTimestamp;
+static uint64_t lastTrigger;
+static uint32_t warmAcqs;
+static uint64_t lastFrameDataReady;
+static uint64_t lastActiveCycles;
+static uint64_t lastRegAccesses;
+static uint64_t lastWakeups;
+// Payload length and first acquisition of the last matched frame
+static uint32_t matchLen;
+static uint32_t matchFirst;
+// Data ready of the first frame after power-up
+static uint64_t firstFrameDataReady;
+// Patch command: frame after which it was sent, first frame acquired with it
+// and configuration hash reported from then on
+static uint32_t patchSentFrame;
+static int32_t patchFrame = -1;
+static uint16_t patchCrc;
+// Acknowledge frames of the configuration package (and of the rejected
+// package with -N)
+static uint32_t ackFrames;
+static uint32_t nackFrames;
+static uint32_t badAcks;
+static uint8_t *goodPack;
+static uint32_t goodPackLen;
+
+static void statAdd(int idx, double val)
+{
+    stat_t *s = &stats[idx];
+
+    // Phase not reached (e.g. no start-up before a warm acquisition)
+    if (val < 0.0)
+        return;
+
+    if ((s->n == 0) || (val < s->min))
+        s->min = val;
+    if ((s->n == 0) || (val > s->max))
+        s->max = val;
+    s->sum += val;
+    s->n++;
+}
+
+static double statMean(int idx)
+{
+    return stats[idx].n ? stats[idx].sum / stats[idx].n : 0.0;
+}
+
+static double spanUs(uint64_t from, uint64_t to)
+{
+    if ((from == SIM_TIME_NONE) || (to == SIM_TIME_NONE) || (to < from))
+        return -1.0;
+    return simPsToUs(to - from);
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    put16(p, (uint16_t) v);
+    put16(p + 2, (uint16_t)(v >> 16));
+}
+
+// HV MUX configs of the TX/RX configs, different for TX and RX
+static uint16_t txConfig(uint8_t txRxId)
+{
+    return (uint16_t)(1u << txRxId);
+}
+
+static uint16_t rxConfig(uint8_t txRxId)
+{
+    return (uint16_t)(0x8000u >> txRxId);
+}
+
+// DC-DC turn-on time, with periods beyond the 16-bit slow timer the
+// converters are enabled as long before the acquisition as by default
+static uint32_t dcDcTurnOn(void)
+{
+    if (opt.measPeriod > 0xFFFF)
+        return opt.measPeriod - (DEF_MEAS_PERIOD - DEF_DCDC_TURNON);
+    return DEF_DCDC_TURNON;
+}
+
+// Integer log2
+static uint32_t log2u(uint32_t v)
+{
+    uint32_t r = 0;
+
+    while (v > 1)
+    {
+        v >>= 1;
+        r++;
+    }
+    return r;
+}
+
+// Build the configuration package (see extractUsConfig())
+static uint32_t buildConfigPack(uint8_t *buf)
+{
+    uint32_t ofs;
+    uint32_t i;
+
+    memset(buf, 0, SIM_SPI_FRAME_MAX);
+    buf[0] = START_BYTE_CONF_PACK;
+    put16(buf + 1, (uint16_t) dcDcTurnOn());
+    put16(buf + 3, (uint16_t) opt.measPeriod);
+    put32(buf + 5, DEF_TRANS_FREQ);
+    put32(buf + 9, DEF_PULSE_FREQ);
+    buf[13] = DEF_NUM_PULSES;
+    put16(buf + 14, DEF_OSR);
+    put16(buf + 16, opt.sampleSize | (opt.extHeader ? US_SAMPLE_SIZE_EXT_HEADER : 0) |
+                    (opt.packMode << US_SAMPLE_SIZE_PACK_SHIFT) |
+                    (log2u(opt.decimation) << US_SAMPLE_SIZE_LOG2_DEC_SHIFT));
+    buf[18] = DEF_RX_GAIN;
+    // One TX/RX config, one per entry with the sequence table or windows
+    buf[19] = (opt.seqTable || opt.roi) ? SEQ_LEN : 1;
+    ofs = 20;
+    for (i = 0; i < buf[19]; i++)
+    {
+        put16(buf + ofs, txConfig(i));
+        put16(buf + ofs + 2, rxConfig(i));
+        ofs += 4;
+    }
+
+    put16(buf + ofs, DEF_HVMUX_RX);
+    put16(buf + ofs + 2, DEF_START_PPG);
+    put16(buf + ofs + 4, DEF_TURNON_ADC);
+    put16(buf + ofs + 6, DEF_PGA_IN_BIAS);
+    put16(buf + ofs + 8, DEF_ADC_SAMPL);
+    put16(buf + ofs + 10, DEF_RESTART_CAPT);
+    put16(buf + ofs + 12, DEF_CAPT_TIMEOUT);
+    buf[ofs + 14] = opt.triggerMode;
+
+    buf[ofs + 15] = opt.seqTable ? SEQ_LEN : 0;
+    ofs += 16;
+    for (i = 0; i < (opt.seqTable ? SEQ_LEN : 0); i++)
+    {
+        buf[ofs] = seqTable[i].rxGain;
+        put16(buf + ofs + 1, seqTable[i].pulseFreqKhz);
+        buf[ofs + 3] = (uint8_t)(seqTable[i].numPulses | (seqTable[i].osr << 5));
+        put16(buf + ofs + 4, opt.sampleSize / seqTable[i].sampleDiv);
+        ofs += 6;
+    }
+
+    // On-device processing
+    buf[ofs] = opt.decimation ? US_DSP_ENVELOPE : US_DSP_OFF;
+    buf[ofs + 1] = opt.decimation;
+    // Coherent averaging
+    buf[ofs + 2] = (uint8_t)(opt.avgShots | (opt.avgSum32 ? 0x80 : 0));
+
+    // Depth windows
+    buf[ofs + 3] = opt.roi ? SEQ_LEN : 0;
+    ofs += 4;
+    for (i = 0; i < (opt.roi ? SEQ_LEN : 0); i++)
+    {
+        put16(buf + ofs, roiTable[i].adcStart);
+        put16(buf + ofs + 2, roiTable[i].sampleSize);
+        ofs += 4;
+    }
+
+    // Burst mode
+    buf[ofs++] = opt.burstLen;
+
+    // Upper 16 bits of the DC-DC turn-on time and the measurement period
+    put16(buf + ofs, (uint16_t)(dcDcTurnOn() >> 16));
+    put16(buf + ofs + 2, (uint16_t)(opt.measPeriod >> 16));
+    ofs += 4;
+
+    // Threshold gating
+    put16(buf + ofs, opt.gateThreshold);
+    put16(buf + ofs + 2, GATE_START);
+    put16(buf + ofs + 4, GATE_LEN);
+    buf[ofs + 6] = opt.gateHeartbeat;
+    ofs += 7;
+
+    // Preset slot and boot flag, not part of the hash
+    if (opt.bootPreset)
+        buf[ofs] = opt.bootPreset | US_PRESET_BOOT;
+    return ofs;
+}
+
+// RX gain of a TX/RX config, all configs use the patched gain once applied
+static uint8_t expectedGain(uint8_t txRxId)
+{
+    if (patchFrame >= 0)
+        return opt.patchGain;
+    if (opt.seqTable && (txRxId < SEQ_LEN))
+        return seqTable[txRxId].rxGain;
+    return DEF_RX_GAIN;
+}
+
+// Check that the acquisition used the settings of its sequence table entry
+// and depth window
+static bool checkSeqSettings(const sim_acq_t *acq, uint8_t txRxId)
+{
+    const seq_entry_t *e;
+    uint32_t pulseHz;
+    uint32_t per;
+
+    if ((opt.seqTable || opt.roi) && (txRxId >= SEQ_LEN))
+        return false;
+    if (acq->rxGain != expectedGain(txRxId))
+        return false;
+    if (opt.roi && ((acq->adcStart != roiTable[txRxId].adcStart) ||
+                    (acq->numSamples != roiTable[txRxId].sampleSize)))
+        return false;
+    if (!opt.seqTable)
+        return true;
+
+    e = &seqTable[txRxId];
+    pulseHz = (uint32_t) e->pulseFreqKhz * 1000;
+    per = (80000000u + pulseHz / 2) / pulseHz;
+
+    return (acq->numPulses == e->numPulses) &&
+           (acq->ppgPeriod == per) &&
+           (opt.roi || (acq->numSamples == opt.sampleSize / e->sampleDiv));
+}
+
+// CRC-16/CCITT of the configuration package (see extractUsConfig()),
+// continued over patches from the hash of the package
+static uint16_t crc16(uint16_t crc, const uint8_t *data, uint32_t len)
+{
+    uint32_t i;
+    int bit;
+
+    for (i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t) data[i] << 8;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+static uint32_t headerLength(void)
+{
+    return opt.extHeader ? US_FRAME_EXT_HEADER_SIZE : US_FRAME_HEADER_SIZE;
+}
+
+// Number of 16-bit samples the firmware sends for a TX/RX config
+// (two sample size counts per sample, limited by the frame size)
+static uint32_t frameSamples(uint8_t txRxId)
+{
+    uint32_t sampleSize = opt.sampleSize;
+
+    if (opt.roi && (txRxId < SEQ_LEN))
+        sampleSize = roiTable[txRxId].sampleSize;
+    else if (opt.seqTable && (txRxId < SEQ_LEN))
+        sampleSize /= seqTable[txRxId].sampleDiv;
+
+    if (sampleSize / 2 > (BYTES_PR_XFER_TX - headerLength()) / 2)
+        return (BYTES_PR_XFER_TX - headerLength()) / 2;
+    return sampleSize / 2;
+}
+
+// Envelope the firmware must send for the samples of one acquisition,
+// computed with the reference model (little endian bytes)
+static uint32_t referenceEnvelope(const uint8_t *samples, uint32_t len,
+                                  uint8_t txRxId, uint8_t *out)
+{
+    static int16_t in[US_FRAME_SAMPLES_MAX];
+    static int16_t env[US_FRAME_SAMPLES_MAX];
+    int16_t coeffs[DSP_REF_TAPS];
+    uint32_t pulseKhz = DEF_PULSE_FREQ / 1000;
+    uint32_t osr = DEF_OSR;
+    uint32_t n = frameSamples(txRxId);
+    uint32_t i;
+
+    if (opt.seqTable && (txRxId < SEQ_LEN))
+    {
+        pulseKhz = seqTable[txRxId].pulseFreqKhz;
+        osr = seqTable[txRxId].osr;
+    }
+
+    if (2 * n > len)
+        return 0;
+
+    for (i = 0; i < n; i++)
+        in[i] = (int16_t)(samples[2 * i] | (samples[2 * i + 1] << 8));
+
+    dspRefBandpass(coeffs, pulseKhz, 8000 >> osr);
+    n = dspRefEnvelope(in, n, coeffs, log2u(opt.decimation), env);
+
+    for (i = 0; i < n; i++)
+    {
+        out[2 * i] = (uint8_t) env[i];
+        out[2 * i + 1] = (uint8_t)((uint16_t) env[i] >> 8);
+    }
+    return 2 * n;
+}
+
+// Packed samples of a raw or averaged frame (dsp_ref.c)
+static uint32_t referencePack(const uint8_t *samples, uint32_t len, uint8_t txRxId,
+                              uint8_t *out)
+{
+    static int16_t in[US_FRAME_SAMPLES_MAX];
+    uint32_t n = frameSamples(txRxId);
+    uint32_t i;
+
+    if (2 * n > len)
+        return 0;
+
+    for (i = 0; i < n; i++)
+        in[i] = (int16_t)(samples[2 * i] | (samples[2 * i + 1] << 8));
+
+    return dspRefPack(in, n, opt.packMode, out);
+}
+
+// Samples of a frame whose last acquisition is last: the DTC output or,
+// with averaging, the mean or the sums over the last avgShots acquisitions
+// (failed acquisitions are repeated by the firmware and skipped here)
+static const uint8_t * averagedSamples(uint32_t last, uint8_t txRxId, uint32_t *len)
+{
+    static uint8_t avg[SIM_SPI_FRAME_MAX];
+    static int32_t sum[US_AVG_SAMPLES_MAX];
+    const uint8_t *samples;
+    uint32_t shot = 0;
+    uint32_t idx = last + 1;
+    uint32_t shotLen;
+    uint32_t n, i;
+
+    samples = simAcqSamples(last, len);
+    matchFirst = last;
+    if ((samples == NULL) || (*len == 0) || (opt.avgShots <= 1))
+        return samples;
+
+    n = frameSamples(txRxId);
+    if (2 * n > *len)
+        return NULL;
+    memset(sum, 0, sizeof(sum));
+
+    while (shot < opt.avgShots)
+    {
+        if (idx == 0)
+            return NULL;
+        idx--;
+        samples = simAcqSamples(idx, &shotLen);
+        if (samples == NULL)
+            return NULL;
+        if (shotLen == 0)
+            continue;
+        if (shotLen != *len)
+            return NULL;
+
+        for (i = 0; i < n; i++)
+            sum[i] += (int16_t)(samples[2 * i] | (samples[2 * i + 1] << 8));
+        shot++;
+    }
+    matchFirst = idx;
+
+    for (i = 0; i < n; i++)
+    {
+        if (opt.avgSum32)
+        {
+            put32(&avg[4 * i], (uint32_t) sum[i]);
+        }
+        else
+        {
+            int32_t mean = (sum[i] + (int32_t)(opt.avgShots / 2)) >> log2u(opt.avgShots);
+            put16(&avg[2 * i], (uint16_t) mean);
+        }
+    }
+
+    *len = opt.avgSum32 ? 4 * n : 2 * n;
+    return avg;
+}
+
+// Find the acquisition whose samples (raw or processed) the frame carries,
+// heartbeats carry the raw or averaged samples
+static int32_t matchAcquisition(const sim_spi_frame_t *frame, bool heartbeat)
+{
+    static uint8_t expected[SIM_SPI_FRAME_MAX];
+    const uint8_t *samples;
+    uint32_t len;
+    uint32_t cnt = simAcqCount();
+    uint32_t i;
+
+    for (i = cnt; (i > 0) && (cnt - i < SIM_ACQ_SNAPSHOTS); i--)
+    {
+        samples = averagedSamples(i - 1, frame->data[1] & US_FRAME_ID_MASK, &len);
+        if ((samples == NULL) || (len == 0))
+            continue;
+        if (heartbeat)
+        {
+            // Not processed
+        }
+        else if (opt.decimation)
+        {
+            len = referenceEnvelope(samples, len, frame->data[1] & US_FRAME_ID_MASK,
+                                    expected);
+            samples = expected;
+        }
+        else if (opt.packMode != US_PACK_OFF)
+        {
+            len = referencePack(samples, len, frame->data[1] & US_FRAME_ID_MASK, expected);
+            samples = expected;
+        }
+        if (len > frame->len - headerLength())
+            len = frame->len - headerLength();
+        if (memcmp(samples, &frame->data[headerLength()], len) == 0)
+        {
+            matchLen = len;
+            return (int32_t)(i - 1);
+        }
+    }
+    return -1;
+}
+
+// Threshold gating of the raw or averaged samples of a frame
+static bool referenceGate(const uint8_t *samples, uint32_t len, uint8_t txRxId)
+{
+    uint32_t end = GATE_START + GATE_LEN;
+    uint32_t i;
+
+    if (end > frameSamples(txRxId))
+        end = frameSamples(txRxId);
+    if (end > len / 2)
+        end = len / 2;
+
+    for (i = GATE_START; i < end; i++)
+    {
+        int16_t v = (int16_t)(samples[2 * i] | (samples[2 * i + 1] << 8));
+
+        if ((v > (int16_t) opt.gateThreshold) || (v < -(int16_t) opt.gateThreshold))
+            return true;
+    }
+    return false;
+}
+
+// The frames skipped before the frame matched last were quiet, as far as
+// their acquisitions are still kept
+static bool skippedQuiet(uint16_t frameNr)
+{
+    uint32_t first = matchFirst;
+    uint32_t last = matchFirst;
+    bool quiet = true;
+    uint16_t nr;
+
+    for (nr = (uint16_t)(frameNr - 1); nr != lastFrameNr; nr--)
+    {
+        uint8_t txRxId = (opt.seqTable || opt.roi) ? nr % SEQ_LEN : 0;
+        const uint8_t *samples = NULL;
+        uint32_t len = 0;
+
+        // Failed acquisitions are repeated by the firmware
+        while ((last > 0) && (len == 0))
+        {
+            samples = averagedSamples(--last, txRxId, &len);
+            if (samples == NULL)
+                break;
+        }
+        if ((samples == NULL) || (len == 0))
+            break;
+
+        if (referenceGate(samples, len, txRxId))
+            quiet = false;
+        last = matchFirst;
+    }
+
+    matchFirst = first;
+    return quiet;
+}
+
+// Frame numbers count all frames. With threshold gating up to
+// gateHeartbeat - 1 quiet frames are skipped, a heartbeat follows
+// gateHeartbeat frames after the previous frame.
+static bool checkFrameNr(uint16_t frameNr, bool heartbeat)
+{
+    uint16_t gap = (uint16_t)(frameNr - lastFrameNr);
+
+    if (opt.gateHeartbeat == 0)
+        return gap == 1;
+    if (heartbeat)
+        return gap == opt.gateHeartbeat;
+    return (gap >= 1) && (gap <= opt.gateHeartbeat);
+}
+
+// Frame format and decimation bits of the header
+static bool checkFrameFormat(uint8_t hdr)
+{
+    if (opt.avgSum32)
+        return (hdr & ~US_FRAME_ID_MASK) == US_FRAME_FORMAT_SUM32;
+    if (opt.packMode != US_PACK_OFF)
+        return (hdr & ~US_FRAME_ID_MASK) ==
+               (US_FRAME_FORMAT_PACKED | (opt.packMode << US_FRAME_PACK_SHIFT));
+    if (!opt.decimation)
+        return (hdr & ~US_FRAME_ID_MASK) == US_FRAME_FORMAT_RAW;
+
+    return (hdr & ~US_FRAME_ID_MASK) ==
+           (US_FRAME_FORMAT_ENVELOPE | (log2u(opt.decimation) << US_FRAME_LOG2_DEC_SHIFT));
+}
+
+// SPI frame length: header and global sample size (packed: 12 or 8 bits
+// per sample, envelope: decimated by 2^log2Dec) in whole nRF52 transfers,
+// all transfers for a preset
+static uint32_t frameLength(uint32_t log2Dec)
+{
+    uint32_t samples = (opt.sampleSize / 2) >> log2Dec;
+    uint32_t payload = samples * 2;
+    uint32_t xfers;
+
+    if (opt.packMode == US_PACK_12BIT)
+        payload = (12 * samples + 7) / 8;
+    else if (opt.packMode == US_PACK_LOG8)
+        payload = samples;
+
+    xfers = (headerLength() + payload + simParams.nrfChunkBytes - 1) / simParams.nrfChunkBytes;
+
+    if ((xfers > simParams.nrfChunks) || opt.bootPreset)
+        xfers = simParams.nrfChunks;
+    return xfers * simParams.nrfChunkBytes;
+}
+
+// The SPI frame shrinks with the decimation: envelope frames are shorter
+// than raw frames of the same sample size that need 3 or more transfers
+// (fewer may still round up to the same number of transfers)
+static bool checkFrameShrunk(uint32_t len)
+{
+    if ((opt.decimation < 2) || opt.bootPreset || (frameLength(0) <= 2 * simParams.nrfChunkBytes))
+        return true;
+    return len < frameLength(0);
+}
+
+// Split to not overflow with periods of minutes
+static uint64_t psToAclkTicks(uint64_t ps)
+{
+    return (ps / SIM_PS_PER_S) * simParams.aclkHz +
+           (ps % SIM_PS_PER_S) * simParams.aclkHz / SIM_PS_PER_S;
+}
+
+static uint64_t aclkTicksToPs(uint64_t ticks)
+{
+    return (ticks / simParams.aclkHz) * SIM_PS_PER_S +
+           (ticks % simParams.aclkHz) * SIM_PS_PER_S / simParams.aclkHz;
+}
+
+// Check the extended header against the acquisition it reports,
+// returns NULL or the reason of the mismatch
+static const char * checkExtHeader(const sim_spi_frame_t *frame, const sim_acq_t *acq)
+{
+    const uint8_t *h = frame->data;
+    uint32_t ts = h[4] | ((uint32_t) h[5] << 8) | ((uint32_t) h[6] << 16) |
+                  ((uint32_t) h[7] << 24);
+    int64_t seqTicks = (int64_t) psToAclkTicks(acq->tSeqDone) -
+                       (int64_t) psToAclkTicks(acq->tTrigger);
+    const char *err = NULL;
+
+    // The time stamp is taken right before the trigger, the time stamps
+    // of consecutive frames are as far apart as their triggers
+    if (dataFrames > 0)
+    {
+        int64_t d = (int64_t)(uint32_t)(ts - lastTimestamp) -
+                    (int64_t)(psToAclkTicks(acq->tTrigger) - psToAclkTicks(lastTrigger));
+        if ((d < -1) || (d > 1))
+            err = "time stamp";
+    }
+    // Measured from the time stamp, includes the trigger delay
+    if ((h[10] < seqTicks - 1) || (h[10] > seqTicks + 3))
+        err = "sequence time";
+    if (((h[11] & US_ACQ_WARM) != 0) != acq->warm)
+        err = "warm flag";
+    if ((h[11] & ~US_ACQ_WARM) || h[14])
+        err = "error flags";
+    if (h[15] != opt.bootPreset)
+        err = "preset slot";
+    if ((h[12] | ((uint16_t) h[13] << 8)) != ((patchFrame >= 0) ? patchCrc : confCrc))
+        err = "configuration hash";
+
+    lastTimestamp = ts;
+    lastTrigger = acq->tTrigger;
+    return err;
+}
+
+// DC-DC turn-on between the period start and the trigger, as long before
+// the period end as configured
+static bool checkDcDcOn(const sim_acq_t *acq)
+{
+    uint64_t lead = aclkTicksToPs(opt.measPeriod - dcDcTurnOn());
+    uint64_t tick = aclkTicksToPs(1);
+
+    if ((acq->tDcDcOn == SIM_TIME_NONE) || (acq->tDcDcOn > acq->tPeriod))
+        return false;
+    // One ACLK tick of tolerance
+    return (acq->tPeriod - acq->tDcDcOn + tick >= lead) &&
+           (acq->tPeriod - acq->tDcDcOn <= lead + tick);
+}
+
+// Patch the RX gain of all TX/RX configs, sent with the next frame
+static void sendPatch(void)
+{
+    uint8_t patch[US_PATCH_LEN] = { START_BYTE_PATCH, 1, US_PATCH_RX_GAIN,
+                                    US_PATCH_ALL_CONFIGS };
+
+    patch[4] = opt.patchGain;
+    simNrfSetTx(patch, sizeof(patch));
+    patchCrc = crc16(confCrc, patch, sizeof(patch));
+    patchSentFrame = dataFrames;
+}
+
+// Acknowledge of the configuration package, before the first frame. With
+// -N the corrupt package is rejected for its CRC first, the host sends
+// the correct one then.
+static void onAckFrame(const sim_spi_frame_t *frame)
+{
+    uint16_t hash = frame->data[2] | ((uint16_t) frame->data[3] << 8);
+    const char *err = NULL;
+
+    if (frame->data[4] != US_CONF_PACK_VERSION)
+        err = "package version";
+    else if ((frame->data[1] == US_CONF_NACK_CRC) && opt.nackFirst && (nackFrames == 0) &&
+             (ackFrames == 0) && (hash == 0))
+    {
+        nackFrames++;
+        simNrfSetTx(goodPack, goodPackLen);
+        return;
+    }
+    else if (frame->data[1] != US_CONF_ACK)
+        err = "rejected";
+    else if (hash != confCrc)
+        err = "configuration hash";
+    else if ((dataFrames > 0) || (ackFrames > 0))
+        err = "not before the first frame";
+    else if (opt.nackFirst && (nackFrames == 0))
+        err = "corrupt package accepted";
+
+    if (err != NULL)
+    {
+        printf("acknowledge frame (status %u, hash 0x%04x): %s\n", frame->data[1], hash, err);
+        badAcks++;
+        return;
+    }
+    ackFrames++;
+}
+
+static void onFrame(const sim_spi_frame_t *frame)
+{
+    const char *headerErr;
+    const sim_acq_t *acq;
+    uint16_t frameNr;
+    uint64_t cycles = simActiveCycles();
+    bool heartbeat = opt.gateHeartbeat && (frame->data[0] == US_FRAME_START_HEARTBEAT);
+    uint32_t i;
+    int32_t idx;
+
+    if (frame->data[0] == US_FRAME_START_ACK)
+        onAckFrame(frame);
+
+    // Frames exchanged outside of the acquisition loop (config package)
+    if ((frame->data[0] != 0xFF) && !heartbeat)
+    {
+        otherFrames++;
+        lastActiveCycles = cycles;
+        lastRegAccesses = simStats.regAccesses;
+        lastWakeups = simStats.wakeups;
+        return;
+    }
+
+    frameNr = frame->data[2] | ((uint16_t) frame->data[3] << 8);
+    idx = matchAcquisition(frame, heartbeat);
+
+    if (!checkFrameNr(frameNr, heartbeat) || (idx < 0) ||
+        !checkFrameFormat(frame->data[1]) || (frame->len != frameLength(log2u(opt.decimation))) ||
+        !checkFrameShrunk(frame->len))
+    {
+        printf("frame %u: bad frame (nr %u, %s)\n", dataFrames, frameNr,
+               (idx < 0) ? "samples do not match any acquisition" :
+               !checkFrameNr(frameNr, heartbeat) ? "out of order" :
+               (frame->len != frameLength(log2u(opt.decimation))) ? "wrong length" :
+               !checkFrameShrunk(frame->len) ? "not shortened by the decimation" : "wrong format");
+        badFrames++;
+    }
+    else
+    {
+        // The first frame acquired with the patched gain, the ones before and
+        // after must not mix both
+        acq = simAcqGet(matchFirst);
+        if (opt.patchGain && (patchFrame < 0) && (acq->numSamples != 0) &&
+            (acq->rxGain == opt.patchGain))
+            patchFrame = (int32_t) dataFrames;
+
+        // Every averaged acquisition must use the settings of the frame
+        for (i = matchFirst; i <= (uint32_t) idx; i++)
+        {
+            acq = simAcqGet(i);
+            if ((acq->numSamples != 0) &&
+                ((acq->muxTx != txConfig(frame->data[1] & US_FRAME_ID_MASK)) ||
+                 (acq->muxRx != rxConfig(frame->data[1] & US_FRAME_ID_MASK))))
+            {
+                printf("frame %u: TX/RX config %u acquired with HV MUX TX 0x%04x, RX 0x%04x\n",
+                       dataFrames, frame->data[1] & US_FRAME_ID_MASK, acq->muxTx, acq->muxRx);
+                badMux++;
+                break;
+            }
+            if ((acq->numSamples != 0) &&
+                !checkSeqSettings(acq, frame->data[1] & US_FRAME_ID_MASK))
+            {
+                printf("frame %u: TX/RX config %u acquired with gain %u, PPG period %u, "
+                       "%u pulses, %u samples\n", dataFrames, frame->data[1] & US_FRAME_ID_MASK, acq->rxGain,
+                       acq->ppgPeriod, acq->numPulses, acq->numSamples);
+                badSettings++;
+                break;
+            }
+        }
+
+        // Threshold gating: frames with a sample outside the threshold in
+        // the depth range are sent, heartbeats and skipped frames are quiet
+        if (opt.gateHeartbeat)
+        {
+            uint8_t txRxId = frame->data[1] & US_FRAME_ID_MASK;
+            const uint8_t *samples;
+            uint32_t len;
+            bool hit;
+
+            samples = averagedSamples((uint32_t) idx, txRxId, &len);
+            hit = referenceGate(samples, len, txRxId);
+            if ((hit == heartbeat) || !skippedQuiet(frameNr))
+            {
+                printf("frame %u: %s\n", dataFrames,
+                       (hit != heartbeat) ? "frame above the threshold skipped before" :
+                       hit ? "heartbeat instead of a frame above the threshold" :
+                       "quiet frame sent");
+                badGate++;
+            }
+            skippedFrames += (uint16_t)(frameNr - lastFrameNr) - 1u;
+            if (heartbeat)
+                heartbeatFrames++;
+        }
+
+        acq = simAcqGet((uint32_t) idx);
+
+        if (acq->warm)
+            warmAcqs++;
+
+        if (opt.extHeader && ((headerErr = checkExtHeader(frame, acq)) != NULL))
+        {
+            printf("frame %u: extended header does not match the acquisition (%s)\n",
+                   dataFrames, headerErr);
+            badHeaders++;
+        }
+
+        // USSXT on, or the trigger of a warm acquisition
+        statAdd(ST_WAKE, spanUs(acq->tPeriod, acq->warm ? acq->tTrigger : acq->tXtalOn));
+        statAdd(ST_XTAL, spanUs(acq->tXtalOn, acq->tXtalReady));
+        statAdd(ST_UUPS, spanUs(acq->tPwrUpReq, acq->tUupsReady));
+        statAdd(ST_TRIG, spanUs(acq->tUupsReady, acq->tTrigger));
+        statAdd(ST_SEQ, spanUs(acq->tTrigger, acq->tSeqDone));
+        if (idx > 0)
+            statAdd(ST_TRIG_INTERVAL, spanUs(simAcqGet(idx - 1)->tTrigger, acq->tTrigger));
+        statAdd(ST_ACQ, spanUs(acq->tXtalOn, acq->tXtalOff));
+        statAdd(ST_WAIT_SPI, spanUs(acq->tSeqDone, frame->tStart));
+        if (!heartbeat)
+            statAdd(ST_PAYLOAD, (double) matchLen);
+        if (acq->tDcDcOn != SIM_TIME_NONE)
+            statAdd(ST_DCDC, spanUs(acq->tDcDcOn, acq->tTrigger));
+
+        // Long periods: the DC-DC converters are enabled at the turn-on
+        // time of the period of the acquisition. The first acquisition
+        // follows the configuration without a period.
+        if ((opt.measPeriod > 0xFFFF) && (idx > 0) && !checkDcDcOn(acq))
+        {
+            printf("frame %u: DC-DC enabled %.1f us before the trigger\n",
+                   dataFrames, spanUs(acq->tDcDcOn, acq->tTrigger));
+            badDcDc++;
+        }
+
+        if (opt.verbose)
+        {
+            printf("frame %4u: %s %u, seq %.1f us, data ready %.1f us after seq, done at %.1f us\n",
+                   dataFrames, heartbeat ? "heartbeat, acq" : "acq", (unsigned) idx, spanUs(acq->tTrigger, acq->tSeqDone),
+                   spanUs(acq->tSeqDone, frame->tDataReady),
+                   simPsToUs(frame->tDone));
+        }
+    }
+
+    statAdd(ST_SPI, spanUs(frame->tStart, frame->tDone));
+    // Per-frame deltas, the first data frame includes the configuration
+    if (dataFrames > 0)
+    {
+        statAdd(ST_PERIOD, spanUs(lastFrameDataReady, frame->tDataReady));
+        statAdd(ST_ACTIVE, (double)(cycles - lastActiveCycles));
+        statAdd(ST_REGS, (double)(simStats.regAccesses - lastRegAccesses));
+        statAdd(ST_WAKEUPS, (double)(simStats.wakeups - lastWakeups));
+    }
+
+    // Backpressure of the nRF52: no burst frame while the ready line is low,
+    // it is cleared after the first frame of every burst
+    if (opt.stallUs && (frame->tDataReady < stallEnd))
+    {
+        printf("frame %u: sent %.1f us before the BLE ready line was set\n",
+               dataFrames, spanUs(frame->tDataReady, stallEnd));
+        badStalls++;
+    }
+    if (opt.stallUs && ((dataFrames % opt.burstLen) == 0))
+    {
+        stallEnd = simStats.nowPs + SIM_US(opt.stallUs);
+        simNrfSetBleReady(false);
+        simSchedule(SIM_EVT_BLE_READY, stallEnd);
+    }
+
+    if (dataFrames == 0)
+        firstFrameDataReady = frame->tDataReady;
+    if (opt.patchGain && (dataFrames == opt.numFrames / 2))
+        sendPatch();
+    lastFrameDataReady = frame->tDataReady;
+    lastFrameNr = frameNr;
+    lastActiveCycles = cycles;
+    lastRegAccesses = simStats.regAccesses;
+    lastWakeups = simStats.wakeups;
+    dataFrames++;
+}
+
+static bool enoughFrames(void)
+{
+    return dataFrames >= opt.numFrames;
+}
+
+static void runFirmware(void)
+{
+    wulpus_main();
+}
+
+// First run of -P: the configuration package stores the boot preset
+static uint32_t storeFrames;
+
+static void onStoreFrame(const sim_spi_frame_t *frame)
+{
+    if ((frame->data[0] == 0xFF) || (frame->data[0] == US_FRAME_START_HEARTBEAT))
+        storeFrames++;
+}
+
+static bool presetStored(void)
+{
+    return storeFrames > 0;
+}
+
+//// Configuration micro benchmark ////
+
+#define BENCH_ITER          (100)
+
+typedef struct
+{
+    const char *name;
+    void (*setup)(void);
+    void (*body)(uint32_t iter);
+
+} bench_t;
+
+static msp_config_t benchCfg;
+
+static void benchSetupFull(void)
+{
+    getDefaultUsConfig(&benchCfg);
+}
+
+// A different configuration every call, the register image is rebuilt
+static void benchBodyFull(uint32_t iter)
+{
+    benchCfg.measPeriod = (uint16_t)(1000 + iter);
+    setNewUsConfig(&benchCfg);
+    confUsSubsystem();
+}
+
+static void benchSetupCached(void)
+{
+    getDefaultUsConfig(&benchCfg);
+    setNewUsConfig(&benchCfg);
+    confUsSubsystem();
+}
+
+// Same configuration again (restart, PLL unlock recovery)
+static void benchBodyCached(uint32_t iter)
+{
+    (void) iter;
+    setNewUsConfig(&benchCfg);
+    confUsSubsystem();
+}
+
+static void benchSetupSeq(void)
+{
+    uint8_t i;
+
+    getDefaultUsConfig(&benchCfg);
+    benchCfg.txRxConfLen = SEQ_LEN;
+    benchCfg.seqLen = SEQ_LEN;
+    for (i = 0; i < SEQ_LEN; i++)
+    {
+        benchCfg.seqConfigs[i].rxGain = seqTable[i].rxGain;
+        benchCfg.seqConfigs[i].pulseFreq = (uint32_t) seqTable[i].pulseFreqKhz * 1000;
+        benchCfg.seqConfigs[i].numPulses = seqTable[i].numPulses;
+        benchCfg.seqConfigs[i].overSamplRate = (sdhs_over_sampl_rate_t) seqTable[i].osr;
+        benchCfg.seqConfigs[i].sampleSize = benchCfg.sampleSize / seqTable[i].sampleDiv;
+        benchCfg.seqConfigs[i].startAdcSamplCnt = benchCfg.startAdcSamplCnt;
+    }
+    setNewUsConfig(&benchCfg);
+    confUsSubsystem();
+    applyUsSeqConfig(0);
+}
+
+// Step to the next entry of the sequence table
+static void benchBodySeq(uint32_t iter)
+{
+    applyUsSeqConfig((uint8_t)((iter + 1) % SEQ_LEN));
+}
+
+static const bench_t benches[] =
+{
+    { "confUsSubsystem(), new config",  benchSetupFull,   benchBodyFull },
+    { "confUsSubsystem(), same config", benchSetupCached, benchBodyCached },
+    { "applyUsSeqConfig(), next entry", benchSetupSeq,    benchBodySeq },
+};
+
+#define NUM_BENCH           (sizeof(benches) / sizeof(benches[0]))
+
+static const bench_t *curBench;
+static double benchCycles[NUM_BENCH];
+
+static void runBench(void)
+{
+    uint64_t cycles;
+    uint64_t regs;
+    uint64_t divs;
+    uint32_t i;
+
+    curBench->setup();
+
+    cycles = simActiveCycles();
+    regs = simStats.regAccesses;
+    divs = simStats.divU64Calls;
+
+    for (i = 0; i < BENCH_ITER; i++)
+    {
+        curBench->body(i);
+    }
+
+    benchCycles[curBench - benches] = (double)(simActiveCycles() - cycles) / BENCH_ITER;
+    printf("%-32s %10.0f %12.1f %12.1f\n", curBench->name,
+           benchCycles[curBench - benches],
+           (double)(simStats.regAccesses - regs) / BENCH_ITER,
+           (double)(simStats.divU64Calls - divs) / BENCH_ITER);
+}
+
+static void runBenchmark(void)
+{
+    uint32_t i;
+
+    printf("\n%-32s %10s %12s %12s\n", "Configuration (per call)", "cycles",
+           "reg. access", "64-bit div.");
+
+    for (i = 0; i < NUM_BENCH; i++)
+    {
+        curBench = &benches[i];
+        simReset();
+        if (simRun(runBench, NULL, SIM_PS_PER_S) != SIM_EXIT_NONE)
+        {
+            printf("%s benchmark failed: %s\n", curBench->name, simAbortMessage());
+            return;
+        }
+    }
+
+    printf("Cached register image saves %.0f cycles per confUsSubsystem() call\n",
+           benchCycles[0] - benchCycles[1]);
+}
+
+static void printStats(void)
+{
+    uint64_t total = simStats.nowPs;
+    uint64_t ussxtPs, uupsPs;
+    int i;
+
+    printf("\n%-24s %12s %12s %12s\n", "Phase", "mean", "min", "max");
+    for (i = 0; i < ST_NUM; i++)
+    {
+        if (stats[i].n == 0)
+            continue;
+        printf("%-24s %12.1f %12.1f %12.1f  %s\n", stats[i].name,
+               statMean(i), stats[i].min, stats[i].max, stats[i].unit);
+    }
+
+    printf("\nSimulated time %.3f ms: active %.1f %%, LPM0 %.1f %%, LPM3 %.1f %%\n",
+           simPsToUs(total) / 1000.0,
+           100.0 * simStats.statePs[SIM_CPU_ACTIVE] / total,
+           100.0 * simStats.statePs[SIM_CPU_LPM0] / total,
+           100.0 * simStats.statePs[SIM_CPU_LPM3] / total);
+    simUssOnTime(&ussxtPs, &uupsPs);
+    printf("USSXT on %.1f %%, UUPS on %.1f %%, %u of %u frames acquired warm\n",
+           100.0 * ussxtPs / total, 100.0 * uupsPs / total, warmAcqs, dataFrames);
+    printf("Interrupts %llu, wake-ups %llu, driverlib calls %llu, FIR MACs %llu\n",
+           (unsigned long long) simStats.isrCount,
+           (unsigned long long) simStats.wakeups,
+           (unsigned long long) simStats.driverlibCalls,
+           (unsigned long long) simStats.dspMacs);
+    printf("Cycle counts are modeled (register accesses, driverlib calls, ISR overhead)\n");
+}
+
+static bool checkBudget(int idx, double limit)
+{
+    if ((limit <= 0.0) || (stats[idx].n == 0) || (stats[idx].max <= limit))
+        return true;
+
+    printf("FAIL: %s %.1f %s exceeds the budget of %.1f\n", stats[idx].name,
+           stats[idx].max, stats[idx].unit, limit);
+    return false;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [options]\n"
+           "  -n <frames>              Number of US frames to capture (default 10)\n"
+           "  -p <ticks>               Measurement period in ACLK ticks (default %u)\n"
+           "  -s <size>                Sample size register value (default %u)\n"
+           "  -t <mode>                Trigger mode, 0: software, 1: timer (default 0)\n"
+           "  -q                       Cycle through a 3 entry sequence table\n"
+           "  -e <decimation>          Envelope frames decimated by 1, 2, 4 or 8\n"
+           "  -a <shots>               Average 1, 2, 4, ..., 64 acquisitions per frame\n"
+           "  -w                       Send the 32-bit sums of the averaged acquisitions\n"
+           "  -r                       Depth window per TX/RX config (3 configs, %u to %u samples)\n"
+           "  -b <frames>              Acquire bursts of 1..%u frames, sent after each burst\n"
+           "  -B <us>                  Clear the BLE ready line for <us> after the first frame of\n"
+           "                           every burst, checks that the burst waits for it (needs -b)\n"
+           "  -x                       Extended frame header, checked against every acquisition\n"
+           "  -k <bits>                Packed samples, 12: 2 samples in 3 bytes, 8: log-compressed\n"
+           "  -G <threshold>           Threshold gating of samples %u..%u, checks that only frames\n"
+           "                           above the threshold and heartbeats are sent\n"
+           "  -H <frames>              Quiet frames per heartbeat with -G (default 1)\n"
+           "  -P <slot>                Store the configuration as boot preset 0..%u, then check\n"
+           "                           the frames after a power cycle without configuration package\n"
+           "  -N                       Send the configuration package with corrupt packing bits first,\n"
+           "                           checks the CRC reject and the acknowledge of the correct one\n"
+           "  -g <gain>                Patch the RX gain of all TX/RX configs after half of the\n"
+           "                           frames (register value 17..62, not %u), checks the switch\n"
+           "  -v                       Print every frame\n"
+           "  --max-acq-us <us>        Budget for USSXT on -> off\n"
+           "  --max-active-cycles <n>  Budget for the active CPU cycles per frame\n"
+           "  --max-frame-us <us>      Budget for the frame period\n"
+           "  --max-wakeups <n>        Budget for the CPU wake-ups per frame\n",
+           prog, DEF_MEAS_PERIOD, DEF_SAMPLE_SIZE,
+           roiTable[SEQ_LEN - 1].sampleSize / 2, roiTable[0].sampleSize / 2,
+           US_BURST_LEN_MAX, GATE_START, GATE_START + GATE_LEN - 1, US_PRESETS_NUM - 1, DEF_RX_GAIN);
+}
+
+static void parseArgs(int argc, char **argv)
+{
+    static const struct option longOpts[] =
+    {
+        { "max-acq-us",        required_argument, NULL, 'A' },
+        { "max-active-cycles", required_argument, NULL, 'C' },
+        { "max-frame-us",      required_argument, NULL, 'F' },
+        { "max-wakeups",       required_argument, NULL, 'W' },
+        { "help",              no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    bool sampleSizeSet = false;
+    bool gateSet = false;
+    int c;
+
+    opt.numFrames = 10;
+    opt.measPeriod = DEF_MEAS_PERIOD;
+    opt.sampleSize = DEF_SAMPLE_SIZE;
+    opt.avgShots = 1;
+
+    while ((c = getopt_long(argc, argv, "n:p:s:t:qe:a:wrb:B:xk:G:H:P:Ng:vh", longOpts, NULL)) != -1)
+    {
+        switch (c)
+        {
+            case 'n':
+                opt.numFrames = (uint32_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'p':
+                opt.measPeriod = (uint32_t) strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                opt.sampleSize = (uint16_t) strtoul(optarg, NULL, 0);
+                sampleSizeSet = true;
+                break;
+            case 't':
+                opt.triggerMode = (uint8_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'q':
+                opt.seqTable = true;
+                break;
+            case 'e':
+                opt.decimation = (uint8_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'a':
+                opt.avgShots = (uint8_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'w':
+                opt.avgSum32 = true;
+                break;
+            case 'r':
+                opt.roi = true;
+                break;
+            case 'b':
+                opt.burstLen = (uint8_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'B':
+                opt.stallUs = (uint32_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'x':
+                opt.extHeader = true;
+                break;
+            case 'k':
+                switch (strtoul(optarg, NULL, 0))
+                {
+                    case 12:
+                        opt.packMode = US_PACK_12BIT;
+                        break;
+                    case 8:
+                        opt.packMode = US_PACK_LOG8;
+                        break;
+                    default:
+                        printf("Packed samples must have 12 or 8 bits\n");
+                        exit(2);
+                }
+                break;
+            case 'G':
+                opt.gateThreshold = (uint16_t) strtoul(optarg, NULL, 0);
+                gateSet = true;
+                break;
+            case 'H':
+                opt.gateHeartbeat = (uint8_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'N':
+                opt.nackFirst = true;
+                break;
+            case 'g':
+                opt.patchGain = (uint8_t) strtoul(optarg, NULL, 0);
+                break;
+            case 'P':
+                opt.bootPreset = (uint8_t) (strtoul(optarg, NULL, 0) + 1);
+                break;
+            case 'v':
+                opt.verbose = true;
+                break;
+            case 'A':
+                opt.maxAcqUs = strtod(optarg, NULL);
+                break;
+            case 'C':
+                opt.maxActiveCycles = strtod(optarg, NULL);
+                break;
+            case 'F':
+                opt.maxFrameUs = strtod(optarg, NULL);
+                break;
+            case 'W':
+                opt.maxWakeups = strtod(optarg, NULL);
+                break;
+            default:
+                usage(argv[0]);
+                exit((c == 'h') ? 0 : 2);
+        }
+    }
+
+    if ((opt.decimation != 0) && (opt.decimation != 1) && (opt.decimation != 2) &&
+        (opt.decimation != 4) && (opt.decimation != 8))
+    {
+        printf("Decimation must be 1, 2, 4 or 8\n");
+        exit(2);
+    }
+
+    // The frame length follows the largest window
+    if (opt.roi && !sampleSizeSet)
+        opt.sampleSize = roiTable[0].sampleSize;
+
+    if (opt.roi && (opt.sampleSize < roiTable[0].sampleSize))
+    {
+        printf("Sample size must cover the largest window (%u)\n", roiTable[0].sampleSize);
+        exit(2);
+    }
+
+    if ((opt.avgShots == 0) || (opt.avgShots > (1u << US_AVG_LOG2_SHOTS_MAX)) ||
+        (opt.avgShots & (opt.avgShots - 1)))
+    {
+        printf("Number of averaged acquisitions must be 1, 2, 4, ..., %u\n",
+               1u << US_AVG_LOG2_SHOTS_MAX);
+        exit(2);
+    }
+
+    if (opt.avgSum32 && ((opt.avgShots == 1) || opt.decimation))
+    {
+        printf("32-bit sums need -a <shots> > 1 and no envelope frames\n");
+        exit(2);
+    }
+
+    if ((opt.packMode != US_PACK_OFF) && (opt.avgSum32 || opt.decimation))
+    {
+        printf("Packed samples need raw or averaged 16-bit frames\n");
+        exit(2);
+    }
+
+    if (gateSet && (opt.gateHeartbeat == 0))
+        opt.gateHeartbeat = 1;
+
+    if (opt.gateHeartbeat && (!gateSet || (opt.gateThreshold > INT16_MAX) ||
+                              opt.avgSum32 || opt.burstLen))
+    {
+        printf("Threshold gating needs -G <threshold> up to %d, no bursts and no 32-bit sums\n",
+               INT16_MAX);
+        exit(2);
+    }
+
+    // The firmware rejects bursts that do not fit into the FRAM ring
+    if (opt.burstLen > usBurstCapacity(usCalcFrameLength(opt.sampleSize, opt.extHeader, opt.packMode,
+                                                         log2u(opt.decimation))))
+    {
+        printf("Burst length must be 0..%u with this sample size\n",
+               usBurstCapacity(usCalcFrameLength(opt.sampleSize, opt.extHeader, opt.packMode,
+                                                 log2u(opt.decimation))));
+        exit(2);
+    }
+
+    if (opt.stallUs && !opt.burstLen)
+    {
+        printf("-B needs bursts (-b <frames>)\n");
+        exit(2);
+    }
+
+    if ((opt.bootPreset > US_PRESETS_NUM) ||
+        (opt.bootPreset && (opt.burstLen > usBurstCapacity(BYTES_PR_XFER_TX))))
+    {
+        printf("Preset slot must be 0..%u, its bursts must fit 0..%u full length frames\n",
+               US_PRESETS_NUM - 1, usBurstCapacity(BYTES_PR_XFER_TX));
+        exit(2);
+    }
+
+    // The rejected package is checked in the run with acknowledge frames
+    if (opt.nackFirst && opt.bootPreset)
+    {
+        printf("-N cannot be combined with -P\n");
+        exit(2);
+    }
+
+    // The patched gain must differ from all gains of the sequence table
+    if (opt.patchGain && ((opt.patchGain < 17) || (opt.patchGain > 62) ||
+                          (opt.patchGain == DEF_RX_GAIN)))
+    {
+        printf("Patched gain must be 17..62 and differ from %u\n", DEF_RX_GAIN);
+        exit(2);
+    }
+
+    if ((opt.numFrames == 0) || (opt.numFrames > MAX_FRAMES))
+    {
+        printf("Number of frames must be 1..%u\n", MAX_FRAMES);
+        exit(2);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t confPack[SIM_SPI_FRAME_MAX];
+    static uint8_t badPack[SIM_SPI_FRAME_MAX];
+    uint32_t confLen;
+    uint32_t periods;
+    uint64_t limit;
+    sim_exit_t ret;
+    bool ok = true;
+
+    parseArgs(argc, argv);
+
+    simReset();
+    confLen = buildConfigPack(confPack);
+    confCrc = crc16(0xFFFF, confPack, confLen);
+    // Preset byte, version and CRC of the whole package
+    confPack[confLen + 1] = US_CONF_PACK_VERSION;
+    put16(confPack + confLen + 2, crc16(0xFFFF, confPack, confLen + 2));
+    goodPack = confPack;
+    goodPackLen = confLen + 4;
+    if (opt.nackFirst)
+    {
+        // Packing bits flipped (invalid for raw samples), the CRC is
+        // checked before the fields are interpreted
+        memcpy(badPack, confPack, goodPackLen);
+        badPack[17] ^= (uint8_t)(US_SAMPLE_SIZE_PACK_MASK >> 8);
+        simNrfSetTx(badPack, goodPackLen);
+    }
+    else
+    {
+        simNrfSetTx(confPack, goodPackLen);
+    }
+    simNrfSetFrameCallback(onFrame);
+
+    if (opt.bootPreset)
+    {
+        static const uint8_t selectPack[3] = { START_BYTE_PRESET, PRESET_CMD_SELECT, 0 };
+        uint8_t select[3];
+
+        simNrfSetFrameCallback(onStoreFrame);
+        ret = simRun(runFirmware, presetStored, SIM_PS_PER_S +
+                     aclkTicksToPs((uint64_t) (opt.burstLen + 2) * (opt.gateHeartbeat + 1) *
+                                   opt.avgShots * opt.measPeriod));
+        if (ret != SIM_EXIT_STOP)
+        {
+            printf("FAIL: configuration package with preset was not applied (%s)\n",
+                   (ret == SIM_EXIT_ABORT) ? simAbortMessage() : "no frame");
+            return 1;
+        }
+
+        // Power cycle, the firmware boots from the preset. The host selected
+        // the preset before, the command is repeated with every frame.
+        simReset();
+        memcpy(select, selectPack, sizeof(select));
+        select[2] = opt.bootPreset - 1;
+        simNrfSetTx(select, sizeof(select));
+        simNrfSetFrameCallback(onFrame);
+    }
+
+    // Enough for the BLE connection, the configuration and all frames
+    // (whole bursts and one more period after each burst)
+    periods = opt.numFrames + 2;
+    if (opt.burstLen)
+        periods += 2 * opt.burstLen;
+    if (opt.gateHeartbeat)
+        periods *= opt.gateHeartbeat;
+    limit = SIM_PS_PER_S + aclkTicksToPs((uint64_t) periods * opt.avgShots * opt.measPeriod);
+
+    ret = simRun(runFirmware, enoughFrames, limit);
+
+    printf("Captured %u US frames (%u other frames) in %.3f ms of simulated time\n",
+           dataFrames, otherFrames, simPsToUs(simStats.nowPs) / 1000.0);
+    if (opt.gateHeartbeat)
+        printf("Threshold gating: %u heartbeats, %u quiet frames not sent\n",
+               heartbeatFrames, skippedFrames);
+    if (dataFrames > 0)
+        printf("First frame %.3f ms after power-up%s\n", simPsToUs(firstFrameDataReady) / 1000.0,
+               opt.bootPreset ? " (boot preset)" : "");
+
+    if (ret == SIM_EXIT_ABORT)
+    {
+        printf("FAIL: model error: %s\n", simAbortMessage());
+        ok = false;
+    }
+    else if (ret != SIM_EXIT_STOP)
+    {
+        printf("FAIL: firmware did not deliver %u frames\n", opt.numFrames);
+        ok = false;
+    }
+    if (badFrames)
+    {
+        printf("FAIL: %u corrupt frames\n", badFrames);
+        ok = false;
+    }
+    if (badSettings)
+    {
+        printf("FAIL: %u frames acquired with the wrong sequence table entry\n", badSettings);
+        ok = false;
+    }
+    if (badMux)
+    {
+        printf("FAIL: %u frames acquired with the wrong HV MUX configuration\n", badMux);
+        ok = false;
+    }
+    // The patch is seen after the next frame and applied before the one after
+    // (one more with bursts), without a gap in the frame numbers
+    if (opt.patchGain)
+    {
+        uint32_t maxDelay = opt.burstLen ? opt.burstLen + 2 : 3;
+
+        if ((patchFrame < 0) || ((uint32_t) patchFrame > patchSentFrame + maxDelay))
+        {
+            printf("FAIL: gain patch sent after frame %u was not applied within %u frames\n",
+                   patchSentFrame, maxDelay);
+            ok = false;
+        }
+        else
+        {
+            printf("Gain patch sent after frame %u, applied from frame %d\n",
+                   patchSentFrame, patchFrame);
+        }
+    }
+    if (badDcDc)
+    {
+        printf("FAIL: %u acquisitions with the DC-DC turned on at the wrong time\n", badDcDc);
+        ok = false;
+    }
+    if (badAcks || !ackFrames || (opt.nackFirst && !nackFrames))
+    {
+        printf("FAIL: %u wrong acknowledge frames, %u acknowledges, %u rejects\n",
+               badAcks, ackFrames, nackFrames);
+        ok = false;
+    }
+    if (badGate)
+    {
+        printf("FAIL: %u frames sent or skipped against the threshold gating\n", badGate);
+        ok = false;
+    }
+    if (badStalls)
+    {
+        printf("FAIL: %u burst frames sent while the BLE ready line was low\n", badStalls);
+        ok = false;
+    }
+    if (badHeaders)
+    {
+        printf("FAIL: %u frames with a wrong extended header\n", badHeaders);
+        ok = false;
+    }
+
+    printStats();
+
+    ok &= checkBudget(ST_ACQ, opt.maxAcqUs);
+    ok &= checkBudget(ST_ACTIVE, opt.maxActiveCycles);
+    ok &= checkBudget(ST_PERIOD, opt.maxFrameUs);
+    ok &= checkBudget(ST_WAKEUPS, opt.maxWakeups);
+
+    runBenchmark();
+
+    printf("\n%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -31,20 +31,40 @@
 // US measurement header
 static uint8_t meas_header[4] = {0};
 static uint16_t meas_frame_nr = 0;
+// Size of the header of the current configuration
+static uint8_t frame_header_size = US_FRAME_HEADER_SIZE;
+// Preset the acquisition runs with (US_PRESET_NONE: package of the host)
+static uint8_t active_preset = US_PRESET_NONE;
+// Preset to start the next acquisition with instead of waiting for a package
+static uint8_t next_preset = US_PRESET_NONE;
 
 // Empty config with MSP settings for US acquisition
 msp_config_t msp_config;
+// Config extracted from a received package, kept once it is accepted
+static msp_config_t new_config;
 
 // TX RX active config ID
 uint8_t tx_rx_id = 0;
 
 // A routine to get configuration package from nRF
 static void getConfigPack(void);
+// Number of samples in the frame of a TX/RX config
+static uint16_t getFrameSamples(uint8_t id);
+// Write the time stamp and status of the acquisitions into the frame
+static void writeExtHeader(uint8_t * frame);
+// Load a stored preset as Uss config
+static bool loadPreset(uint8_t slot);
+// Execute the command in the SPI RX buffer between two frames
+// Returns true if the acquisition loop has to end
+static bool handleHostCommand(void);
+// Send an acknowledge frame to the host
+static void sendConfAck(uint8_t status, uint16_t hash);
 
 // High level functions used in main
 static void configAfterPowerUp(void);
 static void receiveUssConfPackage(void);
 static void usAcquisitionLoop(void);
+static bool sendBurstFrames(uint8_t frames);
 
 // Callbacks implementation
 static void hsPllUnlockCallback(void);
@@ -63,6 +83,9 @@ int main(void)
     // Sets default parameters
     configAfterPowerUp();
 
+    // Start acquiring right away if a boot preset is stored
+    next_preset = getUsBootPreset();
+
     while(1)
     {
         // Set default parameters
@@ -72,8 +95,19 @@ int main(void)
         // Receive Uss configuration package from nRF
         receiveUssConfPackage();
 
+        frame_header_size = msp_config.extHeader ? US_FRAME_EXT_HEADER_SIZE :
+                                                   US_FRAME_HEADER_SIZE;
+
         // Configure Uss according to the new package
         confUsSubsystem();
+        // Design the filters of the on-device processing
+        confUsDsp(&msp_config);
+
+        // The host consumes frames from the acknowledge on. It may have sent
+        // a restart or another preset meanwhile.
+        sendConfAck(US_CONF_ACK, msp_config.confHash);
+        if (handleHostCommand())
+            continue;
 
         // Configure the events of slow and fast timers
         confTimerSlowSwEvents();
@@ -132,6 +166,9 @@ void configAfterPowerUp(void)
     // stops the DC-DC converter and the Fast timer
     TIMER_FAST_CCR0_CALLBACK = &fastTimerCc0Callback;
 
+    // HV MUX TX latch and RX load overlap with the USSXT start-up
+    US_ACQ_START_CALLBACK = &hvMuxLatchTxLoadRx;
+
     // Hook other callbacks
     HS_PLL_UNLOCK_CALLBACK = &hsPllUnlockCallback;
     SAPH_SEQ_ACQ_DONE_CALLBACK = &saphSeqAcqDoneCallback;
@@ -157,15 +194,69 @@ static void receiveUssConfPackage(void)
         // Check that nRF52 BLE connection is ready
         if (isBleReady())
         {
+            // Boot preset or preset selected during the acquisition,
+            // no configuration package needed
+            if (loadPreset(next_preset))
+                return;
+
             // Receive configuration package from nRF
             getConfigPack();
 
+            // Preset commands, a selected preset replaces the package
+            if (loadPreset(execUsPresetCommand(usSpiGetRxPtr())))
+                return;
+
+            // The nRF52 clocks the frames of a new configuration package
+            // with its sample size, even if the package is rejected
+            if (usSpiGetRxPtr()[0] == START_BYTE_CONF_PACK)
+            {
+                uint16_t sample_size = READ_uint16(usSpiGetRxPtr() + 16);
+
+                usSetFrameLength(usCalcFrameLength(sample_size & ~(US_SAMPLE_SIZE_EXT_HEADER |
+                                                                   US_SAMPLE_SIZE_PACK_MASK |
+                                                                   US_SAMPLE_SIZE_LOG2_DEC_MASK),
+                                                   sample_size & US_SAMPLE_SIZE_EXT_HEADER,
+                                                   (sample_size & US_SAMPLE_SIZE_PACK_MASK) >>
+                                                   US_SAMPLE_SIZE_PACK_SHIFT,
+                                                   (sample_size & US_SAMPLE_SIZE_LOG2_DEC_MASK) >>
+                                                   US_SAMPLE_SIZE_LOG2_DEC_SHIFT));
+            }
+
             // Process received package and update Uss config
-            if (extractUsConfig(usSpiGetRxPtr(), &msp_config))
+            if (usSpiGetRxPtr()[0] == START_BYTE_CONF_PACK)
             {
-                // Update Ultrasound config
-                setNewUsConfig(&msp_config);
-                return;
+                // A corrupted package is rejected by its CRC, the config
+                // is only replaced by a package that is intact and valid.
+                // Settings the package does not carry are kept.
+                uint8_t status = checkUsConfigTrailer(usSpiGetRxPtr());
+
+                new_config = msp_config;
+                if ((status == US_CONF_ACK) &&
+                    !extractUsConfig(usSpiGetRxPtr(), &new_config))
+                    status = US_CONF_NACK_INVALID;
+
+                if (status == US_CONF_ACK)
+                {
+                    msp_config = new_config;
+
+                    // Keep the package in FRAM if the host asks for it
+                    storeUsPreset(usSpiGetRxPtr(), &msp_config);
+                    active_preset = US_PRESET_NONE;
+
+                    // Update Ultrasound config
+                    setNewUsConfig(&msp_config);
+                    return;
+                }
+
+                // Rejected once, the nRF52 repeats the package
+                if (isUsCommandNew(usSpiGetRxPtr()))
+                    sendConfAck(status, 0);
+            }
+            else if (isRestartCondition(usSpiGetRxPtr()) &&
+                     isUsCommandNew(usSpiGetRxPtr()))
+            {
+                // The acquisition stopped, ready for a configuration package
+                sendConfAck(US_CONF_STOPPED, 0);
             }
         }
     }
@@ -175,28 +266,65 @@ static void usAcquisitionLoop(void)
 {
 
     bool no_error = true;
+    // Frame slot filled by the next acquisition
+    uint8_t frame_slot = 0;
+    // Frame of the previous acquisition is still being sent
+    bool spi_busy = false;
+    // Acquisitions of the current frame (coherent averaging)
+    uint8_t avg_shot = 0;
+    // Frames of the current burst stored in the FRAM ring
+    uint8_t burst_frame = 0;
+    // Threshold gating: window comparator hit during the acquisitions of
+    // the current frame, frames not sent since the last one
+    bool gate_hit = false;
+    uint8_t quiet_frames = 0;
+    uint8_t * frame;
 
     while(1)
     {
         // Check if nRF52 BLE connection is ready
         if(isBleReady())
         {
+            frame = usGetFrameSlotPtr(frame_slot);
 
             // Update the measurement header
             meas_header[0] = MEAS_START_OF_FRAME_MASK;
             meas_header[1] = tx_rx_id;
+            if (msp_config.dspMode == US_DSP_ENVELOPE)
+            {
+                meas_header[1] |= US_FRAME_FORMAT_ENVELOPE |
+                                  (msp_config.dspLog2Dec << US_FRAME_LOG2_DEC_SHIFT);
+            }
+            else if (msp_config.avgOutput == US_AVG_SUM32)
+            {
+                meas_header[1] |= US_FRAME_FORMAT_SUM32;
+            }
+            else if (msp_config.packMode != US_PACK_OFF)
+            {
+                meas_header[1] |= US_FRAME_FORMAT_PACKED |
+                                  (msp_config.packMode << US_FRAME_PACK_SHIFT);
+            }
             meas_header[2] = (uint8_t) (meas_frame_nr & 0xFF);
             meas_header[3] = (uint8_t) (meas_frame_nr >> 8);
-            memcpy((uint16_t *) 0x4000, &meas_header, 4);
+            memcpy(frame, &meas_header, US_FRAME_HEADER_SIZE);
+
+            // The DTC writes the samples right after the header
+            setUsFrameDstOffset((uint16_t) (frame_slot * US_FRAME_SLOT_SIZE +
+                                            frame_header_size));
 
-            // Configure TX config (applied immediately)
-            hvMuxConfTx(msp_config.txConfigs[tx_rx_id]);
-            // Configure RX config (loaded into shift register but not latched)
-            // Latching will occur in the timer interrupt after completion
-            // of pulse generation
-            hvMuxConfRx(msp_config.rxConfigs[tx_rx_id]);
+            // Start shifting the TX config into the HV MUX. It is latched
+            // and the RX config shifted in while the USSXT starts up
+            // (hvMuxLatchTxLoadRx()). The RX config is latched in the
+            // timer interrupt after completion of pulse generation.
+            hvMuxLoadTx(msp_config.txConfigs[tx_rx_id],
+                        msp_config.rxConfigs[tx_rx_id]);
+
+            // Apply the acquisition settings of this TX/RX config
+            // (precomputed register values, only the changed ones are written)
+            applyUsSeqConfig(tx_rx_id);
 
             // Trigger ultrasound acquisition
+            // The previous frame is sent by the DMA in the meantime
             no_error = triggerUsAcq();
             if (no_error == false)
             {
@@ -205,21 +333,147 @@ static void usAcquisitionLoop(void)
                 continue;
             }
 
-            // If instead aquisition sequencer finished as expected
-            // and we reached this line, then
-            // wait for the SPI DMA transaction to be completed
+            // The SDHS window comparator flags the acquisitions with a
+            // sample outside the gate threshold
+            gate_hit |= isUsWindowHit();
+
+            // Accumulate the shots of this TX/RX config, the frame is sent
+            // after the last one. Each shot waits for the measurement period.
+            if (!averageUsShot((int16_t *) (frame + frame_header_size),
+                               getFrameSamples(tx_rx_id), avg_shot))
+            {
+                avg_shot++;
+                waitTimerSlowElapse();
+                continue;
+            }
+            avg_shot = 0;
 
-            // Wait for SPI DMA transmission to complete
-            usWaitForSpiDmaRx();
+            // Threshold gating: a quiet frame is not sent, after
+            // gateHeartbeat of them a heartbeat header is sent instead.
+            // Only frames flagged by the window comparator are searched.
+            if (msp_config.gateHeartbeat != 0)
+            {
+                bool hit = gate_hit &&
+                           gateUsFrame((int16_t *) (frame + frame_header_size),
+                                       getFrameSamples(tx_rx_id));
+
+                gate_hit = false;
+                if (hit)
+                {
+                    quiet_frames = 0;
+                }
+                else if (++quiet_frames == msp_config.gateHeartbeat)
+                {
+                    quiet_frames = 0;
+                    frame[0] = US_FRAME_START_HEARTBEAT;
+                }
+                else
+                {
+                    // The host commands come with the SPI exchanges, the one
+                    // of the previous frame is checked once it is complete.
+                    // A command sent later waits for the next frame or
+                    // heartbeat, at most gateHeartbeat measurement periods.
+                    if (spi_busy && usSpiDmaRxDone())
+                    {
+                        usWaitForSpiDmaRx();
+                        spi_busy = false;
+
+                        if (handleHostCommand())
+                        {
+                            pauseTimerSlowSwEvents();
+                            powerDownUss();
+                            return;
+                        }
+                    }
+
+                    waitTimerSlowElapse();
+
+                    meas_frame_nr++;
+                    tx_rx_id++;
+                    if(tx_rx_id == msp_config.txRxConfLen)
+                        tx_rx_id = 0;
+                    continue;
+                }
+            }
 
+            if (msp_config.extHeader)
+                writeExtHeader(frame);
 
-            // Check the SPI RX buffer for restart command
-            if (isRestartCondition(usSpiGetRxPtr()))
+            // The samples of a heartbeat are not relayed
+            if (frame[0] != US_FRAME_START_HEARTBEAT)
             {
-                pauseTimerSlowSwEvents();
-                return;
+                // Envelope detection and decimation in place
+                // (the SPI transfer of the previous frame continues meanwhile)
+                processUsFrame((int16_t *) (frame + frame_header_size),
+                               getFrameSamples(tx_rx_id), tx_rx_id);
+                // Packing of the samples, fewer nRF52 transfers per frame
+                packUsFrame((int16_t *) (frame + frame_header_size),
+                            getFrameSamples(tx_rx_id));
+            }
+
+            // Burst mode: keep the frame and acquire the next one, the
+            // frames are sent after the last acquisition of the burst
+            if (msp_config.burstLen != 0)
+            {
+                usBurstStoreFrame(burst_frame++, frame);
+
+                if (burst_frame == msp_config.burstLen)
+                {
+                    burst_frame = 0;
+
+                    // No acquisitions while the ring is drained
+                    pauseTimerSlowSwEvents();
+                    powerDownUss();
+
+                    if (!sendBurstFrames(msp_config.burstLen))
+                        return;
+
+                    // The next burst starts one period later, after the
+                    // DC-DC converters have been turned on
+                    confTimerSlowSwEvents();
+                }
+
+                waitTimerSlowElapse();
+
+                meas_frame_nr++;
+                tx_rx_id++;
+                if(tx_rx_id == msp_config.txRxConfLen)
+                    tx_rx_id = 0;
+                continue;
             }
 
+            // If instead aquisition sequencer finished as expected
+            // and we reached this line, then
+            // wait for the SPI DMA transaction of the previous frame
+            // to be completed before reusing the DMA channels
+            if (spi_busy)
+            {
+                // Wait for SPI DMA transmission to complete
+                usWaitForSpiDmaRx();
+                spi_busy = false;
+
+                // Check the SPI RX buffer for restart, preset or patch command
+                if (handleHostCommand())
+                {
+                    pauseTimerSlowSwEvents();
+                    // USSXT and UUPS may still be powered (keep-warm)
+                    powerDownUss();
+                    return;
+                }
+            }
+
+            // Send the new frame, the next acquisition goes to the other slot
+            // Enable DMA SPI interrupt
+            usSpiEnableDmaRxIsr();
+            // Start SPI transaction
+            usStartSPI(frame);
+            usSpiSignalDataReady();
+            spi_busy = true;
+
+            frame_slot++;
+            if (frame_slot == US_FRAME_SLOTS)
+                frame_slot = 0;
+
             // Wait for timer to elapse
             waitTimerSlowElapse();
 
@@ -230,19 +484,58 @@ static void usAcquisitionLoop(void)
             if(tx_rx_id == msp_config.txRxConfLen)
                 tx_rx_id = 0;
         }
+        else
+        {
+            // Sleep for one measurement period instead of polling the pin.
+            // The DC-DC converters were turned on for this period.
+            waitTimerSlowElapse();
+            disableHvPcbDcDc();
+            disableOpAmp();
+        }
     }
 }
 
 //// HELPER FUNCTIONS  ////
 
+// Send the frames of a burst from the FRAM ring, one SPI frame each,
+// every frame waits for the BLE ready line.
+// Returns false if the nRF sent a restart or preset select command.
+static bool sendBurstFrames(uint8_t frames)
+{
+    uint8_t i;
+
+    for (i = 0; i < frames; i++)
+    {
+        // The nRF52 clears the ready line while its BLE queue is full,
+        // hold the frame like the streaming path does
+        while (!isBleReady())
+            timerSlowDelay(327, LPM3_bits);
+
+        // Enable DMA SPI interrupt
+        usSpiEnableDmaRxIsr();
+        // Start SPI transaction
+        usStartSPI(usBurstGetFramePtr(i));
+        usSpiSignalDataReady();
+
+        // Wait for SPI DMA transmission to complete
+        usWaitForSpiDmaRx();
+
+        // Check the SPI RX buffer for restart, preset or patch command
+        if (handleHostCommand())
+            return false;
+    }
+
+    return true;
+}
+
 // Get configuration package from nRF
 static void getConfigPack(void)
 {
     // Initiate an SPI transaction to receive a config file
     // Clear TX buffer
-    memset((uint16_t *) 0x4000, 0, (uint32_t)BYTES_PR_XFER_TX);
+    memset(usGetFrameSlotPtr(0), 0, (uint32_t)BYTES_PR_XFER_TX);
     // Start SPI transaction
-    usStartSPI();
+    usStartSPI(usGetFrameSlotPtr(0));
 
     // Enable DMA SPI interrupt
     // It will wake up the CPU from LPM0
@@ -252,6 +545,112 @@ static void getConfigPack(void)
     usWaitForSpiDmaRx();
 }
 
+static void sendConfAck(uint8_t status, uint16_t hash)
+{
+    uint8_t * frame = usGetFrameSlotPtr(0);
+
+    // Relayed like a heartbeat, only the first transfer reaches the host
+    memset(frame, 0, (uint32_t)BYTES_PR_XFER_TX);
+    frame[0] = US_FRAME_START_ACK;
+    frame[1] = status;
+    frame[2] = (uint8_t) (hash & 0xFF);
+    frame[3] = (uint8_t) (hash >> 8);
+    frame[4] = US_CONF_PACK_VERSION;
+
+    // Commands are answered again once a configuration is applied
+    if (status == US_CONF_ACK)
+        forgetUsCommand();
+
+    usStartSPI(frame);
+    usSpiEnableDmaRxIsr();
+    usWaitForSpiDmaRx();
+}
+
+static uint16_t getFrameSamples(uint8_t id)
+{
+    uint16_t samples = msp_config.sampleSize;
+
+    if (msp_config.seqLen != 0)
+        samples = msp_config.seqConfigs[id].sampleSize;
+
+    // The sample size is sent as twice the number of samples
+    // (see sw/wulpus/uss_conf.py)
+    samples >>= 1;
+
+    if (samples > (BYTES_PR_XFER_TX - frame_header_size) / 2)
+        samples = (BYTES_PR_XFER_TX - frame_header_size) / 2;
+
+    return samples;
+}
+
+static uint8_t satTicks(uint16_t ticks)
+{
+    return (ticks > UINT8_MAX) ? UINT8_MAX : (uint8_t) ticks;
+}
+
+static void writeExtHeader(uint8_t * frame)
+{
+    const us_acq_status_t * status = getUsAcqStatus();
+
+    frame[4]  = (uint8_t) (status->tTrigger);
+    frame[5]  = (uint8_t) (status->tTrigger >> 8);
+    frame[6]  = (uint8_t) (status->tTrigger >> 16);
+    frame[7]  = (uint8_t) (status->tTrigger >> 24);
+    frame[8]  = satTicks(status->xtalTicks);
+    frame[9]  = satTicks(status->uupsTicks);
+    frame[10] = satTicks(status->seqTicks);
+    frame[11] = status->flags;
+    frame[12] = (uint8_t) (msp_config.confHash);
+    frame[13] = (uint8_t) (msp_config.confHash >> 8);
+    frame[14] = status->failedAcqs;
+    frame[15] = (active_preset == US_PRESET_NONE) ? 0 : active_preset + 1;
+
+    // The next frame reports the acquisitions failing from now on
+    clearUsAcqErrors();
+}
+
+// Load a stored preset as Uss config. Its frames are sent with the full
+// length, the nRF52 only learns the frame length from configuration packages.
+static bool loadPreset(uint8_t slot)
+{
+    next_preset = US_PRESET_NONE;
+
+    if ((slot == US_PRESET_NONE) || !loadUsPreset(slot, &msp_config))
+        return false;
+
+    usSetFrameLength(BYTES_PR_XFER_TX);
+    setNewUsConfig(&msp_config);
+    active_preset = slot;
+
+    return true;
+}
+
+// Restart command, or selection of another preset (the command is repeated
+// with every frame, selecting the running preset again is ignored).
+// A patch is applied to the next frame, the acquisition continues.
+static bool handleHostCommand(void)
+{
+    uint8_t preset;
+
+    if (isRestartCondition(usSpiGetRxPtr()))
+        return true;
+
+    if (extractUsPatch(usSpiGetRxPtr(), &msp_config))
+    {
+        patchUsConfig(&msp_config);
+        return false;
+    }
+
+    preset = execUsPresetCommand(usSpiGetRxPtr());
+    if ((preset != US_PRESET_NONE) && (preset != active_preset))
+    {
+        next_preset = preset;
+        return true;
+    }
+
+    return false;
+}
+
 //// Callbacks implementation ////
 static void hsPllUnlockCallback(void)
 {
@@ -264,7 +663,11 @@ static void saphSeqAcqDoneCallback(void)
 {
 
     // Power Down the UUPS after the acquisition is complete
-    UUPSCTL |= USSPWRDN;
+    // (kept in READY state if the period is short)
+    if (!isUsKeepWarm())
+    {
+        UUPSCTL |= USSPWRDN;
+    }
 
     // Disable HV PCB DC-DC converters
     // and OpAmp
@@ -274,15 +677,8 @@ static void saphSeqAcqDoneCallback(void)
     // Disable RX OPA836
     disableOpAmp();
 
-    // if PLL unlock event occurs earlier the acquisition might be not valid
-    if (isEventFlagSet(HS_PLL_UNLOCK_EVENT) == false)
-    {
-        // Enable DMA SPI interrupt
-        // It will wake up the CPU from LPM0
-        usSpiEnableDmaRxIsr();
-        // Start SPI transaction
-        usStartSPI();
-    }
+    // The SPI transfer of the frame is started in usAcquisitionLoop()
+    // once the previous frame has been sent
 }
 
 static void slowTimerCc2Callback(void)
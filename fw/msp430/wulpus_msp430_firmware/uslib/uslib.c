@@ -23,9 +23,123 @@
 static msp_config_t config;
 static bool config_updated = false;
 
+// Offset of the SDHS DTC destination in the LEA RAM (Bytes)
+static uint16_t dtc_dst_offset = US_FRAME_DST_OFFSET_DEFAULT;
+
+static void setDtcDstAddress(void);
+
+// Keep USSXT, HSPLL and UUPS powered between acquisitions
+static bool keep_warm = false;
+
+// Ticks left of a long measurement period and until the DC-DC turn-on
+// (see scheduleTimerSlowStep())
+static uint32_t period_left = 0;
+static uint32_t dcdc_left = 0;
+
+static void scheduleTimerSlowStep(uint16_t base);
+
+// One register write of the configuration register image
+typedef struct
+{
+    uint16_t addr;
+    uint16_t value;
+
+} us_reg_write_t;
+
+// Enough for all writes done by buildUsRegImage()
+#define US_REG_IMAGE_LEN_MAX    (48)
+
+// Register image of the current configuration, the register writes of
+// confUsSubsystem() in order. Built once per configuration.
+static us_reg_write_t reg_image[US_REG_IMAGE_LEN_MAX];
+static uint8_t reg_image_len = 0;
+static bool reg_image_valid = false;
+
+static bool buildUsRegImage(void);
+static inline void regImageAdd(uint16_t addr, uint16_t value);
+static void regImageSet(uint16_t addr, uint16_t value);
+static void applyUsRegImage(void);
+
+// Register values of one sequence table entry
+typedef struct
+{
+    uint16_t sdhsCtl1;      // Oversampling rate
+    uint16_t sdhsCtl2;      // Sample size
+    uint16_t sdhsCtl6;      // PGA gain
+    uint16_t apgc;          // Number of pulses
+    uint16_t apgLper;       // PPG low period
+    uint16_t apgHper;       // PPG high period
+    uint16_t aatmD;         // Start of the ADC sampling
+    // Registers which differ from the previous entry
+    uint8_t  delta;
+
+} us_seq_regs_t;
+
+#define SEQ_REG_SDHSCTL1    BIT0
+#define SEQ_REG_SDHSCTL2    BIT1
+#define SEQ_REG_SDHSCTL6    BIT2
+#define SEQ_REG_APGC        BIT3
+#define SEQ_REG_APGLPER     BIT4
+#define SEQ_REG_APGHPER     BIT5
+#define SEQ_REG_AATMD       BIT6
+
+#define SEQ_REGS_SDHS       (SEQ_REG_SDHSCTL1 | SEQ_REG_SDHSCTL2 | SEQ_REG_SDHSCTL6)
+#define SEQ_REGS_PPG        (SEQ_REG_APGC | SEQ_REG_APGLPER | SEQ_REG_APGHPER)
+#define SEQ_REGS_SAPH       (SEQ_REGS_PPG | SEQ_REG_AATMD)
+#define SEQ_REGS_ALL        (SEQ_REGS_SDHS | SEQ_REGS_SAPH)
+
+// No entry applied, the registers hold the global settings
+#define SEQ_ID_NONE         (0xFF)
+
+// Computed once per configuration in buildUsRegImage()
+static us_seq_regs_t seq_regs[TX_RX_CONF_LEN_MAX];
+static uint8_t seq_applied = SEQ_ID_NONE;
+
+static bool calcPpgPeriods(uint32_t pulseFreq, uint16_t *lper, uint16_t *hper);
+static bool prepareSeqRegs(void);
+static void prepareSeqDeltas(void);
+
+// Time stamps and status of the acquisitions
+static us_acq_status_t acq_status;
+
+static bool failUsAcq(uint8_t error);
+static inline uint16_t readTimerSlow(void);
+
+// Called by startUsAcq() after the USSXT was turned on
+#pragma PERSISTENT(US_ACQ_START_CALLBACK)
+void (*US_ACQ_START_CALLBACK)(void) = 0;
+
+// State of the acquisition in progress (see stepUsAcq())
+static us_acq_state_t acq_state = US_ACQ_IDLE;
+// Start-up checks of the current phase so far
+static uint8_t acq_retries = 0;
+// Slow timer count at the start of the current start-up phase
+static uint16_t acq_t_phase = 0;
+
+// Events which advance the acquisition in each state
+#define ACQ_STARTUP_EVENTS    (TIMER_SLOW_CCR1_EVENT | UUPS_PWR_UP_TIMEOUT_EVENT)
+#define ACQ_SEQUENCE_EVENTS   ((SAPH_SEQ_ACQ_DONE_EVENT)    | \
+                               (SAPH_TIME_MF_TIMEOUT_EVENT) | \
+                               (SAPH_DATA_ERROR_EVENT)      | \
+                               (UUPS_INTERRUPT_DBG_EVENT)   | \
+                               (HS_PLL_UNLOCK_EVENT))
+
+static void armStartupCheck(uint16_t ticks);
+static void disarmStartupCheck(void);
+static bool abortUsAcq(uint8_t error);
+static void startUsSequence(void);
+static void finishUsSequence(void);
+
 void setNewUsConfig(msp_config_t *newConfig)
 {
-    config = *newConfig;
+    // The register image is kept if the same configuration is sent again
+    // (e.g. restart of the acquisition)
+    if ((reg_image_valid == false) ||
+        (memcmp(&config, newConfig, sizeof(msp_config_t)) != 0))
+    {
+        config = *newConfig;
+        reg_image_valid = false;
+    }
     config_updated = true;
     return;
 }
@@ -43,40 +157,154 @@ bool confUsSubsystem(void)
         return false;
     }
 
-    // Always triggered in SW
-    // Future alternative - USSTRG (see datasheet)
-    UUPSCTL = ASQEN + 0x00;
-
-    // // Unlock SDHS register for configuration
-    // SDHSCTL3 &= ~(TRIGEN);
-
-    // // Configure SDHS Modulator Optimization
-    // // (p. 614 of slau367p)
-    // switch (config.pllOutFreq)
-    // {
-    //     case HSPLL_OUT_80_MHZ:
-    //     case HSPLL_OUT_79_MHZ:
-    //     case HSPLL_OUT_78_MHZ:
-    //     case HSPLL_OUT_77_MHZ:
-    //         SDHSCTL7 = MODOPTI3 + MODOPTI2; // 0xC
-    //         break;
-    //     case HSPLL_OUT_76_MHZ:
-    //     case HSPLL_OUT_75_MHZ:
-    //     case HSPLL_OUT_74_MHZ:
-    //         SDHSCTL7 = MODOPTI3 + MODOPTI2 + MODOPTI0; // 0xD
-    //         break;
-    //     case HSPLL_OUT_73_MHZ:
-    //     case HSPLL_OUT_72_MHZ:
-    //     case HSPLL_OUT_71_MHZ:
-    //         SDHSCTL7 = MODOPTI3 + MODOPTI2 + MODOPTI1; // 0xE
-    //         break;
-    //     default:
-    //         SDHSCTL7 = MODOPTI3 + MODOPTI2 + MODOPTI1 + MODOPTI0; // 0xF
-    //         break;
-    // }
-
-    // // Lock SDHS register for configuration
-    // SDHSCTL3 |= (TRIGEN);
+    // The clock and power settings must not change while powered
+    powerDownUss();
+
+    // Compute the register values only once per configuration
+    if (reg_image_valid == false)
+    {
+        if (buildUsRegImage() != true)
+            return false;
+        reg_image_valid = true;
+    }
+
+    applyUsRegImage();
+
+    // The registers hold the global settings
+    seq_applied = SEQ_ID_NONE;
+
+    // Power policy between acquisitions
+    keep_warm = (config.measPeriod < US_KEEP_WARM_PERIOD_MAX);
+
+    // Configure DTC destination offset address
+    setDtcDstAddress();
+
+    return true;
+}
+
+void patchUsConfig(const msp_config_t *newConfig)
+{
+    uint16_t apgc = (newConfig->numPulses) | ((config.numStopPulses) << 8);
+    uint8_t i;
+
+    // Keep the register image in line, it is applied again at restart
+    regImageSet(SDHS_BASE + OFS_SDHSCTL6, newConfig->rxGain);
+    regImageSet(SAPH_A_BASE + OFS_SAPH_APGC, apgc);
+
+    for (i = 0; i < config.seqLen; i++)
+    {
+        seq_regs[i].sdhsCtl6 = newConfig->seqConfigs[i].rxGain;
+        seq_regs[i].apgc = (newConfig->seqConfigs[i].numPulses) |
+                           ((config.numStopPulses) << 8);
+    }
+
+    // Only the patched fields differ
+    config = *newConfig;
+
+    if (config.seqLen != 0)
+    {
+        // The next applyUsSeqConfig() writes all registers of its entry
+        prepareSeqDeltas();
+        seq_applied = SEQ_ID_NONE;
+    }
+    else
+    {
+        // Unlock SDHS registers
+        SDHSCTL3 &= ~(TRIGEN);
+        SDHSCTL6 = config.rxGain;
+        // Lock SDHS registers
+        SDHSCTL3 |= (TRIGEN);
+
+        // The PPG is disabled while reconfigured
+        SAPH_AKEY = KEY;
+        SAPH_APGCTL &= ~(PPGEN);
+        SAPH_APGC = apgc;
+        SAPH_APGCTL |= (PPGEN);
+        SAPH_AKEY = 0;
+    }
+
+    // The measurement period and DC-DC turn-on time are reloaded by the
+    // slow timer from the next period on (reloadTimerSlowSwEvents())
+    keep_warm = (config.measPeriod < US_KEEP_WARM_PERIOD_MAX);
+}
+
+static inline void regImageAdd(uint16_t addr, uint16_t value)
+{
+    reg_image[reg_image_len].addr = addr;
+    reg_image[reg_image_len].value = value;
+    reg_image_len++;
+}
+
+// Replace the value of a register written by the image
+static void regImageSet(uint16_t addr, uint16_t value)
+{
+    uint8_t i;
+
+    for (i = 0; i < reg_image_len; i++)
+    {
+        if (reg_image[i].addr == addr)
+            reg_image[i].value = value;
+    }
+}
+
+static void applyUsRegImage(void)
+{
+    const us_reg_write_t *w = reg_image;
+    const us_reg_write_t *end = reg_image + reg_image_len;
+
+    while (w < end)
+    {
+        HWREG16(w->addr) = w->value;
+        w++;
+    }
+}
+
+// Compute the register writes of the configuration
+static bool buildUsRegImage(void)
+{
+    uint16_t amcnf;
+    uint16_t atactl;
+    uint16_t uupsctl;
+    uint16_t sdhsctl3;
+
+    reg_image_len = 0;
+
+    // Register values of the sequence table
+    if (prepareSeqRegs() != true)
+        return false;
+
+    // The ASQ is triggered in SW (ASQTRIG) or by the rising edge of the fast
+    // timer CC1 output (TRIGSEL, triggerMode, see startUsAcq())
+    uupsctl = ASQEN + 0x00;
+
+    // Configure ULP bias configuration
+    // Low power bias mode enable
+    amcnf = 0;
+    switch (config.uupsBiasDelay)
+    {
+       case UUPS_BIAS_100_USEC:
+           amcnf |= (LPBE);
+           uupsctl |= (LBHDEL_1);
+           break;
+
+       case UUPS_BIAS_200_USEC:
+           amcnf |= (LPBE);
+           uupsctl |= (LBHDEL_2);
+           break;
+
+       case UUPS_BIAS_300_USEC:
+           amcnf |= (LPBE);
+           uupsctl |= (LBHDEL_3);
+           break;
+
+       case UUPS_BIAS_NO_DELAY:
+       default:
+           // Default is no ULP delay
+           uupsctl |= (LBHDEL_0);
+           break;
+    }
+
+    regImageAdd(UUPS_BASE + OFS_UUPSCTL, uupsctl);
 
     // Calculate HSPLL Multiplier
     // (p. 481 of slau367p)
@@ -107,11 +335,11 @@ bool confUsSubsystem(void)
     // If input frequency is > 6 MHz => set PLLINFREQ bit
     if(config.xtalFreq ==  HSPLL_XTAL_FREQ_8_MHZ)
     {
-        HSPLLCTL = tempVar + PLLINFREQ;
+        regImageAdd(HSPLL_BASE + OFS_HSPLLCTL, tempVar + PLLINFREQ);
     }
     else
     {
-        HSPLLCTL = tempVar;
+        regImageAdd(HSPLL_BASE + OFS_HSPLLCTL, tempVar);
     }
 
     // Configure HSPLLUSSXTLCTL register based on HSPLL input frequency clock
@@ -121,44 +349,37 @@ bool confUsSubsystem(void)
     //  Enable USSXT buffered output?
     if(config.outEnPllXtal == true)
     {
-        HSPLLUSSXTLCTL = config.xtalType;
+        regImageAdd(HSPLL_BASE + OFS_HSPLLUSSXTLCTL, config.xtalType);
     }
     else
     {
-        HSPLLUSSXTLCTL = config.xtalType | XTOUTOFF;
+        regImageAdd(HSPLL_BASE + OFS_HSPLLUSSXTLCTL, config.xtalType | XTOUTOFF);
     }
 
     // Prepare acquisition sequencer and Programmable Pulse Generator (PPG)
     // for configuration
-    SAPH_AKEY = KEY;
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AKEY, KEY);
 
     //// Configure bias impedance generator ////
 
-    // Unlock SAPH and SAPH trim registers
-    // Unlock trim register to be able to modify SAPHMCNF register
-    SAPH_ATACTL |= (UNLOCK);
-
-    // Clear currently configured bias impedance generator
-
     // As per slau367p (page 536)
     // Bias generator Impedance configuration. These bits define the
     // impedance of the buffers for RxBias and TxBias. While for resistive
     // loads the lowest impedance shows the fastest settling, this is not the
     // case for reactive loads.
 
-    SAPH_AMCNF &= ~(BIMP_3);
     switch (config.biasImp) {
         case BIAS_IMP_500_OHM:
-            SAPH_AMCNF |= (BIMP_0);
+            amcnf |= (BIMP_0);
             break;
         case BIAS_IMP_900_OHM:
-            SAPH_AMCNF |= (BIMP_1);
+            amcnf |= (BIMP_1);
             break;
         case BIAS_IMP_1500_OHM:
-            SAPH_AMCNF |= (BIMP_2);
+            amcnf |= (BIMP_2);
             break;
         case BIAS_IMP_2950_OHM:
-            SAPH_AMCNF |= (BIMP_3);
+            amcnf |= (BIMP_3);
             break;
     }
 
@@ -166,21 +387,27 @@ bool confUsSubsystem(void)
         case CHARGE_PUMP_ALWAYS_ON:
             // RX input multiplexer charge pump is on
             // during the capture
-            SAPH_AMCNF |= (CPEO);
+            amcnf |= (CPEO);
             break;
         case CHARGE_PUMP_NORMAL_MODE:
             // Off during capture
-            SAPH_AMCNF &= ~(CPEO);
             break;
     }
 
-    // Lock trim register
-    SAPH_ATACTL &= ~(UNLOCK);
+    // The trim registers keep the bits not set by the configuration
+    atactl = SAPH_ATACTL & ~(UNLOCK);
+    amcnf |= SAPH_AMCNF & ~(BIMP_3 | CPEO | LPBE);
 
+    // Unlock trim register to be able to modify SAPHMCNF register
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_ATACTL, atactl | UNLOCK);
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AMCNF, amcnf);
+    // Lock trim register
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_ATACTL, atactl);
 
     // Disable ACQ and PPG
-    SAPH_AASCTL0 &= ~(ASQTEN);
-    SAPH_APGCTL &= ~(PPGEN);
+    // ASQ on CH1, the trigger is enabled at the end
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AASCTL0, TRIGSEL_1 + ASQCHSEL_1);
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_APGCTL, TRSEL_1 + PGSEL_1);
 
     //// Configure PPG (single tone generation) ////
     if (confPPG() != true)
@@ -191,103 +418,67 @@ bool confUsSubsystem(void)
     // Configure Bias Control registers
     // Defaulting excitation bias to 0.4V Nominal
     // Enable CH1 TX voltage
-    SAPH_ABCTL = (ASQBSC_1 | EXCBIAS_2 | CH1EBSW | PGABSW);
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_ABCTL, ASQBSC_1 | EXCBIAS_2 | CH1EBSW | PGABSW);
     // Configure mux to select correct RX channel
-    SAPH_AICTL0 = (DUMEN | MUXCTL | MUXSEL_0);
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AICTL0, DUMEN | MUXCTL | MUXSEL_0);
 
     // Configure SAPH Acquisition sequencer
-    // CH1
-    SAPH_AASCTL0 = TRIGSEL_1 + ASQCHSEL_1;
     // Standby state after the end of the sequence
-    SAPH_AASCTL1 = 0 ;
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AASCTL1, 0);
     // Selects pulse polarity
     // Starts either with high or low pulse
-    SAPH_AAPOL = config.pulserPolarity;
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AAPOL, config.pulserPolarity);
 
     // Select pause state
     if(config.pulserPauseState == PPG_PAUSE_STATE_LOW)
     {
-        SAPH_AAPHIZ = 0;
-        SAPH_AAPLEV = 0;
+        regImageAdd(SAPH_A_BASE + OFS_SAPH_AAPHIZ, 0);
+        regImageAdd(SAPH_A_BASE + OFS_SAPH_AAPLEV, 0);
     }
     else if(config.pulserPauseState == PPG_PAUSE_STATE_HIGH)
     {
-        SAPH_AAPHIZ = 0;
-        SAPH_AAPLEV = 0x000F;
+        regImageAdd(SAPH_A_BASE + OFS_SAPH_AAPHIZ, 0);
+        regImageAdd(SAPH_A_BASE + OFS_SAPH_AAPLEV, 0x000F);
     }
     else // High impedance
     {
-        SAPH_AAPHIZ = 0x000F;
-        SAPH_AAPLEV = 0;
+        regImageAdd(SAPH_A_BASE + OFS_SAPH_AAPHIZ, 0x000F);
+        regImageAdd(SAPH_A_BASE + OFS_SAPH_AAPLEV, 0);
     }
 
     // Configure SAPH time marks
-    SAPH_AATM_A = config.startPpgCnt;
-    SAPH_AATM_B = config.turnOnAdcCnt;
-    SAPH_AATM_C = config.startPgaInBiasCnt;
-    SAPH_AATM_D = config.startAdcSamplCnt;
-    SAPH_AATM_E = config.restartCaptCnt;
-    SAPH_AATM_F = config.captTimeoutCnt;
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AATM_A, config.startPpgCnt);
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AATM_B, config.turnOnAdcCnt);
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AATM_C, config.startPgaInBiasCnt);
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AATM_D, config.startAdcSamplCnt);
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AATM_E, config.restartCaptCnt);
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AATM_F, config.captTimeoutCnt);
 
     // Acquisition sequencer trigger enable
-    SAPH_AASCTL0 |= (ASQTEN);
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AASCTL0, TRIGSEL_1 + ASQCHSEL_1 + ASQTEN);
 
     // Lock SAPH registers
-    SAPH_AKEY = 0;
-
-    SAPH_AKEY = KEY;
-    SAPH_ATACTL |= (UNLOCK);
-
-    // Configure ULP bias configuration
-    UUPSCTL &= ~(LBHDEL_3);
-    switch (config.uupsBiasDelay)
-    {
-       case UUPS_BIAS_NO_DELAY:
-           // Low power bias mode enable
-           SAPH_AMCNF &= ~(LPBE);
-           UUPSCTL |= (LBHDEL_0);
-           break;
-
-       case UUPS_BIAS_100_USEC:
-           SAPH_AMCNF |= (LPBE);
-           UUPSCTL |= (LBHDEL_1);
-           break;
-
-       case UUPS_BIAS_200_USEC:
-           SAPH_AMCNF |= (LPBE);
-           UUPSCTL |= (LBHDEL_2);
-           break;
-
-       case UUPS_BIAS_300_USEC:
-           SAPH_AMCNF |= (LPBE);
-           UUPSCTL |= (LBHDEL_3);
-           break;
-
-       default:
-           // Default is no ULP delay
-           SAPH_AMCNF &= ~(LPBE);
-           UUPSCTL |= (LBHDEL_0);
-           break;
-    }
-
-    // Lock SAPH registers and lock trim registers
-    SAPH_ATACTL &= ~(UNLOCK);
-    SAPH_AKEY = 0;
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AKEY, 0);
 
     // Unlock SDHS register for configuration
-    SDHSCTL3 &= ~(TRIGEN);
+    sdhsctl3 = SDHSCTL3 & ~(TRIGEN);
+    regImageAdd(SDHS_BASE + OFS_SDHSCTL3, sdhsctl3);
 
     // Configure SDHS.CTL0, SDHS.CTL1, SDHS.CTL2, SDHS.CTL6, SDHS.CTL7,
     // SDHS.WINHITH, SDHS.WINLOTH, SDHS.DTCSA  registers
-    SDHSCTL0 = TRGSRC + SHIFT_0 + OBR_0 + DFMSEL_0 + DALGN_0 + + INTDLY_0 +
-           AUTOSSDIS;
-    SDHSCTL1 = config.overSamplRate;
-
-    SDHSCTL2 = DTCOFF_0 + (config.sampleSize - 1);
+    regImageAdd(SDHS_BASE + OFS_SDHSCTL0, TRGSRC + SHIFT_0 + OBR_0 + DFMSEL_0 +
+                DALGN_0 + INTDLY_0 + AUTOSSDIS);
+    regImageAdd(SDHS_BASE + OFS_SDHSCTL1, config.overSamplRate);
 
+    // Window comparator of the threshold gating, flags samples above
+    // +gateThreshold (WINHI) or below -gateThreshold (WINLO)
+    regImageAdd(SDHS_BASE + OFS_SDHSCTL2, DTCOFF_0 + (config.sampleSize - 1) +
+                ((config.gateHeartbeat != 0) ? WINCMPEN_1 : WINCMPEN_0));
+    regImageAdd(SDHS_BASE + OFS_SDHSWINHITH, config.gateThreshold);
+    regImageAdd(SDHS_BASE + OFS_SDHSWINLOTH, (uint16_t) -(int16_t) config.gateThreshold);
 
     //// Configure PGA Gain ////
-    SDHSCTL6 = config.rxGain;
+    regImageAdd(SDHS_BASE + OFS_SDHSCTL6, config.rxGain);
 
     // Configure SDHS Modulator Optimization
     // (p. 614 of slau367p)
@@ -297,39 +488,93 @@ bool confUsSubsystem(void)
         case HSPLL_OUT_79_MHZ:
         case HSPLL_OUT_78_MHZ:
         case HSPLL_OUT_77_MHZ:
-            SDHSCTL7 = MODOPTI3 + MODOPTI2; // 0xC
+            regImageAdd(SDHS_BASE + OFS_SDHSCTL7, MODOPTI3 + MODOPTI2); // 0xC
             break;
         case HSPLL_OUT_76_MHZ:
         case HSPLL_OUT_75_MHZ:
         case HSPLL_OUT_74_MHZ:
-            SDHSCTL7 = MODOPTI3 + MODOPTI2 + MODOPTI0; // 0xD
+            regImageAdd(SDHS_BASE + OFS_SDHSCTL7, MODOPTI3 + MODOPTI2 + MODOPTI0); // 0xD
             break;
         case HSPLL_OUT_73_MHZ:
         case HSPLL_OUT_72_MHZ:
         case HSPLL_OUT_71_MHZ:
-            SDHSCTL7 = MODOPTI3 + MODOPTI2 + MODOPTI1; // 0xE
+            regImageAdd(SDHS_BASE + OFS_SDHSCTL7, MODOPTI3 + MODOPTI2 + MODOPTI1); // 0xE
             break;
         default:
-            SDHSCTL7 = MODOPTI3 + MODOPTI2 + MODOPTI1 + MODOPTI0; // 0xF
+            regImageAdd(SDHS_BASE + OFS_SDHSCTL7, MODOPTI3 + MODOPTI2 + MODOPTI1 + MODOPTI0); // 0xF
             break;
     }
 
     // Reset SDHSCTL4 and SDHSCTL5 registers
-    SDHSCTL4 = 0;
-    SDHSCTL5 = 0;
+    // (SDHS powered down)
+    regImageAdd(SDHS_BASE + OFS_SDHSCTL4, 0);
+    regImageAdd(SDHS_BASE + OFS_SDHSCTL5, 0);
 
-    // Configure DTC destination offset address
-    SDHSCTL4 &= ~(SDHSON);
+    // Lock SDHS registers
+    regImageAdd(SDHS_BASE + OFS_SDHSCTL3, sdhsctl3 | TRIGEN);
+
+    return true;
+}
+
+void powerDownUss(void)
+{
+    // Power Down the UUPS
+    UUPSCTL |= USSPWRDN;
+    // Power off USSXTAL
+    HSPLLUSSXTLCTL &= ~USSXTEN;
+}
+
+bool isUsKeepWarm(void)
+{
+    return keep_warm;
+}
+
+const us_acq_status_t * getUsAcqStatus(void)
+{
+    return &acq_status;
+}
+
+void clearUsAcqErrors(void)
+{
+    acq_status.flags &= US_ACQ_WARM;
+    acq_status.failedAcqs = 0;
+}
+
+// Record the error of a failed acquisition
+static bool failUsAcq(uint8_t error)
+{
+    acq_status.flags |= error;
+    if (acq_status.failedAcqs != UINT8_MAX)
+        acq_status.failedAcqs++;
+
+    return false;
+}
+
+static inline uint16_t readTimerSlow(void)
+{
+    return HWREG16(TIMER_SLOW_BASE + OFS_TAxR);
+}
+
+void setUsFrameDstOffset(uint16_t offset)
+{
+    dtc_dst_offset = offset;
+    return;
+}
+
+bool isUsWindowHit(void)
+{
+    // The flags are cleared before every acquisition (startUsAcq())
+    return (SDHSRIS & (WINHI | WINLO)) != 0;
+}
+
+static void setDtcDstAddress(void)
+{
     // Unlock SDHS registers
     SDHSCTL3 &= ~(TRIGEN);
-    //Restore SDHSDTCDA address
-    // LEA start address (0x4000)
-    // Destination location = base address + DTCDA x 2
-    SDHSDTCDA = ((uint32_t)((0x4005) - (0x4000))>>1);
+    // Destination location = LEA start address + DTCDA x 2
+    SDHSDTCDA = dtc_dst_offset >> 1;
     // Lock SDHS registers
     SDHSCTL3 |= (TRIGEN);
-
-    return true;
 }
 
 
@@ -337,75 +582,239 @@ static inline bool confPPG(void)
 {
     // Refer to the slau367p (page 498)
 
+    uint16_t lper, hper;
+
+    // Configure Drive strength
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AOCTL1,
+                (config.driveStrength << 1) + (config.driveStrength));
+
+    if (calcPpgPeriods(config.pulseFreq, &lper, &hper) != true)
+    {
+        // PPG cannot generate the selected frequency (too low)
+        return false;
+    }
+    else
+    {
+        // Start PPG Configuration
+        regImageAdd(SAPH_A_BASE + OFS_SAPH_APGC,
+                    (config.numPulses) | ((config.numStopPulses) << 8));
+
+        regImageAdd(SAPH_A_BASE + OFS_SAPH_AXPGCTL, ETY_0 | XMOD_0);
+
+        regImageAdd(SAPH_A_BASE + OFS_SAPH_APGLPER, lper);
+        regImageAdd(SAPH_A_BASE + OFS_SAPH_APGHPER, hper);
+    }
+
+    // Configure USS CH0 and CH1 to be configured by the PPG
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_AOSEL, PCH0SEL_1 | PCH1SEL_1);
+    // Trigger from ACQ, channel selection by ASQ
+    // PPG configuration done
+    regImageAdd(SAPH_A_BASE + OFS_SAPH_APGCTL, TRSEL_1 + PGSEL_1 + PPGEN);
+
+    return true;
+}
+
+// Calculate the PPG OFF and ON times (HSPLL cycles) of a pulse frequency
+static bool calcPpgPeriods(uint32_t pulseFreq, uint16_t *lper, uint16_t *hper)
+{
     uint64_t temp;
     uint32_t hspllFreq;
-    volatile uint16_t lper;
-    volatile uint16_t per, hper;
+    uint16_t per;
 
-    hspllFreq = (uint32_t)(config.pllOutFreq) * 1000000;
-
-    // Configure Drive strength
-    SAPH_AOCTL1 = ((config.driveStrength << 1) + (config.driveStrength));
+    if (pulseFreq == 0)
+        return false;
 
+    hspllFreq = (uint32_t)(config.pllOutFreq) * 1000000;
 
     // Calculate the period
-    temp = (uint64_t)((uint64_t)hspllFreq + ((uint64_t)config.pulseFreq >> 1));
-    temp /= (uint64_t)(config.pulseFreq);
+    temp = (uint64_t)((uint64_t)hspllFreq + ((uint64_t)pulseFreq >> 1));
+    temp = US_DIV_U64(temp, pulseFreq);
     per = (uint16_t) temp;
 
-
     // Calculate the ON time
     temp = (uint64_t)((uint64_t)hspllFreq * (uint64_t)config.pulsesDutyCycle);
-    temp = (uint64_t)((uint64_t)temp - ((uint64_t)(config.pulseFreq) >> 1));
-    temp /= (uint64_t)(config.pulseFreq);
-    hper = (uint16_t) ((temp + 99)/100);
+    temp = (uint64_t)((uint64_t)temp - ((uint64_t)(pulseFreq) >> 1));
+    temp = US_DIV_U64(temp, pulseFreq);
+    *hper = (uint16_t) US_DIV_U64(temp + 99, 100);
 
     // Calculate OFF time
-    lper = per - hper;
+    *lper = per - *hper;
 
     // Check for the maximum value
-    if((hper > 255) || (lper > 255))
-    {
-        // PPG cannot generate the selected frequency (too low)
+    return (*hper <= 255) && (*lper <= 255);
+}
+
+// Compute the register values of the sequence table entries
+// and which of them change from one entry to the next
+static bool prepareSeqRegs(void)
+{
+    us_seq_regs_t *regs;
+    const us_seq_config_t *seq;
+    uint8_t i;
+
+    if (config.seqLen > TX_RX_CONF_LEN_MAX)
         return false;
-    }
-    else
+
+    for (i = 0; i < config.seqLen; i++)
     {
-        // Start PPG Configuration
-        SAPH_APGC = ((config.numPulses) |
-                    ((config.numStopPulses) << 8));
+        seq = &config.seqConfigs[i];
+        regs = &seq_regs[i];
 
-        SAPH_AXPGCTL = (ETY_0 | XMOD_0);
+        regs->sdhsCtl1 = seq->overSamplRate;
+        regs->sdhsCtl2 = DTCOFF_0 + (seq->sampleSize - 1) +
+                         ((config.gateHeartbeat != 0) ? WINCMPEN_1 : WINCMPEN_0);
+        regs->sdhsCtl6 = seq->rxGain;
+        regs->apgc = ((seq->numPulses) | ((config.numStopPulses) << 8));
+        regs->aatmD = seq->startAdcSamplCnt;
 
-        SAPH_APGLPER = lper;
-        SAPH_APGHPER = hper;
+        if (calcPpgPeriods(seq->pulseFreq, &regs->apgLper, &regs->apgHper) != true)
+            return false;
     }
 
-    // Configure Trigger from ACQ, channel skection by ASQ
-    SAPH_APGCTL |= (TRSEL_1 + PGSEL_1);
-
-    // Configure USS CH0 and CH1 to be configured by the PPG
-    SAPH_AOSEL |= (PCH0SEL_1 | PCH1SEL_1);
-    // PPG configuration done
-    SAPH_APGCTL |= (PPGEN);
+    prepareSeqDeltas();
 
     return true;
 }
 
+// Registers of each sequence table entry which differ from the previous one
+static void prepareSeqDeltas(void)
+{
+    us_seq_regs_t *regs;
+    const us_seq_regs_t *prev;
+    uint8_t i;
+
+    for (i = 0; i < config.seqLen; i++)
+    {
+        regs = &seq_regs[i];
+        prev = &seq_regs[(i == 0) ? (config.seqLen - 1) : (i - 1)];
+
+        regs->delta = 0;
+        if (regs->sdhsCtl1 != prev->sdhsCtl1)
+            regs->delta |= SEQ_REG_SDHSCTL1;
+        if (regs->sdhsCtl2 != prev->sdhsCtl2)
+            regs->delta |= SEQ_REG_SDHSCTL2;
+        if (regs->sdhsCtl6 != prev->sdhsCtl6)
+            regs->delta |= SEQ_REG_SDHSCTL6;
+        if (regs->apgc != prev->apgc)
+            regs->delta |= SEQ_REG_APGC;
+        if (regs->apgLper != prev->apgLper)
+            regs->delta |= SEQ_REG_APGLPER;
+        if (regs->apgHper != prev->apgHper)
+            regs->delta |= SEQ_REG_APGHPER;
+        if (regs->aatmD != prev->aatmD)
+            regs->delta |= SEQ_REG_AATMD;
+    }
+}
+
+void applyUsSeqConfig(uint8_t seqId)
+{
+    const us_seq_regs_t *regs;
+    uint8_t mask;
+
+    if ((seqId >= config.seqLen) || (seqId == seq_applied))
+        return;
+
+    regs = &seq_regs[seqId];
+
+    // Stepping through the table only the registers that change are written,
+    // otherwise (first entry, skipped entry) all of them
+    if (seq_applied == ((seqId == 0) ? (config.seqLen - 1) : (seqId - 1)))
+        mask = regs->delta;
+    else
+        mask = SEQ_REGS_ALL;
+
+    if (mask & SEQ_REGS_SDHS)
+    {
+        // Unlock SDHS registers
+        SDHSCTL3 &= ~(TRIGEN);
+
+        if (mask & SEQ_REG_SDHSCTL1)
+            SDHSCTL1 = regs->sdhsCtl1;
+        if (mask & SEQ_REG_SDHSCTL2)
+            SDHSCTL2 = regs->sdhsCtl2;
+        if (mask & SEQ_REG_SDHSCTL6)
+            SDHSCTL6 = regs->sdhsCtl6;
+
+        // Lock SDHS registers
+        SDHSCTL3 |= (TRIGEN);
+    }
+
+    if (mask & SEQ_REGS_SAPH)
+    {
+        // Unlock SAPH
+        SAPH_AKEY = KEY;
+
+        if (mask & SEQ_REGS_PPG)
+        {
+            // The PPG is disabled while reconfigured
+            SAPH_APGCTL &= ~(PPGEN);
+
+            if (mask & SEQ_REG_APGC)
+                SAPH_APGC = regs->apgc;
+            if (mask & SEQ_REG_APGLPER)
+                SAPH_APGLPER = regs->apgLper;
+            if (mask & SEQ_REG_APGHPER)
+                SAPH_APGHPER = regs->apgHper;
+
+            SAPH_APGCTL |= (PPGEN);
+        }
+
+        if (mask & SEQ_REG_AATMD)
+            SAPH_AATM_D = regs->aatmD;
+
+        // Lock SAPH registers
+        SAPH_AKEY = 0;
+    }
+
+    seq_applied = seqId;
+}
 
 bool triggerUsAcq(void)
 {
+    startUsAcq();
+
+    // Sleep until the next transition, the interrupts only post events
+    while ((acq_state != US_ACQ_DONE) && (acq_state != US_ACQ_FAILED))
+    {
+        waitEvent(getUsAcqEvents(), false, getUsAcqLpmBits());
+        stepUsAcq();
+    }
+
+    return (acq_state == US_ACQ_DONE);
+}
+
+void startUsAcq(void)
+{
+    // USSXT, HSPLL and UUPS still powered from the previous acquisition
+    bool warm = keep_warm &&
+                ((HSPLLUSSXTLCTL & OSCSTATE_1) == OSCSTATE_1) &&
+                ((UUPSCTL & UPSTATE_3) == UPSTATE_3);
+
+    acq_status.xtalTicks = 0;
+    acq_status.uupsTicks = 0;
+    if (warm)
+        acq_status.flags |= US_ACQ_WARM;
+    else
+        acq_status.flags &= ~US_ACQ_WARM;
 
     // Configure SAPH
     // Unlock SAPH
     SAPH_AKEY = KEY;
 
-    // The ASQ sends a power down request to the
-    // PSQ (Power Sequencer) when the OFF request is received.
-    // Enbable OFF request when ASQ completes the measurement sequences
-    SAPH_AASCTL1 &= ~(STDBY);
-    // OFF request is generated after sequence
-    SAPH_AASCTL1 |= ESOFF;
+    if (keep_warm)
+    {
+        // The UUPS stays in READY state after the sequence
+        SAPH_AASCTL1 &= ~(STDBY | ESOFF);
+    }
+    else
+    {
+        // The ASQ sends a power down request to the
+        // PSQ (Power Sequencer) when the OFF request is received.
+        // Enbable OFF request when ASQ completes the measurement sequences
+        SAPH_AASCTL1 &= ~(STDBY);
+        // OFF request is generated after sequence
+        SAPH_AASCTL1 |= ESOFF;
+    }
 
     // // Lock SAPH registers
     // SAPH_AKEY = 0;
@@ -413,11 +822,6 @@ bool triggerUsAcq(void)
     // // Unlock SAPH
     // SAPH_AKEY = KEY;
 
-    // Turn on USSXTAL
-    // (Step 2 of the USSXT start-up seq)
-    // slau367p page 481
-    HSPLLUSSXTLCTL |= USSXTEN;
-
     // Clear any pending USS Interrupts
     SAPH_AICR = (DATAERR | TMFTO | SEQDN | PNGDN);
     SDHSICR = (WINLO | WINHI | DTRDY | SSTRG | ACQDONE | OVF);
@@ -427,6 +831,22 @@ bool triggerUsAcq(void)
     // Clear all event flags
     clearEventFlag(ALL_EVENTS_MASK);
 
+    if (!warm)
+    {
+        // Turn on USSXTAL
+        // (Step 2 of the USSXT start-up seq)
+        // slau367p page 481
+        HSPLLUSSXTLCTL |= USSXTEN;
+        acq_t_phase = readTimerSlow();
+
+        // Check the USSXT after its start-up time, the rest of the
+        // set-up runs meanwhile
+        // (Step 3 of the USSXT start-up seq)
+        acq_retries = 0;
+        acq_state = US_ACQ_XTAL_STARTUP;
+        armStartupCheck(US_XTAL_STARTUP_TICKS);
+    }
+
     // Enable interrupts
     UUPSIMSC |= (PTMOUT | STPBYDB);
     HSPLLIMSC |= (PLLUNLOCK);
@@ -436,75 +856,187 @@ bool triggerUsAcq(void)
     // Clear ISTOP bit before triggering capture
     SDHSICR |= (ISTOP);
 
+    // DTC destination of this frame
+    setDtcDstAddress();
+
     // Clear current sequence selection early bias switch selection
     SAPH_ABCTL &= ~(CH1EBSW | CH0EBSW);
     // Clear current input multiplexer channel selection
     SAPH_AICTL0 &= ~(MUXSEL_15);
 
     // CH0 TX , CH0 RX
-    // ASQ is triggered in software
-    SAPH_AASCTL0 = (TRIGSEL_0 | ASQTEN);
+    // ASQ is triggered in software or by the fast timer output
+    if (config.triggerMode == US_TRIGGER_TIMER)
+    {
+        SAPH_AASCTL0 = (TRIGSEL__TIMER | ASQTEN);
+    }
+    else
+    {
+        SAPH_AASCTL0 = (TRIGSEL__SWTRIG | ASQTEN);
+    }
     SAPH_ABCTL &= ~(ASQBSC);
     SAPH_ABCTL |= (PGABSW);
     SAPH_AASCTL1 |= (CHOWN);
     // Select Rx Mux input channel_0
     SAPH_AICTL0 |= (MUXSEL_0);
 
-    // Wait for the USSXTLCTL start-up time
-    // (Step 3 of the USSXT start-up seq)
-    // ~120 us delay
-    timerSlowDelay(4, LPM3_bits);
-
-    // Before powering up the USS module wait for USSXT
-    // oscillator to start-up (OSCSTATE bit)
-    // (Step 4 of the USSXT start-up seq)
-    uint8_t ussxtl_timeout = 0;
-    while((HSPLLUSSXTLCTL & OSCSTATE_1) != OSCSTATE_1)
+    // Work that overlaps with the USSXT start-up (e.g. the HV MUX),
+    // it must be done before the trigger
+    if (US_ACQ_START_CALLBACK)
     {
-        if (ussxtl_timeout > 5)
-        {
-            // XTAL start-up issue
-            // Power Down the XTAL
-            HSPLLUSSXTLCTL &= ~(USSXTEN);
-            return false;
-        }
-
-        // ~ 30 us delay
-        timerSlowDelay(1, LPM3_bits);
-        ussxtl_timeout++;
+        US_ACQ_START_CALLBACK();
     }
 
-    // (Step 5 of the USSXT start-up seq)
-    // Turn on USS Power and PLL and start measurement
-    UUPSCTL |= USSPWRUP;
+    if (warm)
+    {
+        startUsSequence();
+    }
+}
 
-    // Wait until UUPS module is in READY state
-    // (Ideally can be done after a low-power delay)
-    uint8_t uups_timeout = 0;
-    while((UUPSCTL & UPSTATE_3) != UPSTATE_3)
+us_acq_state_t stepUsAcq(void)
+{
+    switch (acq_state)
     {
-        if (uups_timeout > 5)
-        {
-            // UUPS start-up issue
-            // Power Down the UUPS
-            UUPSCTL |= USSPWRDN;
-            return false;
-        }
+        case US_ACQ_XTAL_STARTUP:
+            if (isEventFlagSet(TIMER_SLOW_CCR1_EVENT) == false)
+                break;
+            clearEventFlag(TIMER_SLOW_CCR1_EVENT);
+
+            // Before powering up the USS module wait for USSXT
+            // oscillator to start-up (OSCSTATE bit)
+            // (Step 4 of the USSXT start-up seq)
+            if ((HSPLLUSSXTLCTL & OSCSTATE_1) != OSCSTATE_1)
+            {
+                if (acq_retries++ < US_STARTUP_RETRIES)
+                {
+                    armStartupCheck(US_STARTUP_RETRY_TICKS);
+                    break;
+                }
+
+                // XTAL start-up issue
+                // Power Down the XTAL
+                HSPLLUSSXTLCTL &= ~(USSXTEN);
+                abortUsAcq(US_ACQ_ERR_XTAL);
+                break;
+            }
+
+            // (Step 5 of the USSXT start-up seq)
+            // Turn on USS Power and PLL and check it after its power-up time
+            acq_status.xtalTicks = readTimerSlow() - acq_t_phase;
+            UUPSCTL |= USSPWRUP;
+            acq_t_phase = readTimerSlow();
+
+            acq_retries = 0;
+            acq_state = US_ACQ_UUPS_POWERUP;
+            armStartupCheck(US_UUPS_POWERUP_TICKS);
+            break;
 
-        // ~ 30 us delay
-        timerSlowDelay(1, LPM3_bits);
-        uups_timeout++;
+        case US_ACQ_UUPS_POWERUP:
+            if (isEventFlagSet(UUPS_PWR_UP_TIMEOUT_EVENT) == true)
+            {
+                // Power-up timeout reported by the UUPS itself
+                powerDownUss();
+                abortUsAcq(US_ACQ_ERR_UUPS);
+                break;
+            }
+            if (isEventFlagSet(TIMER_SLOW_CCR1_EVENT) == false)
+                break;
+            clearEventFlag(TIMER_SLOW_CCR1_EVENT);
+
+            // Wait until UUPS module is in READY state
+            if ((UUPSCTL & UPSTATE_3) != UPSTATE_3)
+            {
+                if (acq_retries++ < US_STARTUP_RETRIES)
+                {
+                    armStartupCheck(US_STARTUP_RETRY_TICKS);
+                    break;
+                }
+
+                // UUPS start-up issue
+                // Power Down the UUPS and the XTAL
+                powerDownUss();
+                abortUsAcq(US_ACQ_ERR_UUPS);
+                break;
+            }
+
+            acq_status.uupsTicks = readTimerSlow() - acq_t_phase;
+            disarmStartupCheck();
+            startUsSequence();
+            break;
+
+        case US_ACQ_SEQUENCE:
+            if (isEventFlagSet(ACQ_SEQUENCE_EVENTS) == true)
+                finishUsSequence();
+            break;
+
+        default:
+            break;
     }
 
+    return acq_state;
+}
+
+uint32_t getUsAcqEvents(void)
+{
+    if (acq_state == US_ACQ_SEQUENCE)
+        return ACQ_SEQUENCE_EVENTS;
+
+    return ACQ_STARTUP_EVENTS;
+}
+
+uint16_t getUsAcqLpmBits(void)
+{
+    // The fast timer runs from SMCLK, the start-up checks from ACLK
+    if (acq_state == US_ACQ_SEQUENCE)
+        return LPM0_bits;
+
+    return LPM3_bits;
+}
+
+// Check the start-up phase on the slow timer CC1 without halting the timer,
+// ticks >= 2 as TAR may advance between the read and the CCR1 write
+static void armStartupCheck(uint16_t ticks)
+{
+    timerSetCcReg(TIMER_SLOW_BASE,
+                  ticks,
+                  OFS_TAxCCR1,
+                  true,
+                  false);
+
+    HWREG16(TIMER_SLOW_BASE + OFS_TAxCCTL1) &= ~(CCIFG);
+    clearEventFlag(TIMER_SLOW_CCR1_EVENT);
+    HWREG16(TIMER_SLOW_BASE + OFS_TAxCCTL1) |= (CCIE);
+}
+
+static void disarmStartupCheck(void)
+{
+    HWREG16(TIMER_SLOW_BASE + OFS_TAxCCTL1) &= ~(CCIE | CCIFG);
+    clearEventFlag(TIMER_SLOW_CCR1_EVENT);
+}
+
+static bool abortUsAcq(uint8_t error)
+{
+    disarmStartupCheck();
+    acq_state = US_ACQ_FAILED;
+
+    return failUsAcq(error);
+}
+
+static void startUsSequence(void)
+{
+    // Time stamp of the acquisition
+    acq_status.tTrigger = timerSlowGetTimestamp();
+    acq_state = US_ACQ_SEQUENCE;
+
     // Trigger through the timer interrupt
     // This helps to synchronize the start with the other time-sensitive SW events
     // Such as switching HV MUX to RX
     startTimerFast();
+}
 
-    // Wait for any of the events
-    waitEvent((SAPH_SEQ_ACQ_DONE_EVENT)  ||
-              (UUPS_INTERRUPT_DBG_EVENT) ||
-              (HS_PLL_UNLOCK_EVENT), false, LPM0_bits);
+static void finishUsSequence(void)
+{
+    acq_status.seqTicks = readTimerSlow() - (uint16_t) acq_status.tTrigger;
 
     // Configure GPIOs after conversion
     // E.g. disable OPA
@@ -513,31 +1045,34 @@ bool triggerUsAcq(void)
     {
         // Power Down the UUPS
         UUPSCTL |= USSPWRDN;
-        return false;
+        abortUsAcq(US_ACQ_ERR_PLL_UNLOCK);
+        return;
     }
     else if (isEventFlagSet(UUPS_INTERRUPT_DBG_EVENT) == true)
     {
-        return false;
+        abortUsAcq(US_ACQ_ERR_UUPS_INT);
+        return;
+    }
+    else if (isEventFlagSet(SAPH_SEQ_ACQ_DONE_EVENT) == false)
+    {
+        // Capture timed out or data error, the frame is not valid
+        powerDownUss();
+        abortUsAcq(isEventFlagSet(SAPH_DATA_ERROR_EVENT) ?
+                   US_ACQ_ERR_DATA : US_ACQ_ERR_TIMEOUT);
+        return;
     }
 
-    // Power Down the UUPS after the acquisition is complete
-    UUPSCTL |= USSPWRDN;
-
-    // Power off USSXTAL
-    HSPLLUSSXTLCTL &= ~USSXTEN;
+    if (!keep_warm)
+    {
+        // Power Down the UUPS after the acquisition is complete
+        // and power off USSXTAL
+        powerDownUss();
+    }
 
     // Power down SDHS
     SDHSCTL4 &= ~(SDHSON);
-    // Unlock SDHS registers
-    SDHSCTL3 &= ~(TRIGEN);
-    // Restore SDHSDTCDA address
-    // LEA start address (0x4000)
-    // Destination location = base address + DTCDA x 2
-    SDHSDTCDA = ((uint32_t)((0x4005) - (0x4000))>>1);
-    // Lock SDHS registers
-    SDHSCTL3 |= (TRIGEN);
 
-    return true;
+    acq_state = US_ACQ_DONE;
 }
 
 void pllUnlockCallback(void)
@@ -569,19 +1104,29 @@ void confTimerSlowSwEvents(void)
     // Stop Slow Timer
     timerStop(TIMER_SLOW_BASE);
 
-    // Configure measurement period
-    timerSetCcReg(TIMER_SLOW_BASE,
-                  config.measPeriod,
-                  OFS_TAxCCR0,
-                  true,
-                  false);
-
-    // Configure the time to enable DC-DC converter
-    timerSetCcReg(TIMER_SLOW_BASE,
-                  config.dcDcTurnOnTime,
-                  OFS_TAxCCR2,
-                  true,
-                  false);
+    if (config.measPeriod > 0xFFFF)
+    {
+        // Long period, counted in steps
+        period_left = config.measPeriod;
+        dcdc_left = config.dcDcTurnOnTime;
+        scheduleTimerSlowStep(HWREG16(TIMER_SLOW_BASE + OFS_TAxR));
+    }
+    else
+    {
+        // Configure measurement period
+        timerSetCcReg(TIMER_SLOW_BASE,
+                      (uint16_t) config.measPeriod,
+                      OFS_TAxCCR0,
+                      true,
+                      false);
+
+        // Configure the time to enable DC-DC converter
+        timerSetCcReg(TIMER_SLOW_BASE,
+                      (uint16_t) config.dcDcTurnOnTime,
+                      OFS_TAxCCR2,
+                      true,
+                      false);
+    }
 
     // Clear interrupt flags
     timerClearCcIntFlag(TIMER_SLOW_BASE, OFS_TAxCCTL0);
@@ -599,17 +1144,73 @@ void reloadTimerSlowSwEvents(void)
 {
     uint16_t counter;
 
+    // Intermediate step of a long period: schedule the next step from
+    // the last compare, no event for the CPU
+    if (period_left != 0)
+    {
+        scheduleTimerSlowStep(HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR0));
+        clearEventFlag(TIMER_SLOW_CCR0_EVENT);
+        return;
+    }
+
     counter = HWREG16(TIMER_SLOW_BASE + OFS_TAxR);
 
+    if (config.measPeriod > 0xFFFF)
+    {
+        period_left = config.measPeriod;
+        dcdc_left = config.dcDcTurnOnTime;
+        scheduleTimerSlowStep(counter);
+        return;
+    }
+
     // Reload measurement period
-    HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR0) = counter + config.measPeriod;
+    HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR0) = counter + (uint16_t) config.measPeriod;
 
     // Reload DC-DC turn on time
-    HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR2) = counter + config.dcDcTurnOnTime;
+    HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR2) = counter + (uint16_t) config.dcDcTurnOnTime;
 
     return;
 }
 
+// Schedule the next step of a long measurement period starting at base.
+// The last two steps share the rest of the period, at least
+// US_SLOW_TIMER_STEP_MAX / 2 ticks each: a step of a few ticks could be
+// passed by the counter before its compare is set in the ISR and would only
+// match after a wrap of the timer. The DC-DC compare is set in the step the turn-on falls into and parked
+// one tick behind the counter otherwise, where it only matches after the
+// step has ended.
+static void scheduleTimerSlowStep(uint16_t base)
+{
+    uint16_t step = US_SLOW_TIMER_STEP_MAX;
+
+    if (period_left <= US_SLOW_TIMER_STEP_MAX)
+    {
+        step = (uint16_t) period_left;
+    }
+    else if (period_left < 2 * (uint32_t) US_SLOW_TIMER_STEP_MAX)
+    {
+        step = (uint16_t) (period_left / 2);
+    }
+    period_left -= step;
+
+    if (dcdc_left <= step)
+    {
+        HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR2) = base + (uint16_t) dcdc_left;
+        // Turned on once per period
+        dcdc_left = UINT32_MAX;
+    }
+    else
+    {
+        HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR2) = base - 1;
+        if (dcdc_left != UINT32_MAX)
+        {
+            dcdc_left -= step;
+        }
+    }
+
+    HWREG16(TIMER_SLOW_BASE + OFS_TAxCCR0) = base + step;
+}
+
 void pauseTimerSlowSwEvents(void)
 {
     // Disable interrupts associated with US acquisition
@@ -645,7 +1246,11 @@ void confTimerFastSwEvents(void)
 
     // Configure the time to enable HV MUX
     // switching to receive mode
+    // With the timer trigger the timer is not restarted at the trigger,
+    // so the time is counted from the start of the timer
     timerSetCcReg(TIMER_FAST_BASE,
+                  (config.triggerMode == US_TRIGGER_TIMER) ?
+                  (ACQUIS_START_DELAY_SMCLK_CYCLES + config.startHvMuxRxCnt) :
                   config.startHvMuxRxCnt,
                   OFS_TAxCCR0,
                   false,
@@ -656,7 +1261,10 @@ void confTimerFastSwEvents(void)
     timerClearCcIntFlag(TIMER_FAST_BASE, OFS_TAxCCTL1);
 
     // Enable interrupts
-    timerEnableCcInt(TIMER_FAST_BASE, OFS_TAxCCTL1);
+    if (config.triggerMode == US_TRIGGER_SOFTWARE)
+    {
+        timerEnableCcInt(TIMER_FAST_BASE, OFS_TAxCCTL1);
+    }
     // Interrupt CC0 is enabled later
     return;
 }
@@ -667,8 +1275,21 @@ void startTimerFast(void)
     timerClearCcIntFlag(TIMER_FAST_BASE, OFS_TAxCCTL0);
     timerClearCcIntFlag(TIMER_FAST_BASE, OFS_TAxCCTL1);
 
-    timerEnableCcInt(TIMER_FAST_BASE, OFS_TAxCCTL1);
-    timerDisableCcInt(TIMER_FAST_BASE, OFS_TAxCCTL0);
+    if (config.triggerMode == US_TRIGGER_TIMER)
+    {
+        // CC1 output is set on CCR1 match, the rising edge
+        // triggers the ASQ in HW. Drive the output low first.
+        HWREG16(TIMER_FAST_BASE + OFS_TAxCCTL1) = OUTMOD_0;
+        HWREG16(TIMER_FAST_BASE + OFS_TAxCCTL1) = OUTMOD_1;
+
+        // CC0 (HV MUX switching) is armed from the start
+        timerEnableCcInt(TIMER_FAST_BASE, OFS_TAxCCTL0);
+    }
+    else
+    {
+        timerEnableCcInt(TIMER_FAST_BASE, OFS_TAxCCTL1);
+        timerDisableCcInt(TIMER_FAST_BASE, OFS_TAxCCTL0);
+    }
 
     // Start timer in continuous mode from 0
     timerSetCcReg(TIMER_FAST_BASE, 0,
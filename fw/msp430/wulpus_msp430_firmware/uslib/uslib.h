@@ -180,9 +180,135 @@ typedef enum
 
 } pga_gain_t;
 
+// Acquisition trigger source typedef
+typedef enum
+{
+    // ASQ is triggered by SW in the fast timer CC1 interrupt
+    US_TRIGGER_SOFTWARE,
+    // ASQ is triggered by the fast timer CC1 output (no interrupt latency)
+    US_TRIGGER_TIMER,
+
+} us_trigger_mode_t;
+
+// Processing of the samples before the SPI transfer (see uslib_dsp.h)
+typedef enum
+{
+    US_DSP_OFF,
+    US_DSP_ENVELOPE,
+
+} us_dsp_mode_t;
+
+// Output of the coherent averaging (see uslib_dsp.h)
+typedef enum
+{
+    US_AVG_MEAN16,
+    US_AVG_SUM32,
+
+} us_avg_output_t;
+
+// Packing of the samples in the SPI frame (see uslib_dsp.h)
+typedef enum
+{
+    US_PACK_OFF,        // 16-bit samples
+    US_PACK_12BIT,      // 2 samples in 3 Bytes
+    US_PACK_LOG8,       // 1 Byte per sample, log-compressed
+
+} us_pack_mode_t;
+
+// Acquisition settings of one entry of the sequence table
+// (one entry per TX/RX config)
+typedef struct
+{
+    sdhs_over_sampl_rate_t overSamplRate;
+    // Depth window: start of the ADC sampling and sample size
+    uint16_t startAdcSamplCnt;
+    uint16_t sampleSize;
+    uint8_t  rxGain;
+    uint32_t pulseFreq;
+    uint8_t  numPulses;
+
+} us_seq_config_t;
+
+// Status flags of the acquisitions (see getUsAcqStatus())
+// Last acquisition started without the USSXT and UUPS start-up
+#define US_ACQ_WARM            (1 << 0)
+// Errors of failed acquisitions, kept until clearUsAcqErrors()
+#define US_ACQ_ERR_XTAL        (1 << 1)
+#define US_ACQ_ERR_UUPS        (1 << 2)
+#define US_ACQ_ERR_PLL_UNLOCK  (1 << 3)
+#define US_ACQ_ERR_UUPS_INT    (1 << 4)
+#define US_ACQ_ERR_DATA        (1 << 5)
+#define US_ACQ_ERR_TIMEOUT     (1 << 6)
+
+// Time stamps and status of the acquisitions, phases in ACLK ticks
+// (the fast timer only runs from the trigger to the HV MUX switching)
+typedef struct
+{
+    // Slow timer count at the trigger, overflows in the upper 16 bits
+    uint32_t tTrigger;
+    // USSXTEN -> OSCSTATE and USSPWRUP -> UUPS ready, 0 if warm
+    uint16_t xtalTicks;
+    uint16_t uupsTicks;
+    // Time stamp -> sequence done (includes the trigger delay)
+    uint16_t seqTicks;
+    uint8_t  flags;
+    // Failed acquisitions, kept until clearUsAcqErrors()
+    uint8_t  failedAcqs;
+
+} us_acq_status_t;
+
+// States of an acquisition, see stepUsAcq()
+typedef enum
+{
+    US_ACQ_IDLE,
+    // USSXTEN set, OSCSTATE checked on the slow timer CC1
+    US_ACQ_XTAL_STARTUP,
+    // USSPWRUP set, UUPS READY checked on the slow timer CC1
+    US_ACQ_UUPS_POWERUP,
+    // Fast timer started, waiting for the ASQ (SEQDN or an error)
+    US_ACQ_SEQUENCE,
+    US_ACQ_DONE,
+    US_ACQ_FAILED,
+
+} us_acq_state_t;
+
 // Around 9 uS
 #define ACQUIS_START_DELAY_SMCLK_CYCLES    72
 
+// Start of the LEA RAM, where the SDHS DTC places the US frame
+#ifndef LEA_RAM_START_ADDR
+#define LEA_RAM_START_ADDR    (0x4000)
+#endif
+
+// USSXT, HSPLL and UUPS are kept powered between acquisitions if the
+// measurement period is shorter (ACLK ticks, default 5 ms). With longer
+// periods they are powered down after every acquisition.
+#ifndef US_KEEP_WARM_PERIOD_MAX
+#define US_KEEP_WARM_PERIOD_MAX    (164)
+#endif
+
+// Start-up checks of USSXT (OSCSTATE) and UUPS (READY) in ACLK ticks.
+// Neither raises an interrupt when ready: each is checked once after its
+// typical start-up time, then up to US_STARTUP_RETRIES times more.
+#define US_XTAL_STARTUP_TICKS      (6)     // ~180 us
+#define US_UUPS_POWERUP_TICKS      (4)     // ~120 us
+#define US_STARTUP_RETRY_TICKS     (2)     // ~60 us, at least 2
+#define US_STARTUP_RETRIES         (3)
+
+// Measurement periods longer than the 16-bit slow timer range are counted
+// in steps of at most this many ACLK ticks (1 s), and at least half as many.
+// Only the last step of a period wakes up the CPU.
+#define US_SLOW_TIMER_STEP_MAX     (0x8000)
+
+// 64-bit unsigned division (runtime library call on the MSP430)
+#ifndef US_DIV_U64
+#define US_DIV_U64(num, den)    ((uint64_t)(num) / (uint64_t)(den))
+#endif
+
+// Default DTC destination (LEA RAM offset in Bytes), leaves room for the
+// 4 Bytes frame header
+#define US_FRAME_DST_OFFSET_DEFAULT    (4)
+
 // MSP ultrasound sybsystem configuration struct
 typedef struct
 {
@@ -208,20 +334,56 @@ typedef struct
 
     // Extra time events (SW-managed)
     uint16_t startHvMuxRxCnt;
-    uint16_t dcDcTurnOnTime;
+    uint32_t dcDcTurnOnTime;
 
 
     // Acquisition settings
     sdhs_over_sampl_rate_t overSamplRate;
     uint16_t sampleSize;
     uint8_t  rxGain;
-    uint16_t measPeriod;
+    uint32_t measPeriod;
+    us_trigger_mode_t triggerMode;
 
     // TX/RX configurations
     uint8_t  txRxConfLen;
     uint16_t txConfigs[TX_RX_CONF_LEN_MAX];
     uint16_t rxConfigs[TX_RX_CONF_LEN_MAX];
 
+    // Sequence table, overrides the acquisition and pulser settings
+    // per TX/RX config. 0 - the global settings are used for all configs
+    uint8_t  seqLen;
+    us_seq_config_t seqConfigs[TX_RX_CONF_LEN_MAX];
+
+    // On-device processing, decimation by 2^dspLog2Dec
+    us_dsp_mode_t dspMode;
+    uint8_t  dspLog2Dec;
+
+    // Coherent averaging of 2^avgLog2Shots acquisitions per frame
+    uint8_t  avgLog2Shots;
+    us_avg_output_t avgOutput;
+
+    // Packing of the raw or averaged samples in the frame
+    us_pack_mode_t packMode;
+
+    // Burst mode: burstLen frames are acquired one measurement period
+    // apart and sent afterwards. 0 - every frame is sent right away
+    uint8_t  burstLen;
+
+    // Threshold gating: a frame is only sent if one of the samples
+    // [gateStart, gateStart + gateLen) lies outside +-gateThreshold
+    // (SDHS window comparator), otherwise a heartbeat header is sent after
+    // gateHeartbeat quiet frames. gateLen 0 - up to the end of the frame,
+    // gateHeartbeat 0 - every frame is sent (no gating)
+    uint16_t gateThreshold;
+    uint16_t gateStart;
+    uint16_t gateLen;
+    uint8_t  gateHeartbeat;
+
+    // Frames carry the extended header (time stamp, phase timing, status)
+    bool     extHeader;
+    // CRC-16 of the configuration package, sent in the extended header
+    uint16_t confHash;
+
     // Pulser settings
     ppg_drive_strength_t driveStrength;
 
@@ -237,10 +399,42 @@ typedef struct
 
 //// High-level Ultrasound routines /////
 
+// Called by startUsAcq() once the USSXT start-up has begun, before the
+// trigger. Runs in the acquisition context, not in an interrupt.
+extern void (*US_ACQ_START_CALLBACK)(void);
+
 void setNewUsConfig(msp_config_t *newConfig);
 bool confUsSubsystem(void);
+// Take over the gains, numbers of pulses, measurement period and DC-DC
+// turn-on time of newConfig between two acquisitions, without
+// confUsSubsystem(). All other settings must be unchanged.
+void patchUsConfig(const msp_config_t *newConfig);
 static inline bool confPPG(void);
+// Acquire one frame, sleeps between the transitions of the acquisition.
+// Returns false if the acquisition failed (see getUsAcqStatus()).
 bool triggerUsAcq(void);
+// Non-blocking steps of triggerUsAcq(): start the acquisition, then call
+// stepUsAcq() whenever one of getUsAcqEvents() is set, sleeping in
+// getUsAcqLpmBits() in between, until it returns US_ACQ_DONE or US_ACQ_FAILED
+void startUsAcq(void);
+us_acq_state_t stepUsAcq(void);
+uint32_t getUsAcqEvents(void);
+uint16_t getUsAcqLpmBits(void);
+// Apply the settings of a sequence table entry (between acquisitions)
+void applyUsSeqConfig(uint8_t seqId);
+// Power down USSXT, HSPLL and UUPS (e.g. before leaving the acquisition loop)
+void powerDownUss(void);
+// True if USSXT, HSPLL and UUPS stay powered between acquisitions
+bool isUsKeepWarm(void);
+// Set the LEA RAM offset (Bytes) where the DTC places the next US frame
+void setUsFrameDstOffset(uint16_t offset);
+// True if a sample of the last acquisition lay outside the window of the
+// SDHS window comparator (+-gateThreshold)
+bool isUsWindowHit(void);
+// Time stamps and status of the last acquisition
+const us_acq_status_t * getUsAcqStatus(void);
+// Clear the errors and the count of failed acquisitions
+void clearUsAcqErrors(void);
 
 //// Helper-Ultrasound functions ////
 
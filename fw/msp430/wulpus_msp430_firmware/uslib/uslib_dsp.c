@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "uslib_dsp.h"
+
+// Center tap of the bandpass filter
+#define BP_CENTER    ((US_DSP_BP_TAPS - 1) / 2)
+
+// sin(i * pi / 128) in Q15, i = 0..64 (quarter wave)
+static const int16_t sin_table[65] =
+{
+        0,   804,  1608,  2410,  3212,  4011,  4808,  5602,
+     6393,  7179,  7962,  8739,  9512, 10278, 11039, 11793,
+    12539, 13279, 14010, 14732, 15446, 16151, 16846, 17530,
+    18204, 18868, 19519, 20159, 20787, 21403, 22005, 22594,
+    23170, 23731, 24279, 24811, 25329, 25832, 26319, 26790,
+    27245, 27683, 28105, 28510, 28898, 29268, 29621, 29956,
+    30273, 30571, 30852, 31113, 31356, 31580, 31785, 31971,
+    32137, 32285, 32412, 32521, 32609, 32678, 32728, 32757,
+    32767,
+};
+
+static us_dsp_mode_t dsp_mode = US_DSP_OFF;
+static uint8_t dsp_log2_dec = 0;
+
+// Bandpass filter of each TX/RX config (one set without sequence table)
+static int16_t bp_coeffs[TX_RX_CONF_LEN_MAX][US_DSP_BP_TAPS];
+static uint8_t bp_sets = 0;
+
+static uint8_t avg_log2_shots = 0;
+static us_avg_output_t avg_output = US_AVG_MEAN16;
+
+static us_pack_mode_t pack_mode = US_PACK_OFF;
+
+static int16_t gate_threshold = 0;
+static uint16_t gate_start = 0;
+static uint16_t gate_len = 0;
+
+// Accumulator of the coherent averaging, next to the frame slots
+#pragma DATA_SECTION(avg_acc, ".leaRAM")
+static int32_t avg_acc[US_AVG_SAMPLES_MAX];
+
+// Sine of a phase in 1/65536 turns, Q15
+static int16_t sinQ15(uint16_t phase)
+{
+    uint16_t p = phase & 0x3FFF;
+    uint16_t idx;
+    int16_t val;
+
+    // Second and fourth quadrant are mirrored
+    if (phase & 0x4000)
+        p = 0x4000 - p;
+
+    idx = p >> 8;
+    val = sin_table[idx];
+    if (idx < 64)
+        val += (int16_t)(((int32_t)(sin_table[idx + 1] - val) * (p & 0xFF)) >> 8);
+
+    return (phase & 0x8000) ? -val : val;
+}
+
+static int16_t cosQ15(uint16_t phase)
+{
+    return sinQ15(phase + 0x4000);
+}
+
+void designUsDspBandpass(int16_t *coeffs, uint16_t centerFreqKhz,
+                         uint16_t samplFreqKhz)
+{
+    // Phase step per sample in 1/65536 turns
+    uint16_t step = (uint16_t)(((uint32_t)centerFreqKhz << 16) / samplFreqKhz);
+    int32_t gain = 0;
+    int16_t k;
+
+    for (k = 0; k < US_DSP_BP_TAPS; k++)
+    {
+        // Hann window (1 - cos(2 pi (k + 1) / (taps + 1))) / 2
+        int16_t win = (int16_t)((32767 - (int32_t)cosQ15((uint16_t)
+                      (((uint32_t)(k + 1) << 16) / (US_DSP_BP_TAPS + 1)))) >> 1);
+        int16_t c = cosQ15((uint16_t)((uint32_t)step * (uint16_t)(k - BP_CENTER)));
+
+        coeffs[k] = (int16_t)(((int32_t)win * c) >> 15);
+        // Gain at the center frequency, Q15
+        gain += ((int32_t)coeffs[k] * c) >> 15;
+    }
+
+    // Unity gain at the center frequency
+    if (gain <= 0)
+        gain = 1;
+
+    for (k = 0; k < US_DSP_BP_TAPS; k++)
+    {
+        coeffs[k] = (int16_t)(((int32_t)coeffs[k] * 32768) / gain);
+    }
+}
+
+void confUsDsp(const msp_config_t *config)
+{
+    uint8_t i;
+
+    dsp_mode = config->dspMode;
+    dsp_log2_dec = config->dspLog2Dec;
+    avg_log2_shots = config->avgLog2Shots;
+    avg_output = config->avgOutput;
+    pack_mode = config->packMode;
+    gate_threshold = (int16_t) config->gateThreshold;
+    gate_start = config->gateStart;
+    gate_len = config->gateLen;
+
+    if (dsp_mode == US_DSP_OFF)
+        return;
+
+    bp_sets = (config->seqLen != 0) ? config->seqLen : 1;
+
+    for (i = 0; i < bp_sets; i++)
+    {
+        uint32_t pulse_freq = config->pulseFreq;
+        sdhs_over_sampl_rate_t osr = config->overSamplRate;
+
+        if (config->seqLen != 0)
+        {
+            pulse_freq = config->seqConfigs[i].pulseFreq;
+            osr = config->seqConfigs[i].overSamplRate;
+        }
+
+        // Sampling frequency = PLL output / (10 * 2^OSR)
+        designUsDspBandpass(bp_coeffs[i], (uint16_t)(pulse_freq / 1000),
+                            (uint16_t)((uint32_t)config->pllOutFreq * 100 >> osr));
+    }
+}
+
+bool averageUsShot(int16_t *samples, uint16_t numSamples, uint8_t shot)
+{
+    int32_t *out;
+    int32_t round;
+    uint16_t n;
+
+    if (avg_log2_shots == 0)
+        return true;
+
+    if (numSamples > US_AVG_SAMPLES_MAX)
+        numSamples = US_AVG_SAMPLES_MAX;
+
+    if (shot == 0)
+    {
+        for (n = 0; n < numSamples; n++)
+            avg_acc[n] = samples[n];
+    }
+    else
+    {
+        for (n = 0; n < numSamples; n++)
+            avg_acc[n] += samples[n];
+    }
+
+    if (shot != (1u << avg_log2_shots) - 1)
+        return false;
+
+    if (avg_output == US_AVG_SUM32)
+    {
+        // The frame slot has room for the 32-bit sums
+        out = (int32_t *) samples;
+        for (n = 0; n < numSamples; n++)
+            out[n] = avg_acc[n];
+    }
+    else
+    {
+        round = (int32_t)1 << (avg_log2_shots - 1);
+        for (n = 0; n < numSamples; n++)
+            samples[n] = (int16_t)((avg_acc[n] + round) >> avg_log2_shots);
+    }
+
+    return true;
+}
+
+uint16_t processUsFrame(int16_t *samples, uint16_t numSamples, uint8_t seqId)
+{
+    // Delay line, the output overwrites the input behind it
+    int16_t hist[US_DSP_BP_TAPS] = {0};
+    const int16_t *h;
+    uint16_t block_mask = (1u << dsp_log2_dec) - 1;
+    uint16_t n_out = 0;
+    int32_t sum = 0;
+    uint16_t n;
+    uint8_t pos = 0;
+    uint8_t k;
+
+    if (dsp_mode == US_DSP_OFF)
+        return numSamples;
+
+    h = bp_coeffs[(seqId < bp_sets) ? seqId : 0];
+
+    for (n = 0; n < numSamples; n++)
+    {
+        uint8_t new_idx = pos;
+        uint8_t old_idx;
+        int32_t acc = 0;
+
+        hist[pos] = samples[n];
+        pos = (pos == US_DSP_BP_TAPS - 1) ? 0 : pos + 1;
+        // Oldest sample x[n - taps + 1]
+        old_idx = pos;
+
+        // Symmetric filter: pairs of samples share one coefficient.
+        // The SDHS delivers 12-bit samples, the sums cannot overflow.
+        for (k = 0; k < BP_CENTER; k++)
+        {
+            US_DSP_MAC(acc, h[k], (int32_t)hist[new_idx] + hist[old_idx]);
+            new_idx = (new_idx == 0) ? US_DSP_BP_TAPS - 1 : new_idx - 1;
+            old_idx = (old_idx == US_DSP_BP_TAPS - 1) ? 0 : old_idx + 1;
+        }
+        US_DSP_MAC(acc, h[BP_CENTER], hist[new_idx]);
+
+        // Round, saturate and rectify
+        acc = (acc + 0x4000) >> 15;
+        if (acc < 0)
+            acc = -acc;
+        if (acc > 32767)
+            acc = 32767;
+
+        sum += acc;
+        if ((n & block_mask) == block_mask)
+        {
+            samples[n_out++] = (int16_t)(sum >> dsp_log2_dec);
+            sum = 0;
+        }
+    }
+
+    return n_out;
+}
+
+bool gateUsFrame(const int16_t *samples, uint16_t numSamples)
+{
+    uint16_t end = numSamples;
+    uint16_t n;
+
+    // Depth range within the samples of this frame
+    if ((gate_len != 0) && ((uint32_t) gate_start + gate_len < numSamples))
+        end = gate_start + gate_len;
+
+    for (n = gate_start; n < end; n++)
+    {
+        if ((samples[n] > gate_threshold) || (samples[n] < -gate_threshold))
+            return true;
+    }
+
+    return false;
+}
+
+uint16_t packUsFrame(int16_t *samples, uint16_t numSamples)
+{
+    // The output is never ahead of the input, in place from the start
+    uint8_t *out = (uint8_t *) samples;
+    uint16_t n;
+
+    switch (pack_mode)
+    {
+        case US_PACK_12BIT:
+            for (n = 0; n + 1 < numSamples; n += 2)
+            {
+                uint16_t a = (uint16_t) samples[n] & 0x0FFF;
+                uint16_t b = (uint16_t) samples[n + 1] & 0x0FFF;
+
+                *out++ = (uint8_t) a;
+                *out++ = (uint8_t) ((a >> 8) | (b << 4));
+                *out++ = (uint8_t) (b >> 4);
+            }
+            if (n < numSamples)
+            {
+                uint16_t a = (uint16_t) samples[n] & 0x0FFF;
+
+                *out++ = (uint8_t) a;
+                *out++ = (uint8_t) (a >> 8);
+            }
+            return (uint16_t) (out - (uint8_t *) samples);
+
+        case US_PACK_LOG8:
+            for (n = 0; n < numSamples; n++)
+            {
+                int16_t x = samples[n];
+                uint16_t mag = (x < 0) ? (uint16_t) -x : (uint16_t) x;
+                uint8_t exp = 1;
+
+                if (mag > 2047)
+                    mag = 2047;
+
+                // Linear below 32, then 16 steps per octave
+                if (mag < 32)
+                {
+                    out[n] = (uint8_t) mag;
+                }
+                else
+                {
+                    while (mag >= 32)
+                    {
+                        mag >>= 1;
+                        exp++;
+                    }
+                    out[n] = (uint8_t) ((exp << 4) | (mag & 0x0F));
+                }
+                if (x < 0)
+                    out[n] |= 0x80;
+            }
+            return numSamples;
+
+        default:
+            return numSamples * 2;
+    }
+}
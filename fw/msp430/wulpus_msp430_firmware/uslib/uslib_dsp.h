@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2024 ETH Zurich. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef USLIB_USLIB_DSP_H_
+#define USLIB_USLIB_DSP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "uslib.h"
+
+//// On-device frame processing ////
+
+// The envelope stage runs on the samples in the LEA RAM after the
+// acquisition, in place:
+//   1. Bandpass FIR (US_DSP_BP_TAPS taps, Q15) centered at the pulse
+//      frequency, y = sat16((sum(h[k] * x[n - k]) + 2^14) >> 15), x[n < 0] = 0
+//   2. Rectification, r = min(|y|, 32767)
+//   3. Mean over blocks of 2^log2Dec samples, e[m] = sum(r) >> log2Dec
+// The output has numSamples >> log2Dec samples, a trailing partial block is
+// dropped. The filter delays the envelope by (US_DSP_BP_TAPS - 1) / 2
+// input samples.
+//
+// The coefficients are designed with integer arithmetic only: Hann window
+// times a cosine at the pulse frequency (quarter-wave sine table with linear
+// interpolation), normalized to unity gain at the pulse frequency.
+// fw/msp430/host_sim/dsp_ref.c is a bit-exact reference model.
+//
+// Coherent averaging runs before the envelope stage: 2^log2Shots consecutive
+// acquisitions of the same TX/RX config are summed sample by sample into a
+// 32-bit accumulator in the LEA RAM. The frame then holds either the rounded
+// mean, m[n] = (sum[n] + 2^(log2Shots - 1)) >> log2Shots (16-bit), or the
+// sums themselves (32-bit, little endian).
+//
+// Raw and averaged 16-bit frames can be packed in place as the last step:
+//   US_PACK_12BIT  Two 12-bit samples a, b in 3 Bytes: a[7:0],
+//                  b[3:0] a[11:8], b[11:4]. An odd last sample takes
+//                  2 Bytes. The SDHS samples are 12-bit, packing is lossless.
+//   US_PACK_LOG8   Sign (bit 7), exponent (bits 4-6) and mantissa (bits 0-3)
+//                  of the magnitude m (saturated to 2047): codes below 32
+//                  are m itself, above m = (16 + mantissa) << (exponent - 1)
+//                  truncated. The host decodes to the middle of the step.
+//
+// Threshold gating runs on the raw or averaged 16-bit samples, before the
+// envelope stage: the frame is sent if a sample of the depth range
+// [gateStart, gateStart + gateLen) lies outside +-gateThreshold, the same
+// window the SDHS window comparator checks during the acquisition. Only
+// frames of acquisitions flagged by the comparator are searched.
+
+// Number of bandpass taps (odd, symmetric filter)
+#define US_DSP_BP_TAPS           (15)
+
+// Maximum decimation factor (log2)
+#define US_DSP_LOG2_DEC_MAX      (3)
+
+// Maximum number of shots averaged into one frame (log2)
+#define US_AVG_LOG2_SHOTS_MAX    (6)
+
+// Size of the averaging accumulator (samples)
+#define US_AVG_SAMPLES_MAX       (400)
+
+// Multiply-accumulate of the FIR (the host build charges its cost)
+#ifndef US_DSP_MAC
+#define US_DSP_MAC(acc, a, b)    ((acc) += (int32_t)(a) * (int32_t)(b))
+#endif
+
+// Design the bandpass filters of all TX/RX configs (once per configuration)
+void confUsDsp(const msp_config_t *config);
+
+// Add the samples of one acquisition to the accumulator, shot 0 of a frame
+// restarts it. Returns true after the last shot of the frame, the samples
+// are then replaced by the averaged frame (always true without averaging).
+bool averageUsShot(int16_t *samples, uint16_t numSamples, uint8_t shot);
+
+// Process the samples of one frame in place, returns the number of output
+// samples (numSamples if processing is off)
+uint16_t processUsFrame(int16_t *samples, uint16_t numSamples, uint8_t seqId);
+
+// True if one of the samples in the depth range of the threshold gating lies
+// outside +-gateThreshold (range clipped to numSamples)
+bool gateUsFrame(const int16_t *samples, uint16_t numSamples);
+
+// Pack the samples of one frame in place, returns the number of Bytes
+// (2 per sample if packing is off)
+uint16_t packUsFrame(int16_t *samples, uint16_t numSamples);
+
+// Design one bandpass filter, frequencies in kHz
+void designUsDspBandpass(int16_t *coeffs, uint16_t centerFreqKhz,
+                         uint16_t samplFreqKhz);
+
+#endif /* USLIB_USLIB_DSP_H_ */
@@ -56,6 +56,9 @@ void (*SAPH_PNGND_CALLBACK)          (void)=0;
 
 uint32_t usEventFlags = 0;
 
+// Overflows of the slow timer (time stamps)
+static volatile uint16_t timer_slow_overflows = 0;
+
 void timerSlowInit(void)
 {
     // Clear
@@ -68,6 +71,8 @@ void timerSlowInit(void)
     // Enable Capture compare interrupt 1
     HWREG16(TIMER_SLOW_BASE + OFS_TAxCCTL1) =
             CCIE;
+    // Enable the overflow interrupt (upper half of the time stamps)
+    HWREG16(TIMER_SLOW_BASE + OFS_TAxCTL) |= TAIE;
 
     // Check the fault flag of LXFT oscillator
     // Unlock CS regs
@@ -98,6 +103,33 @@ void timerSlowStop()
 }
 
 
+uint32_t timerSlowGetTimestamp(void)
+{
+    // Save GIE status
+    uint16_t gieStatus = ( __get_SR_register() & GIE);
+    uint16_t overflows;
+    uint16_t counter;
+
+    __disable_interrupt();
+
+    counter = HWREG16(TIMER_SLOW_BASE + OFS_TAxR);
+    overflows = timer_slow_overflows;
+
+    // Overflow not handled by the ISR yet
+    if ((HWREG16(TIMER_SLOW_BASE + OFS_TAxCTL) & TAIFG) && !(counter & 0x8000))
+    {
+        overflows++;
+    }
+
+    // Restore GIE status
+    if(gieStatus == GIE)
+    {
+        __bis_SR_register(GIE);
+    }
+
+    return ((uint32_t) overflows << 16) | counter;
+}
+
 void timerSlowDelay(uint16_t delay, uint16_t lpmBits)
 {
     // Save GIE status
@@ -283,7 +315,12 @@ __interrupt void timerSlowCc0Int(void)
         TIMER_SLOW_CCR0_CALLBACK();
     }
 
-    LPM4_EXIT;
+    // The callback clears the event on the intermediate steps of a long
+    // measurement period, the CPU stays in low-power mode then
+    if (isEventFlagSet(TIMER_SLOW_CCR0_EVENT))
+    {
+        LPM4_EXIT;
+    }
 }
 
 #pragma vector = TIMER_SLOW_CC1_VECTOR
@@ -324,7 +361,10 @@ __interrupt void timerSlowCc1Int(void)
         case  8: break;                            // CCR4 not used
         case 10: break;                            // CCR5 not used
         case 12: break;                            // CCR6 not used
-        case 14: break;                            // overflow
+        case 14:                                   // overflow
+            timer_slow_overflows++;
+            // Nothing to wake up for
+            return;
         default: break;
     }
 
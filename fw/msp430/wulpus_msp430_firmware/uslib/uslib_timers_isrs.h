@@ -84,6 +84,8 @@ extern void (*SAPH_PNGND_CALLBACK)          (void);
 
 void timerSlowInit(void);
 void timerSlowStop(void);
+// Slow timer count, overflows counted in the upper 16 bits
+uint32_t timerSlowGetTimestamp(void);
 // Blocking function
 void timerSlowDelay(uint16_t delay, uint16_t lpmBits);
 
@@ -21,6 +21,11 @@
 #include "us_hv_mux.h"
 #include "us_spi.h"
 
+// RX config shifted in by hvMuxLatchTxLoadRx()
+static uint16_t rx_config_next = 0;
+
+static inline void hvMuxWriteBytes(uint16_t config);
+
 void hvMuxInit(void)
 {
     // Configure SPI pins
@@ -34,6 +39,8 @@ void hvMuxInit(void)
 
     // Latch enable (SW_LE) signal will be manually controlled
     GPIO_setAsOutputPin(LE_PIN_PORT, LE_PIN);
+    // ~LE idles high, the latches hold while a config is shifted in
+    GPIO_setOutputHighOnPin(LE_PIN_PORT, LE_PIN);
 
 
     // Initialize SPI master: MSB first, inactive high clock polarity and 4 wire SPI
@@ -90,6 +97,37 @@ void hvMuxConfRx(uint16_t rx_config)
     while(UCB1STAT & UCBBUSY);
 }
 
+void hvMuxLoadTx(uint16_t tx_config, uint16_t rx_config)
+{
+    rx_config_next = rx_config;
+
+    // ~LE is high between latch pulses
+    hvMuxWriteBytes(tx_config);
+}
+
+void hvMuxLatchTxLoadRx(void)
+{
+    // The TX config was shifted in long before (2 us at 8 MHz)
+    while(UCB1STAT & UCBBUSY);
+
+    hvMuxLatchOutput();
+
+    // Latched in the fast timer CC0 interrupt after the pulses
+    hvMuxWriteBytes(rx_config_next);
+}
+
+// Queue both bytes of a config (MSB first) without waiting for the
+// transfer, the TX buffer takes the second byte while the first shifts
+static inline void hvMuxWriteBytes(uint16_t config)
+{
+    // Write first byte (MSB) (Channel 0...3)
+    UCB1TXBUF = (uint8_t) (config >> 8);
+    // Wait until it moved to the shift register
+    while(!(UCB1IFG & UCTXIFG));
+    // Write second byte (LSB)(Channel 4...7)
+    UCB1TXBUF = (uint8_t) (config & 0xFF);
+}
+
 // Latch outputs
 // Transition from High to Low transfers the contents of the
 // shift registers into the latches and turns on switches
@@ -35,6 +35,13 @@ void hvMuxInit(void);
 void hvMuxConfTx(uint16_t tx_config);
 void hvMuxConfRx(uint16_t rx_config);
 
+// Non-blocking load of the TX and RX configs of an acquisition:
+// hvMuxLoadTx() starts shifting the TX config and returns,
+// hvMuxLatchTxLoadRx() latches it and starts shifting the RX config
+// (called by the acquisition while the USSXT starts, see US_ACQ_START_CALLBACK)
+void hvMuxLoadTx(uint16_t tx_config, uint16_t rx_config);
+void hvMuxLatchTxLoadRx(void);
+
 // Latch outputs
 // Transition from High to Low  transfers the contents of the
 // shift registers into the latches and turn on switches
@@ -19,12 +19,22 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
+
 #include "driverlib.h"
 #include "us_spi.h"
+#include "uslib.h"
 
 // Buffers for US data
 uint8_t s_rx_buf_1[BYTES_PR_XFER_TX] = {0};
 
+// Length of the SPI frames (Bytes)
+static uint16_t frame_length = BYTES_PR_XFER_TX;
+
+// Frames of a burst, written once per frame and sent afterwards
+#pragma PERSISTENT(burst_ring)
+static uint8_t burst_ring[US_BURST_RING_SIZE] = {0};
+
 static uint8_t dmaRxIsrFlag = 0;
 
 
@@ -38,24 +48,20 @@ __interrupt void ISR_DMA (void)
     dmaRxIsrFlag = 1;
 }
 
-// Function to start SPI transaction. Called from USS_Lib_HAL.c
-// The function is called from USS_Lib_HAL.c once the US
-// measurement is finished. The function initiates one SPI transfer to
-// transfer the whole US frame to the nRF52. The data is handled by
+// Function to start SPI transaction.
+// The function is called once the US measurement is finished.
+// The function initiates one SPI transfer to transfer the whole
+// US frame starting at txBuf to the nRF52. The data is handled by
 // the DMA.
-void usStartSPI(void)
+void usStartSPI(uint8_t * txBuf)
 {
-    // Double buffering not yet implemented
-
     // Fill in first byte to SPI TX buffer to be ready when the transaction starts
-    uint8_t first_byte;
-    memcpy(&first_byte, (uint16_t *) 0x4000, 1);
-    UCA1TXBUF = first_byte;
+    UCA1TXBUF = txBuf[0];
 
     // Set Source address of DMA channel 0 to US data, start at second byte
     DMA_disableTransfers(DMA_CHANNEL_0);
     DMA_setSrcAddress(DMA_CHANNEL_0,
-                      (uint32_t) 0x4001,
+                      (uint32_t) (txBuf + 1),
                       DMA_DIRECTION_INCREMENT);
     DMA_enableTransfers(DMA_CHANNEL_0);
 
@@ -69,14 +75,59 @@ void usStartSPI(void)
     return;
 }
 
+uint16_t usCalcFrameLength(uint16_t sampleSize, bool extHeader, uint8_t packMode, uint8_t log2Dec)
+{
+    uint16_t header = extHeader ? US_FRAME_EXT_HEADER_SIZE : US_FRAME_HEADER_SIZE;
+    uint32_t payload;
+    uint32_t xfers;
+
+    // Envelope frames carry every 2^log2Dec-th sample
+    sampleSize = ((sampleSize / 2) >> log2Dec) * 2;
+    payload = sampleSize;
+
+    // See packUsFrame()
+    if (packMode == US_PACK_12BIT)
+        payload = (3 * (sampleSize / 2) + 1) / 2;
+    else if (packMode == US_PACK_LOG8)
+        payload = sampleSize / 2;
+
+    xfers = (header + payload + US_SPI_XFER_SIZE - 1) / US_SPI_XFER_SIZE;
+
+    if (xfers > BYTES_PR_XFER_TX / US_SPI_XFER_SIZE)
+        xfers = BYTES_PR_XFER_TX / US_SPI_XFER_SIZE;
+
+    return (uint16_t) (xfers * US_SPI_XFER_SIZE);
+}
+
+void usSetFrameLength(uint16_t length)
+{
+    // Takes effect when the channels are enabled in usStartSPI()
+    DMA_setTransferSize(DMA_CHANNEL_0, length - 1);
+    DMA_setTransferSize(DMA_CHANNEL_1, length);
+    frame_length = length;
+}
+
+// Generate "Data ready" signal for the nRF52 (SPI master)
+// The rising edge initiates the SPI transfer
+void usSpiSignalDataReady(void)
+{
+    GPIO_setOutputHighOnPin(GPIO_PORT_DATA_READY, GPIO_PIN_DATA_READY);
+}
+
 // Wait for interrupt that indicates DMA RX complete
+bool usSpiDmaRxDone(void)
+{
+    return dmaRxIsrFlag != 0;
+}
+
 void usWaitForSpiDmaRx(void)
 {
     // Save global interrupt status
     uint16_t gieStatus = ( __get_SR_register() & GIE);
 
     // Generate "Data ready" signal for SPI master which will initiate the SPI transfer
-    GPIO_setOutputHighOnPin(GPIO_PORT_DATA_READY, GPIO_PIN_DATA_READY);
+    // (no effect if the signal was already raised by usSpiSignalDataReady())
+    usSpiSignalDataReady();
 
     // Check if dmaRXIsrFlag is raised
     while(!dmaRxIsrFlag)
@@ -107,6 +158,29 @@ uint8_t * usSpiGetRxPtr(void)
     return (uint8_t *) s_rx_buf_1;
 }
 
+uint8_t * usGetFrameSlotPtr(uint8_t slot)
+{
+    return (uint8_t *) (LEA_RAM_START_ADDR + (uint32_t) slot * US_FRAME_SLOT_SIZE);
+}
+
+uint8_t usBurstCapacity(uint16_t frameLength)
+{
+    uint16_t frames = US_BURST_RING_SIZE / frameLength;
+
+    return (frames > US_BURST_LEN_MAX) ? US_BURST_LEN_MAX : (uint8_t) frames;
+}
+
+void usBurstStoreFrame(uint8_t idx, const uint8_t * frame)
+{
+    // The whole SPI frame is stored, the DMA reads the entry as it is
+    memcpy(usBurstGetFramePtr(idx), frame, frame_length);
+}
+
+uint8_t * usBurstGetFramePtr(uint8_t idx)
+{
+    return &burst_ring[(uint16_t) idx * frame_length];
+}
+
 void usSpiEnableDmaRxIsr(void)
 {
     DMA_enableInterrupt(DMA_CHANNEL_1);
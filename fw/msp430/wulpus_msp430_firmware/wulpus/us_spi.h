@@ -25,6 +25,76 @@
 // 4 Bytes Header + 800 Bytes US frame
 #define BYTES_PR_XFER_TX 804
 
+// The nRF52 clocks a frame in transfers of US_SPI_XFER_SIZE Bytes, as many
+// as needed for the header and the sample size of the configuration (see
+// usCalcFrameLength()), BYTES_PR_XFER_TX at most
+#define US_SPI_XFER_SIZE     201
+
+// US frame slots in the LEA RAM (double buffering)
+// The SDHS DTC fills one slot while the DMA sends the other one to the nRF52
+#define US_FRAME_SLOTS       2
+#define US_FRAME_SLOT_SIZE   (0x800)
+// Size of the measurement header at the start of each slot
+#define US_FRAME_HEADER_SIZE 4
+// Size of the extended header, selected by the MSB of the sample size in the
+// configuration package (US_SAMPLE_SIZE_EXT_HEADER). Bytes 0-3 as above, then
+// (little endian):
+//   4-7    Slow timer (ACLK) time stamp of the trigger, overflows in the
+//          upper 16 bits (last acquisition of an averaged frame)
+//   8      USSXT start-up (ACLK ticks, 0 if warm)
+//   9      UUPS power-up (ACLK ticks, 0 if warm)
+//   10     Time stamp -> sequence done (ACLK ticks)
+//   11     Status flags (US_ACQ_WARM, US_ACQ_ERR_xxx of the acquisitions
+//          that failed since the previous frame, see uslib.h)
+//   12-13  CRC-16 of the configuration package
+//   14     Failed acquisitions since the previous frame (saturates at 255)
+//   15     Preset slot + 1 the acquisition runs with (0: configuration
+//          package of the host, see wulpus_sys.h)
+// The phases saturate at 255 ticks. They are counted by the slow timer, one
+// ACLK tick is 30.5 us: the start-ups are resolved to a few percent, the
+// sequence (under 100 us for most configurations) only to 0..3 ticks. The
+// fast timer (SMCLK) stops at the HV MUX switching, before the sequence is
+// done, and 8 bits of SMCLK cycles would saturate after 32 us.
+#define US_FRAME_EXT_HEADER_SIZE  16
+#define US_SAMPLE_SIZE_EXT_HEADER (0x8000)
+// Bits 12-13 of the sample size select the packing of the samples
+// (us_pack_mode_t, raw and averaged 16-bit frames only)
+#define US_SAMPLE_SIZE_PACK_MASK  (0x3000)
+#define US_SAMPLE_SIZE_PACK_SHIFT (12)
+// Bits 10-11 of the sample size carry log2 of the envelope decimation (0 for
+// raw frames), the frames of an envelope configuration are shorter by it
+#define US_SAMPLE_SIZE_LOG2_DEC_MASK  (0x0C00)
+#define US_SAMPLE_SIZE_LOG2_DEC_SHIFT (10)
+// Maximum number of 16-bit samples in one frame (half as many 32-bit sums)
+#define US_FRAME_SAMPLES_MAX ((BYTES_PR_XFER_TX - US_FRAME_HEADER_SIZE) / 2)
+
+// First header Byte: start of a US frame (0xFF), or of a heartbeat of the
+// threshold gating. A heartbeat is sent like a frame, the nRF52 only relays
+// its first transfer (header, no samples).
+#define US_FRAME_START_HEARTBEAT   (0xFE)
+// Acknowledge frame, sent like a heartbeat after a configuration package or
+// a restart command: status (US_CONF_ACK or the reason of the rejection),
+// configuration hash (2 Bytes, 0 if not applied) and package version
+#define US_FRAME_START_ACK         (0xFD)
+#define US_FRAME_ACK_LEN           (5)
+
+// Second header Byte: TX/RX config ID (bits 0-3), frame format (bits 4-5)
+// and log2 of the envelope decimation factor or the packing of a packed
+// frame (bits 6-7)
+#define US_FRAME_ID_MASK           (0x0F)
+#define US_FRAME_FORMAT_RAW        (0x00)
+#define US_FRAME_FORMAT_ENVELOPE   (0x10)
+#define US_FRAME_FORMAT_SUM32      (0x20)
+#define US_FRAME_FORMAT_PACKED     (0x30)
+#define US_FRAME_LOG2_DEC_SHIFT    (6)
+#define US_FRAME_PACK_SHIFT        (6)
+
+// Burst mode: the frames of a burst are kept in a ring in the FRAM, one
+// frame length apart, and sent after the last acquisition of the burst
+#define US_BURST_RING_SIZE   (0x3000)
+// Frames per burst, at most as many as the nRF52 can buffer
+#define US_BURST_LEN_MAX     (32)
+
 // Defines for data ready signal
 #define GPIO_PORT_DATA_READY GPIO_PORT_P4
 #define GPIO_PIN_DATA_READY GPIO_PIN0
@@ -38,16 +108,42 @@ void usDmaInit(void);
 // GPIOs that are used by the SPI peripheral.
 void usSpiInit(void);
 
-// Function to start SPI transaction. Called from USS_Lib_HAL.c
-// The function is called from USS_Lib_HAL.c once the US
-// measurement is finished. The function initiates one SPI transfer to
-// transfer the whole US frame to the nRF52. The data is handled by
+// Function to start SPI transaction.
+// The function is called once the US measurement is finished.
+// The function initiates one SPI transfer to transfer the whole
+// US frame starting at txBuf to the nRF52. The data is handled by
 // the DMA.
-void usStartSPI(void);
+void usStartSPI(uint8_t * txBuf);
+
+// Length of the SPI frames of a configuration with the given sample size
+// (sample size register value, 2 Bytes per sample): the header and the
+// (packed or decimated) samples rounded up to whole nRF52 transfers. The
+// same rule is applied by the nRF52 (fw/nrf52/ble_peripheral) from the
+// exchange after the one that delivered the configuration package.
+uint16_t usCalcFrameLength(uint16_t sampleSize, bool extHeader, uint8_t packMode, uint8_t log2Dec);
+
+// Set the length of the following SPI frames (DMA transfer size)
+void usSetFrameLength(uint16_t length);
+
+// Generate "Data ready" signal for the nRF52 (SPI master)
+void usSpiSignalDataReady(void);
 
 // Wait for interrupt that indicates DMA RX complete
 void usWaitForSpiDmaRx(void);
 
+// Check without waiting if the DMA RX of the SPI exchange is complete
+bool usSpiDmaRxDone(void);
+
+// Get pointer to a US frame slot in the LEA RAM
+uint8_t * usGetFrameSlotPtr(uint8_t slot);
+
+// Number of frames of the given length the burst ring holds
+uint8_t usBurstCapacity(uint16_t frameLength);
+// Copy a frame (current frame length) into entry idx of the burst ring
+void usBurstStoreFrame(uint8_t idx, const uint8_t * frame);
+// Get pointer to entry idx of the burst ring
+uint8_t * usBurstGetFramePtr(uint8_t idx);
+
 // Get pointer to SPI RX buffer
 uint8_t * usSpiGetRxPtr(void);
 
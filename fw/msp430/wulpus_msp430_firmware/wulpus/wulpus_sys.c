@@ -18,8 +18,40 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
+
 #include "wulpus_sys.h"
 
+// Configuration preset, the package as received (zero padded)
+typedef struct
+{
+    uint8_t  pack[US_CONF_PACK_LEN_MAX];
+    // Length of the package covered by the CRC, 0 if the slot is empty
+    uint8_t  len;
+    uint16_t crc;
+
+} us_preset_t;
+
+// Kept over power cycles, written once per stored package
+#pragma PERSISTENT(us_presets)
+static us_preset_t us_presets[US_PRESETS_NUM] = {0};
+#pragma PERSISTENT(boot_preset)
+static uint8_t boot_preset = US_PRESET_NONE;
+
+// Length of the package extracted last (without the preset byte)
+static uint8_t conf_pack_len = 0;
+
+// Number of the patch applied last, 0 after a configuration package
+static uint8_t patch_nr = 0;
+
+// Command answered last by an acknowledge frame: start byte and, for a
+// configuration package, a checksum of its transfer
+static uint8_t ack_cmd = 0;
+static uint16_t ack_sum = 0;
+
+#define CRC16_INIT    (0xFFFF)
+
+static uint16_t calcCrc16(uint16_t crc, const uint8_t * data, uint16_t len);
 
 void getDefaultUsConfig(msp_config_t * msp_config)
 {
@@ -54,11 +86,30 @@ void getDefaultUsConfig(msp_config_t * msp_config)
     msp_config->sampleSize = 400;
     msp_config->rxGain = PGA_GAIN_9_0_DB;
     msp_config->measPeriod = 32768;
+    msp_config->triggerMode = US_TRIGGER_SOFTWARE;
 
     // TX/RX configurations
     msp_config->txRxConfLen = 0;
 //    msp_config->txConfigs[TX_RX_CONF_LEN_MAX];
 //    msp_config->rxConfigs[TX_RX_CONF_LEN_MAX];
+    // No sequence table, global settings for all TX/RX configs
+    msp_config->seqLen = 0;
+    // Raw samples are sent
+    msp_config->dspMode = US_DSP_OFF;
+    msp_config->dspLog2Dec = 0;
+    // One acquisition per frame
+    msp_config->avgLog2Shots = 0;
+    msp_config->avgOutput = US_AVG_MEAN16;
+    // No burst mode
+    msp_config->burstLen = 0;
+    // Every frame is sent
+    msp_config->gateThreshold = 0;
+    msp_config->gateStart = 0;
+    msp_config->gateLen = 0;
+    msp_config->gateHeartbeat = 0;
+    // Standard frame header
+    msp_config->extHeader = false;
+    msp_config->confHash = 0;
 
     // Pulser settins
     msp_config->driveStrength = PPG_NORMAL_DRIVE;
@@ -74,6 +125,33 @@ void getDefaultUsConfig(msp_config_t * msp_config)
     return;
 }
 
+// Length of the package up to the preset byte, from its length fields only
+// (TX/RX configs, sequence table and depth windows, see extractUsConfig()).
+// Return 0 if the package and its trailer do not fit into the transfer.
+static uint16_t calcUsConfigLength(uint8_t * spi_rx)
+{
+    // Header and TX RX configs, advanced settings up to the sequence length
+    uint16_t offset = 20 + 4 * (uint16_t) READ_uint8(spi_rx + 19);
+
+    if (offset + 16 > US_CONF_PACK_LEN_MAX - 4)
+        return 0;
+
+    // Sequence table, processing and averaging up to the number of windows
+    offset += 16 + 6 * (uint16_t) READ_uint8(spi_rx + offset + 15);
+
+    if (offset + 4 > US_CONF_PACK_LEN_MAX - 4)
+        return 0;
+
+    // Depth windows, burst length, upper bits of the period and gating
+    offset += 4 + 4 * (uint16_t) READ_uint8(spi_rx + offset + 3) + 5 + 7;
+
+    // Preset byte, version and CRC
+    if (offset > US_CONF_PACK_LEN_MAX - 4)
+        return 0;
+
+    return offset;
+}
+
 // Extract Uss config from spi RX buffer
 // Return 1 if config is valid
 bool extractUsConfig(uint8_t * spi_rx, msp_config_t * msp_config)
@@ -82,6 +160,10 @@ bool extractUsConfig(uint8_t * spi_rx, msp_config_t * msp_config)
     if (spi_rx[0] != START_BYTE_CONF_PACK)
         return 0;
 
+    // All fields are read within the package
+    if (calcUsConfigLength(spi_rx) == 0)
+        return 0;
+
     // Note: The MSP430 cannot access 2-byte words at odd addresses, so the CPU just ignores the lowest bit of word addresses.
     //Therefore, we do here some magic
 
@@ -92,6 +174,16 @@ bool extractUsConfig(uint8_t * spi_rx, msp_config_t * msp_config)
     msp_config->numPulses      = READ_uint8(spi_rx + 13);
     msp_config->overSamplRate  = (sdhs_over_sampl_rate_t)READ_uint16(spi_rx + 14);
     msp_config->sampleSize     = READ_uint16(spi_rx + 16);
+    // The MSB of the sample size selects the extended frame header
+    msp_config->extHeader      = (msp_config->sampleSize & US_SAMPLE_SIZE_EXT_HEADER) != 0;
+    // Bits 12-13 select the packing of the samples
+    msp_config->packMode       = (us_pack_mode_t)((msp_config->sampleSize & US_SAMPLE_SIZE_PACK_MASK) >>
+                                                  US_SAMPLE_SIZE_PACK_SHIFT);
+    // Bits 10-11 repeat the decimation of the envelope for the frame length
+    uint8_t frameLog2Dec       = (msp_config->sampleSize & US_SAMPLE_SIZE_LOG2_DEC_MASK) >>
+                                 US_SAMPLE_SIZE_LOG2_DEC_SHIFT;
+    msp_config->sampleSize    &= ~(US_SAMPLE_SIZE_EXT_HEADER | US_SAMPLE_SIZE_PACK_MASK |
+                                   US_SAMPLE_SIZE_LOG2_DEC_MASK);
     msp_config->rxGain         = READ_uint8(spi_rx + 18);
     msp_config->txRxConfLen    = READ_uint8(spi_rx + 19);
 
@@ -106,7 +198,7 @@ bool extractUsConfig(uint8_t * spi_rx, msp_config_t * msp_config)
         msp_config->rxConfigs[i] = READ_uint16(spi_rx + 22 + 4*i);
     }
 
-    uint8_t offset = 20 + 4*(msp_config->txRxConfLen);
+    uint16_t offset = 20 + 4*(msp_config->txRxConfLen);
 
     // Copy the data from the Advanced settings section
     msp_config->startHvMuxRxCnt   = READ_uint16(spi_rx + offset);
@@ -117,9 +209,397 @@ bool extractUsConfig(uint8_t * spi_rx, msp_config_t * msp_config)
     msp_config->restartCaptCnt    = READ_uint16(spi_rx + offset + 10);
     msp_config->captTimeoutCnt    = READ_uint16(spi_rx + offset + 12);
 
+    // Acquisition trigger source (0 if not sent by the host)
+    if (READ_uint8(spi_rx + offset + 14) == US_TRIGGER_TIMER)
+        msp_config->triggerMode = US_TRIGGER_TIMER;
+    else
+        msp_config->triggerMode = US_TRIGGER_SOFTWARE;
+
+    // Optional sequence table, one entry per TX/RX config (0 if not sent)
+    msp_config->seqLen = READ_uint8(spi_rx + offset + 15);
+
+    if ((msp_config->seqLen != 0) &&
+        (msp_config->seqLen != msp_config->txRxConfLen))
+        return 0;
+
+    offset += 16;
+
+    // Entry: rx gain (1 Byte), pulse frequency in kHz (2 Bytes),
+    // number of pulses (bits 0-4) and oversampling rate (bits 5-7),
+    // sample size (2 Bytes)
+    for (i = 0; i < (msp_config->seqLen); i++)
+    {
+        us_seq_config_t * seq = &msp_config->seqConfigs[i];
+
+        seq->rxGain        = READ_uint8(spi_rx + offset);
+        seq->pulseFreq     = (uint32_t)READ_uint16(spi_rx + offset + 1) * 1000;
+        seq->numPulses     = READ_uint8(spi_rx + offset + 3) & 0x1F;
+        seq->overSamplRate = (sdhs_over_sampl_rate_t)(READ_uint8(spi_rx + offset + 3) >> 5);
+        seq->sampleSize    = READ_uint16(spi_rx + offset + 4);
+        seq->startAdcSamplCnt = msp_config->startAdcSamplCnt;
+
+        // Frames are sent with the length of the global sample size
+        if ((seq->sampleSize == 0) ||
+            (seq->sampleSize > msp_config->sampleSize) ||
+            (seq->overSamplRate > SDHS_OVER_SAMPL_RATE_160))
+            return 0;
+
+        offset += 6;
+    }
+
+    // Optional on-device processing (0 if not sent): mode (1 Byte),
+    // decimation factor 1, 2, 4 or 8 (1 Byte)
+    switch (READ_uint8(spi_rx + offset))
+    {
+        case US_DSP_OFF:
+            msp_config->dspMode = US_DSP_OFF;
+            break;
+        case US_DSP_ENVELOPE:
+            msp_config->dspMode = US_DSP_ENVELOPE;
+            break;
+        default:
+            return 0;
+    }
+
+    msp_config->dspLog2Dec = 0;
+    if (msp_config->dspMode != US_DSP_OFF)
+    {
+        uint8_t decimation = READ_uint8(spi_rx + offset + 1);
+
+        while ((decimation > 1) && ((decimation & 1) == 0))
+        {
+            decimation >>= 1;
+            msp_config->dspLog2Dec++;
+        }
+        if ((decimation != 1) || (msp_config->dspLog2Dec > US_DSP_LOG2_DEC_MAX))
+            return 0;
+    }
+
+    // The nRF52 and the host size the frames with the decimation of the sample size
+    if (frameLog2Dec != msp_config->dspLog2Dec)
+        return 0;
+
+    // Optional coherent averaging (0 if not sent): number of shots per
+    // frame 1, 2, 4, ..., 64 (bits 0-6), send the 32-bit sums (bit 7)
+    uint8_t shots = READ_uint8(spi_rx + offset + 2) & 0x7F;
+
+    msp_config->avgOutput = (READ_uint8(spi_rx + offset + 2) & 0x80) ?
+                            US_AVG_SUM32 : US_AVG_MEAN16;
+    msp_config->avgLog2Shots = 0;
+    while ((shots > 1) && ((shots & 1) == 0))
+    {
+        shots >>= 1;
+        msp_config->avgLog2Shots++;
+    }
+    if ((shots > 1) || (msp_config->avgLog2Shots > US_AVG_LOG2_SHOTS_MAX))
+        return 0;
+
+    // The envelope stage takes 16-bit samples
+    if ((msp_config->avgOutput == US_AVG_SUM32) &&
+        ((msp_config->avgLog2Shots == 0) || (msp_config->dspMode != US_DSP_OFF)))
+        return 0;
+
+    // Only raw and averaged 16-bit samples are packed
+    if ((msp_config->packMode > US_PACK_LOG8) ||
+        ((msp_config->packMode != US_PACK_OFF) &&
+         ((msp_config->avgOutput == US_AVG_SUM32) || (msp_config->dspMode != US_DSP_OFF))))
+        return 0;
+
+    // Optional depth windows, one per TX/RX config (0 if not sent)
+    uint8_t roi_len = READ_uint8(spi_rx + offset + 3);
+
+    if ((roi_len != 0) && (roi_len != msp_config->txRxConfLen))
+        return 0;
+
+    offset += 4;
+
+    // Entry: start of the ADC sampling (2 Bytes, same unit as
+    // startAdcSamplCnt), sample size (2 Bytes). The window replaces the
+    // start and the sample size of the global settings or of the sequence
+    // table entry, a sequence table is created if none was sent.
+    for (i = 0; i < roi_len; i++)
+    {
+        us_seq_config_t * seq = &msp_config->seqConfigs[i];
+
+        if (msp_config->seqLen == 0)
+        {
+            seq->rxGain        = msp_config->rxGain;
+            seq->pulseFreq     = msp_config->pulseFreq;
+            seq->numPulses     = msp_config->numPulses;
+            seq->overSamplRate = msp_config->overSamplRate;
+        }
+
+        seq->startAdcSamplCnt = READ_uint16(spi_rx + offset);
+        seq->sampleSize       = READ_uint16(spi_rx + offset + 2);
+
+        // The frame length follows the global sample size
+        if ((seq->sampleSize == 0) ||
+            (seq->sampleSize > msp_config->sampleSize))
+            return 0;
+
+        offset += 4;
+    }
+
+    if (roi_len != 0)
+        msp_config->seqLen = roi_len;
+
+    // Optional burst mode (0 if not sent): number of frames per burst,
+    // the burst has to fit into the FRAM ring
+    msp_config->burstLen = READ_uint8(spi_rx + offset);
+
+    if (msp_config->burstLen >
+        usBurstCapacity(usCalcFrameLength(msp_config->sampleSize,
+                                          msp_config->extHeader,
+                                          msp_config->packMode,
+                                          msp_config->dspLog2Dec)))
+        return 0;
+
+    // Optional upper 16 bits of the DC-DC turn-on time and of the
+    // measurement period (0 if not sent), periods beyond 2 s
+    msp_config->dcDcTurnOnTime |= (uint32_t) READ_uint16(spi_rx + offset + 1) << 16;
+    msp_config->measPeriod     |= (uint32_t) READ_uint16(spi_rx + offset + 3) << 16;
+
+    offset += 5;
+
+    // Optional threshold gating (0 if not sent): threshold (2 Bytes), start
+    // and length of the depth range (2 Bytes each, samples of the frame),
+    // quiet frames per heartbeat (1 Byte, 0: gating off)
+    msp_config->gateThreshold = READ_uint16(spi_rx + offset);
+    msp_config->gateStart     = READ_uint16(spi_rx + offset + 2);
+    msp_config->gateLen       = READ_uint16(spi_rx + offset + 4);
+    msp_config->gateHeartbeat = READ_uint8(spi_rx + offset + 6);
+
+    // The gate takes 16-bit samples, the frames of a burst are all sent
+    if ((msp_config->gateThreshold > INT16_MAX) ||
+        ((msp_config->gateHeartbeat != 0) &&
+         ((msp_config->avgOutput == US_AVG_SUM32) || (msp_config->burstLen != 0))))
+        return 0;
+
+    offset += 7;
+
+    // Hash of the package up to the last field, sent in the extended header
+    msp_config->confHash = calcCrc16(CRC16_INIT, spi_rx, (uint16_t) offset);
+    conf_pack_len = (uint8_t) offset;
+    patch_nr = 0;
+
+    return 1;
+}
+
+// Check the version and the CRC after the preset byte of the package,
+// located by its length fields before any other field is interpreted
+uint8_t checkUsConfigTrailer(uint8_t * spi_rx)
+{
+    uint16_t offset = calcUsConfigLength(spi_rx);
+    uint16_t len = offset + 2;
+
+    // Preset byte, version and CRC within the transfer
+    if (offset == 0)
+        return US_CONF_NACK_INVALID;
+
+    if (READ_uint8(spi_rx + offset + 1) != US_CONF_PACK_VERSION)
+        return US_CONF_NACK_VERSION;
+
+    if (calcCrc16(CRC16_INIT, spi_rx, len) != READ_uint16(spi_rx + len))
+        return US_CONF_NACK_CRC;
+
+    return US_CONF_ACK;
+}
+
+// Configuration packages are told apart by a rotating sum over the
+// transfer, only computed while a rejected package is repeated
+bool isUsCommandNew(uint8_t * spi_rx)
+{
+    uint16_t sum = 0;
+    uint8_t i;
+
+    if (spi_rx[0] == START_BYTE_CONF_PACK)
+    {
+        for (i = 0; i < US_CONF_PACK_LEN_MAX; i++)
+            sum = ((sum << 1) | (sum >> 15)) + spi_rx[i];
+    }
+
+    if ((spi_rx[0] == ack_cmd) && (sum == ack_sum))
+        return 0;
+
+    ack_cmd = spi_rx[0];
+    ack_sum = sum;
     return 1;
 }
 
+void forgetUsCommand(void)
+{
+    ack_cmd = 0;
+}
+
+// Store the package extracted last as preset if its preset byte asks for it
+void storeUsPreset(uint8_t * spi_rx, msp_config_t * msp_config)
+{
+    uint8_t request = READ_uint8(spi_rx + conf_pack_len);
+    uint8_t slot = (request & US_PRESET_STORE_MASK) - 1;
+    us_preset_t * preset;
+
+    if (((request & US_PRESET_STORE_MASK) == 0) || (slot >= US_PRESETS_NUM))
+        return;
+
+    // Presets are sent in full length frames (see loadUsPreset()),
+    // the burst has to fit into the FRAM ring with them
+    if ((conf_pack_len >= US_CONF_PACK_LEN_MAX) ||
+        (msp_config->burstLen > usBurstCapacity(BYTES_PR_XFER_TX)))
+        return;
+
+    // The slot is only valid again once the package is complete
+    preset = &us_presets[slot];
+    preset->len = 0;
+    memset(preset->pack, 0, US_CONF_PACK_LEN_MAX);
+    memcpy(preset->pack, spi_rx, conf_pack_len);
+    preset->crc = msp_config->confHash;
+    preset->len = conf_pack_len;
+
+    if (request & US_PRESET_BOOT)
+        boot_preset = slot;
+}
+
+// Extract the Uss config of a stored preset
+// Return 1 if the preset is valid
+bool loadUsPreset(uint8_t slot, msp_config_t * msp_config)
+{
+    if ((slot >= US_PRESETS_NUM) || (us_presets[slot].len == 0))
+        return 0;
+
+    // Reject a package corrupted in FRAM (e.g. power lost while storing)
+    if (calcCrc16(CRC16_INIT, us_presets[slot].pack, us_presets[slot].len) !=
+        us_presets[slot].crc)
+        return 0;
+
+    return extractUsConfig(us_presets[slot].pack, msp_config);
+}
+
+uint8_t getUsBootPreset(void)
+{
+    return boot_preset;
+}
+
+// Execute a preset command in the spi RX buffer
+// The nRF52 repeats the command with every frame until the host sends a new
+// one, the operations only write to FRAM if something changes
+uint8_t execUsPresetCommand(uint8_t * spi_rx)
+{
+    uint8_t slot = READ_uint8(spi_rx + 2);
+
+    if (spi_rx[0] != START_BYTE_PRESET)
+        return US_PRESET_NONE;
+
+    // US_PRESET_NONE as slot clears the boot preset
+    if ((slot >= US_PRESETS_NUM) && (slot != US_PRESET_NONE))
+        return US_PRESET_NONE;
+
+    switch (READ_uint8(spi_rx + 1))
+    {
+        case PRESET_CMD_SELECT:
+            if ((slot != US_PRESET_NONE) && (us_presets[slot].len != 0))
+                return slot;
+            break;
+        case PRESET_CMD_SET_BOOT:
+            if ((boot_preset != slot) &&
+                ((slot == US_PRESET_NONE) || (us_presets[slot].len != 0)))
+                boot_preset = slot;
+            break;
+        case PRESET_CMD_ERASE:
+            if ((slot != US_PRESET_NONE) && (us_presets[slot].len != 0))
+            {
+                us_presets[slot].len = 0;
+                if (boot_preset == slot)
+                    boot_preset = US_PRESET_NONE;
+            }
+            break;
+        default:
+            break;
+    }
+
+    return US_PRESET_NONE;
+}
+
+// Extract a patch of the Uss config from the spi RX buffer
+// Return 1 if the config changed
+bool extractUsPatch(uint8_t * spi_rx, msp_config_t * msp_config)
+{
+    uint8_t fields = READ_uint8(spi_rx + 2);
+    uint8_t id = READ_uint8(spi_rx + 3);
+    uint8_t gain = READ_uint8(spi_rx + 4);
+    uint8_t pulses = READ_uint8(spi_rx + 5);
+    uint32_t period;
+    uint32_t dcDcTurnOn;
+    uint8_t i;
+
+    // The nRF52 repeats the command with every frame, each patch is
+    // applied once
+    if ((spi_rx[0] != START_BYTE_PATCH) || (READ_uint8(spi_rx + 1) == patch_nr))
+        return 0;
+    patch_nr = READ_uint8(spi_rx + 1);
+
+    // A rejected patch leaves the config unchanged
+    if ((id >= msp_config->txRxConfLen) && (id != US_PATCH_ALL_CONFIGS))
+        return 0;
+    if ((fields & US_PATCH_RX_GAIN) &&
+        ((gain < PGA_GAIN_MINUS_6_5_DB) || (gain > PGA_GAIN_30_8_DB)))
+        return 0;
+    if ((fields & US_PATCH_NUM_PULSES) && ((pulses == 0) || (pulses > 0x1F)))
+        return 0;
+    if ((fields & US_PATCH_MEAS_PERIOD) && (READ_uint16(spi_rx + 6) == 0))
+        return 0;
+    // The DC-DC converters have to be turned on within the period, before
+    // the acquisition (a field not patched keeps its value)
+    period = (fields & US_PATCH_MEAS_PERIOD) ? READ_uint16(spi_rx + 6) : msp_config->measPeriod;
+    dcDcTurnOn = (fields & US_PATCH_DCDC_TURNON) ? READ_uint16(spi_rx + 8) : msp_config->dcDcTurnOnTime;
+    if (dcDcTurnOn >= period)
+        return 0;
+
+    // The gain and the number of pulses of a TX/RX config are those of its
+    // sequence table entry, the global ones apply to all configs
+    if ((msp_config->seqLen == 0) || (id == US_PATCH_ALL_CONFIGS))
+    {
+        if (fields & US_PATCH_RX_GAIN)
+            msp_config->rxGain = gain;
+        if (fields & US_PATCH_NUM_PULSES)
+            msp_config->numPulses = pulses;
+    }
+    for (i = 0; i < msp_config->seqLen; i++)
+    {
+        if ((i != id) && (id != US_PATCH_ALL_CONFIGS))
+            continue;
+        if (fields & US_PATCH_RX_GAIN)
+            msp_config->seqConfigs[i].rxGain = gain;
+        if (fields & US_PATCH_NUM_PULSES)
+            msp_config->seqConfigs[i].numPulses = pulses;
+    }
+
+    if (fields & US_PATCH_MEAS_PERIOD)
+        msp_config->measPeriod = READ_uint16(spi_rx + 6);
+    if (fields & US_PATCH_DCDC_TURNON)
+        msp_config->dcDcTurnOnTime = READ_uint16(spi_rx + 8);
+
+    // Frames acquired with the patch report the hash continued over it
+    msp_config->confHash = calcCrc16(msp_config->confHash, spi_rx, US_PATCH_LEN);
+
+    return 1;
+}
+
+// CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF), once per package
+static uint16_t calcCrc16(uint16_t crc, const uint8_t * data, uint16_t len)
+{
+    uint16_t i;
+    uint8_t bit;
+
+    for (i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t) data[i] << 8;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+
+    return crc;
+}
+
 // Check the first byte and check if restart should be done.
 bool isRestartCondition(uint8_t * spi_rx)
 {
@@ -26,6 +26,7 @@
 #include "us_spi.h"
 #include "us_hv_mux.h"
 #include "uslib.h"
+#include "uslib_dsp.h"
 
 // Defines for LED on Acquisition PCB
 #define GPIO_PORT_LED_MSP430  GPIO_PORT_P1
@@ -50,6 +51,52 @@
 // Commands for indicating the configuration package or restart command
 #define START_BYTE_CONF_PACK    (0xFA)
 #define START_BYTE_RESTART      (0xFB)
+// Preset command: operation (1 Byte), slot (1 Byte)
+#define START_BYTE_PRESET       (0xFC)
+// Patch command, applied between two frames without restart:
+//   1      Patch number (applied once, the nRF52 repeats the command)
+//   2      Patched fields (US_PATCH_xxx)
+//   3      TX/RX config of the gain and number of pulses
+//          (US_PATCH_ALL_CONFIGS: global value and all sequence table entries)
+//   4      RX gain (pga_gain_t)
+//   5      Number of pulses (1 - 31)
+//   6-7    Measurement period (ACLK ticks, up to 2 s)
+//   8-9    DC-DC turn-on time (ACLK ticks, up to 2 s)
+#define START_BYTE_PATCH        (0xFD)
+
+// Preset command operations
+#define PRESET_CMD_SELECT       (0x01)
+#define PRESET_CMD_SET_BOOT     (0x02)
+#define PRESET_CMD_ERASE        (0x03)
+
+// Patch command fields
+#define US_PATCH_RX_GAIN        (1 << 0)
+#define US_PATCH_NUM_PULSES     (1 << 1)
+#define US_PATCH_MEAS_PERIOD    (1 << 2)
+#define US_PATCH_DCDC_TURNON    (1 << 3)
+#define US_PATCH_ALL_CONFIGS    (0xFF)
+#define US_PATCH_LEN            (10)
+
+// Configuration presets stored in FRAM
+#define US_PRESETS_NUM          (4)
+#define US_PRESET_NONE          (0xFF)
+// A configuration package fits into one nRF52 transfer
+#define US_CONF_PACK_LEN_MAX    (BYTES_PR_XFER_TX / 4)
+// Preset byte after the last field of the configuration package:
+// slot + 1 to store the package in (0: not stored), boot with the preset
+#define US_PRESET_STORE_MASK    (0x07)
+#define US_PRESET_BOOT          (0x80)
+
+// After the preset byte: format version of the package (1 Byte) and the
+// CRC-16 of the whole package from the start byte to the version (2 Bytes)
+#define US_CONF_PACK_VERSION    (1)
+
+// Status of the acknowledge frame (US_FRAME_START_ACK)
+#define US_CONF_ACK             (0x00)
+#define US_CONF_NACK_INVALID    (0x01)
+#define US_CONF_NACK_VERSION    (0x02)
+#define US_CONF_NACK_CRC        (0x03)
+#define US_CONF_STOPPED         (0x04)
 
 void getDefaultUsConfig(msp_config_t * msp_config);
 
@@ -57,6 +104,31 @@ void getDefaultUsConfig(msp_config_t * msp_config);
 // Return 1 if config is valid
 bool extractUsConfig(uint8_t * spi_rx, msp_config_t * msp_config);
 
+// Check the version and the CRC after the preset byte of the package in the
+// spi RX buffer, before its fields are extracted
+// Return US_CONF_ACK or the reason of the rejection
+uint8_t checkUsConfigTrailer(uint8_t * spi_rx);
+// Return 1 if the command in the spi RX buffer was not answered last by an
+// acknowledge frame (the nRF52 repeats it with every exchange)
+bool isUsCommandNew(uint8_t * spi_rx);
+// Answer the next command even if it is the one answered last
+void forgetUsCommand(void);
+
+// Extract a patch of the Uss config from the spi RX buffer
+// Return 1 if the config changed
+bool extractUsPatch(uint8_t * spi_rx, msp_config_t * msp_config);
+
+// Store the package extracted last as preset if its preset byte asks for it
+void storeUsPreset(uint8_t * spi_rx, msp_config_t * msp_config);
+// Extract the Uss config of a stored preset
+// Return 1 if the preset is valid
+bool loadUsPreset(uint8_t slot, msp_config_t * msp_config);
+// Preset to start with after power-up (US_PRESET_NONE if none)
+uint8_t getUsBootPreset(void);
+// Execute a preset command in the spi RX buffer
+// Return the slot of a selected preset (US_PRESET_NONE otherwise)
+uint8_t execUsPresetCommand(uint8_t * spi_rx);
+
 //// Extra functions ////
 
 // Check the first byte and check if restart should be performed
@@ -1,6 +1,9 @@
+#include <string.h>
+#include "app_timer.h"
 #include "iis2dh.h"
 #include "us_spi.h"
 #include "us_defines.h"
+#include "us_ble.h"
 
 
 /* TWI instance */
@@ -8,18 +11,18 @@ static const nrf_drv_twi_t IIS2DH_twi = NRF_DRV_TWI_INSTANCE(TWI_INSTANCE_ID);
 
 /* Flag to know when a I2C transfer has been completed */
 static volatile bool IIS2DH_xfer_done = false;
+/* Set with IIS2DH_xfer_done if the transfer was not acknowledged */
+static volatile bool IIS2DH_xfer_error = false;
 
-extern volatile bool flag_add_IMU;
+/* Set from the FIFO watermark interrupt until the FIFO is drained */
+static volatile bool IIS2DH_fifo_wtm = false;
+/* RTC1 ticks at the watermark interrupt */
+static volatile uint32_t IIS2DH_fifo_wtm_ticks = 0;
 
-extern int buffer_content;
-extern int buffer_counter;
-extern int BLE_packet_ready;
-extern ArrayList_type m_rx_buf[NUMBER_OF_XFERS*MAX_BUFFER_NUMBER_OF_US_FRAMES];
-
-uint8_t IIS2DH_buffer[805] = {};
-uint16_t IIS2DH_buffer_index =0;
-/* Frame counter for IIS2DH over bluetooth */
-uint16_t IIS2DH_frame_number =0;
+/* IMU record being filled, index of its first sample and flags for the next one */
+static uint8_t IIS2DH_imu_rec[US_STREAM_IMU_LEN];
+static uint32_t IIS2DH_sample_index = 0;
+static uint8_t IIS2DH_imu_flags = 0;
 
 
 //Event Handler
@@ -32,7 +35,14 @@ static void twi_handler(nrf_drv_twi_evt_t const * p_event, void * p_context)
 	case NRF_DRV_TWI_EVT_DONE:
         IIS2DH_xfer_done = true;//Set the flag
         break;
-        
+
+        // The address or a data byte was not acknowledged, the transfer ended
+        case NRF_DRV_TWI_EVT_ADDRESS_NACK:
+        case NRF_DRV_TWI_EVT_DATA_NACK:
+        IIS2DH_xfer_error = true;
+        IIS2DH_xfer_done = true;
+        break;
+
         default:
         // do nothing
           break;
@@ -51,7 +61,7 @@ static void iis2dh_twi_init (void)
     const nrf_drv_twi_config_t twi_config = {
        .scl                = PIN_IIS2DH_SCL,
        .sda                = PIN_IIS2DH_SDA,
-       .frequency          = NRF_DRV_TWI_FREQ_100K, 
+       .frequency          = NRF_DRV_TWI_FREQ_400K, 
        .interrupt_priority = APP_IRQ_PRIORITY_LOWEST, 
        .clear_bus_init     = false
     };
@@ -62,34 +72,58 @@ static void iis2dh_twi_init (void)
     nrf_drv_twi_enable(&IIS2DH_twi);
 }
 
+// Interrupt handler of INT1, the FIFO reached the watermark
+static void iis2dh_int1_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+    IIS2DH_fifo_wtm_ticks = app_timer_cnt_get();
+    IIS2DH_fifo_wtm = true;
+}
+
 void IIS2DH_init()
 {
+    ret_code_t err_code;
+
     iis2dh_twi_init();
-    IIS2DH_buffer[0] = 0xFF;
-    IIS2DH_buffer[1] = 128;
-    //((uint16_t*)IIS2DH_buffer)[1] = IIS2DH_frame_number++;
-        IIS2DH_buffer[3] = 0;
-    IIS2DH_buffer[2] = IIS2DH_frame_number++;
 
-    IIS2DH_buffer_index = 4;
+    // INT1 is high while the FIFO holds more samples than the watermark
+    nrf_drv_gpiote_in_config_t int1_config = GPIOTE_CONFIG_IN_SENSE_LOTOHI(true);
+    int1_config.pull = NRF_GPIO_PIN_NOPULL;
+    err_code = nrf_drv_gpiote_in_init(PIN_IIS2DH_INT1, &int1_config, iis2dh_int1_handler);
+    APP_ERROR_CHECK(err_code);
+    nrf_drv_gpiote_in_event_enable(PIN_IIS2DH_INT1, true);
+
     nrf_delay_ms(500);
 }
 
+// Wait for the end of a transfer started with err_code, no event follows a
+// transfer that did not start (e.g. NRF_ERROR_BUSY)
+// Return true if the transfer was acknowledged
+static bool IIS2DH_wait_xfer(ret_code_t err_code)
+{
+    if (NRF_SUCCESS != err_code)
+    {
+        return false;
+    }
+
+    while (IIS2DH_xfer_done == false){}
+
+    return !IIS2DH_xfer_error;
+}
+
 bool IIS2DH_register_read(uint8_t register_address, uint8_t * rx_buffer, uint8_t number_of_bytes)
 {
     ret_code_t err_code;
 
     //Set the flag to false to show the receiving is not yet completed
     IIS2DH_xfer_done = false;
+    IIS2DH_xfer_error = false;
 
     // Send the register address where we want to read the data from
     err_code = nrf_drv_twi_tx(&IIS2DH_twi, IIS2DH_ADDRESS, &register_address, 1, true);
 
-    //Wait for the transmission to be completed
-    while (IIS2DH_xfer_done == false){}
-    
-    // If transmission was not successful, exit the function and return false
-    if (NRF_SUCCESS != err_code)
+    //Wait for the transmission to be completed, exit the function and
+    //return false if it was not successful
+    if (!IIS2DH_wait_xfer(err_code))
     {
         return false;
     }
@@ -99,16 +133,9 @@ bool IIS2DH_register_read(uint8_t register_address, uint8_t * rx_buffer, uint8_t
 	  
     // Receive the data from the IIS2DH
     err_code = nrf_drv_twi_rx(&IIS2DH_twi, IIS2DH_ADDRESS, rx_buffer, number_of_bytes);
-    //wait until the transmission is completed
-    while (IIS2DH_xfer_done == false){}
-	
+
     // if data was successfully read, return true else return false
-    if (NRF_SUCCESS != err_code)
-    {
-        return false;
-    }
-    
-    return true;
+    return IIS2DH_wait_xfer(err_code);
 }
 bool IIS2DH_register_write(uint8_t register_address, uint8_t * wx_buffer, uint8_t number_of_bytes)
 {
@@ -116,6 +143,7 @@ bool IIS2DH_register_write(uint8_t register_address, uint8_t * wx_buffer, uint8_
 
     //Set the flag to false to show the receiving is not yet completed
     IIS2DH_xfer_done = false;
+    IIS2DH_xfer_error = false;
 
     uint8_t wxbuffer_with_address[10];
     wxbuffer_with_address[0] = register_address;
@@ -127,15 +155,8 @@ bool IIS2DH_register_write(uint8_t register_address, uint8_t * wx_buffer, uint8_
     // Send the register address where we want to read the data from
     err_code = nrf_drv_twi_tx(&IIS2DH_twi, IIS2DH_ADDRESS, wxbuffer_with_address, number_of_bytes+1, true);
 
-    //Wait for the transmission to be completed
-    while (IIS2DH_xfer_done == false){}
-    
-    // If transmission was not successful, exit the function and return false
-    if (NRF_SUCCESS != err_code)
-    {
-        return false;
-    }
-    return true;
+    //Wait for the transmission to be completed, return false if it was not successful
+    return IIS2DH_wait_xfer(err_code);
 }
 
 bool setupTemp(){
@@ -246,69 +267,106 @@ bool getAccelerationData(uint16_t* X, uint16_t* Y, uint16_t* Z, IIS2DH_Operating
 
 }
 
-static void finalizeCurrentFrame(void)
+// Empty the FIFO and set it to stream mode with the watermark interrupt, or disable it
+static bool IIS2DH_fifo_setup(bool enable)
 {
-    buffer_counter++;
-    if (buffer_counter == MAX_BUFFER_NUMBER_OF_US_FRAMES)
+    uint8_t reg;
+    bool res;
+
+    // Bypass mode resets the FIFO
+    reg = IIS2DH_FIFO_MODE_BYPASS;
+    res = IIS2DH_register_write(IIS2DH_REG_FIFO_CTRL_REG, &reg, 1);
+    reg = enable ? IIS2DH_CTRL_REG5_FIFO_EN : 0x00;
+    res &= IIS2DH_register_write(IIS2DH_REG_CTRL_REG5, &reg, 1);
+    reg = enable ? IIS2DH_CTRL_REG3_I1_WTM : 0x00;
+    res &= IIS2DH_register_write(IIS2DH_REG_CTRL_REG3, &reg, 1);
+    if (enable)
     {
-        buffer_counter = 0;
+        reg = IIS2DH_FIFO_MODE_STREAM | IIS2DH_FIFO_WATERMARK;
+        res &= IIS2DH_register_write(IIS2DH_REG_FIFO_CTRL_REG, &reg, 1);
     }
 
-    BLE_packet_ready = 1;
+    IIS2DH_fifo_wtm = false;
+    IIS2DH_sample_index = 0;
+    IIS2DH_imu_flags = 0;
+    return res;
 }
 
 bool IIS2DH_set_streaming_enabled(bool enable)
 {
     if (enable)
     {
-        return setupAccelormeter(IIS2DH_HighResolutionMode,
-                                 AllModes_400Hz,
-                                 IIS2DH_Precision_2g);
+        bool res = setupAccelormeter(IIS2DH_HighResolutionMode,
+                                     AllModes_400Hz,
+                                     IIS2DH_Precision_2g);
+        return res && IIS2DH_fifo_setup(true);
     }
     else
     {
         // Power-down mode: CTRL_REG1 = 0
         uint8_t ctrl_reg1 = 0x00;
-        return IIS2DH_register_write(IIS2DH_REG_CTRL_REG1, &ctrl_reg1, 1);
+        bool res = IIS2DH_register_write(IIS2DH_REG_CTRL_REG1, &ctrl_reg1, 1);
+        return res && IIS2DH_fifo_setup(false);
     }
 }
 
-void finalizeFrameWithoutIMU(void)
+// Read the samples of the FIFO into an IMU record and queue it
+static bool IIS2DH_fifo_read_record(void)
 {
-    while(flag_add_IMU == false) {}
-
-    flag_add_IMU = false;
+    uint8_t fifo_src;
+    uint8_t samples;
 
-    // Zero out the 6 bytes that would normally carry accel data
-    uint8_t *dst = &m_rx_buf[3 + buffer_counter * NUMBER_OF_XFERS].buffer[0] + 202 - 6;
-    dst[0] = 0;
-    dst[1] = 0;
-    dst[2] = 0;
-    dst[3] = 0;
-    dst[4] = 0;
-    dst[5] = 0;
-
-    finalizeCurrentFrame();
-}
+    if (!IIS2DH_register_read(IIS2DH_REG_FIFO_SRC_REG, &fifo_src, 1))
+        return false;
 
-void getIIS2DHData2Buffer(){
+    // A full FIFO holds one sample more than FSS counts
+    samples = fifo_src & IIS2DH_FIFO_SRC_FSS_MASK;
+    if (fifo_src & IIS2DH_FIFO_SRC_OVRN)
+    {
+        samples = IIS2DH_FIFO_DEPTH;
+        IIS2DH_imu_flags |= US_IMU_FLAG_OVERRUN;
+    }
+    // The rest stays in the FIFO for the next record
+    if (samples > US_IMU_MAX_SAMPLES)
+        samples = US_IMU_MAX_SAMPLES;
 
-  IIS2DH_buffer_index = 0;
-  IIS2DH_register_read(IIS2DH_REG_OUT_X_H, &IIS2DH_buffer[IIS2DH_buffer_index++], 1); 
-  IIS2DH_register_read(IIS2DH_REG_OUT_X_L, &IIS2DH_buffer[IIS2DH_buffer_index++], 1); 
-  IIS2DH_register_read(IIS2DH_REG_OUT_Y_H, &IIS2DH_buffer[IIS2DH_buffer_index++], 1); 
-  IIS2DH_register_read(IIS2DH_REG_OUT_Y_L, &IIS2DH_buffer[IIS2DH_buffer_index++], 1); 
-  IIS2DH_register_read(IIS2DH_REG_OUT_Z_H, &IIS2DH_buffer[IIS2DH_buffer_index++], 1); 
-  IIS2DH_register_read(IIS2DH_REG_OUT_Z_L, &IIS2DH_buffer[IIS2DH_buffer_index++], 1); 
-  //NRF_LOG_INFO("Received: %u", IIS2DH_buffer_index);
+    if (samples != 0)
+    {
+        // X, Y and Z of all samples in one read
+        if (!IIS2DH_register_read(IIS2DH_REG_OUT_X_L | IIS2DH_AUTO_INCREMENT,
+                                  &IIS2DH_imu_rec[US_IMU_HEADER_LEN], samples * 6))
+            return false;
+
+        memset(&IIS2DH_imu_rec[US_IMU_HEADER_LEN + samples * 6], 0, (US_IMU_MAX_SAMPLES - samples) * 6);
+        IIS2DH_imu_rec[0] = US_STREAM_START_IMU;
+        IIS2DH_imu_rec[1] = samples;
+        IIS2DH_imu_rec[2] = IIS2DH_imu_flags;
+        IIS2DH_imu_rec[3] = 0;
+        memcpy(&IIS2DH_imu_rec[4], &IIS2DH_sample_index, 4);
+        memcpy(&IIS2DH_imu_rec[8], (const void *)&IIS2DH_fifo_wtm_ticks, 4);
+        IIS2DH_sample_index += samples;
+
+        IIS2DH_imu_flags = us_ble_push_imu_record(IIS2DH_imu_rec) ? 0 : US_IMU_FLAG_DROPPED;
+    }
 
-  while(flag_add_IMU == false) {}
+    return true;
+}
 
-  flag_add_IMU = false;
+void IIS2DH_fifo_drain(void)
+{
+    if (!IIS2DH_fifo_wtm)
+        return;
+    IIS2DH_fifo_wtm = false;
 
-  memcpy(&m_rx_buf[3 + buffer_counter * NUMBER_OF_XFERS].buffer[0] + 202 - 6,
-         &IIS2DH_buffer[0],
-         6);
+    // A failed read leaves the FIFO above the watermark: INT1 stays high
+    // without a new edge, the drain is retried on the next call
+    if (!IIS2DH_fifo_read_record())
+    {
+        IIS2DH_fifo_wtm = true;
+        return;
+    }
 
-  finalizeCurrentFrame();
+    // Filled up again during the read, INT1 did not go low in between
+    if (nrf_drv_gpiote_in_is_set(PIN_IIS2DH_INT1))
+        IIS2DH_fifo_wtm = true;
 }
@@ -6,6 +6,7 @@
 #include "app_util_platform.h"
 #include "app_error.h"
 #include "nrf_drv_twi.h"
+#include "nrf_drv_gpiote.h"
 #include "nrf_delay.h"
 #include "us_ble.h"
 
@@ -30,6 +31,25 @@
 #define IIS2DH_REG_CTRL_REG5  0x24
 #define IIS2DH_REG_CTRL_REG6  0x25
 
+#define IIS2DH_REG_FIFO_CTRL_REG 0x2E
+#define IIS2DH_REG_FIFO_SRC_REG  0x2F
+
+// MSB of the register address: auto-increment for multi-byte reads. With the
+// FIFO enabled, the address wraps from OUT_Z_H back to OUT_X_L.
+#define IIS2DH_AUTO_INCREMENT 0x80
+
+#define IIS2DH_CTRL_REG3_I1_WTM  0x04
+#define IIS2DH_CTRL_REG5_FIFO_EN 0x40
+#define IIS2DH_FIFO_MODE_BYPASS  0x00
+#define IIS2DH_FIFO_MODE_STREAM  0x80
+#define IIS2DH_FIFO_SRC_WTM      0x80
+#define IIS2DH_FIFO_SRC_OVRN     0x40
+#define IIS2DH_FIFO_SRC_FSS_MASK 0x1F
+#define IIS2DH_FIFO_DEPTH        32
+
+// FIFO samples that raise the watermark interrupt on INT1 (40 ms at 400 Hz)
+#define IIS2DH_FIFO_WATERMARK 16
+
 #define IIS2DH_REG_STATUS_REG_AUX 0x07
 #define IIS2DH_REG_OUT_TEMP_L 0x0C
 #define IIS2DH_REG_OUT_TEMP_H 0x0D
@@ -58,12 +78,6 @@
 #endif
 
 
-extern uint8_t IIS2DH_buffer[805];
-extern uint16_t IIS2DH_buffer_index;
-/* Frame counter for IIS2DH over bluetooth */
-extern uint16_t IIS2DH_frame_number;
-
-
 typedef enum {
   IIS2DH_LowPowerMode = 0,
   IIS2DH_NormalMode = 1,
@@ -118,10 +132,20 @@ int8_t getTemp();
 bool setupAccelormeter(IIS2DH_OperatingModes mode, IIS2DH_DataRate rate, IIS2DH_FullScale fs);
 bool getAccelerationData(uint16_t* X, uint16_t* Y, uint16_t* Z, IIS2DH_OperatingModes mode, IIS2DH_FullScale range);
 
+/**
+ * @brief Function for enabling the accelerometer (400 Hz, FIFO in stream mode with the
+ *        watermark interrupt on INT1) or putting it into power-down mode
+ */
 bool IIS2DH_set_streaming_enabled(bool enable);
-void finalizeFrameWithoutIMU(void);
 
-void getIIS2DHData2Buffer();
+/**
+ * @brief Function for reading the FIFO after a watermark interrupt, called from the main loop
+ *
+ * @details The samples are read with one multi-byte read and queued as an IMU record
+ *          (see US_STREAM_START_IMU), independent of the US frames. A failed TWI read
+ *          is retried on the next call (woken by the next event of the main loop).
+ */
+void IIS2DH_fifo_drain(void);
 #endif
 
 
@@ -60,18 +60,11 @@ ArrayList_type m_rx_buf[NUMBER_OF_XFERS*MAX_BUFFER_NUMBER_OF_US_FRAMES] = {0};
 // Buffer to store commands from python
 ArrayList_type m_tx_buf_1[NUMBER_OF_XFERS] = {0};
 
-// Timer and counter to control SPI transactions
-extern nrf_drv_timer_t timer_timer;
-extern nrf_drv_timer_t timer_counter;
 extern int buffer_counter;
 
 // To check if SPI data can be relayed to BLE dongle
 volatile bool ble_connected = false;
 
-// A flag to signal that MSP config is received
-volatile bool msp_conf_received = false;
-
-volatile bool do_act_reading=false;
 
 
 // Handle accelerometer as requested by GUI/User (see us_ble.c)
@@ -138,11 +131,7 @@ void in_pin_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
     // Check if the interrupt is from the data ready pin. If yes, start the SPI transactions
     if (pin == PIN_DATA_READY)
     {
-        NRF_SPIM0->RXD.PTR = (uint32_t)&m_rx_buf[buffer_counter*NUMBER_OF_XFERS].buffer[0];
-        // Enable timer and counter to start the four SPI transactions
-        nrf_drv_timer_enable(&timer_timer);
-        nrf_drv_timer_enable(&timer_counter);
-        do_act_reading =true;
+        us_spi_start_frame(&m_rx_buf[buffer_counter*NUMBER_OF_XFERS].buffer[0]);
     }
 }
 
@@ -221,15 +210,10 @@ int main(void)
     // and until the switch to 2 Mbps (LE 2M PHY) is done
     nrf_delay_ms(2000);
 
-    while(msp_conf_received==false)
-    {
-        idle_state_handle();
-    }
-    msp_conf_received = false;
-
     apply_accel_mode_if_pending();
 
-    // Now the BLE connection is ready to send US data
+    // Now the BLE connection is ready to send US data. The MSP430 starts
+    // acquiring with its boot preset or polls for a configuration package.
     nrf_drv_gpiote_out_set(PIN_BLE_CONN_READY);
 
     // Enter main loop.
@@ -238,18 +222,10 @@ int main(void)
         // Enable/disable accelerometer as requested by user-config
         apply_accel_mode_if_pending();
 
-        if (do_act_reading)
+        // Send the accelerometer samples after a FIFO watermark interrupt
+        if (accel_stream_enabled)
         {
-            if (accel_stream_enabled)
-            {
-                getIIS2DHData2Buffer();
-            }
-            else
-            {
-                finalizeFrameWithoutIMU();
-            }
-
-            do_act_reading = false;
+            IIS2DH_fifo_drain();
         }
 
         send_pending_frames();
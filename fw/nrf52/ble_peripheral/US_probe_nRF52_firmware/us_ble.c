@@ -57,6 +57,7 @@
  */
 
 
+#include <string.h>
 #include "nrf_drv_gpiote.h"
 #include "ble_advertising.h"
 #include "ble_conn_params.h"
@@ -71,8 +72,10 @@
 #include "nrf_drv_ppi.h"
 #include "nrf_drv_spi.h"
 #include "nrf_delay.h"
+#include "app_util_platform.h"
 #include "us_ble.h"
 #include "us_defines.h"
+#include "us_spi.h"
 #include "iis2dh.h"
 
 
@@ -96,11 +99,9 @@
 
 #define DEAD_BEEF                       0xDEADBEEF                                  /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 
-extern ArrayList_type m_tx_buf_1[NUMBER_OF_XFERS];
 extern ArrayList_type m_rx_buf[NUMBER_OF_XFERS*MAX_BUFFER_NUMBER_OF_US_FRAMES];
 
 extern volatile bool ble_connected;
-extern volatile bool msp_conf_received;
 extern int BLE_packet_ready;
 
 extern volatile bool accel_stream_enabled;
@@ -122,10 +123,54 @@ static ble_uuid_t m_adv_uuids[]          =
     {BLE_UUID_NUS_SERVICE, NUS_SERVICE_UUID_TYPE}
 };
 
-int buffer_content = 0;
 int buffer_counter = 0;
 int current_buffer = 0;
 
+// BLE TX queue: the US frames from current_buffer to buffer_counter, m_tx_frame_pos is the
+// next byte of the frame at current_buffer
+static uint16_t           m_tx_frame_pos = 0;
+// BLE packet being sent (see US_BLE_PACKET_HEADER_LEN), 0 if none
+static uint8_t            m_tx_packet[BLE_NUS_MAX_DATA_LEN];
+static uint16_t           m_tx_packet_len = 0;
+static uint8_t            m_tx_seq = 0;
+// Set while all notification buffers of the SoftDevice are in use
+static volatile bool      m_tx_stalled = false;
+static uint32_t           m_tx_stall_start;
+// Counters of the BLE TX queue since the last configuration package, sent in the status record
+static struct
+{
+    uint32_t packets;         // BLE packets handed to the SoftDevice (each up to the ATT MTU)
+    uint32_t stalls;          // Times all notification buffers were in use
+    uint32_t stall_ticks;     // Time waiting for a free buffer (RTC1 ticks, 32768 Hz)
+    uint8_t  queue_depth;     // US frames buffered when the queue was fed last
+    uint8_t  queue_depth_max;
+} m_tx_stats;
+
+// Counters of the ring since the last configuration package, sent in the status record
+static uint32_t           m_ring_frames = 0;
+static uint32_t           m_ring_drops = 0;
+static uint16_t           m_ring_backpressures = 0;
+static uint8_t            m_ring_fill_max = 0;
+static bool               m_ring_backpressure = false;
+#if (US_RING_DROP_POLICY == US_RING_DECIMATE)
+static bool               m_ring_decimate_drop = false;
+#endif
+// Status record queued after a drop, and being sent
+static volatile bool      m_status_pending = false;
+static bool               m_status_sending = false;
+static uint8_t            m_status_rec[US_STREAM_STATUS_LEN];
+
+// IMU records from m_imu_tail to m_imu_head, sent between two frames like the status record
+static uint8_t            m_imu_recs[US_IMU_RECORDS][US_STREAM_IMU_LEN];
+static volatile uint8_t   m_imu_head = 0;
+static uint8_t            m_imu_tail = 0;
+static bool               m_imu_sending = false;
+
+static void ble_tx_feed(void);
+static void ring_release_backpressure(void);
+
+extern uint8_t frame_number_of_xfers[MAX_BUFFER_NUMBER_OF_US_FRAMES];
+
 /**@brief Function for assert macro callback.
  *
  * @details This function will be called in case of an assert in the SoftDevice.
@@ -215,7 +260,7 @@ static void nus_data_handler(ble_nus_evt_t * p_evt)
         uint16_t       len = p_evt->params.rx_data.length;
 
         // Only decode config packets: start byte 0xFA, transFreq at bytes 5..8
-        if ((len >= 9) && (rx[0] == 0xFA))
+        if ((len >= 9) && (rx[0] == START_BYTE_CONF_PACK))
         {
             uint32_t transFreq = read_u32_le(&rx[5]);
           
@@ -225,14 +270,57 @@ static void nus_data_handler(ble_nus_evt_t * p_evt)
         }
 
         // Forward packet unchanged to MSP430
-        memcpy(m_tx_buf_1, rx, len);
-        msp_conf_received = true;
-
-        // Clear the BLE buffers to send US data with the received configuration
-        current_buffer = 0;
-        buffer_counter = 0;
-        buffer_content = 0;
-        BLE_packet_ready = 0;
+        us_spi_forward_package(rx, len);
+
+        // A configuration package or a restart ends the acquisition, the buffered frames are
+        // dropped. Patches and preset commands apply to the running stream, the ring is kept.
+        if ((len >= 1) && ((rx[0] == START_BYTE_CONF_PACK) || (rx[0] == START_BYTE_RESTART)))
+        {
+            CRITICAL_REGION_ENTER();
+
+            // The SPI may be receiving into the slot at buffer_counter, the tail catches up
+            current_buffer = buffer_counter;
+
+            // A frame or record cut off here is dropped by the dongle on the sequence gap
+            if (m_tx_frame_pos != 0)
+            {
+                m_tx_seq++;
+                if (m_imu_sending)
+                    m_imu_tail = (m_imu_tail + 1) % US_IMU_RECORDS;
+            }
+            m_tx_frame_pos = 0;
+            m_tx_packet_len = 0;
+            m_status_sending = false;
+            m_imu_sending = false;
+            BLE_packet_ready = (m_imu_tail != m_imu_head);
+            ring_release_backpressure();
+
+            // New session, the counters restart
+            if (rx[0] == START_BYTE_CONF_PACK)
+            {
+                m_ring_frames = 0;
+                m_ring_drops = 0;
+                m_ring_backpressures = 0;
+                m_ring_fill_max = 0;
+                memset(&m_tx_stats, 0, sizeof(m_tx_stats));
+                m_status_pending = false;
+            }
+
+            CRITICAL_REGION_EXIT();
+        }
+    }
+    else if (p_evt->type == BLE_NUS_EVT_TX_RDY)
+    {
+        // A notification was sent, its buffer is free again
+        if (m_tx_stalled)
+        {
+            m_tx_stats.stall_ticks += app_timer_cnt_diff_compute(app_timer_cnt_get(), m_tx_stall_start);
+            m_tx_stalled = false;
+        }
+        if (ble_connected)
+        {
+            ble_tx_feed();
+        }
     }
 }
 /**@snippet [Handling the data received over BLE] */
@@ -382,6 +470,8 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
         case BLE_GAP_EVT_DISCONNECTED:
             // LED indication will be changed when advertising starts.
             m_conn_handle = BLE_CONN_HANDLE_INVALID;
+            // No BLE_NUS_EVT_TX_RDY follows, the frames are dropped
+            m_tx_stalled = false;
             break;
 
         case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
@@ -557,21 +647,300 @@ void advertising_start(void)
 }
 
 /**
- * Function to send one BLE packet
+ * Function to get the number of US frames in the ring
  */
-void send_packet(uint8_t* start_address, uint16_t length)
+static uint8_t ring_fill(void)
 {
-        uint32_t err_code;
-        do
+    return (uint8_t)((buffer_counter - current_buffer + MAX_BUFFER_NUMBER_OF_US_FRAMES) %
+                     MAX_BUFFER_NUMBER_OF_US_FRAMES);
+}
+
+
+/**
+ * Function to let the MSP430 acquire again
+ */
+static void ring_release_backpressure(void)
+{
+    if (m_ring_backpressure)
+    {
+        m_ring_backpressure = false;
+        nrf_drv_gpiote_out_set(PIN_BLE_CONN_READY);
+    }
+}
+
+
+#if (US_RING_DROP_POLICY == US_RING_DROP_OLDEST)
+/**
+ * Function to drop the oldest US frame of the ring. If the packets of the oldest frame are
+ * being built, it is moved into the slot of the next one instead.
+ */
+static void ring_drop_oldest(void)
+{
+    uint8_t next = (current_buffer + 1) % MAX_BUFFER_NUMBER_OF_US_FRAMES;
+
+    if ((m_tx_frame_pos != 0) && !m_status_sending && !m_imu_sending)
+    {
+        memcpy(&m_rx_buf[next*NUMBER_OF_XFERS], &m_rx_buf[current_buffer*NUMBER_OF_XFERS],
+               NUMBER_OF_XFERS * sizeof(ArrayList_type));
+        frame_number_of_xfers[next] = frame_number_of_xfers[current_buffer];
+    }
+    current_buffer = next;
+}
+#endif
+
+
+/**
+ * Function to add the US frame at buffer_counter to the ring
+ */
+void us_ble_push_frame(void)
+{
+    bool drop = false;
+
+    // Not interrupted by the BLE event handler taking frames from the ring
+    CRITICAL_REGION_ENTER();
+
+    uint8_t fill = ring_fill();
+    m_ring_frames++;
+
+    if (fill >= MAX_BUFFER_NUMBER_OF_US_FRAMES - 1)
+    {
+#if (US_RING_DROP_POLICY == US_RING_DROP_OLDEST)
+        ring_drop_oldest();
+        fill--;
+        m_ring_drops++;
+        m_status_pending = true;
+#else
+        drop = true;
+#endif
+    }
+#if (US_RING_DROP_POLICY == US_RING_DECIMATE)
+    else if (fill >= US_RING_HIGH_WATER)
+    {
+        drop = m_ring_decimate_drop;
+        m_ring_decimate_drop = !m_ring_decimate_drop;
+    }
+#endif
+
+    if (drop)
+    {
+        // The next frame is received into the same slot
+        m_ring_drops++;
+        m_status_pending = true;
+    }
+    else
+    {
+        buffer_counter++;
+        if (buffer_counter == MAX_BUFFER_NUMBER_OF_US_FRAMES)
+            buffer_counter = 0;
+        fill++;
+    }
+
+    if (fill > m_ring_fill_max)
+        m_ring_fill_max = fill;
+
+    // Nearly full, the MSP430 skips its acquisitions until the ring drained
+    if ((fill >= US_RING_HIGH_WATER) && !m_ring_backpressure)
+    {
+        m_ring_backpressure = true;
+        m_ring_backpressures++;
+        nrf_drv_gpiote_out_clear(PIN_BLE_CONN_READY);
+    }
+
+    BLE_packet_ready = 1;
+
+    CRITICAL_REGION_EXIT();
+}
+
+
+/**
+ * Function to queue an IMU record, called from the main loop
+ */
+bool us_ble_push_imu_record(const uint8_t * p_rec)
+{
+    bool queued = false;
+
+    CRITICAL_REGION_ENTER();
+    uint8_t next = (m_imu_head + 1) % US_IMU_RECORDS;
+    if (next != m_imu_tail)
+    {
+        memcpy(m_imu_recs[m_imu_head], p_rec, US_STREAM_IMU_LEN);
+        m_imu_head = next;
+        BLE_packet_ready = 1;
+        queued = true;
+    }
+    CRITICAL_REGION_EXIT();
+
+    return queued;
+}
+
+
+/**
+ * Function to write the status record of the probe (see US_STREAM_START_STATUS)
+ */
+static void ble_tx_build_status(void)
+{
+    memset(m_status_rec, 0, sizeof(m_status_rec));
+    m_status_rec[0] = US_STREAM_START_STATUS;
+    m_status_rec[1] = US_RING_DROP_POLICY;
+    memcpy(&m_status_rec[2], &m_ring_frames, 4);
+    memcpy(&m_status_rec[6], &m_ring_drops, 4);
+    memcpy(&m_status_rec[10], &m_ring_backpressures, 2);
+    m_status_rec[12] = m_ring_fill_max;
+    m_status_rec[13] = MAX_BUFFER_NUMBER_OF_US_FRAMES - 1;
+    m_status_rec[14] = m_tx_stats.queue_depth;
+    m_status_rec[15] = m_tx_stats.queue_depth_max;
+    memcpy(&m_status_rec[16], &m_tx_stats.packets, 4);
+    memcpy(&m_status_rec[20], &m_tx_stats.stalls, 4);
+    memcpy(&m_status_rec[24], &m_tx_stats.stall_ticks, 4);
+}
+
+
+/**
+ * Function to build the next BLE packet from the buffered US frames. The frame bytes are
+ * copied, the frames are released as soon as their last byte is in a packet.
+ */
+static void ble_tx_build_packet(void)
+{
+    uint16_t max_len = (m_ble_nus_max_data_len < sizeof(m_tx_packet)) ? m_ble_nus_max_data_len : sizeof(m_tx_packet);
+    uint16_t len = US_BLE_PACKET_HEADER_LEN;
+
+    m_tx_packet[0] = m_tx_seq++;
+    m_tx_packet[1] = US_BLE_NO_FRAME_START;
+
+    // Tail of a frame and the head of the next one share a packet
+    while (len < max_len)
+    {
+        uint8_t  *frame;
+        uint16_t frame_len;
+
+        // The status and IMU records go between two frames
+        if ((m_tx_frame_pos == 0) && !m_status_sending && !m_imu_sending)
         {
-            err_code = ble_nus_data_send(&m_nus, start_address, &length, m_conn_handle);
-            if ((err_code != NRF_ERROR_INVALID_STATE) &&
-                (err_code != NRF_ERROR_RESOURCES) &&
-                (err_code != NRF_ERROR_NOT_FOUND))
+            if (m_status_pending)
             {
-                APP_ERROR_CHECK(err_code);
+                ble_tx_build_status();
+                m_status_pending = false;
+                m_status_sending = true;
+            }
+            else if (m_imu_tail != m_imu_head)
+            {
+                m_imu_sending = true;
+            }
+        }
+
+        if (m_status_sending)
+        {
+            frame = m_status_rec;
+            frame_len = US_STREAM_STATUS_LEN;
+        }
+        else if (m_imu_sending)
+        {
+            frame = m_imu_recs[m_imu_tail];
+            frame_len = US_STREAM_IMU_LEN;
+        }
+        else if (current_buffer != buffer_counter)
+        {
+            // A heartbeat or an acknowledge carries only the header, the other
+            // transfers are not relayed
+            frame = &m_rx_buf[current_buffer*NUMBER_OF_XFERS].buffer[0];
+            frame_len = frame_number_of_xfers[current_buffer] * BYTES_PR_XFER_RX;
+            if ((frame[0] == US_FRAME_START_HEARTBEAT) || (frame[0] == US_FRAME_START_ACK))
+                frame_len = BYTES_PR_XFER_RX;
+        }
+        else
+        {
+            break;
+        }
+
+        if ((m_tx_frame_pos == 0) && (m_tx_packet[1] == US_BLE_NO_FRAME_START))
+            m_tx_packet[1] = len - US_BLE_PACKET_HEADER_LEN;
+
+        uint16_t n = frame_len - m_tx_frame_pos;
+        if (n > max_len - len)
+            n = max_len - len;
+        memcpy(&m_tx_packet[len], &frame[m_tx_frame_pos], n);
+        len += n;
+        m_tx_frame_pos += n;
+
+        if (m_tx_frame_pos == frame_len)
+        {
+            m_tx_frame_pos = 0;
+            if (m_status_sending)
+            {
+                m_status_sending = false;
+                continue;
+            }
+            if (m_imu_sending)
+            {
+                m_imu_sending = false;
+                m_imu_tail = (m_imu_tail + 1) % US_IMU_RECORDS;
+                continue;
             }
-        } while (err_code==NRF_ERROR_RESOURCES); //while (err_code==NRF_ERROR_RESOURCES && msp_conf_received==false);  
+            current_buffer++;
+            if(current_buffer == MAX_BUFFER_NUMBER_OF_US_FRAMES)
+              current_buffer = 0;
+
+            // Drained, the MSP430 acquires again
+            if (ring_fill() <= US_RING_LOW_WATER)
+                ring_release_backpressure();
+        }
+    }
+
+    m_tx_packet_len = len;
+}
+
+
+/**
+ * Function to hand the buffered US frames to the SoftDevice. Returns when the queue is empty
+ * or all notification buffers are in use, the queue is fed again on BLE_NUS_EVT_TX_RDY
+ * (a notification was sent).
+ */
+static void ble_tx_feed(void)
+{
+    uint32_t err_code;
+    uint8_t  depth;
+
+    depth = ring_fill();
+    m_tx_stats.queue_depth = depth;
+    if (depth > m_tx_stats.queue_depth_max)
+        m_tx_stats.queue_depth_max = depth;
+
+    while (1)
+    {
+        // The packet refused last is sent again
+        if (m_tx_packet_len == 0)
+        {
+            if ((current_buffer == buffer_counter) && !m_status_pending && !m_status_sending &&
+                (m_imu_tail == m_imu_head))
+                break;
+            ble_tx_build_packet();
+        }
+
+        uint16_t length = m_tx_packet_len;
+        err_code = ble_nus_data_send(&m_nus, m_tx_packet, &length, m_conn_handle);
+        if (err_code == NRF_ERROR_RESOURCES)
+        {
+            // All notification buffers in use, wait for BLE_NUS_EVT_TX_RDY
+            if (!m_tx_stalled)
+            {
+                m_tx_stalled = true;
+                m_tx_stall_start = app_timer_cnt_get();
+                m_tx_stats.stalls++;
+            }
+            return;
+        }
+        if ((err_code != NRF_ERROR_INVALID_STATE) &&
+            (err_code != NRF_ERROR_NOT_FOUND))
+        {
+            APP_ERROR_CHECK(err_code);
+        }
+        // Not connected or notifications disabled, the packet is dropped
+        if (err_code == NRF_SUCCESS)
+            m_tx_stats.packets++;
+
+        m_tx_packet_len = 0;
+    }
+    BLE_packet_ready=0;
 }
 
 
@@ -583,26 +952,19 @@ void send_pending_frames()
 
   if(ble_connected)
   {
-      if (BLE_packet_ready==1)
+      // Starts the queue when a frame is buffered and no notification buffer is
+      // awaited, otherwise it is fed from BLE_NUS_EVT_TX_RDY
+      if ((BLE_packet_ready==1) && !m_tx_stalled)
       { 
-          
-          while(current_buffer !=  buffer_counter)
-          {
-            // Send all 4 BLE packets that make up one US frame
-            send_packet(&m_rx_buf[0+current_buffer*NUMBER_OF_XFERS].buffer[0], BYTES_PR_XFER_RX+1);
-            send_packet(&m_rx_buf[1+current_buffer*NUMBER_OF_XFERS].buffer[0], BYTES_PR_XFER_RX);
-            send_packet(&m_rx_buf[2+current_buffer*NUMBER_OF_XFERS].buffer[0], BYTES_PR_XFER_RX);
-            send_packet(&m_rx_buf[3+current_buffer*NUMBER_OF_XFERS].buffer[0], BYTES_PR_XFER_RX);
-            current_buffer++;
-            buffer_content--;
-            if(current_buffer == MAX_BUFFER_NUMBER_OF_US_FRAMES)
-              current_buffer = 0;
-          }
-          BLE_packet_ready=0;
+          // Not interrupted by the BLE event handler feeding the queue
+          CRITICAL_REGION_ENTER();
+          ble_tx_feed();
+          CRITICAL_REGION_EXIT();
       }
   }
 }
 
+
 /** 
  * Function to initialize BLE
  */
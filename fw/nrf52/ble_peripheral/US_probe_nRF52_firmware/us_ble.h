@@ -21,16 +21,32 @@
 #ifndef US_BLE_H
 #define US_BLE_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
     /** 
      * Function to initialize BLE
      */
     void us_ble_init(void);
 
     /**
-     * Function to send all the US frame that are currently buffered in the m_rx_buf ringbuffer
+     * Function to send all the US frame that are currently buffered in the m_rx_buf ringbuffer.
+     * Starts the BLE TX queue, it is fed from BLE_NUS_EVT_TX_RDY until it is empty.
      */
     void send_pending_frames(void);
 
+    /**
+     * Function to add the US frame at buffer_counter to the ring, applies the drop policy
+     * and the backpressure to the MSP430 (see US_RING_DROP_POLICY)
+     */
+    void us_ble_push_frame(void);
+
+    /**
+     * Function to queue an IMU record (see US_STREAM_START_IMU), sent between two US frames.
+     * Returns false if the queue is full and the record is dropped.
+     */
+    bool us_ble_push_imu_record(const uint8_t * p_rec);
+
     /**
      * Function to start BLE advertising, called from main
      */
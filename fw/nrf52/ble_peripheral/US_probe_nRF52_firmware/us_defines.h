@@ -35,13 +35,105 @@
     // Number of bytes per transfer to receive from SPI slave
     #define BYTES_PR_XFER_RX   201
 
-    // Number of SPI transfers to complete for one US frame
+    // Max number of SPI transfers to complete for one US frame
     #define NUMBER_OF_XFERS 4
+
+    // SPI transfers of a US frame: 1 starts each transfer from the END of the one
+    // before (PPI), 0 starts them with TIMER3 every US_SPI_XFER_INTERVAL_US
+    #define US_SPI_CHAINED_XFERS 1
+    // SPI clock (MHz), see spi_init()
+    #define US_SPI_SCK_MHZ 8
+    // Time to clock one transfer (us)
+    #define US_SPI_XFER_TIME_US ((BYTES_PR_XFER_RX * 8) / US_SPI_SCK_MHZ)
+    // The MSP430 DMA moves one byte per TX/RX flag in a few MCLK cycles, less
+    // than a byte time at 8 MHz, and keeps the frame going across transfers.
+    // The guard only covers the start latency of a timer started transfer.
+    #define US_SPI_MSP430_DMA_GUARD_US 4
+    // Interval of timer started transfers (us)
+    #define US_SPI_XFER_INTERVAL_US (US_SPI_XFER_TIME_US + US_SPI_MSP430_DMA_GUARD_US)
+
+    // Size of the US frame header sent by the MSP430 (bytes)
+    #define US_FRAME_HEADER_SIZE 4
+    // First header byte of a US frame
+    #define US_FRAME_START 0xFF
+    // First header byte of a heartbeat sent instead of a quiet frame
+    // (threshold gating), only its first SPI transfer is relayed
+    #define US_FRAME_START_HEARTBEAT 0xFE
+    // First header byte of the acknowledge of a configuration package or
+    // restart command, relayed like a heartbeat
+    #define US_FRAME_START_ACK 0xFD
+    // Size of the extended header, selected by the MSB of the sample size
+    #define US_FRAME_EXT_HEADER_SIZE 16
+    #define CONF_PACK_SAMPLE_SIZE_EXT_HEADER 0x8000
+    // Bits 12-13 of the sample size select the packing of the samples
+    // (1: 2 samples in 3 bytes, 2: 1 byte per sample)
+    #define CONF_PACK_SAMPLE_SIZE_PACK_MASK 0x3000
+    #define CONF_PACK_SAMPLE_SIZE_PACK_SHIFT 12
+    // Bits 10-11 of the sample size carry log2 of the envelope decimation,
+    // the frames hold every 2^n-th sample
+    #define CONF_PACK_SAMPLE_SIZE_LOG2_DEC_MASK 0x0C00
+    #define CONF_PACK_SAMPLE_SIZE_LOG2_DEC_SHIFT 10
+    #define SAMPLE_PACK_12BIT 1
+    #define SAMPLE_PACK_LOG8 2
+
+    // Start byte of a configuration package and offset of its sample size
+    #define START_BYTE_CONF_PACK 0xFA
+    #define CONF_PACK_SAMPLE_SIZE_OFFSET 16
+
+    // Start byte of a preset command, followed by the operation and the slot.
+    // The MSP430 sends full length frames for a selected preset.
+    #define START_BYTE_PRESET 0xFC
+    #define PRESET_CMD_SELECT 0x01
+
+    // Start byte of the restart command, stops the acquisition
+    #define START_BYTE_RESTART 0xFB
     //#define DELAY_BETWEEN_TRANSFERS 1
 
+    // The relayed US frames are a byte stream cut into BLE packets as long as the
+    // negotiated ATT MTU allows. Header of a packet: sequence number (wraps at 256)
+    // and offset of the first frame start in the payload, US_BLE_NO_FRAME_START if
+    // the packet only continues a frame.
+    #define US_BLE_PACKET_HEADER_LEN 2
+    #define US_BLE_NO_FRAME_START 0xFF
+
     // Max number of US frames to buffer
     #define MAX_BUFFER_NUMBER_OF_US_FRAMES 35
 
+    // The ring holds MAX_BUFFER_NUMBER_OF_US_FRAMES - 1 frames from current_buffer (tail)
+    // to buffer_counter (head), the SPI fills the slot at the head. Policy if it is full:
+    #define US_RING_DROP_NEWEST 0   // the new frame is not relayed
+    #define US_RING_DROP_OLDEST 1   // the oldest frame not being sent yet is dropped
+    #define US_RING_DECIMATE    2   // from the high water mark on every other new frame is
+                                    // dropped, the new frame if the ring is full
+    #define US_RING_DROP_POLICY US_RING_DROP_OLDEST
+    // Backpressure: PIN_BLE_CONN_READY is cleared (the MSP430 skips its acquisitions)
+    // once the ring holds US_RING_HIGH_WATER frames and set again at US_RING_LOW_WATER
+    #define US_RING_HIGH_WATER 28
+    #define US_RING_LOW_WATER 16
+
+    // Status of the probe in the stream of relayed frames, sent ahead of the buffered frames
+    // after a frame was dropped. Drop policy (1 Byte), US frames received from the MSP430 and
+    // dropped by the ring since the last configuration package (4 Bytes each), times the
+    // backpressure was applied (2 Bytes), maximum and capacity of the ring (1 Byte each). Then the
+    // BLE TX queue: frames buffered when it was fed last and their maximum (1 Byte each), BLE
+    // packets sent, times all notification buffers were in use and RTC1 ticks waited for a free
+    // one (4 Bytes each).
+    #define US_STREAM_START_STATUS 0xFC
+    #define US_STREAM_STATUS_LEN 28
+
+    // IMU record in the stream, samples of the IIS2DH FIFO sent between two frames. Number of
+    // samples (1 Byte), flags (1 Byte, see US_IMU_FLAG_*), reserved (1 Byte), index of the first
+    // sample since the accelerometer was enabled (4 Bytes), RTC1 ticks (32768 Hz, 24 bit) at the
+    // FIFO watermark interrupt (4 Bytes), then X, Y, Z of each sample (int16 LE each).
+    #define US_STREAM_START_IMU 0xFB
+    #define US_IMU_HEADER_LEN 12
+    #define US_IMU_MAX_SAMPLES 31
+    #define US_STREAM_IMU_LEN (US_IMU_HEADER_LEN + 6 * US_IMU_MAX_SAMPLES)
+    #define US_IMU_FLAG_OVERRUN 0x01    // the FIFO was full, samples were lost before this record
+    #define US_IMU_FLAG_DROPPED 0x02    // the record before this one was dropped (queue full)
+    // IMU records waiting to be sent
+    #define US_IMU_RECORDS 4
+
     // Define GPIOs
     #define LED_NRF52 23
     #define PIN_DATA_READY 29
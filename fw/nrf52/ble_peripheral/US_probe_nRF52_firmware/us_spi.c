@@ -25,7 +25,9 @@
  * 
  * This file contains the source code for the SPI connection
  * between the MSP430 and the nRF52. One US frame is transfered
- * in four SPI transactions.
+ * in up to four SPI transactions, as many as the sample size of
+ * the current configuration needs. The frame is relayed to the
+ * dongle in one BLE packet per SPI transaction.
  *
 */
 
@@ -45,12 +47,14 @@
 #include "nrf_drv_ppi.h"
 #include "nrf_drv_spi.h"
 #include "nrf_delay.h"
+#include "app_util_platform.h"
 
 #include "us_spi.h"
 #include "us_defines.h"
 
 #include "us_defines.h"
 #include "us_spi.h"
+#include "us_ble.h"
 
 extern ArrayList_type m_rx_buf[NUMBER_OF_XFERS*MAX_BUFFER_NUMBER_OF_US_FRAMES];
 extern ArrayList_type m_tx_buf_1[NUMBER_OF_XFERS];
@@ -58,20 +62,11 @@ extern ArrayList_type m_tx_buf_1[NUMBER_OF_XFERS];
 // Flag to know if BLE is connected (-> and therefore US measurements can start)
 extern volatile bool ble_connected;
 
-extern volatile bool msp_conf_received;
-
-volatile bool flag_add_IMU;
-
-extern int buffer_content;
 extern int buffer_counter;
 
-// Function to send one BLE packet
-void send_packet(uint8_t* start_address, uint16_t length);
-void send_packet(uint8_t* start_address, uint16_t length);
-
 
-//Time(in microseconds) between consecutive compare events. (257 us is absolute min for 255Bytes at 8Mbps)
-uint32_t time_us = 300; 
+//Time(in microseconds) between consecutive compare events, unused if the transfers are chained
+uint32_t time_us = US_SPI_XFER_INTERVAL_US;
 uint32_t time_ticks;
 
 static const nrf_drv_spi_t spi = NRF_DRV_SPI_INSTANCE(0);
@@ -88,8 +83,27 @@ uint32_t timer0_timeout_cc0_evt_addr;
 uint32_t counter1_count_task_addr;
 uint32_t counter1_cc0_evt_addr;
 
+#if US_SPI_CHAINED_XFERS
+// PPI group of the channel that starts a transfer from the END of the one before
+static nrf_ppi_channel_group_t ppi_group_xfer_chain;
+#endif
+
 int BLE_packet_ready = 0;
 
+// Set from the data ready edge until all SPI transfers of a US frame are done
+volatile bool spi_xfer_active = false;
+
+// Number of SPI transfers of a US frame (the MSP430 sends 804 bytes until configured)
+static uint8_t number_of_xfers = NUMBER_OF_XFERS;
+// Number of SPI transfers of each buffered US frame
+uint8_t frame_number_of_xfers[MAX_BUFFER_NUMBER_OF_US_FRAMES];
+// Number of SPI transfers after the next exchange, 0 if unchanged
+static volatile uint8_t next_number_of_xfers = 0;
+
+// Package received over BLE during a transfer
+static uint8_t deferred_package[BYTES_PR_XFER_TX];
+static volatile uint16_t deferred_package_len = 0;
+
 void spi_event_handler(nrf_drv_spi_evt_t const * p_event,
                        void *                    p_context)
 {
@@ -133,6 +147,69 @@ void spi_init()
     spi_end_evt_addr = nrf_drv_spi_end_event_get(&spi);
 }
 
+uint8_t us_spi_calc_number_of_xfers(uint16_t sampleSize)
+{
+    uint32_t header = (sampleSize & CONF_PACK_SAMPLE_SIZE_EXT_HEADER) ? US_FRAME_EXT_HEADER_SIZE : US_FRAME_HEADER_SIZE;
+    uint8_t pack = (sampleSize & CONF_PACK_SAMPLE_SIZE_PACK_MASK) >> CONF_PACK_SAMPLE_SIZE_PACK_SHIFT;
+    uint8_t log2Dec = (sampleSize & CONF_PACK_SAMPLE_SIZE_LOG2_DEC_MASK) >> CONF_PACK_SAMPLE_SIZE_LOG2_DEC_SHIFT;
+    uint32_t payload = sampleSize & ~(CONF_PACK_SAMPLE_SIZE_EXT_HEADER | CONF_PACK_SAMPLE_SIZE_PACK_MASK |
+                                      CONF_PACK_SAMPLE_SIZE_LOG2_DEC_MASK);
+    uint32_t xfers;
+
+    // Envelope frames, see the MSP430 firmware (usCalcFrameLength())
+    payload = ((payload / 2) >> log2Dec) * 2;
+
+    // Packed samples, see the MSP430 firmware (packUsFrame())
+    if (pack == SAMPLE_PACK_12BIT)
+        payload = (3 * (payload / 2) + 1) / 2;
+    else if (pack == SAMPLE_PACK_LOG8)
+        payload = payload / 2;
+
+    xfers = (header + payload + BYTES_PR_XFER_RX - 1) / BYTES_PR_XFER_RX;
+
+    if (xfers > NUMBER_OF_XFERS)
+        xfers = NUMBER_OF_XFERS;
+
+    return (uint8_t)xfers;
+}
+
+// Copy a package to the SPI TX buffer, only between two exchanges
+static void load_tx_package(const uint8_t *data, uint16_t len)
+{
+    memcpy(m_tx_buf_1, data, len);
+
+    // The MSP430 switches to the new frame length after this exchange,
+    // even if it rejects the configuration
+    if ((len >= CONF_PACK_SAMPLE_SIZE_OFFSET + 2) && (data[0] == START_BYTE_CONF_PACK))
+    {
+        next_number_of_xfers = us_spi_calc_number_of_xfers(
+            data[CONF_PACK_SAMPLE_SIZE_OFFSET] | ((uint16_t)data[CONF_PACK_SAMPLE_SIZE_OFFSET + 1] << 8));
+    }
+    else if ((len >= 2) && (data[0] == START_BYTE_PRESET) && (data[1] == PRESET_CMD_SELECT))
+    {
+        next_number_of_xfers = NUMBER_OF_XFERS;
+    }
+}
+
+void us_spi_forward_package(const uint8_t *data, uint16_t len)
+{
+    if (len > BYTES_PR_XFER_TX)
+        len = BYTES_PR_XFER_TX;
+
+    CRITICAL_REGION_ENTER();
+    if (spi_xfer_active)
+    {
+        // Sent with the exchange after the current one
+        memcpy(deferred_package, data, len);
+        deferred_package_len = len;
+    }
+    else
+    {
+        load_tx_package(data, len);
+    }
+    CRITICAL_REGION_EXIT();
+}
+
 // @brief Handler for timer events.
 void timer_timeout_event_handler(nrf_timer_event_t event_type, void* p_context)
 {
@@ -142,63 +219,95 @@ void timer_timeout_event_handler(nrf_timer_event_t event_type, void* p_context)
 
 
 
+// Set the counter compares for xfers SPI transfers per US frame
+static void counter_set_xfers(uint8_t xfers)
+{
+#if US_SPI_CHAINED_XFERS
+    // CC0 stops the chain when the last transfer has been started, CC1 ends the frame
+    nrf_drv_timer_compare(&timer_counter, NRF_TIMER_CC_CHANNEL0, xfers - 1, false);
+    nrf_drv_timer_extended_compare(&timer_counter, NRF_TIMER_CC_CHANNEL1, xfers, NRF_TIMER_SHORT_COMPARE1_CLEAR_MASK, true);
+#else
+    nrf_drv_timer_extended_compare(&timer_counter, NRF_TIMER_CC_CHANNEL0, xfers, NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, true);
+#endif
+}
+
+void us_spi_start_frame(uint8_t *rx_buf)
+{
+    NRF_SPIM0->RXD.PTR = (uint32_t)rx_buf;
+    spi_xfer_active = true;
+
+#if US_SPI_CHAINED_XFERS
+    nrf_drv_timer_enable(&timer_counter);
+    if (number_of_xfers > 1)
+    {
+        ret_code_t err_code = nrf_drv_ppi_group_enable(ppi_group_xfer_chain);
+        APP_ERROR_CHECK(err_code);
+    }
+    nrf_spim_task_trigger(NRF_SPIM0, NRF_SPIM_TASK_START);
+#else
+    // Enable timer and counter to start the SPI transactions
+    nrf_drv_timer_enable(&timer_timer);
+    nrf_drv_timer_enable(&timer_counter);
+#endif
+}
+
 /**@brief Called when the SPI transfers are done. Here, the data is sent through BLE to the dongle.
  *
- * @details This timer event handler is called when all four SPI transfers are done. It will then stop
- * timer_timer and timer_counter to stop the SPI transfers. Then, this function sends the received 
- * US frame to the dongle
+ * @details This timer event handler (compare event of timer_counter) is called when all SPI transfers of a US frame are done. It will then stop
+ * timer_timer and timer_counter to stop the SPI transfers. Then, the received US frame is added
+ * to the ring of frames relayed to the dongle
  *
  */
-void counter_cc0_event_handler(nrf_timer_event_t event_type, void* p_context)
+void counter_frame_done_handler(nrf_timer_event_t event_type, void* p_context)
 {
     // Stop timers and hence, stop SPI transfers.
+#if !US_SPI_CHAINED_XFERS
     nrf_drv_timer_disable(&timer_timer);
+#endif
     nrf_drv_timer_disable(&timer_counter);
-    
-    buffer_content++;
-    
-    // LED for Debug
-    //if(buffer_content>3)
-    //{
-    //    // Just for testing
-    //    nrf_drv_gpiote_out_set(LED_NRF52);
-    //}
-    //else
-    //{
-    //    nrf_drv_gpiote_out_clear(LED_NRF52);
-    //}
 
-    
-    if(buffer_content>MAX_BUFFER_NUMBER_OF_US_FRAMES-1)
+    frame_number_of_xfers[buffer_counter] = number_of_xfers;
+
+    // A configuration package was delivered with this exchange
+    if (next_number_of_xfers != 0)
     {
-        // Buffer overflow error handling 
-        //APP_ERROR_CHECK(1);
+        number_of_xfers = next_number_of_xfers;
+        next_number_of_xfers = 0;
+        counter_set_xfers(number_of_xfers);
     }
 
-    // Buffer ready to add IMU data
-    flag_add_IMU = true;
-    
-    //msp_conf_received = false;
-    
-    // Relay the received SPI data to the BLE dongle
-    uint32_t err_code;
-    uint16_t length;
-
-    length = BYTES_PR_XFER_RX;
+    if (deferred_package_len != 0)
+    {
+        load_tx_package(deferred_package, deferred_package_len);
+        deferred_package_len = 0;
+    }
 
+    spi_xfer_active = false;
+    
+    // Add the frame to the ring, a full ring drops frames according to US_RING_DROP_POLICY.
+    // The MSP430 polling for a package sends no frame.
+    uint8_t frame_start = m_rx_buf[buffer_counter*NUMBER_OF_XFERS].buffer[0];
+    if ((frame_start == US_FRAME_START) ||
+        (frame_start == US_FRAME_START_HEARTBEAT) ||
+        (frame_start == US_FRAME_START_ACK))
+    {
+        us_ble_push_frame();
+    }
 }
 
 /**@brief Function to initialize timer and counter for SPI transfers
  *
  * @details The timer and counter are initialized and connected through PPI.
- * The counter is used to count the SPI transfers (four per US frame) and the 
- * timer is used to start new SPI transfers in the set interval.
+ * The counter is used to count the SPI transfers (up to four per US frame) and the 
+ * timer is used to start new SPI transfers in the set interval. With chained
+ * transfers (US_SPI_CHAINED_XFERS), the timer is not used.
  *
  */
 void timer_init()
 {
     uint32_t err_code = NRF_SUCCESS;
     
+#if !US_SPI_CHAINED_XFERS
     // Init timer to start SPI transfers on CC0 event
     nrf_drv_timer_config_t timer_timout_cfg = NRF_DRV_TIMER_DEFAULT_CONFIG;
     err_code = nrf_drv_timer_init(&timer_timer, &timer_timout_cfg, timer_timeout_event_handler);
@@ -209,30 +318,60 @@ void timer_init()
     nrf_drv_timer_extended_compare(&timer_timer, NRF_TIMER_CC_CHANNEL0, time_ticks, NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, false);
     
     timer0_timeout_cc0_evt_addr = nrf_drv_timer_event_address_get(&timer_timer, NRF_TIMER_EVENT_COMPARE0);
-    
+#endif
     
     // Init Counter to count SPI transfers
     nrf_drv_timer_config_t timer_counter_cfg = NRF_DRV_TIMER_DEFAULT_CONFIG;
     timer_counter_cfg.mode = NRF_TIMER_MODE_COUNTER;
-    err_code = nrf_drv_timer_init(&timer_counter, &timer_counter_cfg, counter_cc0_event_handler);
+    err_code = nrf_drv_timer_init(&timer_counter, &timer_counter_cfg, counter_frame_done_handler);
     APP_ERROR_CHECK(err_code);
 
-    nrf_drv_timer_extended_compare(&timer_counter, NRF_TIMER_CC_CHANNEL0, NUMBER_OF_XFERS, NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, true);
+    counter_set_xfers(NUMBER_OF_XFERS);
     
+    counter1_cc0_evt_addr = nrf_drv_timer_event_address_get(&timer_counter, NRF_TIMER_EVENT_COMPARE0);
     counter1_count_task_addr = nrf_drv_timer_task_address_get(&timer_counter, NRF_TIMER_TASK_COUNT);
 }
 
 /**@brief Initialize the PPI channels
  *
  * @details This functions connects the timer and counter to the SPI peripheral.
+ * With US_SPI_CHAINED_XFERS, the END of a transfer starts the next one until
+ * the counter disables the chain.
  *
  */
 void ppi_init()
 {
     uint32_t err_code;
-    nrf_ppi_channel_t ppi_ch_timer_cc0_start_spi;
     nrf_ppi_channel_t ppi_ch_spi_end_counter1_count;
-    
+#if US_SPI_CHAINED_XFERS
+    nrf_ppi_channel_t ppi_ch_spi_end_start_spi;
+    nrf_ppi_channel_t ppi_ch_counter1_cc0_stop_chain;
+
+     //* Init SPI END event starts the next transfer, enabled through the group for each US frame
+    err_code = nrf_drv_ppi_group_alloc(&ppi_group_xfer_chain);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_drv_ppi_channel_alloc(&ppi_ch_spi_end_start_spi);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_drv_ppi_channel_assign(ppi_ch_spi_end_start_spi, spi_end_evt_addr, start_spi_task_addr);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_drv_ppi_channel_include_in_group(ppi_ch_spi_end_start_spi, ppi_group_xfer_chain);
+    APP_ERROR_CHECK(err_code);
+
+     //* Init COUNTER 1 CC0 disables the chain once the last transfer is started
+    err_code = nrf_drv_ppi_channel_alloc(&ppi_ch_counter1_cc0_stop_chain);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_drv_ppi_channel_assign(ppi_ch_counter1_cc0_stop_chain, counter1_cc0_evt_addr,
+                                          nrf_drv_ppi_task_addr_group_disable_get(ppi_group_xfer_chain));
+    APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_drv_ppi_channel_enable(ppi_ch_counter1_cc0_stop_chain);
+    APP_ERROR_CHECK(err_code);
+#else
+    nrf_ppi_channel_t ppi_ch_timer_cc0_start_spi;
 
      //* Init timer0 timout to start SPI
     err_code = nrf_drv_ppi_channel_alloc(&ppi_ch_timer_cc0_start_spi);
@@ -240,6 +379,10 @@ void ppi_init()
     
     err_code = nrf_drv_ppi_channel_assign(ppi_ch_timer_cc0_start_spi, timer0_timeout_cc0_evt_addr, start_spi_task_addr);
     APP_ERROR_CHECK(err_code);
+
+    err_code = nrf_drv_ppi_channel_enable(ppi_ch_timer_cc0_start_spi);
+    APP_ERROR_CHECK(err_code);
+#endif
     
 
      //* Init SPI END event causes COUNTER 1 to increment
@@ -249,9 +392,6 @@ void ppi_init()
     err_code = nrf_drv_ppi_channel_assign(ppi_ch_spi_end_counter1_count, spi_end_evt_addr, counter1_count_task_addr);
     APP_ERROR_CHECK(err_code);
     
-    // Enable both configured PPI channels
-    err_code = nrf_drv_ppi_channel_enable(ppi_ch_timer_cc0_start_spi);
-    APP_ERROR_CHECK(err_code);
     err_code = nrf_drv_ppi_channel_enable(ppi_ch_spi_end_counter1_count);
     APP_ERROR_CHECK(err_code);
 }
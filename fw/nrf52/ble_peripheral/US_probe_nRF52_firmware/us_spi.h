@@ -36,6 +36,30 @@
      */
     void us_spi_init(void);
 
+    /**@brief Start the SPI transfers of a US frame into rx_buf
+     *
+     *@details Called on the data ready edge of the MSP430. The
+     * transfers run without the CPU, chained through PPI or started
+     * by the timer (US_SPI_CHAINED_XFERS).
+     */
+    void us_spi_start_frame(uint8_t *rx_buf);
+
+    /**@brief Forward a package received over BLE to the MSP430
+     *
+     *@details The package is sent with the next SPI transactions.
+     * If a US frame is being transferred, it is held back until the
+     * transfer is done. A configuration package also sets the number
+     * of SPI transfers per US frame, starting after the exchange
+     * that delivers it to the MSP430.
+     */
+    void us_spi_forward_package(const uint8_t *data, uint16_t len);
+
+    /**@brief Number of SPI transfers for a US frame of sampleSize bytes
+     *        (sample size field of a configuration package, the MSB
+     *        selects the extended header)
+     */
+    uint8_t us_spi_calc_number_of_xfers(uint16_t sampleSize);
+
 
 #endif
 
@@ -92,12 +92,19 @@ static uint16_t   m_conn_handle          = BLE_CONN_HANDLE_INVALID;
 ArrayList_type p_rx_data_1[NUMBER_OF_XFERS] = {0};
 ArrayList_type p_rx_data_2[NUMBER_OF_XFERS] = {0};
 
-// Flag to implement double buffering
+// Flag to implement double buffering, set if the next frame is received into buffer 1
 volatile bool flag_use_buf_1 = true;
+// Set if the frame to send to python is in buffer 1
+volatile bool us_frame_in_buf_1 = true;
 
 // Flag to indicate that an US frame is ready to be sent to python
 bool send_us_frame_to_vcom = false;
 
+// Number of transfers of a US frame, follows the sample size of the last configuration package
+volatile uint8_t number_of_xfers = NUMBER_OF_XFERS;
+// Number of transfers of the US frame ready to be sent to python
+volatile uint8_t us_frame_number_of_xfers = NUMBER_OF_XFERS;
+
 //static bool m_usb_connected = false;
 bool m_usb_connected = false;
 
@@ -112,6 +112,15 @@ extern volatile bool flag_use_buf_1;
 extern ArrayList_type p_rx_data_1[NUMBER_OF_XFERS];
 extern ArrayList_type p_rx_data_2[NUMBER_OF_XFERS];
 
+extern volatile uint8_t number_of_xfers;
+extern volatile uint8_t us_frame_number_of_xfers;
+extern volatile bool us_frame_in_buf_1;
+
+// Frames lost over the radio (sequence gap) and frames dropped because the previous one
+// was still being sent to python
+static uint32_t us_frames_lost = 0;
+static uint32_t us_frames_dropped = 0;
+
 
 
 /**@brief Function to start scanning. */
@@ -217,6 +226,112 @@ static void db_disc_handler(ble_db_discovery_evt_t * p_evt)
  * @param[in]   p_ble_nus_evt Pointer to the NUS client event.
  */
 
+/**@brief Function to reassemble the US frames from the BLE packets of the probe.
+ *
+ * @details The payload of a packet continues the current frame or starts new ones at the
+ *          offset of its header. A missing packet (sequence gap) drops the current frame,
+ *          the next frame start resynchronizes. A complete frame is handed to the virtual
+ *          COM port and the other buffer is filled next. If the previous frame was not sent
+ *          yet, the frame is dropped and its buffer reused.
+ */
+static void us_stream_packet_received(uint8_t const * p_data, uint16_t data_len)
+{
+    static uint8_t  next_seq = 0;
+    static bool     in_frame = false;
+    static uint16_t frame_len = 0;
+    static uint16_t frame_pos = 0;
+    uint8_t  frame_start;
+    uint16_t pos;
+
+    if (data_len <= US_BLE_PACKET_HEADER_LEN)
+        return;
+
+    if (p_data[0] != next_seq)
+    {
+        // Packets lost, wait for the next frame start
+        if (in_frame)
+            us_frames_lost++;
+        in_frame = false;
+    }
+    next_seq = p_data[0] + 1;
+    frame_start = p_data[1];
+
+    p_data += US_BLE_PACKET_HEADER_LEN;
+    data_len -= US_BLE_PACKET_HEADER_LEN;
+    pos = 0;
+
+    if (!in_frame)
+    {
+        if (frame_start >= data_len)
+            return;
+        pos = frame_start;
+    }
+
+    while (pos < data_len)
+    {
+        uint8_t * frame = flag_use_buf_1 ? &p_rx_data_1[0].buffer[0] : &p_rx_data_2[0].buffer[0];
+
+        if (!in_frame)
+        {
+            // Frames of the configuration, a heartbeat or an acknowledge is one transfer long,
+            // the status and IMU records of the probe are shorter
+            if (p_data[pos] == MEAS_START_OF_FRAME_MASK)
+                frame_len = number_of_xfers * BYTES_PR_XFER;
+            else if ((p_data[pos] == MEAS_START_OF_HEARTBEAT) || (p_data[pos] == MEAS_START_OF_ACK))
+                frame_len = BYTES_PR_XFER;
+            else if (p_data[pos] == US_STREAM_START_STATUS)
+                frame_len = US_STREAM_STATUS_LEN;
+            else if (p_data[pos] == US_STREAM_START_IMU)
+                frame_len = US_STREAM_IMU_LEN;
+            else
+                return;
+
+            // Invert LED 1 (Green)
+            bsp_board_led_invert(BLE_LED_ID);
+            frame_pos = 0;
+            in_frame = true;
+        }
+
+        uint16_t n = frame_len - frame_pos;
+        if (n > data_len - pos)
+            n = data_len - pos;
+        memcpy(&frame[frame_pos], &p_data[pos], n);
+        frame_pos += n;
+        pos += n;
+
+        if (frame_pos == frame_len)
+        {
+            in_frame = false;
+            if (send_us_frame_to_vcom)
+            {
+                // Previous frame still being sent to python
+                us_frames_dropped++;
+                continue;
+            }
+
+            // The status record is sent like a frame of one transfer
+            if (frame[0] == US_STREAM_START_STATUS)
+            {
+                memset(&frame[frame_len], 0, BYTES_PR_XFER - frame_len);
+                memcpy(&frame[frame_len], &us_frames_lost, 4);
+                memcpy(&frame[frame_len + 4], &us_frames_dropped, 4);
+                frame_len = BYTES_PR_XFER;
+            }
+            else if (frame[0] == US_STREAM_START_IMU)
+            {
+                memset(&frame[frame_len], 0, BYTES_PR_XFER - frame_len);
+                frame_len = BYTES_PR_XFER;
+            }
+
+            // Ready to send entire frame to python through virtual COM
+            us_frame_number_of_xfers = frame_len / BYTES_PR_XFER;
+            us_frame_in_buf_1 = flag_use_buf_1;
+            flag_use_buf_1 = !flag_use_buf_1;
+            send_us_frame_to_vcom = true;
+        }
+    }
+}
+
 /**@snippet [Handling events from the ble_nus_c module] */
 static void ble_nus_c_evt_handler(ble_nus_c_t * p_ble_nus_c, ble_nus_c_evt_t const * p_ble_nus_evt)
 {
@@ -232,44 +347,8 @@ static void ble_nus_c_evt_handler(ble_nus_c_t * p_ble_nus_c, ble_nus_c_evt_t con
             APP_ERROR_CHECK(err_code);
             break;
 
-        case BLE_NUS_C_EVT_NUS_TX_EVT:;
-            static uint8_t count_packets = 0;
-            // Check if it is the first (of the four) BLE packets
-            if((p_ble_nus_evt->p_data[0] == MEAS_START_OF_FRAME_MASK) && (p_ble_nus_evt->data_len == 202))
-            {
-                // Invert LED 1 (Green)
-                bsp_board_led_invert(BLE_LED_ID);
-                // First BLE packet of this frame
-                count_packets = 0;
-                if(flag_use_buf_1)
-                {
-                    memcpy(&p_rx_data_1[count_packets], p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
-                }
-                else
-                {
-                    memcpy(&p_rx_data_2[count_packets], p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
-                }
-                count_packets++;
-            }
-            else if (count_packets < NUMBER_OF_XFERS)
-            {   
-                // More BLE packets of the same frame
-                if(flag_use_buf_1)
-                {
-                    memcpy(&p_rx_data_1[count_packets], p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
-                }
-                else
-                {
-                    memcpy(&p_rx_data_2[count_packets], p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
-                }
-                count_packets++;
-                if(count_packets == NUMBER_OF_XFERS)
-                {
-                    // Ready to send entire frame to python through virtual COM
-                    send_us_frame_to_vcom = true;
-                }
-            }
-            
+        case BLE_NUS_C_EVT_NUS_TX_EVT:
+            us_stream_packet_received(p_ble_nus_evt->p_data, p_ble_nus_evt->data_len);
             break;
 
         case BLE_NUS_C_EVT_DISCONNECTED:
@@ -28,9 +28,58 @@
 #define US_DEFINES_H
 
     #define BYTES_PR_XFER   201
-    // Number of transfers to complete
+    // Max number of transfers to complete
     #define NUMBER_OF_XFERS 4
     #define MEAS_START_OF_FRAME_MASK 0xFF
+    // Heartbeat sent instead of a quiet frame (threshold gating),
+    // a single BLE packet
+    #define MEAS_START_OF_HEARTBEAT 0xFE
+    // Acknowledge of a configuration package or restart command,
+    // a single BLE packet
+    #define MEAS_START_OF_ACK 0xFD
+
+    // The probe sends the US frames as a byte stream cut into BLE packets up to the
+    // ATT MTU. Header of a packet: sequence number (wraps at 256) and offset of the
+    // first frame start in the payload, US_BLE_NO_FRAME_START if the packet only
+    // continues a frame.
+    #define US_BLE_PACKET_HEADER_LEN 2
+    #define US_BLE_NO_FRAME_START 0xFF
+
+    // Status record of the probe in the stream (ring and BLE TX queue counters, see the probe firmware),
+    // forwarded as a frame of one transfer. The dongle appends the frames lost over the
+    // radio and the frames it dropped itself (4 Bytes each).
+    #define US_STREAM_START_STATUS 0xFC
+    #define US_STREAM_STATUS_LEN 28
+
+    // IMU record of the probe in the stream (accelerometer FIFO samples with their index
+    // and time stamp, see the probe firmware), forwarded as a frame of one transfer
+    #define US_STREAM_START_IMU 0xFB
+    #define US_STREAM_IMU_LEN 198
+
+    // Size of the US frame header sent by the MSP430 (bytes)
+    #define US_FRAME_HEADER_SIZE 4
+    // Size of the extended header, selected by the MSB of the sample size
+    #define US_FRAME_EXT_HEADER_SIZE 16
+    #define CONF_PACK_SAMPLE_SIZE_EXT_HEADER 0x8000
+    // Bits 12-13 of the sample size select the packing of the samples
+    // (1: 2 samples in 3 bytes, 2: 1 byte per sample)
+    #define CONF_PACK_SAMPLE_SIZE_PACK_MASK 0x3000
+    #define CONF_PACK_SAMPLE_SIZE_PACK_SHIFT 12
+    // Bits 10-11 of the sample size carry log2 of the envelope decimation,
+    // the frames hold every 2^n-th sample
+    #define CONF_PACK_SAMPLE_SIZE_LOG2_DEC_MASK 0x0C00
+    #define CONF_PACK_SAMPLE_SIZE_LOG2_DEC_SHIFT 10
+    #define SAMPLE_PACK_12BIT 1
+    #define SAMPLE_PACK_LOG8 2
+
+    // Start byte of a configuration package and offset of its sample size
+    #define START_BYTE_CONF_PACK 0xFA
+    #define CONF_PACK_SAMPLE_SIZE_OFFSET 16
+
+    // Start byte of a preset command, followed by the operation and the slot.
+    // The MSP430 sends full length frames for a selected preset.
+    #define START_BYTE_PRESET 0xFC
+    #define PRESET_CMD_SELECT 0x01
 
 
 
@@ -55,6 +55,7 @@
  * 
  */
 
+#include <string.h>
 #include "boards.h"
 #include "ble_nus_c.h"
 #include "nrf_drv_clock.h"
@@ -83,12 +84,15 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
 #define CDC_ACM_DATA_EPOUT      NRF_DRV_USBD_EPOUT1
 
 
-// Maximum size of the MSP config in bytes
-// According to the Config description
-#define READ_SIZE               68
+// Size of the packages from python in bytes (configuration packages and
+// commands are padded to one SPI transfer to the MSP430, see PACKAGE_LEN
+// in uss_conf.py)
+#define READ_SIZE               BYTES_PR_XFER
 
 
 static char m_rx_buffer[READ_SIZE];
+// Package being forwarded, the next read goes to m_rx_buffer meanwhile
+static uint8_t m_package[READ_SIZE];
 static char m_cdc_data_array[BLE_NUS_MAX_DATA_LEN];
 static char start_string[9] = "START\n";
 
@@ -117,6 +121,10 @@ extern ArrayList_type p_rx_data_2[NUMBER_OF_XFERS];
 
 extern bool m_usb_connected;
 
+extern volatile uint8_t number_of_xfers;
+extern volatile uint8_t us_frame_number_of_xfers;
+extern volatile bool us_frame_in_buf_1;
+
 
 /**@brief Function to process virual COM port queue
  *
@@ -147,14 +155,14 @@ void us_virtual_com_port_queue_process(void)
 
         }
         static int  frame_counter = 0;
-        // Switch between buffers each time
-        if(flag_use_buf_1)
+        int frame_xfers = us_frame_number_of_xfers;
+        // The BLE handler switched buffers when the frame was complete
+        if(us_frame_in_buf_1)
         {
-            flag_use_buf_1 = false;
-            while(frame_counter<NUMBER_OF_XFERS)
+            while(frame_counter<frame_xfers)
             {
                 app_usbd_event_queue_process();
-                if(frame_counter<NUMBER_OF_XFERS)
+                if(frame_counter<frame_xfers)
                 {      
                     ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, &p_rx_data_1[frame_counter], BYTES_PR_XFER);
                     if (ret == NRF_SUCCESS)
@@ -166,11 +174,10 @@ void us_virtual_com_port_queue_process(void)
         }
         else
         {
-            flag_use_buf_1 = true;
-            while(frame_counter<NUMBER_OF_XFERS)
+            while(frame_counter<frame_xfers)
             {
                 app_usbd_event_queue_process();
-                if(frame_counter<NUMBER_OF_XFERS)
+                if(frame_counter<frame_xfers)
                 {      
                     ret = app_usbd_cdc_acm_write(&m_app_cdc_acm, &p_rx_data_2[frame_counter], BYTES_PR_XFER);
                     if (ret == NRF_SUCCESS)
@@ -231,15 +238,49 @@ static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
             size_t size = app_usbd_cdc_acm_rx_size(p_cdc_acm);
             //NRF_LOG_INFO("RX: size: %lu char: %c", size, m_rx_buffer[0]);
 
-            //Set up the next first transfer
+            // Keep the package, then set up the next transfer
+            memcpy(m_package, m_rx_buffer, READ_SIZE);
             ret = app_usbd_cdc_acm_read(&m_app_cdc_acm,
                                         m_rx_buffer,
                                         READ_SIZE);
 
-            uint16_t length = READ_SIZE;
+            // The probe sends the US frames of a new configuration in as many
+            // transfers as the frame header and its sample size need
+            if (m_package[0] == START_BYTE_CONF_PACK)
+            {
+                uint16_t sample_size = m_package[CONF_PACK_SAMPLE_SIZE_OFFSET] |
+                                       ((uint16_t)m_package[CONF_PACK_SAMPLE_SIZE_OFFSET + 1] << 8);
+                uint16_t header = (sample_size & CONF_PACK_SAMPLE_SIZE_EXT_HEADER) ?
+                                  US_FRAME_EXT_HEADER_SIZE : US_FRAME_HEADER_SIZE;
+                uint8_t pack = (sample_size & CONF_PACK_SAMPLE_SIZE_PACK_MASK) >>
+                               CONF_PACK_SAMPLE_SIZE_PACK_SHIFT;
+                uint8_t log2_dec = (sample_size & CONF_PACK_SAMPLE_SIZE_LOG2_DEC_MASK) >>
+                                   CONF_PACK_SAMPLE_SIZE_LOG2_DEC_SHIFT;
+                uint32_t payload = sample_size & ~(CONF_PACK_SAMPLE_SIZE_EXT_HEADER |
+                                                   CONF_PACK_SAMPLE_SIZE_PACK_MASK |
+                                                   CONF_PACK_SAMPLE_SIZE_LOG2_DEC_MASK);
+
+                // Envelope frames hold every 2^n-th sample
+                payload = ((payload / 2) >> log2_dec) * 2;
+
+                // Packed samples take 3 bytes per 2 samples or 1 byte each
+                if (pack == SAMPLE_PACK_12BIT)
+                    payload = (3 * (payload / 2) + 1) / 2;
+                else if (pack == SAMPLE_PACK_LOG8)
+                    payload = payload / 2;
+
+                uint32_t xfers = (header + payload + BYTES_PR_XFER - 1) / BYTES_PR_XFER;
+
+                number_of_xfers = (xfers > NUMBER_OF_XFERS) ? NUMBER_OF_XFERS : xfers;
+            }
+            else if ((m_package[0] == START_BYTE_PRESET) &&
+                     (m_package[1] == PRESET_CMD_SELECT))
+            {
+                number_of_xfers = NUMBER_OF_XFERS;
+            }
 
             // Invert LED if data transmission is sucessfull
-            if(send_ble_packet((uint8_t *) m_rx_buffer, READ_SIZE) == NRF_SUCCESS)
+            if(send_ble_packet(m_package, READ_SIZE) == NRF_SUCCESS)
             {
                 // Red LED of RGB
                 bsp_board_led_invert(SERIAL_RX_LED_ID);
@@ -77,6 +77,15 @@ class _ConfigBytes():
 
         # Get configuration parameter as bytes
 
+        self.check_value(value)
+
+        return np.array([value]).astype(self.format).tobytes()
+
+
+    def check_value(self, value):
+
+        # Check the configuration parameter against its limits
+
         if self.limit_type == 'limit':
             # Check if value is within the allowed range
             if (value < self.min_val) or (value > self.max_val):
@@ -85,8 +94,6 @@ class _ConfigBytes():
             # Check if value is located in the list of allowed values
             if value not in self.min_val:
                 raise ValueError(self.friendly_name + " equal to " + str(value) + " is not allowed. Allowed values are: " + str(self.min_val))
-        
-        return np.array([value]).astype(self.format).tobytes()
   
     
     def get_as_widget(self, value):
@@ -134,6 +141,10 @@ class _ConfigBytes():
             )
 
 
+# The DC-DC turn on time and the measurement period go beyond the 16-bit slow timer of the MSP430 (2 s), the upper
+# 16 bits of both are sent after the burst length. The MSP430 counts long periods in steps and stays in LPM3 in between.
+PERIOD_TICKS_MAX = 3600 * 32768     # 1 hour
+
 # Configuration package representation
 # The first list contains basic settings
 # The second list contains advanced settings
@@ -142,8 +153,8 @@ class _ConfigBytes():
 #                     config_name,         friendly_name,                limit_type, min_val,                           max_val,                        format  
 configuration_package = [
     [
-        _ConfigBytes('dcdc_turnon',       'DC-DC turn on time [us]',        'limit', 0,                                 65535,                          '<u2'),
-        _ConfigBytes('meas_period',       'Acquisition Period [us]',        'limit', 655,                               65535,                          '<u2'),
+        _ConfigBytes('dcdc_turnon',       'DC-DC turn on time [us]',        'limit', 0,                                 PERIOD_TICKS_MAX,               '<u2'),
+        _ConfigBytes('meas_period',       'Acquisition Period [us]',        'limit', 655,                               PERIOD_TICKS_MAX,               '<u2'),
         _ConfigBytes('trans_freq',        'Transmitter frequency [Hz]',     'limit', 0,                                 5000000,                        '<u4'),
         _ConfigBytes('pulse_freq',        'Pulse frequency [Hz]',           'limit', 0,                                 5000000,                        '<u4'),
         _ConfigBytes('num_pulses',        'Number of pulses',               'limit', 0,                                 30,                             '<u1'),
@@ -159,9 +170,105 @@ configuration_package = [
         _ConfigBytes('start_pgainbias',   'PGA in bias start time [us]',    'limit', 0,                                 65535,                          '<u2'),
         _ConfigBytes('start_adcsampl',    'ADC sampling start time [us]',   'limit', 0,                                 65535,                          '<u2'),
         _ConfigBytes('restart_capt',      'Capture restart time [us]',      'limit', 0,                                 65535,                          '<u2'),
-        _ConfigBytes('capt_timeout',      'Capture timeout time [us]',      'limit', 0,                                 65535,                          '<u2')
+        _ConfigBytes('capt_timeout',      'Capture timeout time [us]',      'limit', 0,                                 65535,                          '<u2'),
+        _ConfigBytes('trigger_mode',      'Trigger (0: SW, 1: timer)',      'limit', 0,                                 1,                              '<u1')
     ],
     [
         _ConfigBytes('num_acqs',          'Number of acquisitions',         'limit', 0,                                 10000000,                        None)
     ]
-]
\ No newline at end of file
+]
+
+# Sequence table entry (optional, one per TX/RX config)
+# Overrides the basic settings of the same name for one TX/RX config
+# Number of pulses and sampling frequency are packed into one byte
+SEQ_ENTRY_PARAMS = ('rx_gain', 'pulse_freq', 'num_pulses', 'sampling_freq', 'num_samples')
+#                     config_name,         friendly_name,                limit_type, min_val,                           max_val,                        format
+sequence_table_entry = [
+    _ConfigBytes('rx_gain',           'Receive (RX) gain [dB]',         'list',  PGA_GAIN_REG,                      PGA_GAIN,                       '<u1'),
+    _ConfigBytes('pulse_freq',        'Pulse frequency [kHz]',          'limit', 1,                                 5000,                           '<u2'),
+    _ConfigBytes('num_pulses',        'Number of pulses',               'limit', 0,                                 30,                             '<u1'),
+    _ConfigBytes('sampling_freq',     'Sampling frequency [Hz]',        'list',  USS_CAPT_OVER_SAMPLE_RATES_REG,    USS_CAPTURE_ACQ_RATES,          '<u1'),
+    _ConfigBytes('num_samples',       'Number of samples',              'limit', 1,                                 1600,                           '<u2')
+]
+
+# Extended frame header, selected by the MSB of the number of samples
+SAMPLE_SIZE_EXT_HEADER = 0x8000
+EXT_HEADER_LEN         = 16
+FRAME_LEN_MAX          = 804
+
+# Packed samples, selected by bits 12-13 of the number of samples (raw and averaged 16-bit frames only)
+# 12 bits - 2 samples in 3 bytes (lossless for the 12-bit ADC), 8 bits - log-compressed
+SAMPLE_BITS            = (16, 12, 8)
+SAMPLE_BITS_REG        = (0, 1, 2)
+SAMPLE_SIZE_PACK_SHIFT = 12
+SAMPLE_SIZE_PACK_MASK  = 0x3000
+
+# log2 of the envelope decimation, bits 10-11 of the number of samples (sizes the frames on the probe and the dongle)
+SAMPLE_SIZE_LOG2_DEC_SHIFT = 10
+SAMPLE_SIZE_LOG2_DEC_MASK  = 0x0C00
+
+
+def sample_payload_length(num_samples, sample_bits=16):
+
+    # Bytes of num_samples samples in a frame (see packUsFrame() of the MSP430)
+    return -(-num_samples * sample_bits // 8)
+
+# Burst mode, sent after the depth windows
+# The MSP430 keeps burst_len frames in a ring of 12 kB in its FRAM and sends them after the last acquisition of the burst
+BURST_LEN_MAX   = 32
+BURST_RING_SIZE = 12288
+#                     config_name,         friendly_name,                limit_type, min_val,                           max_val,                        format
+frame_burst = [
+    _ConfigBytes('burst_len',         'Frames per burst (0: off)',      'limit', 0,                                 BURST_LEN_MAX,                  '<u1')
+]
+
+# Threshold gating, sent after the upper 16 bits of the period
+# A frame is only sent if one of the samples [gate_start, gate_start + gate_samples) of the raw or averaged frame lies
+# outside +-gate_threshold (gate_samples 0 - up to the end of the frame). After gate_heartbeat quiet frames the MSP430
+# sends a heartbeat (header only, see WulpusDongle.receive_data()) instead, 0 - every frame is sent.
+GATE_THRESHOLD_MAX = 2047
+#                     config_name,         friendly_name,                limit_type, min_val,                           max_val,                        format
+frame_gate = [
+    _ConfigBytes('gate_threshold',    'Gate threshold [ADC counts]',    'limit', 0,                                 GATE_THRESHOLD_MAX,             '<u2'),
+    _ConfigBytes('gate_start',        'Gate start sample',              'limit', 0,                                 800,                            '<u2'),
+    _ConfigBytes('gate_samples',      'Gate samples (0: to the end)',   'limit', 0,                                 800,                            '<u2'),
+    _ConfigBytes('gate_heartbeat',    'Quiet frames per heartbeat (0: off)', 'limit', 0,                            255,                            '<u1')
+]
+
+# Configuration presets, sent after the threshold gating (not part of the configuration hash)
+# The MSP430 stores the package in one of PRESET_SLOTS slots of its FRAM (slot + 1, 0 - not stored), with PRESET_BOOT
+# it acquires with the preset right after power-up
+PRESET_SLOTS = 4
+PRESET_BOOT  = 0x80
+#                     config_name,         friendly_name,                limit_type, min_val,                           max_val,                        format
+frame_preset = [
+    _ConfigBytes('preset_slot',       'Preset slot + 1 (0: not stored)', 'limit', 0,                                PRESET_SLOTS,                   '<u1')
+]
+
+# On-device processing, sent after the sequence table
+# 0 - raw samples, 1 - bandpass, envelope and decimation on the MSP430
+DSP_MODE_RAW      = 0
+DSP_MODE_ENVELOPE = 1
+DSP_DECIMATION    = (1, 2, 4, 8)
+#                     config_name,         friendly_name,                limit_type, min_val,                           max_val,                        format
+frame_processing = [
+    _ConfigBytes('dsp_mode',          'Processing (0: raw, 1: envelope)', 'limit', 0,                               1,                              '<u1'),
+    _ConfigBytes('decimation',        'Envelope decimation',            'list',  DSP_DECIMATION,                    DSP_DECIMATION,                 '<u1')
+]
+
+# Coherent averaging, sent after the on-device processing settings
+# Number of acquisitions per frame (bits 0-6) and 32-bit sums instead of the mean (bit 7) share one byte
+AVG_NUM_ACQS      = (1, 2, 4, 8, 16, 32, 64)
+#                     config_name,         friendly_name,                limit_type, min_val,                           max_val,                        format
+frame_averaging = [
+    _ConfigBytes('num_avg',           'Averaged acquisitions per frame', 'list', AVG_NUM_ACQS,                      AVG_NUM_ACQS,                   '<u1'),
+    _ConfigBytes('avg_sum32',         'Averaging output (0: mean, 1: 32-bit sums)', 'limit', 0,                     1,                              '<u1')
+]
+
+# Depth windows (optional, one per TX/RX config), sent after the averaging settings
+# Each window replaces the ADC sampling start time and the number of samples of its TX/RX config
+#                     config_name,         friendly_name,                limit_type, min_val,                           max_val,                        format
+depth_window_entry = [
+    _ConfigBytes('start_adcsampl',    'ADC sampling start time [us]',   'limit', 0,                                 65535,                          '<u2'),
+    _ConfigBytes('num_samples',       'Number of samples',              'limit', 1,                                 1600,                           '<u2')
+]
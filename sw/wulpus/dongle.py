@@ -15,13 +15,122 @@
    SPDX-License-Identifier: Apache-2.0
 """
 
+import time
 import serial
 from serial.tools.list_ports import comports
 from serial.tools.list_ports_common import ListPortInfo
 import numpy as np
 
+from wulpus.uss_conf import START_BYTE_CONF_PACK, SAMPLE_SIZE_EXT_HEADER, START_BYTE_PRESET, PRESET_CMD_SELECT, \
+                            SAMPLE_BITS, SAMPLE_BITS_REG, SAMPLE_SIZE_PACK_SHIFT, SAMPLE_SIZE_PACK_MASK, \
+                            SAMPLE_SIZE_LOG2_DEC_SHIFT, SAMPLE_SIZE_LOG2_DEC_MASK, sample_payload_length
+
+# Number of samples per frame until a configuration package is sent
 ACQ_LENGTH_SAMPLES = 400
 
+# A frame (4 byte header and samples) is sent in transfers of BYTES_PR_XFER
+# bytes, as many as the number of samples of the configuration needs
+BYTES_PR_XFER      = 201
+NUMBER_OF_XFERS    = 4
+FRAME_HEADER_LEN   = 4
+# Extended header (WulpusUssConfig ext_header), see last_header
+FRAME_EXT_HEADER_LEN = 16
+
+# Status flags of the extended header
+FRAME_STATUS_WARM            = 0x01
+FRAME_STATUS_ERR_XTAL        = 0x02
+FRAME_STATUS_ERR_UUPS        = 0x04
+FRAME_STATUS_ERR_PLL_UNLOCK  = 0x08
+FRAME_STATUS_ERR_UUPS_INT    = 0x10
+FRAME_STATUS_ERR_DATA        = 0x20
+FRAME_STATUS_ERR_TIMEOUT     = 0x40
+
+# Second header byte: TX/RX config ID (bits 0-3), frame format (bits 4-5)
+# and log2 of the envelope decimation factor or the packing (bits 6-7)
+FRAME_ID_MASK          = 0x0F
+FRAME_FORMAT_RAW       = 0
+FRAME_FORMAT_ENVELOPE  = 1
+FRAME_FORMAT_SUM32     = 2
+FRAME_FORMAT_PACKED    = 3
+FRAME_PACK_12BIT       = 1
+FRAME_PACK_LOG8        = 2
+
+# First header byte of a heartbeat, sent instead of quiet frames with the
+# threshold gating of the configuration (gate_heartbeat). Only its first
+# transfer is relayed, receive_data() returns no samples and
+# FRAME_FORMAT_HEARTBEAT (not a header value).
+FRAME_START_HEARTBEAT  = 0xFE
+FRAME_FORMAT_HEARTBEAT = 4
+
+# First header byte of the acknowledge of a configuration package or a
+# restart command, relayed like a heartbeat. receive_data() returns no
+# samples and FRAME_FORMAT_ACK, last_ack holds the status, the configuration
+# hash (0 unless applied) and the package version of the MSP430.
+FRAME_START_ACK  = 0xFD
+FRAME_FORMAT_ACK = 5
+
+# Status of the acknowledge
+ACK_OK            = 0x00
+ACK_NACK_INVALID  = 0x01
+ACK_NACK_VERSION  = 0x02
+ACK_NACK_CRC      = 0x03
+ACK_STOPPED       = 0x04
+
+# Status record of the probe, a single transfer sent after the nRF52 dropped
+# frames from its ring. receive_data() returns no samples and
+# FRAME_FORMAT_STATUS, last_status holds the counters since the last
+# configuration package. A gap in the acquisition numbers that frames_dropped
+# does not account for happened on the radio (frames_lost of the dongle).
+# The tx_* counters show the BLE TX queue of the probe: frames buffered and
+# their maximum, packets sent, times and time (s) waited for a free buffer.
+FRAME_START_STATUS  = 0xFC
+FRAME_FORMAT_STATUS = 6
+RING_DROP_POLICIES  = ('drop newest', 'drop oldest', 'decimate')
+
+# IMU record of the probe, accelerometer samples read from the FIFO of the
+# IIS2DH (400 Hz, high resolution), independent of the US frames.
+# receive_data() returns no samples and FRAME_FORMAT_IMU, last_imu holds the
+# index of the first sample, the time stamp of the FIFO watermark (RTC ticks,
+# IMU_TICKS_HZ, 24 bit) and the samples (X, Y, Z, left-justified 12 bit).
+FRAME_START_IMU     = 0xFB
+FRAME_FORMAT_IMU    = 7
+IMU_TICKS_HZ        = 32768
+IMU_FLAG_OVERRUN    = 0x01
+IMU_FLAG_DROPPED    = 0x02
+IMU_HEADER_LEN      = 12
+
+
+def unpack_12bit(data:bytes, num_samples:int):
+    """
+    Unpack 12-bit samples, 2 samples in 3 bytes (a[7:0], a[11:8] | b[3:0] << 4, b[11:4]).
+    """
+
+    raw = np.frombuffer(data[:sample_payload_length(num_samples, 12)], dtype=np.uint8)
+    raw = np.append(raw, np.zeros(-len(raw) % 3, dtype=np.uint8)).reshape(-1, 3).astype('<i2')
+
+    samples = np.empty(raw.shape[0] * 2, dtype='<i2')
+    samples[0::2] = raw[:, 0] | ((raw[:, 1] & 0x0F) << 8)
+    samples[1::2] = (raw[:, 1] >> 4) | (raw[:, 2] << 4)
+
+    # Sign extension of the 12-bit values
+    return ((samples ^ 0x800) - 0x800)[:num_samples]
+
+
+def _log8_table():
+
+    # Sign (bit 7), exponent (bits 4-6) and mantissa (bits 0-3), codes below 32 are linear,
+    # above they are decoded to the middle of their step of 2^(exponent - 1)
+    codes = np.arange(256)
+    exp = (codes >> 4) & 0x07
+    mant = codes & 0x0F
+    mag = np.where(exp < 2, codes & 0x7F,
+                   ((16 + mant) << np.maximum(exp - 1, 0)) + (1 << np.maximum(exp - 2, 0)))
+    return np.where(codes & 0x80, -mag, mag).astype('<i2')
+
+# Log-compressed 8-bit code to sample
+LOG8_TABLE = _log8_table()
+
+
 class WulpusDongle():
     """
     Class representing the Wulpus dongle.
@@ -56,7 +165,28 @@ class WulpusDongle():
         self.__ser__.dsrdtr = False                 # disable hardware (DSR/DTR) flow control
         self.__ser__.writeTimeout = timeout_write   # timeout for write
 
-        self.acq_length = ACQ_LENGTH_SAMPLES
+        self.set_acq_length(ACQ_LENGTH_SAMPLES)
+        self.last_header = None
+        self.last_ack = None
+        self.last_status = None
+        self.last_imu = None
+
+
+    def set_acq_length(self, acq_length:int, ext_header:bool = False, full_frame:bool = False, sample_bits:int = 16,
+                       log2_dec:int = 0):
+        """
+        Set the number of samples per frame, the header and the frame length.
+        Called by send_config() with the number of samples of a configuration package.
+        Frames of a preset have the full length (full_frame), packed samples (sample_bits
+        12 or 8) and the decimation of the envelope (log2_dec) shorten the frame.
+        """
+
+        self.header_length = FRAME_EXT_HEADER_LEN if ext_header else FRAME_HEADER_LEN
+        payload = sample_payload_length(acq_length >> log2_dec, sample_bits)
+        xfers = NUMBER_OF_XFERS if full_frame else -(-(self.header_length + payload) // BYTES_PR_XFER)
+
+        self.acq_length = min(acq_length, (NUMBER_OF_XFERS * BYTES_PR_XFER - self.header_length) // 2)
+        self.frame_length = min(xfers, NUMBER_OF_XFERS) * BYTES_PR_XFER
 
 
     def get_available(self):
@@ -110,9 +240,11 @@ class WulpusDongle():
         return True
     
     
-    def send_config(self, conf_bytes_pack:bytes):
+    def send_config(self, conf_bytes_pack:bytes, preset_conf = None):
         """
-        Send a configuration package to the device.
+        Send a configuration package or a preset command to the device.
+        For a preset select command, preset_conf is the WulpusUssConfig stored in the preset
+        (number of samples and header of its frames).
         """
 
         if not self.__ser__.is_open:
@@ -125,21 +257,163 @@ class WulpusDongle():
 
         self.__ser__.write(conf_bytes_pack)
 
+        # The frames of a new configuration are sized to its number of samples
+        if conf_bytes_pack[0] == START_BYTE_CONF_PACK:
+            sample_size = int.from_bytes(conf_bytes_pack[16:18], 'little')
+            packing = (sample_size & SAMPLE_SIZE_PACK_MASK) >> SAMPLE_SIZE_PACK_SHIFT
+            self.set_acq_length((sample_size & ~(SAMPLE_SIZE_EXT_HEADER | SAMPLE_SIZE_PACK_MASK | SAMPLE_SIZE_LOG2_DEC_MASK)) // 2,
+                                bool(sample_size & SAMPLE_SIZE_EXT_HEADER),
+                                sample_bits=SAMPLE_BITS[SAMPLE_BITS_REG.index(packing)],
+                                log2_dec=(sample_size & SAMPLE_SIZE_LOG2_DEC_MASK) >> SAMPLE_SIZE_LOG2_DEC_SHIFT)
+        elif (conf_bytes_pack[0] == START_BYTE_PRESET) and (conf_bytes_pack[1] == PRESET_CMD_SELECT):
+            if preset_conf is not None:
+                self.set_acq_length(preset_conf.num_samples, preset_conf.ext_header, full_frame=True,
+                                    sample_bits=preset_conf.sample_bits)
+            else:
+                self.set_acq_length(ACQ_LENGTH_SAMPLES, self.header_length == FRAME_EXT_HEADER_LEN, full_frame=True)
+
         return True
     
 
+    def wait_config_ack(self, conf_hash = None, timeout:float = 2.5):
+        """
+        Wait for the acknowledge of the last command, frames received before are discarded.
+        With conf_hash (WulpusUssConfig conf_hash), wait for the acknowledge of the configuration
+        package, otherwise for the one of a restart command (acquisition stopped).
+        Returns True if acknowledged, False if rejected (last_ack holds the reason) and None on timeout.
+        """
+
+        if not self.__ser__.is_open:
+            print("Error: serial port is not open.")
+            return None
+
+        deadline = time.time() + timeout
+        timeout_read = self.__ser__.timeout
+        try:
+            while time.time() < deadline:
+                self.__ser__.timeout = deadline - time.time()
+                data = self.receive_data()
+                if (data is None) or (data[3] != FRAME_FORMAT_ACK):
+                    continue
+                if conf_hash is None:
+                    if self.last_ack['status'] == ACK_STOPPED:
+                        return True
+                elif self.last_ack['status'] == ACK_OK:
+                    return self.last_ack['conf_hash'] == conf_hash
+                elif self.last_ack['status'] != ACK_STOPPED:
+                    return False
+        finally:
+            self.__ser__.timeout = timeout_read
+
+        return None
+
+
+    def __get_ext_header__(self, header:bytes):
+
+        # Decode the extended header (see fw/msp430 us_spi.h), phases in ACLK ticks (32768 Hz, 30.5 us each,
+        # saturated at 255). seq_ticks only resolves the sequence to 0 - 3 ticks, it tells a delayed or timed out
+        # sequence apart, not the latency of a normal one.
+        return {
+            'timestamp':   int.from_bytes(header[4:8], 'little'),
+            'xtal_ticks':  header[8],
+            'uups_ticks':  header[9],
+            'seq_ticks':   header[10],
+            'status':      header[11],
+            'conf_hash':   int.from_bytes(header[12:14], 'little'),
+            'failed_acqs': header[14],
+            'preset':      header[15] - 1 if header[15] else None,
+        }
+
+
     def __get_rf_data_and_info__(self, bytes_arr:bytes):
     
-        rf_arr = np.frombuffer(bytes_arr[7:], dtype='<i2')    
-        tx_rx_id = bytes_arr[4]
+        if bytes_arr[3] == FRAME_START_ACK:
+            self.last_ack = {
+                'status':    bytes_arr[4],
+                'conf_hash': int.from_bytes(bytes_arr[5:7], 'little'),
+                'version':   bytes_arr[7],
+            }
+            return np.zeros(0, dtype='<i2'), 0, 0, FRAME_FORMAT_ACK
+
+        if bytes_arr[3] == FRAME_START_STATUS:
+            status = bytes_arr[3:]
+            self.last_status = {
+                'drop_policy':    RING_DROP_POLICIES[status[1]] if status[1] < len(RING_DROP_POLICIES) else status[1],
+                'frames':         int.from_bytes(status[2:6], 'little'),
+                'frames_dropped': int.from_bytes(status[6:10], 'little'),
+                'backpressures':  int.from_bytes(status[10:12], 'little'),
+                'ring_max':       status[12],
+                'ring_size':      status[13],
+                'tx_queue':       status[14],
+                'tx_queue_max':   status[15],
+                'tx_packets':     int.from_bytes(status[16:20], 'little'),
+                'tx_stalls':      int.from_bytes(status[20:24], 'little'),
+                'tx_stall_time':  int.from_bytes(status[24:28], 'little') / 32768,
+                'frames_lost':    int.from_bytes(status[28:32], 'little'),
+                'dongle_dropped': int.from_bytes(status[32:36], 'little'),
+            }
+            return np.zeros(0, dtype='<i2'), 0, 0, FRAME_FORMAT_STATUS
+
+        if bytes_arr[3] == FRAME_START_IMU:
+            imu = bytes_arr[3:]
+            num_samples = imu[1]
+            self.last_imu = {
+                'sample_index': int.from_bytes(imu[4:8], 'little'),
+                'ticks':        int.from_bytes(imu[8:12], 'little'),
+                'overrun':      bool(imu[2] & IMU_FLAG_OVERRUN),
+                'dropped':      bool(imu[2] & IMU_FLAG_DROPPED),
+                'acc':          np.frombuffer(imu[IMU_HEADER_LEN:IMU_HEADER_LEN + num_samples * 6],
+                                              dtype='<i2').reshape(num_samples, 3),
+            }
+            return np.zeros(0, dtype='<i2'), 0, 0, FRAME_FORMAT_IMU
+
+        start = 3 + self.header_length
+        rf_arr = np.frombuffer(bytes_arr[start:start + self.acq_length * 2], dtype='<i2')
+        tx_rx_id = bytes_arr[4] & FRAME_ID_MASK
+        frame_format = (bytes_arr[4] >> 4) & 0x03
         acq_nr = np.frombuffer(bytes_arr[5:7], dtype='<u2')[0]
 
-        return rf_arr, acq_nr, tx_rx_id
+        if bytes_arr[3] == FRAME_START_HEARTBEAT:
+            # Quiet frames skipped by the threshold gating, no samples
+            rf_arr = np.zeros(0, dtype='<i2')
+            frame_format = FRAME_FORMAT_HEARTBEAT
+        elif frame_format == FRAME_FORMAT_ENVELOPE:
+            # Only the first acq_length / decimation samples are valid
+            rf_arr = rf_arr[:self.acq_length >> (bytes_arr[4] >> 6)]
+        elif frame_format == FRAME_FORMAT_SUM32:
+            # Sums of the averaged acquisitions, half as many 32-bit samples
+            rf_arr = np.frombuffer(bytes_arr[start:start + (self.acq_length // 2) * 4], dtype='<i4')
+        elif frame_format == FRAME_FORMAT_PACKED:
+            # Packed samples, 12-bit or log-compressed 8-bit (bits 6-7)
+            if (bytes_arr[4] >> 6) == FRAME_PACK_12BIT:
+                rf_arr = unpack_12bit(bytes_arr[start:], self.acq_length)
+            else:
+                rf_arr = LOG8_TABLE[np.frombuffer(bytes_arr[start:start + self.acq_length], dtype=np.uint8)]
+
+        if self.header_length == FRAME_EXT_HEADER_LEN:
+            self.last_header = self.__get_ext_header__(bytes_arr[3:3 + FRAME_EXT_HEADER_LEN])
+        else:
+            self.last_header = None
+
+        return rf_arr, acq_nr, tx_rx_id, frame_format
     
     
     def receive_data(self):
         """
         Receive a data package from the device.
+
+        Returns (samples, acquisition number, TX/RX config ID, frame format),
+        raw frames carry acq_length samples (the number of samples of the
+        last configuration package), envelope frames acq_length / decimation
+        samples and frames with 32-bit sums acq_length / 2 samples.
+        Packed frames (sample_bits of the configuration) are unpacked to
+        acq_length 16-bit samples. Heartbeats of the threshold gating carry
+        no samples, their frame format is FRAME_FORMAT_HEARTBEAT. Acknowledges
+        and status and IMU records of the probe neither, their frame format is
+        FRAME_FORMAT_ACK (see last_ack), FRAME_FORMAT_STATUS (see last_status) or
+        FRAME_FORMAT_IMU (see last_imu).
+        With the extended header, last_header holds its fields (time stamp,
+        phase timing, status flags, failed acquisitions and config hash).
         """
 
         if not self.__ser__.is_open:
@@ -151,7 +425,12 @@ class WulpusDongle():
         if len(response_start) == 0:
             return None
         elif response_start[-6:] == b'START\n':
-            response = self.__ser__.read(self.acq_length*2 + 7)
+            # 3 padding bytes of the start string, then the frame. A heartbeat,
+            # an acknowledge, a status or an IMU record is a single transfer.
+            response = self.__ser__.read(BYTES_PR_XFER + 3)
+            if (len(response) > 3) and (response[3] not in (FRAME_START_HEARTBEAT, FRAME_START_ACK, FRAME_START_STATUS,
+                                                            FRAME_START_IMU)):
+                response += self.__ser__.read(self.frame_length - BYTES_PR_XFER)
             return self.__get_rf_data_and_info__(response)
         else:
             return None
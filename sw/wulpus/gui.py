@@ -24,7 +24,8 @@ import time
 from threading import Thread
 import os.path
 
-from wulpus.dongle import WulpusDongle
+from wulpus.dongle import WulpusDongle, ACQ_LENGTH_SAMPLES, FRAME_FORMAT_ENVELOPE, FRAME_FORMAT_SUM32, FRAME_FORMAT_HEARTBEAT, \
+                         FRAME_FORMAT_ACK, FRAME_FORMAT_STATUS, FRAME_FORMAT_IMU
 
 # plt.ioff()
 
@@ -53,8 +54,9 @@ class WulpusGuiSingleCh(widgets.VBox):
         self.uss_conf = uss_conf
         
         # Allocate memory to store the data and other parameters
-        self.data_arr = np.zeros((self.com_link.acq_length, uss_conf.num_acqs), dtype='<i2')
-        self.data_arr_bmode = np.zeros((8, self.com_link.acq_length), dtype='<i2')
+        # Frames shorter than ACQ_LENGTH_SAMPLES are padded with zeros
+        self.data_arr = np.zeros((ACQ_LENGTH_SAMPLES, uss_conf.num_acqs), dtype='<i2')
+        self.data_arr_bmode = np.zeros((8, ACQ_LENGTH_SAMPLES), dtype='<i2')
         self.acq_num_arr = np.zeros(uss_conf.num_acqs, dtype='<u2')
         self.tx_rx_id_arr = np.zeros(uss_conf.num_acqs, dtype=np.uint8)
         
@@ -391,7 +393,7 @@ class WulpusGuiSingleCh(widgets.VBox):
 #         self.fig.show()
         
         # Clean data buffer
-        acq_length = self.com_link.acq_length
+        acq_length = ACQ_LENGTH_SAMPLES
         number_of_acq = self.uss_conf.num_acqs
         self.data_arr = np.zeros((acq_length, number_of_acq), dtype='<i2')
         self.acq_num_arr = np.zeros(number_of_acq, dtype='<u2')
@@ -402,12 +404,17 @@ class WulpusGuiSingleCh(widgets.VBox):
         # Send a restart command (if system is already running)
         self.com_link.send_config(self.uss_conf.get_restart_package())
         
-        # Wait 2.5 seconds (much larger than max measurement period = 2s)
-        time.sleep(2.5)
+        # Wait until the acquisition stopped, at most 2.5 seconds (much larger
+        # than max measurement period = 2s)
+        self.com_link.wait_config_ack(timeout=2.5)
         
-        # Generate and send a configuration package
+        # Generate and send a configuration package, the MSP430 acknowledges it
         try:
             self.com_link.send_config(self.uss_conf.get_conf_package())
+            acked = self.com_link.wait_config_ack(self.uss_conf.conf_hash)
+            if not acked:
+                raise ValueError('Configuration package not acknowledged.' if acked is None else
+                                 'Configuration package rejected (status ' + str(self.com_link.last_ack['status']) + ').')
         except ValueError as e:
             self.save_data_label.value = str(e)
             self.acquisition_running = False
@@ -425,8 +432,19 @@ class WulpusGuiSingleCh(widgets.VBox):
         while self.data_cnt < number_of_acq and self.acquisition_running:
             # Receive the data
             data = self.com_link.receive_data()
-            if data is not None:
-
+            # Heartbeats of the threshold gating, acknowledges, status and IMU records carry no samples
+            if data is not None and data[3] not in (FRAME_FORMAT_HEARTBEAT, FRAME_FORMAT_ACK, FRAME_FORMAT_STATUS,
+                                                    FRAME_FORMAT_IMU):
+
+                if data[3] == FRAME_FORMAT_ENVELOPE:
+                    # Hold each envelope sample for the decimation factor
+                    data = (np.repeat(data[0], self.uss_conf.decimation),) + data[1:]
+                elif data[3] == FRAME_FORMAT_SUM32:
+                    # Display the mean
+                    data = (np.round(data[0] / self.uss_conf.num_avg).astype('<i2'),) + data[1:]
+
+                # The samples beyond the frame stay zero
+                data = (np.pad(data[0], (0, acq_length - len(data[0]))),) + data[1:]
                 self.current_data = data
 
                 if data[2] == self.rx_tx_conf_to_display and not self.bmode_check.value:
@@ -440,8 +458,12 @@ class WulpusGuiSingleCh(widgets.VBox):
                 self.tx_rx_id_arr[self.data_cnt] = data[2]
 
                 # Save data to specific z
-                self.data_arr_bmode[self.tx_rx_id_arr[self.data_cnt]] = self.get_envelope(
-                    self.filter_data(data[0]))
+                if data[3] == FRAME_FORMAT_ENVELOPE:
+                    # Envelope already computed on the device
+                    self.data_arr_bmode[self.tx_rx_id_arr[self.data_cnt]] = data[0]
+                else:
+                    self.data_arr_bmode[self.tx_rx_id_arr[self.data_cnt]] = self.get_envelope(
+                        self.filter_data(data[0]))
                 
                 self.data_cnt = self.data_cnt + 1
 
@@ -15,6 +15,7 @@
    SPDX-License-Identifier: Apache-2.0
 """
 
+import binascii
 import numpy as np
 from wulpus.config_package import *
 
@@ -23,8 +24,28 @@ from wulpus.config_package import *
 # Protocol related
 START_BYTE_CONF_PACK = 250
 START_BYTE_RESTART   = 251
-# Maximum length of the configuration package
-PACKAGE_LEN  = 68
+START_BYTE_PRESET    = 252
+START_BYTE_PATCH     = 253
+# Preset commands (get_preset_package())
+PRESET_CMD_SELECT    = 1
+PRESET_CMD_SET_BOOT  = 2
+PRESET_CMD_ERASE     = 3
+PRESET_NONE          = 255
+# Fields of a patch (get_patch_package())
+PATCH_RX_GAIN        = 0x01
+PATCH_NUM_PULSES     = 0x02
+PATCH_MEAS_PERIOD    = 0x04
+PATCH_DCDC_TURNON    = 0x08
+PATCH_ALL_CONFIGS    = 255
+PATCH_LEN            = 10
+# Size of one SPI transfer from the nRF52 to the MSP430
+PACKAGE_LEN_MAX = 201
+# Length of the packages sent to the dongle, which reads fixed-length
+# packages. Shorter packages are padded with zeros.
+PACKAGE_LEN  = PACKAGE_LEN_MAX
+# Format version of the configuration package, sent with its CRC-16 after
+# the preset byte. The MSP430 rejects other versions (see WulpusDongle.wait_config_ack()).
+CONF_PACK_VERSION = 1
 
 
 class WulpusUssConfig():
@@ -33,14 +54,16 @@ class WulpusUssConfig():
 
     Attributes:
         num_acqs (int): Number of acquisitions to perform.
-        dcdc_turnon (int): DC-DC turn on time in microseconds.
-        meas_period (int): Measurement period in microseconds.
+        dcdc_turnon (int): DC-DC turn on time in microseconds, from the start of the measurement period. With long
+                           periods set it shortly before meas_period, the converters stay on until the acquisition.
+        meas_period (int): Measurement period in microseconds (up to 1 hour).
         trans_freq (int): Transducer frequency in Hertz.
         pulse_freq (int): Pulse frequency in Hertz.
         num_pulses (int): Number of pulses to excite the transducer.
         sampling_freq (int): Sampling frequency in Hertz.
         oversampling_rate (int): Oversampling rate.
-        num_samples (int): Number of samples to acquire.
+        num_samples (int): Number of samples to acquire. Sets the frame length from the MSP430 to the host, fewer samples
+                           allow shorter measurement periods.
         rx_gain (int): RX gain in dB. (must be one of PGA_GAIN)
         num_txrx_configs (int): Number of TX/RX configurations.
         tx_configs (int[]): TX configurations. (Generated by WulpusRxTxConfigGen)
@@ -52,6 +75,44 @@ class WulpusUssConfig():
         start_adcsampl (int): ADC sampling start time in microseconds.
         restart_capt (int): Capture restart time in microseconds.
         capt_timeout (int): Capture timeout time in microseconds.
+        trigger_mode (int): Acquisition trigger, 0 - software (timer interrupt), 1 - timer output (hardware).
+        seq_configs (dict[]): Optional sequence table, one dict per TX/RX configuration. Each dict can override
+                              rx_gain, pulse_freq, num_pulses, sampling_freq and num_samples for its configuration,
+                              missing keys keep the global value. num_samples must not exceed the global value and
+                              pulse_freq is sent with 1 kHz resolution. (None - global settings for all configurations)
+        dsp_mode (int): On-device processing, 0 - raw samples, 1 - bandpass at the pulse frequency, envelope and decimation.
+        decimation (int): Decimation factor of the envelope (1, 2, 4 or 8), the frame carries num_samples / decimation samples.
+        num_avg (int): Number of acquisitions of the same TX/RX configuration averaged on the MSP430 into one frame
+                       (1, 2, 4, ..., 64), the frame period is num_avg * meas_period.
+        avg_sum32 (bool): Send the 32-bit sums of the averaged acquisitions instead of the rounded 16-bit mean. The frame
+                          then carries the first 200 samples and dsp_mode must be raw.
+        roi_windows (tuple[]): Optional depth windows, one (start_adcsampl, num_samples) tuple per TX/RX configuration.
+                               The window replaces the ADC sampling start time in microseconds and the number of samples
+                               of its configuration, num_samples must not exceed the global value. The global num_samples
+                               sets the frame length, use the longest window as global value.
+                               (None - global start and number of samples for all configurations)
+        ext_header (bool): Frames carry the extended 16 byte header: time stamp of the trigger, start-up and sequence
+                           timing, status flags, failed acquisitions and the CRC-16 of the configuration package
+                           (conf_hash), see WulpusDongle.receive_data(). At most 394 samples per frame.
+        sample_bits (int): Bits per sample in the frames, 16, 12 (2 samples in 3 bytes, lossless) or 8 (log-compressed,
+                           16 steps per octave). Fewer bytes per frame, the frame shrinks by whole transfers of 201
+                           bytes (e.g. 396 instead of 400 samples fit into 3 transfers with 12 bits). Requires raw
+                           samples (dsp_mode 0) without 32-bit sums.
+        burst_len (int): Burst mode, the MSP430 stores burst_len frames one meas_period apart and sends them after the
+                         last acquisition of the burst (0 - every frame is sent right away). The burst must fit into
+                         the 12 kB ring of the MSP430, e.g. 15 frames with 400 samples and 32 frames with up to 98.
+        gate_threshold (int): Threshold gating, a frame is only sent if one of its raw or averaged samples
+                              [gate_start, gate_start + gate_samples) lies outside +-gate_threshold ADC counts. Quiet
+                              frames are skipped, their frame numbers are missing.
+        gate_start (int): First sample of the depth range of the threshold gating.
+        gate_samples (int): Number of samples of the depth range (0 - up to the end of the frame).
+        gate_heartbeat (int): After this many quiet frames a heartbeat (header only) is sent instead, so the host sees
+                              the probe alive and its commands still reach the MSP430 (0 - no gating, every frame is
+                              sent). Not with avg_sum32 or burst_len.
+        preset_slot (int): Store the configuration in this FRAM slot of the MSP430 (0 - 3, None - not stored). A preset
+                           is started with get_preset_package() without sending the configuration again, its frames
+                           have the full length of 804 bytes (see WulpusDongle.send_config()).
+        preset_boot (bool): The MSP430 starts acquiring with the preset after power-up.
     """
 
     def __init__(self,
@@ -73,7 +134,23 @@ class WulpusUssConfig():
                  start_pgainbias=5,
                  start_adcsampl=503,
                  restart_capt=3000,
-                 capt_timeout=3000):
+                 capt_timeout=3000,
+                 trigger_mode=0,
+                 seq_configs=None,
+                 dsp_mode=DSP_MODE_RAW,
+                 decimation=1,
+                 num_avg=1,
+                 avg_sum32=False,
+                 roi_windows=None,
+                 burst_len=0,
+                 ext_header=False,
+                 sample_bits=16,
+                 gate_threshold=0,
+                 gate_start=0,
+                 gate_samples=0,
+                 gate_heartbeat=0,
+                 preset_slot=None,
+                 preset_boot=False):
         
         # check if sampling frequency is valid
         if sampling_freq not in USS_CAPTURE_ACQ_RATES:
@@ -81,6 +158,9 @@ class WulpusUssConfig():
         # check if rx gain is valid
         if rx_gain not in PGA_GAIN:
             raise ValueError('RX gain of ' + str(rx_gain) + ' is not allowed.\nAllowed values are: ' + str(PGA_GAIN))
+        # check if the sample packing is valid
+        if sample_bits not in SAMPLE_BITS:
+            raise ValueError('Sample width of ' + str(sample_bits) + ' bits is not allowed.\nAllowed values are: ' + str(SAMPLE_BITS))
         
         # Parse basic settings
         self.num_acqs           = int(num_acqs)
@@ -104,6 +184,24 @@ class WulpusUssConfig():
         self.start_adcsampl     = int(start_adcsampl)
         self.restart_capt       = int(restart_capt)
         self.capt_timeout       = int(capt_timeout)
+        self.trigger_mode       = int(trigger_mode)
+        self.seq_configs        = [dict(entry) for entry in seq_configs] if seq_configs else []
+        self.dsp_mode           = int(dsp_mode)
+        self.decimation         = int(decimation)
+        self.num_avg            = int(num_avg)
+        self.avg_sum32          = bool(avg_sum32)
+        self.roi_windows        = [tuple(window) for window in roi_windows] if roi_windows else []
+        self.burst_len          = int(burst_len)
+        self.ext_header         = bool(ext_header)
+        self.sample_bits        = int(sample_bits)
+        self.gate_threshold     = int(gate_threshold)
+        self.gate_start         = int(gate_start)
+        self.gate_samples       = int(gate_samples)
+        self.gate_heartbeat     = int(gate_heartbeat)
+        self.preset_slot        = None if preset_slot is None else int(preset_slot)
+        self.preset_boot        = bool(preset_boot)
+        # Number of the last patch (get_patch_package())
+        self.patch_nr           = 0
 
         # check if configuration is valid
         self.convert_to_registers() # convert to register saveable values
@@ -130,6 +228,70 @@ class WulpusUssConfig():
         self.start_adcsampl_reg     = int(self.start_adcsampl * us_to_ticks["start_adcsampl"])
         self.restart_capt_reg       = int(self.restart_capt * us_to_ticks["restart_capt"])
         self.capt_timeout_reg       = int(self.capt_timeout * us_to_ticks["capt_timeout"])
+        self.trigger_mode_reg       = int(self.trigger_mode)
+        self.seq_configs_reg        = [self.convert_seq_entry(entry) for entry in self.seq_configs]
+        self.dsp_mode_reg           = int(self.dsp_mode)
+        self.decimation_reg         = int(self.decimation)
+        self.num_avg_reg            = int(self.num_avg)
+        self.avg_sum32_reg          = int(self.avg_sum32)
+        self.roi_windows_reg        = [self.convert_roi_window(window) for window in self.roi_windows]
+        self.burst_len_reg          = int(self.burst_len)
+        self.ext_header_reg         = int(self.ext_header)
+        self.sample_bits_reg        = int(SAMPLE_BITS_REG[SAMPLE_BITS.index(self.sample_bits)])
+        self.gate_threshold_reg     = int(self.gate_threshold)
+        self.gate_start_reg         = int(self.gate_start)
+        self.gate_samples_reg       = int(self.gate_samples)
+        self.gate_heartbeat_reg     = int(self.gate_heartbeat)
+        self.preset_slot_reg        = 0 if self.preset_slot is None else self.preset_slot + 1
+        self.preset_boot_reg        = int(self.preset_boot)
+
+
+    def convert_seq_entry(self, entry):
+
+        # convert one sequence table entry to register values,
+        # keys which are not given keep the global value
+
+        unknown = set(entry) - set(SEQ_ENTRY_PARAMS)
+        if unknown:
+            raise ValueError('Unknown sequence table parameters: ' + str(sorted(unknown)) + '.\nAllowed parameters are: ' + str(SEQ_ENTRY_PARAMS))
+
+        rx_gain       = float(entry.get('rx_gain', self.rx_gain))
+        pulse_freq    = int(entry.get('pulse_freq', self.pulse_freq))
+        num_pulses    = int(entry.get('num_pulses', self.num_pulses))
+        sampling_freq = int(entry.get('sampling_freq', self.sampling_freq))
+        num_samples   = int(entry.get('num_samples', self.num_samples))
+
+        if rx_gain not in PGA_GAIN:
+            raise ValueError('RX gain of ' + str(rx_gain) + ' is not allowed.\nAllowed values are: ' + str(PGA_GAIN))
+        if sampling_freq not in USS_CAPTURE_ACQ_RATES:
+            raise ValueError('Sampling frequency of ' + str(sampling_freq) + ' is not allowed.\nAllowed values are: ' + str(USS_CAPTURE_ACQ_RATES))
+        if (num_samples < 1) or (num_samples > self.num_samples):
+            raise ValueError('Number of samples of a sequence table entry must be within [1, ' + str(self.num_samples) + '].')
+
+        return {
+            'rx_gain':         int(PGA_GAIN_REG[PGA_GAIN.index(rx_gain)]),
+            'pulse_freq_khz':  int(round(pulse_freq / 1000)),
+            'num_pulses':      num_pulses,
+            'sampling_freq':   int(USS_CAPT_OVER_SAMPLE_RATES_REG[USS_CAPTURE_ACQ_RATES.index(sampling_freq)]),
+            'num_samples':     num_samples * 2,
+        }
+
+
+    def convert_roi_window(self, window):
+
+        # convert one depth window to register values
+
+        start_adcsampl, num_samples = window
+
+        if (int(num_samples) < 1) or (int(num_samples) > self.num_samples):
+            raise ValueError('Number of samples of a depth window must be within [1, ' + str(self.num_samples) + '].')
+        if float(start_adcsampl) + int(num_samples) * 1e6 / self.sampling_freq > self.capt_timeout:
+            raise ValueError('Depth window starting at ' + str(start_adcsampl) + ' us ends after the capture timeout of ' + str(self.capt_timeout) + ' us.')
+
+        return {
+            'start_adcsampl':  int(float(start_adcsampl) * us_to_ticks["start_adcsampl"]),
+            'num_samples':     int(num_samples) * 2,
+        }
 
 
     def get_conf_package(self):
@@ -140,10 +302,24 @@ class WulpusUssConfig():
         # Make sure the values are converted to register saveable values
         self.convert_to_registers()
 
-        # Write basic settings
+        # Write basic settings, the DC-DC turn on time and the measurement period with their lower 16 bits
         for param in configuration_package[0]:
             value = getattr(self, param.config_name + "_reg")
-            bytes_arr += param.get_as_bytes(value)
+            if param.config_name in ('dcdc_turnon', 'meas_period'):
+                param.check_value(value)
+                bytes_arr += np.array([value & 0xFFFF]).astype('<u2').tobytes()
+            else:
+                bytes_arr += param.get_as_bytes(value)
+
+        # The MSB of the number of samples selects the extended frame header, bits 12-13 the packing of the samples,
+        # bits 10-11 carry log2 of the envelope decimation
+        if self.ext_header_reg and (self.num_samples_reg > FRAME_LEN_MAX - EXT_HEADER_LEN):
+            raise ValueError('With the extended header the number of samples must not exceed ' + str((FRAME_LEN_MAX - EXT_HEADER_LEN) // 2) + '.')
+        if self.sample_bits_reg and ((self.dsp_mode_reg != DSP_MODE_RAW) or self.avg_sum32_reg):
+            raise ValueError('Packed samples require raw samples (dsp_mode ' + str(DSP_MODE_RAW) + ') without 32-bit sums.')
+        sample_size = self.num_samples_reg | (SAMPLE_SIZE_EXT_HEADER if self.ext_header_reg else 0) | (self.sample_bits_reg << SAMPLE_SIZE_PACK_SHIFT) | \
+                      ((self.decimation_reg.bit_length() - 1) << SAMPLE_SIZE_LOG2_DEC_SHIFT)
+        bytes_arr = bytes_arr[:16] + np.array([sample_size]).astype('<u2').tobytes() + bytes_arr[18:]
         
         # Write TX and RX configurations
         for i in range(self.num_txrx_configs):
@@ -155,6 +331,81 @@ class WulpusUssConfig():
             value = getattr(self, param.config_name + "_reg")
             bytes_arr += param.get_as_bytes(value)
 
+        # Write the sequence table (length 0 if not used)
+        if self.seq_configs_reg and (len(self.seq_configs_reg) != self.num_txrx_configs):
+            raise ValueError('The sequence table must have one entry per TX/RX config (' + str(self.num_txrx_configs) + ').')
+
+        bytes_arr += np.array([len(self.seq_configs_reg)]).astype('<u1').tobytes()
+        for entry in self.seq_configs_reg:
+            bytes_arr += sequence_table_entry[0].get_as_bytes(entry['rx_gain'])
+            bytes_arr += sequence_table_entry[1].get_as_bytes(entry['pulse_freq_khz'])
+            # Number of pulses (bits 0-4) and oversampling rate (bits 5-7) share one byte,
+            # their ranges are checked separately
+            sequence_table_entry[2].get_as_bytes(entry['num_pulses'])
+            sequence_table_entry[3].get_as_bytes(entry['sampling_freq'])
+            bytes_arr += np.array([entry['num_pulses'] | (entry['sampling_freq'] << 5)]).astype('<u1').tobytes()
+            bytes_arr += sequence_table_entry[4].get_as_bytes(entry['num_samples'])
+
+        # Write the on-device processing settings
+        for param in frame_processing:
+            value = getattr(self, param.config_name + "_reg")
+            bytes_arr += param.get_as_bytes(value)
+
+        # Write the averaging settings, both share one byte,
+        # their ranges are checked separately
+        frame_averaging[0].get_as_bytes(self.num_avg_reg)
+        frame_averaging[1].get_as_bytes(self.avg_sum32_reg)
+        if self.avg_sum32_reg and ((self.num_avg_reg == 1) or (self.dsp_mode_reg != DSP_MODE_RAW)):
+            raise ValueError('32-bit sums require num_avg > 1 and raw samples (dsp_mode ' + str(DSP_MODE_RAW) + ').')
+        bytes_arr += np.array([self.num_avg_reg | (self.avg_sum32_reg << 7)]).astype('<u1').tobytes()
+
+        # Write the depth windows (length 0 if not used)
+        if self.roi_windows_reg and (len(self.roi_windows_reg) != self.num_txrx_configs):
+            raise ValueError('The depth windows must have one entry per TX/RX config (' + str(self.num_txrx_configs) + ').')
+
+        bytes_arr += np.array([len(self.roi_windows_reg)]).astype('<u1').tobytes()
+        for window in self.roi_windows_reg:
+            bytes_arr += depth_window_entry[0].get_as_bytes(window['start_adcsampl'])
+            bytes_arr += depth_window_entry[1].get_as_bytes(window['num_samples'])
+
+        # Write the burst length, the burst has to fit into the ring of the MSP430
+        # (frames of whole SPI transfers, see WulpusDongle.set_acq_length())
+        header_length = EXT_HEADER_LEN if self.ext_header_reg else 4
+        frame_samples = self.num_samples // self.decimation_reg
+        frame_length = min(-(-(header_length + sample_payload_length(frame_samples, self.sample_bits)) // PACKAGE_LEN_MAX), 4) * PACKAGE_LEN_MAX
+        if self.burst_len_reg > BURST_RING_SIZE // frame_length:
+            raise ValueError('A burst of ' + str(self.burst_len_reg) + ' frames does not fit into the ring of the MSP430 (' + str(min(BURST_RING_SIZE // frame_length, BURST_LEN_MAX)) + ' frames of ' + str(frame_length) + ' bytes).')
+        bytes_arr += frame_burst[0].get_as_bytes(self.burst_len_reg)
+
+        # Write the upper 16 bits of the DC-DC turn on time and of the measurement period
+        bytes_arr += np.array([self.dcdc_turnon_reg >> 16, self.meas_period_reg >> 16]).astype('<u2').tobytes()
+
+        # Write the threshold gating, the MSP430 gates 16-bit samples and sends all frames of a burst
+        if self.gate_heartbeat_reg and (self.avg_sum32_reg or self.burst_len_reg):
+            raise ValueError('Threshold gating does not work with 32-bit sums or bursts.')
+        bytes_arr += frame_gate[0].get_as_bytes(self.gate_threshold_reg)
+        bytes_arr += frame_gate[1].get_as_bytes(self.gate_start_reg)
+        bytes_arr += frame_gate[2].get_as_bytes(self.gate_samples_reg)
+        bytes_arr += frame_gate[3].get_as_bytes(self.gate_heartbeat_reg)
+
+        # The MSP430 sends the CRC-16 of the package up to here in the extended header
+        self.conf_hash = binascii.crc_hqx(bytes_arr, 0xFFFF)
+
+        # Write the preset slot, presets are sent in full length frames and their bursts have to fit into the ring
+        frame_preset[0].get_as_bytes(self.preset_slot_reg)
+        if self.preset_boot_reg and not self.preset_slot_reg:
+            raise ValueError('A boot preset needs a preset slot.')
+        if self.preset_slot_reg and (self.burst_len_reg > BURST_RING_SIZE // FRAME_LEN_MAX):
+            raise ValueError('A preset with bursts of ' + str(self.burst_len_reg) + ' frames does not fit into the ring of the MSP430 (' + str(BURST_RING_SIZE // FRAME_LEN_MAX) + ' frames of ' + str(FRAME_LEN_MAX) + ' bytes).')
+        bytes_arr += np.array([self.preset_slot_reg | (PRESET_BOOT if self.preset_boot_reg else 0)]).astype('<u1').tobytes()
+
+        # Version and CRC-16 of the whole package, checked before it is applied
+        bytes_arr += np.array([CONF_PACK_VERSION]).astype('<u1').tobytes()
+        bytes_arr += np.array([binascii.crc_hqx(bytes_arr, 0xFFFF)]).astype('<u2').tobytes()
+
+        if len(bytes_arr) > PACKAGE_LEN_MAX:
+            raise ValueError('Configuration package of ' + str(len(bytes_arr)) + ' bytes exceeds the maximum of ' + str(PACKAGE_LEN_MAX) + ' bytes.')
+
         # Add zeros to match the expected package legth if needed
         if len(bytes_arr) < PACKAGE_LEN:
             bytes_arr += np.zeros(PACKAGE_LEN - len(bytes_arr)).astype('<u1').tobytes()
@@ -177,3 +428,82 @@ class WulpusUssConfig():
             bytes_arr += np.zeros(PACKAGE_LEN - len(bytes_arr)).astype('<u1').tobytes()
         
         return bytes_arr
+
+    def get_patch_package(self, rx_gain=None, num_pulses=None, meas_period=None, dcdc_turnon=None, txrx_config=None):
+        """
+        Patch command for the running acquisition: the MSP430 applies the given settings from the next frame boundary on,
+        without restart. rx_gain and num_pulses apply to one TX/RX config (its sequence table entry) or, with
+        txrx_config None, to all of them. The settings of this object are not changed, conf_hash is continued over the
+        patch like on the MSP430 (a new configuration package starts over).
+        """
+
+        fields = 0
+        gain_reg = 0
+        pulses = 0
+        period_reg = 0
+        dcdc_reg = 0
+
+        if rx_gain is not None:
+            if rx_gain not in PGA_GAIN:
+                raise ValueError('RX gain of ' + str(rx_gain) + ' is not allowed.\nAllowed values are: ' + str(PGA_GAIN))
+            fields |= PATCH_RX_GAIN
+            gain_reg = int(PGA_GAIN_REG[PGA_GAIN.index(rx_gain)])
+        if num_pulses is not None:
+            if not 1 <= int(num_pulses) <= 31:
+                raise ValueError('Number of pulses of ' + str(num_pulses) + ' is not allowed in a patch (1 - 31).')
+            fields |= PATCH_NUM_PULSES
+            pulses = int(num_pulses)
+        if meas_period is not None:
+            fields |= PATCH_MEAS_PERIOD
+            period_reg = int(meas_period * us_to_ticks["meas_period"])
+            if not 0 < period_reg <= 65535:
+                raise ValueError('Measurement period of ' + str(meas_period) + ' us is not allowed in a patch (up to 2 s).')
+        if dcdc_turnon is not None:
+            fields |= PATCH_DCDC_TURNON
+            dcdc_reg = int(dcdc_turnon * us_to_ticks["dcdc_turnon"])
+            if not 0 <= dcdc_reg <= 65535:
+                raise ValueError('DC-DC turn on time of ' + str(dcdc_turnon) + ' us is not allowed in a patch (up to 2 s).')
+        if txrx_config is not None and not 0 <= int(txrx_config) < self.num_txrx_configs:
+            raise ValueError('TX/RX config ' + str(txrx_config) + ' does not exist.')
+
+        # The DC-DC converters are turned on within the period (the settings of this object for a field not patched)
+        new_period = period_reg if meas_period is not None else int(self.meas_period * us_to_ticks["meas_period"])
+        new_dcdc = dcdc_reg if dcdc_turnon is not None else int(self.dcdc_turnon * us_to_ticks["dcdc_turnon"])
+        if new_dcdc >= new_period:
+            raise ValueError('The DC-DC turn on time must be shorter than the measurement period, patch both together.')
+
+        # The MSP430 applies every patch number once, the nRF52 repeats the command with every frame
+        self.patch_nr = self.patch_nr % 255 + 1
+
+        bytes_arr = np.array([START_BYTE_PATCH, self.patch_nr, fields,
+                              PATCH_ALL_CONFIGS if txrx_config is None else int(txrx_config),
+                              gain_reg, pulses]).astype('<u1').tobytes()
+        bytes_arr += np.array([period_reg, dcdc_reg]).astype('<u2').tobytes()
+
+        # Hash reported in the extended header of the frames acquired with the patch
+        self.conf_hash = binascii.crc_hqx(bytes_arr, self.conf_hash)
+
+        # Add zeros to match the expected package legth if needed
+        if len(bytes_arr) < PACKAGE_LEN:
+            bytes_arr += np.zeros(PACKAGE_LEN - len(bytes_arr)).astype('<u1').tobytes()
+
+        return bytes_arr
+
+    def get_preset_package(self, command=PRESET_CMD_SELECT, slot=0):
+        """
+        Preset command for the MSP430: select the preset in slot (restarts the acquisition with it, no wait needed),
+        start with it after power-up (PRESET_NONE - no boot preset) or erase it.
+        """
+
+        if command not in (PRESET_CMD_SELECT, PRESET_CMD_SET_BOOT, PRESET_CMD_ERASE):
+            raise ValueError('Preset command ' + str(command) + ' is not allowed.')
+        if (slot >= PRESET_SLOTS) and not ((command == PRESET_CMD_SET_BOOT) and (slot == PRESET_NONE)):
+            raise ValueError('Preset slot ' + str(slot) + ' is not allowed.')
+
+        bytes_arr = np.array([START_BYTE_PRESET, command, slot]).astype('<u1').tobytes()
+
+        # Add zeros to match the expected package legth if needed
+        if len(bytes_arr) < PACKAGE_LEN:
+            bytes_arr += np.zeros(PACKAGE_LEN - len(bytes_arr)).astype('<u1').tobytes()
+
+        return bytes_arr
@@ -143,6 +143,7 @@ class WulpusUssConfigGUI(widgets.VBox, WulpusUssConfig):
         entries_adv.append(self.get_param('start_adcsampl').get_as_widget(self.start_adcsampl))
         entries_adv.append(self.get_param('restart_capt').get_as_widget(self.restart_capt))
         entries_adv.append(self.get_param('capt_timeout').get_as_widget(self.capt_timeout))
+        entries_adv.append(self.get_param('trigger_mode').get_as_widget(self.trigger_mode))
 
         # Disable capture restart, capture timeout and number of samples (per index is sloppy, but works for now)
         entries_acq[4].disabled = True      # num_samples